@@ -0,0 +1,50 @@
+#pragma once
+
+#include <rebound.h>
+
+// Bounding volume hierarchy over axis aligned boxes, split by the surface
+// area heuristic evaluated at BVH_BIN_COUNT planes per axis. Nodes with many
+// items are binned across the job system, once there are enough of them the
+// subtrees are built in parallel. Wald, "On fast Construction of SAH-based
+// Bounding Volume Hierarchies", 2007.
+
+// Planes evaluated per axis are one less.
+#define BVH_BIN_COUNT 16
+
+// Leaves hold at most this many items, fewer when the heuristic finds a
+// cheaper split.
+#define BVH_MAX_LEAF_ITEMS 8
+
+// Cost of visiting a node relative to testing one item.
+#define BVH_TRAVERSAL_COST 1.0f
+
+// Nodes with at least this many items are binned in parallel, smaller ones
+// become subtrees built on a worker each.
+#define BVH_PARALLEL_MIN 16384
+
+// Items binned per job batch.
+#define BVH_BIN_BATCH 4096
+
+// Inner nodes have two children, first and first + 1. Leaves hold count
+// items starting at first in the item order.
+typedef struct bvh_node_t bvh_node_t;
+struct bvh_node_t {
+    f32_t min[3];
+    u32_t first;
+    f32_t max[3];
+    // 0 for inner nodes.
+    u32_t count;
+};
+
+// Most nodes bvh_build writes for item_count items.
+extern u32_t bvh_node_bound(u32_t item_count);
+
+// Builds a hierarchy over item_count boxes, each a min xyz and a max xyz in
+// bounds. Writes the nodes, the root first, and the items in leaf order.
+// Returns the node count, 0 without items. The layout only depends on the
+// input, not on how the work got scheduled.
+extern u32_t bvh_build(bvh_node_t *nodes, u32_t *items, const f32_t *bounds, u32_t item_count);
+
+// Expected cost of a random ray against the hierarchy, in item tests per ray
+// that hits the root, by the same heuristic the build uses.
+extern f32_t bvh_sah_cost(const bvh_node_t *nodes, u32_t node_count);
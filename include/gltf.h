@@ -2,6 +2,8 @@
 
 #include <rebound.h>
 
+#include "HandmadeMath.h"
+
 typedef enum {
     GLTF_BUFFER_TARGET_ARRAY         = 34962,
     GLTF_BUFFER_TARGET_ELEMENT_ARRAY = 34963,
@@ -35,37 +37,703 @@ typedef enum {
     GLTF_ACCESSOR_TYPE_MAT4,
 } gltf_accessor_type_t;
 
+// Elements replaced on top of an accessor's base data.
+typedef struct gltf_accessor_sparse_t gltf_accessor_sparse_t;
+struct gltf_accessor_sparse_t {
+    // 0 when the accessor isn't sparse.
+    u32_t count;
+    u32_t indices_view;
+    u64_t indices_offset;
+    gltf_comp_type_t indices_comp_type;
+    u32_t values_view;
+    u64_t values_offset;
+};
+
 typedef struct gltf_accessor_t gltf_accessor_t;
 struct gltf_accessor_t {
-    u32_t view;
+    // -1 when the accessor has no buffer view, its base data is then zeros.
+    i32_t view;
     u64_t offset;
     gltf_comp_type_t comp_type;
     b8_t normalized;
     u32_t count;
     gltf_accessor_type_t type;
+    gltf_accessor_sparse_t sparse;
+    // min and max of the first four components as given in the file, in the
+    // units gltf_accessor_read_f32 returns. Dropped once the elements change.
+    b8_t has_bounds;
+    f32_t min[4];
+    f32_t max[4];
+};
+
+typedef enum {
+    GLTF_ATTRIBUTE_POSITION,
+    GLTF_ATTRIBUTE_NORMAL,
+    GLTF_ATTRIBUTE_TEXCOORD_0,
+    // xyz tangent and the bitangent sign in w.
+    GLTF_ATTRIBUTE_TANGENT,
+    // Four joints of the node's skin and their weights.
+    GLTF_ATTRIBUTE_JOINTS_0,
+    GLTF_ATTRIBUTE_WEIGHTS_0,
+
+    GLTF_ATTRIBUTE_COUNT,
+} gltf_attribute_t;
+
+// Matches the GL draw modes.
+typedef enum {
+    GLTF_PRIMITIVE_MODE_POINTS,
+    GLTF_PRIMITIVE_MODE_LINES,
+    GLTF_PRIMITIVE_MODE_LINE_LOOP,
+    GLTF_PRIMITIVE_MODE_LINE_STRIP,
+    GLTF_PRIMITIVE_MODE_TRIANGLES,
+    GLTF_PRIMITIVE_MODE_TRIANGLE_STRIP,
+    GLTF_PRIMITIVE_MODE_TRIANGLE_FAN,
+} gltf_primitive_mode_t;
+
+// Axis aligned bounding box, min is above max when it's empty.
+typedef struct gltf_aabb_t gltf_aabb_t;
+struct gltf_aabb_t {
+    HMM_Vec3 min;
+    HMM_Vec3 max;
+};
+
+// Primitives of every mesh in a flat structure of arrays. Accessor indices
+// are -1 when missing.
+typedef struct gltf_primitives_t gltf_primitives_t;
+struct gltf_primitives_t {
+    i32_t *attributes[GLTF_ATTRIBUTE_COUNT];
+    i32_t *indices;
+    gltf_primitive_mode_t *mode;
+    i32_t *material;
+    // Range of gltf_model_t.lods with simplified versions of each primitive,
+    // from fine to coarse. Empty unless built with GLTF_PROCESS_LOD.
+    u32_t *lod_offset;
+    u32_t *lod_count;
+    // Range of gltf_model_t.meshlets covering the full detail triangles.
+    // Empty unless built with GLTF_PROCESS_MESHLETS.
+    u32_t *meshlet_offset;
+    u32_t *meshlet_count;
+    // Bounds of each primitive's positions, empty without them.
+    gltf_aabb_t *bounds;
+    u32_t count;
+};
+
+// A simplified index buffer for a primitive, drawn with its vertex attributes.
+typedef struct gltf_lod_t gltf_lod_t;
+struct gltf_lod_t {
+    u32_t indices;
+    // Upper bound of how far the surface moved from the full detail one, in
+    // the units of the primitive's positions.
+    f32_t error;
+};
+
+// A cluster of a primitive's triangles, culled as a whole. Its vertices are
+// vertex_count entries of gltf_model_t.meshlet_vertices, indexing the
+// primitive's vertices, and its triangles are triangle_count triples of
+// gltf_model_t.meshlet_indices, indexing the meshlet's vertices.
+typedef struct gltf_meshlet_t gltf_meshlet_t;
+struct gltf_meshlet_t {
+    u32_t vertex_offset;
+    u32_t triangle_offset;
+    u32_t vertex_count;
+    u32_t triangle_count;
+
+    // Bounding sphere in the primitive's space.
+    HMM_Vec3 center;
+    f32_t radius;
+    // Every triangle faces away from cameras inside the cone around
+    // -cone_axis, see mesh_meshlet_backfacing.
+    HMM_Vec3 cone_axis;
+    f32_t cone_cutoff;
 };
 
+// A node of a bounding volume hierarchy, see bvh_node_t. Inner nodes have
+// two children, first and first + 1, leaves count items starting at first.
+typedef struct gltf_bvh_node_t gltf_bvh_node_t;
+struct gltf_bvh_node_t {
+    HMM_Vec3 min;
+    u32_t first;
+    HMM_Vec3 max;
+    u32_t count;
+};
+
+// A hierarchy stored in gltf_model_t.bvh_nodes and bvh_items. Node and item
+// numbers within it are relative to the offsets, its root is the first node.
+typedef struct gltf_bvh_t gltf_bvh_t;
+struct gltf_bvh_t {
+    u32_t node_offset;
+    u32_t node_count;
+    u32_t item_offset;
+    u32_t item_count;
+};
+
+// A mesh is a contiguous range of primitives.
 typedef struct gltf_mesh_t gltf_mesh_t;
 struct gltf_mesh_t {
-    i32_t position_accessor;
-    i32_t normal_accessor;
-    i32_t uv_accessor;
-    i32_t indices_accessor;
+    u32_t primitive_offset;
+    u32_t primitive_count;
+};
+
+// Nodes of one depth in the hierarchy.
+typedef struct gltf_node_level_t gltf_node_level_t;
+struct gltf_node_level_t {
+    u32_t offset;
+    u32_t count;
+};
+
+// The node hierarchy flattened into a structure of arrays. Nodes are sorted
+// by depth, so a parent always comes before its children and the nodes of one
+// depth form a contiguous level. Node indices don't match the ones in the
+// file.
+typedef struct gltf_nodes_t gltf_nodes_t;
+struct gltf_nodes_t {
+    i32_t *parent;
+    // -1 for nodes without a mesh, a valid mesh index otherwise.
+    i32_t *mesh;
+    HMM_Vec3 *translation;
+    HMM_Quat *rotation;
+    HMM_Vec3 *scale;
+    HMM_Mat4 *world;
+    // Skin deforming the node's mesh, -1 for rigid meshes.
+    i32_t *skin;
+    u32_t count;
+
+    gltf_node_level_t *levels;
+    u32_t level_count;
+};
+
+// A scene is a range of root nodes in gltf_model_t.scene_roots.
+typedef struct gltf_scene_t gltf_scene_t;
+struct gltf_scene_t {
+    u32_t root_offset;
+    u32_t root_count;
+};
+
+// A skin is a range of gltf_model_t.skin_joints, the nodes whose world
+// matrices deform the vertices of the meshes it's on, with the inverse bind
+// matrix of each joint at the same index of gltf_model_t.inverse_binds.
+typedef struct gltf_skin_t gltf_skin_t;
+struct gltf_skin_t {
+    u32_t joint_offset;
+    u32_t joint_count;
+};
+
+// How a sampler's values change between keyframes.
+typedef enum {
+    GLTF_INTERPOLATION_LINEAR,
+    GLTF_INTERPOLATION_STEP,
+    // Hermite splines, every keyframe has an in tangent, a value and an out
+    // tangent.
+    GLTF_INTERPOLATION_CUBICSPLINE,
+} gltf_interpolation_t;
+
+// Node properties a channel animates. Rotations are quaternions, the others
+// leave w zero.
+typedef enum {
+    GLTF_ANIMATION_PATH_TRANSLATION,
+    GLTF_ANIMATION_PATH_ROTATION,
+    GLTF_ANIMATION_PATH_SCALE,
+} gltf_animation_path_t;
+
+// Keyframes of a sampler: key_count increasing times from
+// gltf_model_t.animation_times and their values from
+// gltf_model_t.animation_values, three per keyframe for cubic splines.
+typedef struct gltf_sampler_t gltf_sampler_t;
+struct gltf_sampler_t {
+    u32_t time_offset;
+    u32_t value_offset;
+    u32_t key_count;
+    gltf_interpolation_t interpolation;
+};
+
+typedef struct gltf_channel_t gltf_channel_t;
+struct gltf_channel_t {
+    u32_t sampler;
+    u32_t node;
+    gltf_animation_path_t path;
+};
+
+// An animation is a range of gltf_model_t.channels, lasting until the last
+// keyframe of any of them.
+typedef struct gltf_animation_t gltf_animation_t;
+struct gltf_animation_t {
+    u32_t channel_offset;
+    u32_t channel_count;
+    f32_t duration;
+};
+
+// Extensions the loader understands, as bits of gltf_model_t.extensions.
+typedef enum {
+    // Vertex attributes may be stored as 8 and 16 bit integers.
+    GLTF_EXTENSION_KHR_MESH_QUANTIZATION = 1 << 0,
+    // Buffer views may be compressed, they are decoded while loading.
+    GLTF_EXTENSION_EXT_MESHOPT_COMPRESSION = 1 << 1,
+    // Primitives may be Draco compressed. Only supported once a decoder is
+    // set with gltf_set_draco_decoder.
+    GLTF_EXTENSION_KHR_DRACO_MESH_COMPRESSION = 1 << 2,
+} gltf_extension_t;
+
+// A file the model was read from as it was when read, what tells a cache
+// built from the model whether it's stale.
+typedef struct gltf_source_t gltf_source_t;
+struct gltf_source_t {
+    u64_t size;
+    i64_t mtime;
+    u64_t hash;
 };
 
 typedef struct gltf_model_t gltf_model_t;
 struct gltf_model_t {
     re_str_t *buffers;
+    // Buffer URIs relative to the .gltf file. Empty for buffers created while
+    // loading.
+    re_str_t *buffer_uris;
     u32_t buffer_count;
+    u32_t buffer_capacity;
 
     gltf_buffer_view_t *views;
     u32_t view_count;
+    u32_t view_capacity;
 
     gltf_accessor_t *accessors;
     u32_t accessor_count;
+    u32_t accessor_capacity;
+
+    gltf_primitives_t primitives;
 
     gltf_mesh_t *meshes;
     u32_t mesh_count;
+
+    gltf_nodes_t nodes;
+
+    gltf_scene_t *scenes;
+    u32_t scene_count;
+    u32_t *scene_roots;
+    u32_t scene_root_count;
+    // Default scene, always a valid index or -1 if there is none.
+    i32_t scene;
+
+    gltf_skin_t *skins;
+    u32_t skin_count;
+    u32_t *skin_joints;
+    HMM_Mat4 *inverse_binds;
+    u32_t skin_joint_count;
+
+    gltf_animation_t *animations;
+    u32_t animation_count;
+    gltf_channel_t *channels;
+    u32_t channel_count;
+    gltf_sampler_t *samplers;
+    u32_t sampler_count;
+    f32_t *animation_times;
+    u32_t animation_time_count;
+    HMM_Vec4 *animation_values;
+    u32_t animation_value_count;
+
+    // Supported extensions listed in extensionsUsed.
+    u32_t extensions;
+
+    gltf_lod_t *lods;
+    u32_t lod_count;
+
+    gltf_meshlet_t *meshlets;
+    u32_t meshlet_count;
+    u32_t *meshlet_vertices;
+    u32_t meshlet_vertex_count;
+    u8_t *meshlet_indices;
+    u32_t meshlet_index_count;
+
+    // Hierarchies built with GLTF_PROCESS_BVH, empty otherwise. Mesh i's
+    // items are the triangles of its full detail triangle lists, numbered
+    // through its primitives in order, in the mesh's space. Scene i's items
+    // are the nodes with a mesh below its roots, boxed in world space as
+    // loaded.
+    gltf_bvh_t *mesh_bvhs;
+    u32_t mesh_bvh_count;
+    gltf_bvh_t *scene_bvhs;
+    u32_t scene_bvh_count;
+    gltf_bvh_node_t *bvh_nodes;
+    u32_t bvh_node_count;
+    u32_t *bvh_items;
+    u32_t bvh_item_count;
+
+    // The .gltf file and the files of buffers with a uri, empty for models
+    // mapped from a cache.
+    gltf_source_t source;
+    gltf_source_t *buffer_sources;
+
+    // Cache file the model was mapped from, empty for parsed models.
+    re_str_t cache_mapping;
+    // Arena the model was loaded into, scratch memory taken while reading it
+    // comes from another one.
+    re_arena_t *arena;
 };
 
+// Parses a .gltf file and its buffers into arena. Loading is re-entrant,
+// gltf_parse, gltf_process and gltf_load only touch the model, arena, the
+// calling thread's scratch arenas and the job system, so any number of
+// threads may load at once. Build with make tsan to check under
+// ThreadSanitizer.
 extern gltf_model_t gltf_parse(const char *path, re_arena_t *arena);
+
+// One Draco compressed primitive handed to the decoder.
+typedef struct gltf_draco_primitive_t gltf_draco_primitive_t;
+struct gltf_draco_primitive_t {
+    const u8_t *data;
+    u64_t size;
+
+    // Draco attribute id of each attribute, -1 if the primitive doesn't have it.
+    i32_t attribute_ids[GLTF_ATTRIBUTE_COUNT];
+    // The accessors give the count and format the decoded data has to be
+    // written in, tightly packed into the matching output. indices is NULL
+    // for point clouds.
+    const gltf_accessor_t *attributes[GLTF_ATTRIBUTE_COUNT];
+    void *attribute_data[GLTF_ATTRIBUTE_COUNT];
+    const gltf_accessor_t *indices;
+    void *index_data;
+};
+
+// Decodes one primitive, returning false on failure. Primitives are decoded in
+// parallel, so the decoder has to be thread safe.
+typedef b8_t (*gltf_draco_decoder_t)(const gltf_draco_primitive_t *primitive);
+
+// No decoder ships with the loader. Without one, Draco primitives use their
+// uncompressed fallback data and files requiring the extension fail to load.
+// Can be called while other threads load, each file uses the decoder set
+// when its decoding starts.
+extern void gltf_set_draco_decoder(gltf_draco_decoder_t decoder);
+
+// Appends a buffer, view or accessor to the model and returns its index.
+extern u32_t gltf_push_buffer(gltf_model_t *model, re_str_t data, re_arena_t *arena);
+extern u32_t gltf_push_view(gltf_model_t *model, gltf_buffer_view_t view, re_arena_t *arena);
+extern u32_t gltf_push_accessor(gltf_model_t *model, gltf_accessor_t accessor, re_arena_t *arena);
+
+// Size in bytes of one component.
+extern u32_t gltf_comp_size(gltf_comp_type_t comp_type);
+// Number of components in one element.
+extern u32_t gltf_accessor_type_count(gltf_accessor_type_t type);
+// Size in bytes of one element, including the column padding of small
+// matrices.
+extern u32_t gltf_accessor_element_size(const gltf_accessor_t *accessor);
+
+// Expands a sparse accessor, or one without a buffer view, into a buffer of
+// its own and points the accessor at it. Elements are packed, except that
+// non-scalar elements are padded to 4 bytes as vertex attributes require.
+// Does nothing for accessors that are already plain.
+extern void gltf_accessor_resolve(gltf_model_t *model, u32_t accessor, re_arena_t *arena);
+// Replaces the accessor's data with a tightly packed float copy. Returns false,
+// leaving the accessor as is, if it can't be read.
+extern b8_t gltf_accessor_to_f32(gltf_model_t *model, u32_t accessor, re_arena_t *arena);
+
+// Points an index accessor at a new buffer holding count indices, stored in
+// the accessor's component type. The indices have to fit that type.
+extern void gltf_accessor_set_indices(gltf_model_t *model, u32_t accessor, const u32_t *indices, u32_t count, re_arena_t *arena);
+
+// Moves element i of a vertex attribute accessor to remap[i] in a new buffer
+// holding count elements. Elements whose remap is count or more are dropped,
+// of several elements with the same remap the first one is kept.
+extern void gltf_accessor_remap(gltf_model_t *model, u32_t accessor, const u32_t *remap, u32_t count, re_arena_t *arena);
+
+// Fills element i of a vertex attribute accessor's new buffer with element
+// sources[i], which unlike gltf_accessor_remap can duplicate elements. Out of
+// range sources give zeroed elements.
+extern void gltf_accessor_gather(gltf_model_t *model, u32_t accessor, const u32_t *sources, u32_t count, re_arena_t *arena);
+
+// Packs vertex attribute accessors with the same count into one buffer view,
+// larger components first and every element padded to 4 bytes, and points
+// the accessors at it. Takes at most GLTF_ATTRIBUTE_COUNT accessors and
+// returns the vertex stride.
+extern u32_t gltf_accessor_interleave(gltf_model_t *model, const u32_t *accessors, u32_t accessor_count, re_arena_t *arena);
+
+// Pointer to the first element of a plain accessor and the byte stride
+// between elements. Returns NULL for sparse accessors, accessors without a
+// view and accessors reading outside of their buffer.
+extern const u8_t *gltf_accessor_data(const gltf_model_t *model, u32_t accessor, u32_t *stride);
+
+// Smallest and largest of the first three components over every element,
+// taken from the accessor's min and max when it has them. Missing
+// components are 0. Returns false if the accessor can't be read, empty
+// accessors give min above max.
+extern b8_t gltf_accessor_bounds(const gltf_model_t *model, u32_t accessor, f32_t min[3], f32_t max[3]);
+
+// Converts every element of an accessor into a tightly packed array of
+// count * gltf_accessor_type_count(type) components, applying sparse data.
+// Normalized integers are mapped to [0, 1] or [-1, 1] when read as floats.
+// The integer readers also take signed and float accessors holding
+// non-negative whole numbers, and fail if a value is negative, fractional or
+// doesn't fit. Returns false if the accessor can't be read.
+extern b8_t gltf_accessor_read_f32(const gltf_model_t *model, u32_t accessor, f32_t *out);
+extern b8_t gltf_accessor_read_u16(const gltf_model_t *model, u32_t accessor, u16_t *out);
+extern b8_t gltf_accessor_read_u32(const gltf_model_t *model, u32_t accessor, u32_t *out);
+
+// Recomputes the world matrices of nodes [begin, end) from their local
+// transforms. The parents of the range must be up to date, which always holds
+// for a range within a single level.
+extern void gltf_nodes_update_range(gltf_nodes_t *nodes, u32_t begin, u32_t end);
+
+// Recomputes every world matrix level by level. Wide levels are split across
+// the job system.
+extern void gltf_nodes_update(gltf_nodes_t *nodes);
+
+// Optional processing steps, applied after parsing and stored in the cache.
+typedef enum {
+    // Reorders triangles for the post-transform vertex cache.
+    GLTF_PROCESS_VERTEX_CACHE = 1 << 0,
+    // Reorders clusters of triangles to reduce overdraw, best combined with
+    // the vertex cache pass which it runs after.
+    GLTF_PROCESS_OVERDRAW = 1 << 1,
+    // Renumbers vertices in the order the triangles use them and drops unused
+    // ones. Runs after the triangle order is final and skips primitives that
+    // share vertex data with others.
+    GLTF_PROCESS_VERTEX_FETCH = 1 << 2,
+    // Merges vertices with identical attributes. Runs first, as the triangle
+    // order passes benefit from the shared vertices.
+    GLTF_PROCESS_DEDUPLICATE = 1 << 3,
+    // Merges vertices within GLTF_WELD_TOLERANCE of each other, replacing
+    // GLTF_PROCESS_DEDUPLICATE.
+    GLTF_PROCESS_WELD = 1 << 4,
+    // Builds a chain of simplified index buffers for every triangle list,
+    // after all other passes.
+    GLTF_PROCESS_LOD = 1 << 5,
+    // Splits the full detail triangles of every triangle list into meshlets
+    // for culling.
+    GLTF_PROCESS_MESHLETS = 1 << 6,
+    // Stores 32 bit indices that fit in 16 bits as such.
+    GLTF_PROCESS_NARROW_INDICES = 1 << 7,
+    // Splits triangle lists with more vertices than 16 bit indices can
+    // address into several primitives that fit.
+    GLTF_PROCESS_SPLIT = 1 << 8,
+    // Packs the attributes of every primitive into one interleaved vertex
+    // stream, so a vertex is fetched from one place instead of one per
+    // attribute.
+    GLTF_PROCESS_INTERLEAVE = 1 << 9,
+    // With GLTF_PROCESS_INTERLEAVE, leaves positions in a tightly packed
+    // stream of their own, which is all a depth prepass fetches.
+    GLTF_PROCESS_POSITION_STREAM = 1 << 10,
+    // Generates MikkTSpace style tangents for triangle lists with normals and
+    // uvs but no tangents. Runs first, so the other passes treat them like
+    // any other attribute.
+    GLTF_PROCESS_TANGENTS = 1 << 11,
+    // Generates smooth normals for triangle lists without them, keeping
+    // edges sharper than GLTF_NORMAL_CREASE_ANGLE hard by splitting their
+    // vertices. Runs before tangents, which need the normals.
+    GLTF_PROCESS_NORMALS = 1 << 12,
+    // Builds a surface area heuristic BVH over the triangles of every mesh
+    // and over the mesh instances of every scene, after all other passes.
+    GLTF_PROCESS_BVH = 1 << 13,
+} gltf_process_t;
+
+// Largest difference of a welded attribute component. Positions use it as a
+// fraction of the primitive's bounding box diagonal.
+#define GLTF_WELD_TOLERANCE 1e-4f
+
+// Most LODs built per primitive, each keeping GLTF_LOD_RATIO of the triangles
+// of the one before. The chain ends early when simplification gets stuck.
+#ifndef GLTF_LOD_MAX_LEVELS
+#define GLTF_LOD_MAX_LEVELS 4
+#endif
+#ifndef GLTF_LOD_RATIO
+#define GLTF_LOD_RATIO 0.5f
+#endif
+// Largest error of a LOD as a fraction of the primitive's bounding box
+// diagonal, coarser levels look too different to be worth keeping.
+// All three can be set at build time, caches built with other values are
+// rebuilt.
+#ifndef GLTF_LOD_MAX_ERROR
+#define GLTF_LOD_MAX_ERROR 0.02f
+#endif
+
+// Largest angle in degrees between faces that share a generated normal. Can
+// be set at build time, caches built with another value are rebuilt.
+#ifndef GLTF_NORMAL_CREASE_ANGLE
+#define GLTF_NORMAL_CREASE_ANGLE 60.0f
+#endif
+
+// Meshlet size limits, same as MESH_MESHLET_MAX_VERTICES and
+// MESH_MESHLET_MAX_TRIANGLES unless set at build time.
+#ifndef GLTF_MESHLET_MAX_VERTICES
+#define GLTF_MESHLET_MAX_VERTICES 64
+#endif
+#ifndef GLTF_MESHLET_MAX_TRIANGLES
+#define GLTF_MESHLET_MAX_TRIANGLES 124
+#endif
+
+// Runs the processing steps in the process bit set on every primitive.
+extern void gltf_process(gltf_model_t *model, u32_t process, re_arena_t *arena);
+
+// Loads a model through a preprocessed binary cache stored next to the .gltf
+// file (path + ".cache"). The cache is memory mapped and used as is when it's
+// valid. If the .gltf or any of its buffers changed, or the cache was built
+// with other processing steps, the model is parsed again and the cache
+// rewritten.
+extern gltf_model_t gltf_load(const char *path, u32_t process, re_arena_t *arena);
+
+// Unmaps the cache file of a model loaded from one. Only needed when the
+// model's arena memory is reused, the model can't be used afterwards.
+extern void gltf_unload(gltf_model_t *model);
+
+// A ray through origin + t * direction for t in (0, t_max). The direction
+// needn't be normalized, distances are in its units.
+typedef struct gltf_ray_t gltf_ray_t;
+struct gltf_ray_t {
+    HMM_Vec3 origin;
+    HMM_Vec3 direction;
+    f32_t t_max;
+};
+
+// The closest triangle a ray hit. The point is corner 0 * (1 - u - v) +
+// corner 1 * u + corner 2 * v, the corners being entries triangle * 3 to
+// triangle * 3 + 2 of the primitive's indices, or its vertices without
+// indices.
+typedef struct gltf_ray_hit_t gltf_ray_hit_t;
+struct gltf_ray_hit_t {
+    f32_t t;
+    f32_t u;
+    f32_t v;
+    // Node whose mesh instance was hit, -1 for mesh queries.
+    i32_t node;
+    // -1 if nothing was hit, the other fields are meaningless then.
+    i32_t primitive;
+    u32_t triangle;
+};
+
+// Four triangles tested against a ray at once, as a corner and the edges to
+// the other two corners, one triangle per lane. Unused lanes are degenerate
+// and never hit.
+typedef struct gltf_triangle_pack_t gltf_triangle_pack_t;
+struct gltf_triangle_pack_t {
+    f32_t corner[3][4];
+    f32_t edge1[3][4];
+    f32_t edge2[3][4];
+    i32_t primitive[4];
+    u32_t triangle[4];
+};
+
+// A node of the four wide hierarchies rays traverse, the boxes of its
+// children one per lane. Leaf children point at count packs starting at
+// child, inner ones at the node child. Unused slots have empty boxes.
+typedef struct gltf_ray_node_t gltf_ray_node_t;
+struct gltf_ray_node_t {
+    f32_t min[3][4];
+    f32_t max[3][4];
+    u32_t child[4];
+    u32_t count[4];
+};
+
+// The triangles of a model's meshes packed for ray queries. Each mesh
+// hierarchy is widened to four children per node, subtrees of at most four
+// triangles becoming one pack.
+typedef struct gltf_raycaster_t gltf_raycaster_t;
+struct gltf_raycaster_t {
+    const gltf_model_t *model;
+    gltf_ray_node_t *nodes;
+    u32_t node_count;
+    // Root node of every mesh, -1 for meshes without a hierarchy.
+    i32_t *mesh_roots;
+    gltf_triangle_pack_t *packs;
+    u32_t pack_count;
+    // Inverse world matrix of every node, to bring rays into mesh space.
+    HMM_Mat4 *inverse_world;
+    // Deepest leaf of any hierarchy, bounding the traversal stacks.
+    u32_t depth;
+};
+
+// Packs the triangles of a model loaded with GLTF_PROCESS_BVH. Queries see
+// the triangles and node transforms the model has now, the model must outlive
+// the raycaster. Every ray misses models without hierarchies.
+extern gltf_raycaster_t gltf_raycaster_new(const gltf_model_t *model, re_arena_t *arena);
+
+// Closest hit of a ray in the mesh's space.
+extern gltf_ray_hit_t gltf_raycast_mesh(const gltf_raycaster_t *raycaster, u32_t mesh, gltf_ray_t ray);
+
+// Closest hit of a ray in world space against the mesh instances of a scene.
+extern gltf_ray_hit_t gltf_raycast_scene(const gltf_raycaster_t *raycaster, u32_t scene, gltf_ray_t ray);
+
+// gltf_raycast_scene for count rays, spread over the job system.
+extern void gltf_raycast_scene_batch(const gltf_raycaster_t *raycaster, u32_t scene, const gltf_ray_t *rays, gltf_ray_hit_t *hits, u32_t count);
+
+// The vertices of a skinned primitive, decoded once to be posed every frame.
+// Every vertex has four joints of its skin, with weights adding up to one.
+typedef struct gltf_skin_vertices_t gltf_skin_vertices_t;
+struct gltf_skin_vertices_t {
+    f32_t *positions;
+    // NULL if the primitive has no normals.
+    f32_t *normals;
+    u16_t *joints;
+    f32_t *weights;
+    u32_t count;
+};
+
+// Decodes the vertices of a primitive drawn with the skin. Joints the skin
+// doesn't have lose their weight, vertices left without any follow the first
+// joint. Returns false if the primitive lacks positions, joints or weights.
+extern b8_t gltf_skin_vertices(const gltf_model_t *model, u32_t prim, u32_t skin, gltf_skin_vertices_t *out, re_arena_t *arena);
+
+// Writes the skin's joint matrices for the current world matrices of the
+// nodes, each joint's world matrix times its inverse bind matrix, in the
+// layout of mesh_skin: 16 floats per joint, the columns without the bottom
+// row padded with zeros.
+extern void gltf_skin_palette(const gltf_model_t *model, u32_t skin, f32_t *palette);
+
+// Poses the vertices with a palette into world space positions and normals,
+// three floats each, spread over the job system in vertex ranges. normals is
+// left alone if the vertices have none.
+extern void gltf_skin_apply(const gltf_skin_vertices_t *vertices, const f32_t *palette, f32_t *positions, f32_t *normals);
+
+// Samples every channel of an animation at time, clamped to its keyframes,
+// into one 16 byte aligned value per channel. cursors holds a keyframe per
+// channel, zeroed before the first call, which is where the search for the
+// next time starts: playback moving forward steps over a keyframe or two
+// instead of searching. Values are interpolated four components at a time
+// with SSE, rotations by nlerp with the time adjusted to follow slerp.
+extern void gltf_animation_sample(const gltf_model_t *model, u32_t animation, f32_t time, u32_t *cursors, HMM_Vec4 *values);
+
+// Instances of an animation, each playing at its own time.
+typedef struct gltf_animation_player_t gltf_animation_player_t;
+struct gltf_animation_player_t {
+    u32_t animation;
+    u32_t count;
+    // Time of every instance, set before sampling.
+    f32_t *times;
+    // Cursors and sampled values of every instance, channel_count apart.
+    u32_t *cursors;
+    HMM_Vec4 *values;
+};
+
+// Makes a player of count instances at time zero.
+extern gltf_animation_player_t gltf_animation_player_new(const gltf_model_t *model, u32_t animation, u32_t count, re_arena_t *arena);
+
+// gltf_animation_sample for every instance of a player at its time, spread
+// over the job system in batches of instances.
+extern void gltf_animation_sample_batch(const gltf_model_t *model, gltf_animation_player_t *player);
+
+// Sets the local transforms an animation's channels target to sampled
+// values. World matrices are left for gltf_nodes_update.
+extern void gltf_animation_apply(const gltf_model_t *model, u32_t animation, const HMM_Vec4 *values, gltf_nodes_t *nodes);
+
+// Called once for every model that loaded. The model only lives until the
+// call returns.
+typedef void (*gltf_batch_fn_t)(void *user, u32_t index, gltf_model_t *model);
+
+typedef struct gltf_batch_stats_t gltf_batch_stats_t;
+struct gltf_batch_stats_t {
+    u32_t loaded;
+    u32_t failed;
+    // Buffer files read from disk, and buffer loads served by a file read
+    // before under the same path or with identical content.
+    u32_t buffer_reads;
+    u32_t path_hits;
+    u32_t content_hits;
+    u64_t bytes_read;
+    // Bytes neither read nor stored again thanks to path hits, and bytes not
+    // stored again thanks to content hits.
+    u64_t bytes_shared;
+    f64_t seconds;
+};
+
+// Loads every path like gltf_load, spread over the job system. Buffer files
+// are read once per batch and shared by every model using them, also when
+// identical files sit under different paths, in arena. Each model lives in
+// the scratch arena of the thread loading it, rewound once fn returns, so
+// memory use doesn't grow with the number of models.
+extern gltf_batch_stats_t gltf_load_batch(const char **paths, u32_t count, u32_t process, gltf_batch_fn_t fn, void *user, re_arena_t *arena);
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <rebound.h>
+
+// Two level segregated fit allocator handing out offsets into a range it
+// never touches, like a GPU buffer. The bookkeeping is plain CPU memory and
+// needs no GL context. Allocation and freeing take constant time. Masmano et
+// al., "TLSF: a New Dynamic Memory Allocator for Real-Time Systems", 2004.
+
+// Offsets and sizes are multiples of the granularity, the smallest block.
+#define HEAP_GRANULARITY 16
+
+// Every first level, a power of two range of sizes, is split into this many
+// second level lists.
+#define HEAP_SL_BITS 4
+#define HEAP_SL_COUNT (1 << HEAP_SL_BITS)
+#define HEAP_FL_COUNT 64
+
+// Block index of no block.
+#define HEAP_NONE 0xffffffffu
+
+// A free or used range, linked to its neighbours in address order and, while
+// free, to the other free blocks of its size class.
+typedef struct heap_block_t heap_block_t;
+struct heap_block_t {
+    u64_t offset;
+    u64_t size;
+    u32_t prev_phys;
+    u32_t next_phys;
+    u32_t prev_free;
+    u32_t next_free;
+    b8_t free;
+};
+
+typedef struct heap_t heap_t;
+struct heap_t {
+    u64_t size;
+
+    // Block nodes, unused ones linked through next_free from unused. Blocks
+    // only ever merge into the one before them, so the block at offset 0
+    // keeps its node.
+    heap_block_t *blocks;
+    u32_t block_capacity;
+    u32_t unused;
+    u32_t first;
+
+    // Free list heads per size class, HEAP_SL_COUNT per first level, and a
+    // bit per non-empty list.
+    u32_t *heads;
+    u64_t fl_bitmap;
+    u32_t sl_bitmap[HEAP_FL_COUNT];
+
+    u64_t used;
+    u32_t allocation_count;
+};
+
+typedef struct heap_allocation_t heap_allocation_t;
+struct heap_allocation_t {
+    u64_t offset;
+    u64_t size;
+    u32_t block;
+};
+
+typedef struct heap_stats_t heap_stats_t;
+struct heap_stats_t {
+    u64_t used;
+    u64_t free;
+    u64_t largest_free;
+    u32_t allocation_count;
+    u32_t free_block_count;
+};
+
+// Manages [0, size), with room for at least max_allocations live allocations.
+extern heap_t heap_new(u64_t size, u32_t max_allocations, re_arena_t *arena);
+
+// Allocates size bytes at a multiple of alignment, a power of two. Returns
+// false if no free block fits or the block nodes ran out.
+extern b8_t heap_alloc(heap_t *heap, u64_t size, u64_t alignment, heap_allocation_t *allocation);
+
+// Frees an allocation, merging it with free neighbours.
+extern void heap_free(heap_t *heap, heap_allocation_t allocation);
+
+// Walks every block, for logs and checks.
+extern heap_stats_t heap_stats(const heap_t *heap);
+
+// Walks every block and free list and checks that the blocks tile the heap,
+// free neighbours were merged, the counters match and every free block is
+// listed under its size class and bitmap bits. Logs the first broken
+// invariant and returns false.
+extern b8_t heap_validate(const heap_t *heap);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <rebound.h>
+
+// Processes items [begin, end) of a parallel for.
+typedef void (*job_fn_t)(void *user, u32_t begin, u32_t end);
+
+// Starts the worker pool. A thread count of 0 uses one thread per core, the
+// calling thread included. Without a pool every job runs on the caller.
+extern void job_system_init(u32_t thread_count);
+extern void job_system_terminate(void);
+
+// Number of threads taking part in a parallel for, the caller included.
+extern u32_t job_thread_count(void);
+
+// Splits [0, count) into batches of batch_size items and runs them across the
+// pool, returning when every batch is done. Calls made from inside a job run
+// inline on the calling worker.
+extern void job_parallel_for(u32_t count, u32_t batch_size, job_fn_t fn, void *user);
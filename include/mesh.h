@@ -0,0 +1,333 @@
+#pragma once
+
+#include <rebound.h>
+
+// Mesh processing on plain u32 index buffers. Outputs may alias the inputs.
+
+/*=========================*/
+// Vertex cache
+/*=========================*/
+
+// Cache size the optimizer targets and the analyzer simulates by default.
+#define MESH_VERTEX_CACHE_SIZE 16
+
+typedef enum {
+    // Vertices leave the cache in the order they entered it, like most GPUs.
+    MESH_CACHE_FIFO,
+    // Hits move a vertex back to the front.
+    MESH_CACHE_LRU,
+} mesh_cache_model_t;
+
+typedef struct mesh_cache_stats_t mesh_cache_stats_t;
+struct mesh_cache_stats_t {
+    // Vertices transformed per triangle, 0.5 at best and 3 at worst.
+    f32_t acmr;
+    // Vertices transformed per vertex referenced, 1 at best.
+    f32_t atvr;
+};
+
+extern mesh_cache_stats_t mesh_analyze_vertex_cache(
+        const u32_t *indices,
+        u32_t index_count,
+        u32_t vertex_count,
+        u32_t cache_size,
+        mesh_cache_model_t model);
+
+// Reorders triangles to reduce vertex cache misses using Tipsify. The winding
+// of every triangle is kept.
+extern void mesh_optimize_vertex_cache(
+        u32_t *out,
+        const u32_t *indices,
+        u32_t index_count,
+        u32_t vertex_count,
+        u32_t cache_size);
+
+/*=========================*/
+// Overdraw
+/*=========================*/
+
+// How much worse than the cluster's own ACMR a split point may be, higher
+// values give more clusters and less overdraw at some vertex cache cost.
+#define MESH_OVERDRAW_THRESHOLD 1.05f
+
+typedef struct mesh_overdraw_stats_t mesh_overdraw_stats_t;
+struct mesh_overdraw_stats_t {
+    // Pixels covered by the mesh and pixels shaded, summed over all views.
+    u32_t covered;
+    u32_t shaded;
+    // Shaded per covered pixel, 1 at best.
+    f32_t overdraw;
+};
+
+// Rasterizes the mesh from the six axis directions with back face culling
+// and a depth test, counting every fragment that passes. positions holds
+// tightly packed xyz triples.
+extern mesh_overdraw_stats_t mesh_analyze_overdraw(
+        const u32_t *indices,
+        u32_t index_count,
+        const f32_t *positions,
+        u32_t vertex_count);
+
+// Splits a vertex cache optimized triangle order into clusters where the
+// cache is cold anyway and sorts the clusters so outward facing ones on the
+// outside of the mesh are drawn first. Sander et al. 2007, same as Tipsify.
+// The input order is kept if the new one's FIFO ACMR would be more than
+// threshold times the input's.
+extern void mesh_optimize_overdraw(
+        u32_t *out,
+        const u32_t *indices,
+        u32_t index_count,
+        const f32_t *positions,
+        u32_t vertex_count,
+        u32_t cache_size,
+        f32_t threshold);
+
+/*=========================*/
+// Vertex fetch
+/*=========================*/
+
+// Cache the fetch analyzer simulates, direct mapped like a small L1.
+#define MESH_FETCH_CACHE_LINE 64
+#define MESH_FETCH_CACHE_SIZE (16 * 1024)
+
+// Remap entry of a vertex no triangle references.
+#define MESH_VERTEX_UNUSED 0xffffffffu
+
+typedef struct mesh_fetch_stats_t mesh_fetch_stats_t;
+struct mesh_fetch_stats_t {
+    u64_t bytes_fetched;
+    // Bytes of referenced vertices per byte fetched, 1 at best.
+    f32_t efficiency;
+};
+
+// Simulates fetching vertices of vertex_size bytes, stored one after another,
+// in cache lines.
+extern mesh_fetch_stats_t mesh_analyze_vertex_fetch(
+        const u32_t *indices,
+        u32_t index_count,
+        u32_t vertex_count,
+        u32_t vertex_size);
+
+// Like mesh_analyze_vertex_fetch, but every vertex is split over several
+// streams stored one after another, stream_strides[s] bytes apart in stream
+// s, that share the cache. A single interleaved stream is the one stream
+// case.
+extern mesh_fetch_stats_t mesh_analyze_vertex_fetch_streams(
+        const u32_t *indices,
+        u32_t index_count,
+        u32_t vertex_count,
+        const u32_t *stream_strides,
+        u32_t stream_count);
+
+// Numbers vertices in the order the indices first use them, writing the new
+// index of every vertex to remap and MESH_VERTEX_UNUSED for unreferenced ones.
+// Returns the number of vertices left. Out of range indices give an identity
+// remap.
+extern u32_t mesh_optimize_vertex_fetch(
+        u32_t *remap,
+        const u32_t *indices,
+        u32_t index_count,
+        u32_t vertex_count);
+
+extern void mesh_remap_indices(
+        u32_t *out,
+        const u32_t *indices,
+        u32_t index_count,
+        const u32_t *remap);
+
+/*=========================*/
+// Deduplication
+/*=========================*/
+
+// One attribute of every vertex, size bytes each and stride bytes apart.
+typedef struct mesh_stream_t mesh_stream_t;
+struct mesh_stream_t {
+    const void *data;
+    u32_t size;
+    u32_t stride;
+};
+
+// Maps every vertex to the first one with bitwise identical data in all
+// streams, numbering the unique vertices in order. Returns how many there are.
+extern u32_t mesh_deduplicate(
+        u32_t *remap,
+        const mesh_stream_t *streams,
+        u32_t stream_count,
+        u32_t vertex_count);
+
+// Like mesh_deduplicate, but vertices match when no float of their packed
+// vertex_floats tuples differs by more than its tolerance. The first three
+// floats are the position and need positive tolerances, they pick the cells
+// of the spatial hash.
+extern u32_t mesh_weld(
+        u32_t *remap,
+        const f32_t *vertices,
+        u32_t vertex_count,
+        u32_t vertex_floats,
+        const f32_t *tolerances);
+
+/*=========================*/
+// Simplification
+/*=========================*/
+
+// Collapses edges in order of their quadric error until at most
+// target_index_count indices are left or the next collapse would move the
+// surface further than target_error. Vertices only move onto their
+// neighbours, so the result indexes the same vertex buffer. Borders only
+// collapse along themselves, and attribute seams (vertices sharing a
+// position) only when every side of the seam can follow. Returns the new
+// index count and writes the largest error, in position units, to error.
+// Garland, Heckbert, "Surface Simplification Using Quadric Error Metrics",
+// 1997.
+extern u32_t mesh_simplify(
+        u32_t *out,
+        const u32_t *indices,
+        u32_t index_count,
+        const f32_t *positions,
+        u32_t vertex_count,
+        u32_t target_index_count,
+        f32_t target_error,
+        f32_t *error);
+
+/*=========================*/
+// Meshlets
+/*=========================*/
+
+// Limits that suit mesh shaders on most GPUs, at most 256 vertices are
+// supported since triangles use 8 bit local indices.
+#define MESH_MESHLET_MAX_VERTICES 64
+#define MESH_MESHLET_MAX_TRIANGLES 124
+
+// A cluster of triangles, vertex_count entries of the meshlet vertex array
+// and triangle_count triples of local indices in the triangle array.
+typedef struct mesh_meshlet_t mesh_meshlet_t;
+struct mesh_meshlet_t {
+    u32_t vertex_offset;
+    u32_t triangle_offset;
+    u32_t vertex_count;
+    u32_t triangle_count;
+};
+
+typedef struct mesh_bounds_t mesh_bounds_t;
+struct mesh_bounds_t {
+    f32_t center[3];
+    f32_t radius;
+    // Every triangle faces away from cameras inside the cone around -axis,
+    // cutoff is the sine of its half angle. A cutoff of 1 never culls.
+    f32_t cone_axis[3];
+    f32_t cone_cutoff;
+};
+
+// Most meshlets mesh_build_meshlets can write for index_count indices.
+extern u32_t mesh_meshlet_bound(u32_t index_count, u32_t max_vertices, u32_t max_triangles);
+
+// Splits the triangles into meshlets, growing each one with the neighbouring
+// triangle that adds the fewest vertices and stays closest to it. The vertex
+// array needs room for index_count entries and the triangle array for
+// index_count bytes. Returns the meshlet count, 0 for invalid input.
+extern u32_t mesh_build_meshlets(
+        mesh_meshlet_t *meshlets,
+        u32_t *meshlet_vertices,
+        u8_t *meshlet_triangles,
+        const u32_t *indices,
+        u32_t index_count,
+        const f32_t *positions,
+        u32_t vertex_count,
+        u32_t max_vertices,
+        u32_t max_triangles);
+
+// Bounding sphere and normal cone of one meshlet, both in position units.
+extern mesh_bounds_t mesh_compute_meshlet_bounds(
+        const u32_t *meshlet_vertices,
+        const u8_t *meshlet_triangles,
+        u32_t triangle_count,
+        const f32_t *positions);
+
+// True if every triangle of the meshlet faces away from camera, which must be
+// in the same space as the bounds.
+extern b8_t mesh_meshlet_backfacing(const mesh_bounds_t *bounds, const f32_t *camera);
+
+/*=========================*/
+// Normals
+/*=========================*/
+
+// Writes a normal for every triangle corner, index_count / 3 * 3 of them.
+// A corner sums the area weighted normals of the faces around its position
+// that are at most crease_angle radians from its own face, so sharper edges
+// stay hard: 0 gives flat shading, pi smooth shading. Corners are sorted by
+// position and each one's faces tested and summed four at a time with SSE.
+// Returns false for out of range indices.
+extern b8_t mesh_generate_normals(
+        f32_t *normals,
+        const u32_t *indices,
+        u32_t index_count,
+        const f32_t *positions,
+        u32_t vertex_count,
+        f32_t crease_angle);
+
+/*=========================*/
+// Tangents
+/*=========================*/
+
+// Writes an xyzw tangent for every vertex following MikkTSpace: corners with
+// the same position, normal and uv share a tangent, which sums the direction
+// of increasing u over each corner's triangle projected onto the corner's
+// normal and weighted by the corner's angle. The bitangent is
+// cross(normal, tangent) * w, with uvs pointing down the image like in glTF.
+// A vertex with corners on both sides of a mirror seam is split, its mirrored
+// corners get a new vertex after the original ones. remap gets the vertex of
+// every index, sources the original vertex of every vertex and
+// new_vertex_count their count, tangents and sources need room for twice
+// vertex_count. Triangles are evaluated four at a time with SSE. Returns
+// false for out of range indices. Mikkelsen, "Simulation of Wrinkled
+// Surfaces Revisited", 2008.
+extern b8_t mesh_generate_tangents(
+        f32_t *tangents,
+        u32_t *remap,
+        u32_t *sources,
+        u32_t *new_vertex_count,
+        const u32_t *indices,
+        u32_t index_count,
+        const f32_t *positions,
+        const f32_t *normals,
+        const f32_t *uvs,
+        u32_t vertex_count);
+
+/*=========================*/
+// Skinning
+/*=========================*/
+
+// Floats per joint of a skinning palette, the four columns of the joint's
+// matrix without the bottom row, each padded to four floats with a zero.
+#define MESH_SKIN_JOINT_FLOATS 16
+
+// Linear blend skinning: moves every position by the sum of its four joint
+// matrices scaled by their weights, and turns its normal by the same matrix
+// and renormalizes it, which is exact for rotations and uniform scale. The
+// columns of a joint are loaded as SSE vectors, blending is a multiply and add
+// per column and weight. Joints must be within the palette and the outputs
+// must not overlap the inputs. normals and out_normals may be NULL.
+extern void mesh_skin(
+        f32_t *out_positions,
+        f32_t *out_normals,
+        const f32_t *positions,
+        const f32_t *normals,
+        const u16_t *joints,
+        const f32_t *weights,
+        u32_t vertex_count,
+        const f32_t *palette);
+
+/*=========================*/
+// Index compression
+/*=========================*/
+
+// Largest size mesh_encode_indices can return.
+extern u64_t mesh_encode_indices_bound(u32_t index_count);
+
+// Encodes every index relative to one more than the largest index before it,
+// which is what vertex fetch optimized meshes use next, as a zigzag varint.
+// Returns the encoded size.
+extern u64_t mesh_encode_indices(u8_t *out, const u32_t *indices, u32_t index_count);
+
+// Returns false if data doesn't hold exactly index_count indices.
+extern b8_t mesh_decode_indices(u32_t *out, u32_t index_count, const u8_t *data, u64_t size);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <rebound.h>
+
+// Decoders for the meshoptimizer codecs used by EXT_meshopt_compression. Every
+// decoder returns false if the data is malformed, the output is then
+// undefined.
+
+// ATTRIBUTES mode. vertex_size has to be a multiple of 4 and at most 256.
+extern b8_t meshopt_decode_vertex_buffer(void *out, u32_t vertex_count, u32_t vertex_size, const u8_t *data, u64_t size);
+// TRIANGLES mode. index_size is 2 or 4 and index_count a multiple of 3.
+extern b8_t meshopt_decode_index_buffer(void *out, u32_t index_count, u32_t index_size, const u8_t *data, u64_t size);
+// INDICES mode. index_size is 2 or 4.
+extern b8_t meshopt_decode_index_sequence(void *out, u32_t index_count, u32_t index_size, const u8_t *data, u64_t size);
+
+// Filters run in place on decoded vertex data.
+
+// Octahedral normals in 8 bit (stride 4) or 16 bit (stride 8) components.
+extern void meshopt_decode_filter_oct(void *data, u32_t count, u32_t stride);
+// Quaternions with the largest component dropped, stride has to be 8.
+extern void meshopt_decode_filter_quat(void *data, u32_t count, u32_t stride);
+// Floats with a shared exponent, stride has to be a multiple of 4.
+extern void meshopt_decode_filter_exp(void *data, u32_t count, u32_t stride);
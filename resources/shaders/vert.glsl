@@ -12,6 +12,7 @@ uniform mat4 transform;
 void main() {
     gl_Position = projection * view * transform * vec4(v_position, 1.0);
 
-    f_normal = mat3(transpose(inverse(transform))) * v_normal;
+    // Quantized normals are only approximately unit length.
+    f_normal = mat3(transpose(inverse(transform))) * normalize(v_normal);
     f_frag_coord = vec3(transform * vec4(v_position, 1.0));
 }
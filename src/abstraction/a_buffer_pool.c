@@ -0,0 +1,76 @@
+#include "a_internal.h"
+
+#include <glad/gl.h>
+
+gl_buffer_pool_t gl_buffer_pool_new(u64_t page_size, u32_t max_allocations, re_arena_t *arena) {
+    return (gl_buffer_pool_t) {
+        .page_size = page_size,
+        .max_allocations = max_allocations,
+        .arena = arena,
+    };
+}
+
+void gl_buffer_pool_free(gl_buffer_pool_t *pool) {
+    glDeleteBuffers(pool->page_count, pool->handles);
+    *pool = (gl_buffer_pool_t) {0};
+}
+
+// Uploads go through the copy write binding, which leaves the array and
+// element array bindings, the latter part of the current VAO, alone.
+static b8_t add_page(gl_buffer_pool_t *pool, u64_t size) {
+    if (pool->page_count == GL_BUFFER_POOL_MAX_PAGES) {
+        return false;
+    }
+
+    u32_t page = pool->page_count++;
+    pool->heaps[page] = heap_new(size, pool->max_allocations, pool->arena);
+
+    glGenBuffers(1, &pool->handles[page]);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, pool->handles[page]);
+    glBufferData(GL_COPY_WRITE_BUFFER, pool->heaps[page].size, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return true;
+}
+
+b8_t gl_buffer_pool_alloc(gl_buffer_pool_t *pool, u64_t size, u64_t alignment, const void *data, gl_buffer_slice_t *slice) {
+    u32_t page = 0;
+    heap_allocation_t allocation;
+    while (page < pool->page_count && !heap_alloc(&pool->heaps[page], size, alignment, &allocation)) {
+        page++;
+    }
+
+    if (page == pool->page_count) {
+        u64_t page_size = pool->page_size;
+        while (page_size < size + alignment) {
+            page_size *= 2;
+        }
+        if (!add_page(pool, page_size) || !heap_alloc(&pool->heaps[page], size, alignment, &allocation)) {
+            return false;
+        }
+    }
+
+    *slice = (gl_buffer_slice_t) {pool->handles[page], allocation.offset, page, allocation};
+    if (data != NULL) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, slice->handle);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, slice->offset, size, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    return true;
+}
+
+void gl_buffer_pool_release(gl_buffer_pool_t *pool, gl_buffer_slice_t slice) {
+    heap_free(&pool->heaps[slice.page], slice.allocation);
+}
+
+heap_stats_t gl_buffer_pool_stats(const gl_buffer_pool_t *pool) {
+    heap_stats_t stats = {0};
+    for (u32_t i = 0; i < pool->page_count; i++) {
+        heap_stats_t page = heap_stats(&pool->heaps[i]);
+        stats.used += page.used;
+        stats.free += page.free;
+        stats.largest_free = page.largest_free > stats.largest_free ? page.largest_free : stats.largest_free;
+        stats.allocation_count += page.allocation_count;
+        stats.free_block_count += page.free_block_count;
+    }
+    return stats;
+}
@@ -2,6 +2,8 @@
 
 #include <rebound.h>
 
+#include "heap.h"
+
 /*=========================*/
 // Shader
 /*=========================*/
@@ -43,6 +45,46 @@ struct gl_index_buffer_t {
 extern gl_index_buffer_t gl_index_buffer_new(u32_t size, const u32_t *data, gl_buffer_usage_t usage);
 extern void gl_index_buffer_free(gl_index_buffer_t *ib);
 
+/*=========================*/
+// Buffer pool
+/*=========================*/
+
+// Most GL buffers one pool creates.
+#define GL_BUFFER_POOL_MAX_PAGES 16
+
+// A range of one of a pool's buffers.
+typedef struct gl_buffer_slice_t gl_buffer_slice_t;
+struct gl_buffer_slice_t {
+    u32_t handle;
+    u64_t offset;
+    u32_t page;
+    heap_allocation_t allocation;
+};
+
+// Sub-allocates data from a few large GL buffers, so many models and views
+// share a handful of buffer objects. A new page of page_size bytes, or more
+// for larger data, is added when the others are full. GL buffers are
+// typeless, the same pool can hold vertex or index data.
+typedef struct gl_buffer_pool_t gl_buffer_pool_t;
+struct gl_buffer_pool_t {
+    u64_t page_size;
+    u32_t max_allocations;
+    re_arena_t *arena;
+
+    u32_t page_count;
+    u32_t handles[GL_BUFFER_POOL_MAX_PAGES];
+    heap_t heaps[GL_BUFFER_POOL_MAX_PAGES];
+};
+
+extern gl_buffer_pool_t gl_buffer_pool_new(u64_t page_size, u32_t max_allocations, re_arena_t *arena);
+extern void gl_buffer_pool_free(gl_buffer_pool_t *pool);
+// Copies size bytes of data into a new slice at a multiple of alignment, a
+// power of two. Returns false when no page has room and no more can be added.
+extern b8_t gl_buffer_pool_alloc(gl_buffer_pool_t *pool, u64_t size, u64_t alignment, const void *data, gl_buffer_slice_t *slice);
+extern void gl_buffer_pool_release(gl_buffer_pool_t *pool, gl_buffer_slice_t slice);
+// Bookkeeping summed over all pages.
+extern heap_stats_t gl_buffer_pool_stats(const gl_buffer_pool_t *pool);
+
 typedef enum {
     GL_VERTEX_ATTRIBUTE_TYPE_FLOAT,
     GL_VERTEX_ATTRIBUTE_TYPE_VEC2,
@@ -0,0 +1,539 @@
+#include "bvh.h"
+#include "job.h"
+#include "rebound.h"
+
+#include <float.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*=========================*/
+// Boxes
+/*=========================*/
+
+// The fourth lanes are padding so the SSE2 paths can load and store whole
+// boxes, their values mean nothing.
+typedef struct box_t box_t;
+struct box_t {
+    f32_t min[4];
+    f32_t max[4];
+};
+
+// An item's box, moved around with its index while partitioning so every
+// pass over a node streams through memory instead of chasing indices.
+typedef struct record_t record_t;
+struct record_t {
+    f32_t min[3];
+    u32_t item;
+    f32_t max[3];
+    u32_t padding;
+};
+
+static box_t box_empty(void) {
+    return (box_t) {{FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX}};
+}
+
+#if defined(__SSE2__)
+static inline void box_grow_sse(box_t *box, __m128 min, __m128 max) {
+    _mm_storeu_ps(box->min, _mm_min_ps(_mm_loadu_ps(box->min), min));
+    _mm_storeu_ps(box->max, _mm_max_ps(_mm_loadu_ps(box->max), max));
+}
+#endif
+
+static void box_grow(box_t *box, const record_t *record) {
+#if defined(__SSE2__)
+    box_grow_sse(box, _mm_loadu_ps(record->min), _mm_loadu_ps(record->max));
+#else
+    for (u32_t axis = 0; axis < 3; axis++) {
+        box->min[axis] = record->min[axis] < box->min[axis] ? record->min[axis] : box->min[axis];
+        box->max[axis] = record->max[axis] > box->max[axis] ? record->max[axis] : box->max[axis];
+    }
+#endif
+}
+
+// Grows the box by a centroid padded to four lanes.
+static void box_grow_point(box_t *box, const f32_t *point) {
+#if defined(__SSE2__)
+    __m128 p = _mm_loadu_ps(point);
+    box_grow_sse(box, p, p);
+#else
+    for (u32_t axis = 0; axis < 3; axis++) {
+        box->min[axis] = point[axis] < box->min[axis] ? point[axis] : box->min[axis];
+        box->max[axis] = point[axis] > box->max[axis] ? point[axis] : box->max[axis];
+    }
+#endif
+}
+
+static void box_merge(box_t *box, const box_t *other) {
+#if defined(__SSE2__)
+    box_grow_sse(box, _mm_loadu_ps(other->min), _mm_loadu_ps(other->max));
+#else
+    for (u32_t axis = 0; axis < 3; axis++) {
+        box->min[axis] = other->min[axis] < box->min[axis] ? other->min[axis] : box->min[axis];
+        box->max[axis] = other->max[axis] > box->max[axis] ? other->max[axis] : box->max[axis];
+    }
+#endif
+}
+
+// Half the surface area, 0 for empty boxes.
+static f32_t box_area(const f32_t *min, const f32_t *max) {
+    f32_t dx = max[0] - min[0];
+    f32_t dy = max[1] - min[1];
+    f32_t dz = max[2] - min[2];
+    if (dx < 0.0f || dy < 0.0f || dz < 0.0f) {
+        return 0.0f;
+    }
+    return dx * dy + dy * dz + dz * dx;
+}
+
+/*=========================*/
+// Binning
+/*=========================*/
+
+// Items whose centroids fall in one bin along one axis and their bounds.
+typedef struct bin_t bin_t;
+struct bin_t {
+    box_t bounds;
+    u32_t count;
+};
+
+typedef struct bins_t bins_t;
+struct bins_t {
+    bin_t axes[3][BVH_BIN_COUNT];
+};
+
+typedef struct builder_t builder_t;
+struct builder_t {
+    bvh_node_t *nodes;
+    record_t *records;
+};
+
+// Centroids span [min, min + count / scale) along each axis. Nodes with
+// fewer items than BVH_BIN_COUNT use one bin per item, clearing and sweeping
+// all bins would otherwise dominate the many small nodes near the leaves.
+typedef struct binning_t binning_t;
+struct binning_t {
+    f32_t min[4];
+    f32_t scale[4];
+    u32_t count;
+};
+
+static binning_t binning_of(const box_t *centroids, u32_t item_count) {
+    binning_t binning = {.count = item_count < BVH_BIN_COUNT ? item_count : BVH_BIN_COUNT};
+    for (u32_t axis = 0; axis < 3; axis++) {
+        f32_t extent = centroids->max[axis] - centroids->min[axis];
+        binning.min[axis] = centroids->min[axis];
+        binning.scale[axis] = extent > 0.0f ? binning.count * (1.0f - 1e-6f) / extent : 0.0f;
+    }
+    return binning;
+}
+
+// Writes a record's centroid, padded to four lanes, and its bin along every
+// axis. Binning and partitioning both go through here so they always agree.
+static inline void locate(const binning_t *binning, const record_t *record, f32_t centroid[4], i32_t bin[4]) {
+#if defined(__SSE2__)
+    // The item index in the padding lane must not reach the arithmetic, it
+    // would be a denormal.
+    __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    __m128 sum = _mm_add_ps(_mm_and_ps(_mm_loadu_ps(record->min), xyz), _mm_and_ps(_mm_loadu_ps(record->max), xyz));
+    __m128 center = _mm_mul_ps(sum, _mm_set1_ps(0.5f));
+    __m128 offset = _mm_mul_ps(_mm_sub_ps(center, _mm_loadu_ps(binning->min)), _mm_loadu_ps(binning->scale));
+    offset = _mm_min_ps(_mm_max_ps(offset, _mm_setzero_ps()), _mm_set1_ps((f32_t) (binning->count - 1)));
+    _mm_storeu_ps(centroid, center);
+    _mm_storeu_si128((__m128i *) bin, _mm_cvttps_epi32(offset));
+#else
+    for (u32_t axis = 0; axis < 3; axis++) {
+        centroid[axis] = (record->min[axis] + record->max[axis]) * 0.5f;
+        f32_t offset = (centroid[axis] - binning->min[axis]) * binning->scale[axis];
+        offset = offset > 0.0f ? offset : 0.0f;
+        offset = offset < (f32_t) (binning->count - 1) ? offset : (f32_t) (binning->count - 1);
+        bin[axis] = (i32_t) offset;
+    }
+    centroid[3] = 0.0f;
+    bin[3] = 0;
+#endif
+}
+
+static void bin_items(bins_t *bins, const builder_t *builder, const binning_t *binning, u32_t begin, u32_t end) {
+    for (u32_t axis = 0; axis < 3; axis++) {
+        for (u32_t b = 0; b < binning->count; b++) {
+            bins->axes[axis][b] = (bin_t) {box_empty(), 0};
+        }
+    }
+
+    for (u32_t i = begin; i < end; i++) {
+        const record_t *record = &builder->records[i];
+        f32_t centroid[4];
+        i32_t bin[4];
+        locate(binning, record, centroid, bin);
+        for (u32_t axis = 0; axis < 3; axis++) {
+            bin_t *b = &bins->axes[axis][bin[axis]];
+            box_grow(&b->bounds, record);
+            b->count++;
+        }
+    }
+}
+
+typedef struct bin_job_t bin_job_t;
+struct bin_job_t {
+    bins_t *bins;
+    const builder_t *builder;
+    const binning_t *binning;
+    u32_t begin;
+    u32_t end;
+};
+
+static void bin_batch(void *user, u32_t begin, u32_t end) {
+    bin_job_t *job = user;
+    for (u32_t c = begin; c < end; c++) {
+        u32_t first = job->begin + c * BVH_BIN_BATCH;
+        u32_t last = job->end - first > BVH_BIN_BATCH ? first + BVH_BIN_BATCH : job->end;
+        bin_items(&job->bins[c], job->builder, job->binning, first, last);
+    }
+}
+
+/*=========================*/
+// Splitting
+/*=========================*/
+
+// Items [begin, end) that still need splitting under node, whose bounds are
+// already written.
+typedef struct task_t task_t;
+struct task_t {
+    u32_t node;
+    u32_t begin;
+    u32_t end;
+    box_t centroids;
+};
+
+typedef struct split_t split_t;
+struct split_t {
+    // -1 when every plane leaves one side empty.
+    i32_t axis;
+    u32_t bin;
+    f32_t cost;
+    box_t left;
+    box_t right;
+};
+
+// Sweeps every axis from both ends to price the planes between bins.
+static split_t best_split(const bins_t *bins, const binning_t *binning) {
+    u32_t count = binning->count;
+    split_t best = {.axis = -1, .cost = FLT_MAX};
+    for (u32_t axis = 0; axis < 3; axis++) {
+        const bin_t *row = bins->axes[axis];
+
+        box_t right[BVH_BIN_COUNT];
+        u32_t right_count[BVH_BIN_COUNT];
+        box_t sum = box_empty();
+        u32_t sum_count = 0;
+        for (u32_t b = count; b-- > 1;) {
+            box_merge(&sum, &row[b].bounds);
+            sum_count += row[b].count;
+            right[b] = sum;
+            right_count[b] = sum_count;
+        }
+
+        sum = box_empty();
+        sum_count = 0;
+        for (u32_t b = 1; b < count; b++) {
+            box_merge(&sum, &row[b - 1].bounds);
+            sum_count += row[b - 1].count;
+            if (sum_count == 0 || right_count[b] == 0) {
+                continue;
+            }
+
+            f32_t cost = box_area(sum.min, sum.max) * (f32_t) sum_count +
+                    box_area(right[b].min, right[b].max) * (f32_t) right_count[b];
+            if (cost < best.cost) {
+                best = (split_t) {(i32_t) axis, b, cost, sum, right[b]};
+            }
+        }
+    }
+    return best;
+}
+
+// Moves the items left of the split to the front of [begin, end), returning
+// where the right ones start, and bounds the centroids of both sides.
+static u32_t partition(
+        const builder_t *builder,
+        const binning_t *binning,
+        const split_t *split,
+        u32_t begin,
+        u32_t end,
+        box_t centroids[2]) {
+    record_t *records = builder->records;
+    u32_t i = begin;
+    u32_t j = end;
+    centroids[0] = box_empty();
+    centroids[1] = box_empty();
+    while (i < j) {
+        f32_t centroid[4];
+        i32_t bin[4];
+        locate(binning, &records[i], centroid, bin);
+        if ((u32_t) bin[split->axis] < split->bin) {
+            box_grow_point(&centroids[0], centroid);
+            i++;
+        } else {
+            box_grow_point(&centroids[1], centroid);
+            record_t record = records[i];
+            records[i] = records[--j];
+            records[j] = record;
+        }
+    }
+    return i;
+}
+
+static void write_bounds(bvh_node_t *node, const box_t *box) {
+    memcpy(node->min, box->min, sizeof(node->min));
+    memcpy(node->max, box->max, sizeof(node->max));
+}
+
+// Splits the task's node given its bins, writing its children at
+// *node_count. Returns false when it stays a leaf, otherwise sets the child
+// tasks.
+static b8_t split_node(
+        const builder_t *builder,
+        const binning_t *binning,
+        const bins_t *bins,
+        const task_t *task,
+        u32_t *node_count,
+        task_t children[2]) {
+    bvh_node_t *node = &builder->nodes[task->node];
+    u32_t count = task->end - task->begin;
+    node->first = task->begin;
+    node->count = count;
+    if (count <= 1) {
+        return false;
+    }
+
+    split_t split = best_split(bins, binning);
+    f32_t area = box_area(node->min, node->max);
+    u32_t middle;
+    box_t bounds[2];
+    box_t centroids[2];
+    if (split.axis >= 0) {
+        // A leaf costs an item test per item, a split the visit plus the
+        // children weighted by how likely a ray through the node hits them.
+        if (count <= BVH_MAX_LEAF_ITEMS && BVH_TRAVERSAL_COST * area + split.cost >= area * (f32_t) count) {
+            return false;
+        }
+        middle = partition(builder, binning, &split, task->begin, task->end, centroids);
+        bounds[0] = split.left;
+        bounds[1] = split.right;
+    } else {
+        // Every centroid is the same point, only the order can split them.
+        if (count <= BVH_MAX_LEAF_ITEMS) {
+            return false;
+        }
+        middle = task->begin + count / 2;
+        bounds[0] = box_empty();
+        bounds[1] = box_empty();
+        centroids[0] = task->centroids;
+        centroids[1] = task->centroids;
+        for (u32_t i = task->begin; i < task->end; i++) {
+            box_grow(&bounds[i >= middle], &builder->records[i]);
+        }
+    }
+
+    u32_t first = *node_count;
+    *node_count += 2;
+    node->first = first;
+    node->count = 0;
+    write_bounds(&builder->nodes[first], &bounds[0]);
+    write_bounds(&builder->nodes[first + 1], &bounds[1]);
+    children[0] = (task_t) {first, task->begin, middle, centroids[0]};
+    children[1] = (task_t) {first + 1, middle, task->end, centroids[1]};
+    return true;
+}
+
+/*=========================*/
+// Subtrees
+/*=========================*/
+
+// A subtree is built serially into nodes [base, base + 2 * count - 2) after
+// its root, which lives with the top of the tree.
+typedef struct subtree_t subtree_t;
+struct subtree_t {
+    task_t root;
+    u32_t base;
+    u32_t end;
+};
+
+typedef struct subtree_job_t subtree_job_t;
+struct subtree_job_t {
+    const builder_t *builder;
+    subtree_t *subtrees;
+};
+
+static void build_subtree(const builder_t *builder, subtree_t *subtree) {
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+
+    // Depth first, left child first, so nodes close in the tree end up close
+    // in memory.
+    u32_t capacity = subtree->root.end - subtree->root.begin + 1;
+    task_t *stack = re_arena_push(scratch.arena, capacity * sizeof(task_t));
+    u32_t depth = 0;
+    stack[depth++] = subtree->root;
+
+    u32_t node_count = subtree->base;
+    bins_t bins;
+    while (depth > 0) {
+        task_t task = stack[--depth];
+        binning_t binning = binning_of(&task.centroids, task.end - task.begin);
+        bin_items(&bins, builder, &binning, task.begin, task.end);
+
+        task_t children[2];
+        if (split_node(builder, &binning, &bins, &task, &node_count, children)) {
+            stack[depth++] = children[1];
+            stack[depth++] = children[0];
+        }
+    }
+    subtree->end = node_count;
+
+    re_arena_scratch_release(&scratch);
+}
+
+static void subtree_batch(void *user, u32_t begin, u32_t end) {
+    subtree_job_t *job = user;
+    for (u32_t s = begin; s < end; s++) {
+        build_subtree(job->builder, &job->subtrees[s]);
+    }
+}
+
+/*=========================*/
+// Build
+/*=========================*/
+
+u32_t bvh_node_bound(u32_t item_count) {
+    return item_count > 0 ? item_count * 2 - 1 : 0;
+}
+
+u32_t bvh_build(bvh_node_t *nodes, u32_t *items, const f32_t *bounds, u32_t item_count) {
+    if (item_count == 0) {
+        return 0;
+    }
+
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+
+    record_t *records = re_arena_push(scratch.arena, (u64_t) item_count * sizeof(record_t));
+    box_t root_bounds = box_empty();
+    box_t root_centroids = box_empty();
+    binning_t binning = {.count = 1};
+    for (u32_t i = 0; i < item_count; i++) {
+        const f32_t *box = bounds + (u64_t) i * 6;
+        record_t *record = &records[i];
+        *record = (record_t) {{box[0], box[1], box[2]}, i, {box[3], box[4], box[5]}, 0};
+
+        f32_t centroid[4];
+        i32_t bin[4];
+        locate(&binning, record, centroid, bin);
+        box_grow(&root_bounds, record);
+        box_grow_point(&root_centroids, centroid);
+    }
+
+    builder_t builder = {nodes, records};
+    write_bounds(&nodes[0], &root_bounds);
+
+    // The top of the tree is split breadth first on this thread, binning
+    // each node across the pool, until every node left is small enough to be
+    // one worker's subtree. Those are leaves of the top, so a tree of k
+    // subtrees has 2k - 1 top nodes and the subtrees' reserved ranges fill
+    // the node bound exactly.
+    // Lopsided splits could make the top arbitrarily deep, past the queue
+    // capacity whatever is left becomes a subtree.
+    u32_t capacity = item_count / BVH_PARALLEL_MIN * 4 + 3;
+    task_t *queue = re_arena_push(scratch.arena, capacity * sizeof(task_t));
+    subtree_t *subtrees = re_arena_push(scratch.arena, capacity * sizeof(subtree_t));
+    u32_t subtree_count = 0;
+    u32_t head = 0;
+    u32_t tail = 0;
+    u32_t node_count = 1;
+    queue[tail++] = (task_t) {0, 0, item_count, root_centroids};
+
+    u32_t batch_capacity = (item_count + BVH_BIN_BATCH - 1) / BVH_BIN_BATCH;
+    bins_t *batch_bins = re_arena_push(scratch.arena, batch_capacity * sizeof(bins_t));
+    while (head < tail) {
+        task_t task = queue[head++];
+        u32_t count = task.end - task.begin;
+        if (count < BVH_PARALLEL_MIN || tail + 2 > capacity) {
+            subtrees[subtree_count++] = (subtree_t) {task, 0, 0};
+            continue;
+        }
+
+        binning = binning_of(&task.centroids, count);
+        u32_t batch_count = (count + BVH_BIN_BATCH - 1) / BVH_BIN_BATCH;
+        bin_job_t job = {batch_bins, &builder, &binning, task.begin, task.end};
+        job_parallel_for(batch_count, 1, bin_batch, &job);
+
+        bins_t bins = batch_bins[0];
+        for (u32_t c = 1; c < batch_count; c++) {
+            for (u32_t axis = 0; axis < 3; axis++) {
+                for (u32_t b = 0; b < binning.count; b++) {
+                    bin_t *bin = &bins.axes[axis][b];
+                    const bin_t *other = &batch_bins[c].axes[axis][b];
+                    box_merge(&bin->bounds, &other->bounds);
+                    bin->count += other->count;
+                }
+            }
+        }
+
+        task_t children[2];
+        if (split_node(&builder, &binning, &bins, &task, &node_count, children)) {
+            queue[tail++] = children[0];
+            queue[tail++] = children[1];
+        }
+    }
+
+    u32_t base = node_count;
+    for (u32_t s = 0; s < subtree_count; s++) {
+        subtrees[s].base = base;
+        base += (subtrees[s].root.end - subtrees[s].root.begin) * 2 - 2;
+    }
+    subtree_job_t job = {&builder, subtrees};
+    job_parallel_for(subtree_count, 1, subtree_batch, &job);
+
+    // Subtrees rarely fill their ranges, slide them down over the gaps. A
+    // subtree only ever moves towards the front, past nodes already moved.
+    for (u32_t s = 0; s < subtree_count; s++) {
+        subtree_t *subtree = &subtrees[s];
+        u32_t used = subtree->end - subtree->base;
+        u32_t shift = subtree->base - node_count;
+        if (used > 0 && shift > 0) {
+            memmove(nodes + node_count, nodes + subtree->base, used * sizeof(bvh_node_t));
+            for (u32_t n = node_count; n < node_count + used; n++) {
+                if (nodes[n].count == 0) {
+                    nodes[n].first -= shift;
+                }
+            }
+        }
+        if (used > 0) {
+            nodes[subtree->root.node].first -= shift;
+        }
+        node_count += used;
+    }
+
+    for (u32_t i = 0; i < item_count; i++) {
+        items[i] = records[i].item;
+    }
+
+    re_arena_scratch_release(&scratch);
+    return node_count;
+}
+
+f32_t bvh_sah_cost(const bvh_node_t *nodes, u32_t node_count) {
+    if (node_count == 0) {
+        return 0.0f;
+    }
+
+    f32_t cost = 0.0f;
+    for (u32_t n = 0; n < node_count; n++) {
+        f32_t area = box_area(nodes[n].min, nodes[n].max);
+        cost += nodes[n].count > 0 ? area * (f32_t) nodes[n].count : area * BVH_TRAVERSAL_COST;
+    }
+
+    f32_t root_area = box_area(nodes[0].min, nodes[0].max);
+    return root_area > 0.0f ? cost / root_area : (f32_t) nodes[0].count;
+}
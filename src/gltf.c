@@ -1,28 +1,92 @@
 #include "gltf.h"
+#include "gltf_internal.h"
 #include "rebound.h"
 
+#include "job.h"
 #include "json.h"
+#include "meshopt.h"
 
 #include <glad/gl.h>
+#include <math.h>
+#include <string.h>
 
-static re_str_t *parse_buffers(const json_object_t *root, re_str_t dir, re_arena_t *arena, u32_t *count) {
+re_str_t gltf_path_dir(re_str_t path) {
+    for (u32_t i = path.len; i > 0; i--) {
+        if (path.str[i - 1] == '/') {
+            return re_str_prefix(path, i);
+        }
+    }
+
+    return re_str_lit("");
+}
+
+char *gltf_path_join(re_str_t dir, re_str_t file, re_arena_t *arena) {
+    char *path = re_arena_push_zero(arena, dir.len + file.len + 1);
+    for (u32_t i = 0; i < dir.len; i++) {
+        path[i] = dir.str[i];
+    }
+    for (u32_t i = 0; i < file.len; i++) {
+        path[dir.len + i] = file.str[i];
+    }
+
+    return path;
+}
+
+// FNV-1a over 8 byte words instead of bytes, which is 8 times fewer
+// multiplies on the buffers it hashes. Folding the high half down after each
+// word keeps every byte reaching the low bits tables index with. The tail
+// goes byte by byte.
+u64_t gltf_hash(const void *data, u64_t size, u64_t seed) {
+    const u8_t *bytes = data;
+    u64_t hash = 0xcbf29ce484222325 ^ seed;
+    u64_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        u64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash ^= word;
+        hash *= 0x100000001b3;
+        hash ^= hash >> 32;
+    }
+    for (; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
+
+void *gltf_push_aligned(re_arena_t *arena, u64_t size) {
+    u64_t address = (u64_t) re_arena_push(arena, size + 15);
+    return (void *) ((address + 15) & ~(u64_t) 15);
+}
+
+static re_str_t *parse_buffers(const json_object_t *root, re_str_t dir, gltf_buffer_cache_t *cache, re_arena_t *arena, re_str_t **uris, gltf_source_t **sources, u32_t *count) {
     json_object_t buffers = json_object(*root, re_str_lit("buffers"));
 
     *count = buffers.value.array.count;
-    re_str_t *buffs = re_arena_push(arena, *count * sizeof(re_str_t *));
+    re_str_t *buffs = re_arena_push_zero(arena, *count * sizeof(re_str_t));
+    *uris = re_arena_push_zero(arena, *count * sizeof(re_str_t));
+    *sources = re_arena_push_zero(arena, *count * sizeof(gltf_source_t));
 
     re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
     for (u32_t i = 0; i < *count; i++) {
         json_object_t buffer = json_array(buffers, i);
         re_str_t uri = json_string(json_object(buffer, re_str_lit("uri")));
 
-        re_str_t buff_path = re_str_concat(dir, uri, scratch.arena);
-        char *path = re_arena_push_zero(arena, buff_path.len + 1);
-        for (u32_t i = 0; i < buff_path.len; i++) {
-            path[i] = buff_path.str[i];
+        // Buffers without a uri only stand in for compressed data, views using
+        // them get buffers of their own once decoded.
+        if (uri.len == 0) {
+            continue;
         }
 
-        buffs[i] = re_file_read(path, arena);
+        char *stored_uri = gltf_path_join(re_str_lit(""), uri, arena);
+        (*uris)[i] = re_str((u8_t *) stored_uri, uri.len);
+
+        char *path = gltf_path_join(dir, uri, scratch.arena);
+        buffs[i] = cache != NULL ? gltf_buffer_cache_read(cache, path, &(*sources)[i]) : gltf_source_read(path, &(*sources)[i], arena);
+        if (buffs[i].str == NULL) {
+            re_log_error("Couldn't open buffer %s.", path);
+        }
     }
 
     re_arena_scratch_release(&scratch);
@@ -30,13 +94,78 @@ static re_str_t *parse_buffers(const json_object_t *root, re_str_t dir, re_arena
     return buffs;
 }
 
-static gltf_buffer_view_t *parse_views(const json_object_t *root, re_arena_t *arena, u32_t *count) {
+typedef enum {
+    MESHOPT_MODE_ATTRIBUTES,
+    MESHOPT_MODE_TRIANGLES,
+    MESHOPT_MODE_INDICES,
+} meshopt_mode_t;
+
+typedef enum {
+    MESHOPT_FILTER_NONE,
+    MESHOPT_FILTER_OCTAHEDRAL,
+    MESHOPT_FILTER_QUATERNION,
+    MESHOPT_FILTER_EXPONENTIAL,
+} meshopt_filter_t;
+
+// Where the EXT_meshopt_compression data of a buffer view lives and how to
+// decode it.
+typedef struct meshopt_view_t meshopt_view_t;
+struct meshopt_view_t {
+    b8_t compressed;
+    u32_t buffer;
+    u32_t offset;
+    u32_t length;
+    u32_t stride;
+    u32_t count;
+    meshopt_mode_t mode;
+    meshopt_filter_t filter;
+};
+
+static meshopt_view_t parse_meshopt_view(json_object_t view) {
+    json_object_t ext = json_object(json_object(view, re_str_lit("extensions")), re_str_lit("EXT_meshopt_compression"));
+    if (ext.type != JSON_TYPE_OBJECT) {
+        return (meshopt_view_t) {0};
+    }
+
+    meshopt_view_t result = {0};
+    result.compressed = true;
+    result.buffer = json_int(json_object(ext, re_str_lit("buffer")));
+    json_object_t json_offset = json_object(ext, re_str_lit("byteOffset"));
+    if (json_offset.type != JSON_TYPE_ERROR) {
+        result.offset = json_int(json_offset);
+    }
+    result.length = json_int(json_object(ext, re_str_lit("byteLength")));
+    result.stride = json_int(json_object(ext, re_str_lit("byteStride")));
+    result.count = json_int(json_object(ext, re_str_lit("count")));
+
+    re_str_t mode = json_string(json_object(ext, re_str_lit("mode")));
+    if (re_str_cmp(mode, re_str_lit("TRIANGLES")) == 0) {
+        result.mode = MESHOPT_MODE_TRIANGLES;
+    } else if (re_str_cmp(mode, re_str_lit("INDICES")) == 0) {
+        result.mode = MESHOPT_MODE_INDICES;
+    }
+
+    re_str_t filter = json_string(json_object(ext, re_str_lit("filter")));
+    if (re_str_cmp(filter, re_str_lit("OCTAHEDRAL")) == 0) {
+        result.filter = MESHOPT_FILTER_OCTAHEDRAL;
+    } else if (re_str_cmp(filter, re_str_lit("QUATERNION")) == 0) {
+        result.filter = MESHOPT_FILTER_QUATERNION;
+    } else if (re_str_cmp(filter, re_str_lit("EXPONENTIAL")) == 0) {
+        result.filter = MESHOPT_FILTER_EXPONENTIAL;
+    }
+
+    return result;
+}
+
+static gltf_buffer_view_t *parse_views(const json_object_t *root, re_arena_t *arena, re_arena_t *scratch, meshopt_view_t **meshopt_views, u32_t *count) {
     json_object_t json_views = json_object(*root, re_str_lit("bufferViews"));
 
     *count = json_views.value.array.count;
     gltf_buffer_view_t *views = re_arena_push(arena, *count * sizeof(gltf_buffer_view_t));
+    *meshopt_views = re_arena_push(scratch, *count * sizeof(meshopt_view_t));
     for (u32_t i = 0; i < *count; i++) {
         json_object_t view = json_array(json_views, i);
+        (*meshopt_views)[i] = parse_meshopt_view(view);
 
         u32_t buffer = json_int(json_object(view, re_str_lit("buffer"))); 
 
@@ -50,13 +179,13 @@ static gltf_buffer_view_t *parse_views(const json_object_t *root, re_arena_t *ar
 
         u32_t stride = 0;
         json_object_t json_stride = json_object(view, re_str_lit("byteStride"));
-        if (json_offset.type != JSON_TYPE_ERROR) {
+        if (json_stride.type != JSON_TYPE_ERROR) {
             stride = json_int(json_stride);
         }
 
-        gltf_buffer_target target = GLTF_BUFFER_TARGET_ARRAY;
+        gltf_buffer_target target = 0;
         json_object_t json_target = json_object(view, re_str_lit("target"));
-        if (json_offset.type != JSON_TYPE_ERROR) {
+        if (json_target.type != JSON_TYPE_ERROR) {
             target = json_int(json_target);
         }
 
@@ -72,6 +201,110 @@ static gltf_buffer_view_t *parse_views(const json_object_t *root, re_arena_t *ar
     return views;
 }
 
+static b8_t decode_meshopt_view(meshopt_view_t view, const u8_t *src, u8_t *out) {
+    switch (view.mode) {
+        case MESHOPT_MODE_TRIANGLES:
+            return meshopt_decode_index_buffer(out, view.count, view.stride, src, view.length);
+        case MESHOPT_MODE_INDICES:
+            return meshopt_decode_index_sequence(out, view.count, view.stride, src, view.length);
+        case MESHOPT_MODE_ATTRIBUTES:
+            break;
+    }
+
+    if (!meshopt_decode_vertex_buffer(out, view.count, view.stride, src, view.length)) {
+        return false;
+    }
+
+    switch (view.filter) {
+        case MESHOPT_FILTER_NONE:
+            break;
+        case MESHOPT_FILTER_OCTAHEDRAL:
+            if (view.stride != 4 && view.stride != 8) {
+                return false;
+            }
+            meshopt_decode_filter_oct(out, view.count, view.stride);
+            break;
+        case MESHOPT_FILTER_QUATERNION:
+            if (view.stride != 8) {
+                return false;
+            }
+            meshopt_decode_filter_quat(out, view.count, view.stride);
+            break;
+        case MESHOPT_FILTER_EXPONENTIAL:
+            if (view.stride % 4 != 0) {
+                return false;
+            }
+            meshopt_decode_filter_exp(out, view.count, view.stride);
+            break;
+    }
+
+    return true;
+}
+
+// Points every compressed buffer view at a buffer holding its decoded data.
+// Fails on the first view that can't be decoded, its fallback data is
+// usually empty.
+static b8_t decode_meshopt_views(gltf_model_t *model, const meshopt_view_t *meshopt_views, u32_t count, re_arena_t *arena) {
+    f64_t start = re_os_get_time();
+    u64_t decoded_bytes = 0;
+
+    for (u32_t i = 0; i < count; i++) {
+        meshopt_view_t mv = meshopt_views[i];
+        if (!mv.compressed) {
+            continue;
+        }
+
+        if (mv.buffer >= model->buffer_count ||
+                (u64_t) mv.offset + mv.length > model->buffers[mv.buffer].len) {
+            re_log_error("Compressed buffer view %u reads outside of its buffer.", i);
+            return false;
+        }
+
+        // Decoded views are addressed with 32 bit lengths like any other.
+        u64_t size = (u64_t) mv.count * mv.stride;
+        if (size > 0xffffffffu) {
+            re_log_error("Compressed buffer view %u decodes to more than 4 GB.", i);
+            return false;
+        }
+
+        u8_t *data = gltf_push_aligned(arena, size);
+        if (!decode_meshopt_view(mv, model->buffers[mv.buffer].str + mv.offset, data)) {
+            re_log_error("Couldn't decode compressed buffer view %u.", i);
+            return false;
+        }
+
+        u32_t buffer = gltf_push_buffer(model, re_str(data, size), arena);
+        gltf_buffer_view_t *view = &model->views[i];
+        view->buffer = buffer;
+        view->offset = 0;
+        view->length = size;
+        decoded_bytes += size;
+    }
+
+    if (decoded_bytes > 0) {
+        f64_t seconds = re_os_get_time() - start;
+        f64_t mb = (f64_t) decoded_bytes / MB(1);
+        re_log_info("Decoded %.2f MB of meshopt data in %.2f ms, %.0f MB/s.", mb, seconds * 1000.0, seconds > 0.0 ? mb / seconds : 0.0);
+    }
+    return true;
+}
+
+// Bounds in the file are raw component values, normalized ones are mapped
+// like gltf_accessor_read_f32 maps the elements.
+static f32_t bound_to_f32(f32_t value, gltf_comp_type_t comp_type, b8_t normalized) {
+    if (!normalized) {
+        return value;
+    }
+
+    switch (comp_type) {
+        case GLTF_COMP_TYPE_BYTE:           return fmaxf(value / 127.0f, -1.0f);
+        case GLTF_COMP_TYPE_UNSIGNED_BYTE:  return value / 255.0f;
+        case GLTF_COMP_TYPE_SHORT:          return fmaxf(value / 32767.0f, -1.0f);
+        case GLTF_COMP_TYPE_UNSIGNED_SHORT: return value / 65535.0f;
+        default:                            return value;
+    }
+}
+
 static gltf_accessor_t *parse_accessors(const json_object_t *root, re_arena_t *arena, u32_t *count) {
     json_object_t json_accs = json_object(*root, re_str_lit("accessors"));
 
@@ -80,7 +313,7 @@ static gltf_accessor_t *parse_accessors(const json_object_t *root, re_arena_t *a
     for (u32_t i = 0; i < *count; i++) {
         json_object_t acc = json_array(json_accs, i);
 
-        u32_t view = 0;
+        i32_t view = -1;
         json_object_t json_view = json_object(acc, re_str_lit("bufferView"));
         if (json_view.type != JSON_TYPE_ERROR) {
             view = json_int(json_view);
@@ -115,6 +348,45 @@ static gltf_accessor_t *parse_accessors(const json_object_t *root, re_arena_t *a
             re_log_error("Unknown accessor type %.*s.", (i32_t) str_type.len, str_type.str);
         }
 
+        gltf_accessor_sparse_t sparse = {0};
+        json_object_t json_sparse = json_object(acc, re_str_lit("sparse"));
+        if (json_sparse.type == JSON_TYPE_OBJECT) {
+            json_object_t json_indices = json_object(json_sparse, re_str_lit("indices"));
+            json_object_t json_values = json_object(json_sparse, re_str_lit("values"));
+
+            sparse.count = json_int(json_object(json_sparse, re_str_lit("count")));
+            sparse.indices_view = json_int(json_object(json_indices, re_str_lit("bufferView")));
+            sparse.indices_offset = json_int(json_object(json_indices, re_str_lit("byteOffset")));
+            sparse.indices_comp_type = json_int(json_object(json_indices, re_str_lit("componentType")));
+            sparse.values_view = json_int(json_object(json_values, re_str_lit("bufferView")));
+            sparse.values_offset = json_int(json_object(json_values, re_str_lit("byteOffset")));
+
+            // An out of range view makes every read of the accessor fail.
+            if (sparse.indices_comp_type != GLTF_COMP_TYPE_UNSIGNED_BYTE &&
+                    sparse.indices_comp_type != GLTF_COMP_TYPE_UNSIGNED_SHORT &&
+                    sparse.indices_comp_type != GLTF_COMP_TYPE_UNSIGNED_INT) {
+                re_log_error("Accessor %u has sparse indices that aren't unsigned integers.", i);
+                sparse.indices_view = 0xffffffffu;
+            }
+        }
+
+        // Only kept when both cover every component, a partial box can't be
+        // trusted.
+        b8_t has_bounds = false;
+        f32_t min[4] = {0};
+        f32_t max[4] = {0};
+        json_object_t json_min = json_object(acc, re_str_lit("min"));
+        json_object_t json_max = json_object(acc, re_str_lit("max"));
+        u32_t bound_count = gltf_accessor_type_count(type) < 4 ? gltf_accessor_type_count(type) : 4;
+        if (json_min.type == JSON_TYPE_ARRAY && json_max.type == JSON_TYPE_ARRAY &&
+                json_min.value.array.count >= bound_count && json_max.value.array.count >= bound_count) {
+            has_bounds = true;
+            for (u32_t c = 0; c < bound_count; c++) {
+                min[c] = bound_to_f32(json_number(json_array(json_min, c)), comp_type, normalized);
+                max[c] = bound_to_f32(json_number(json_array(json_max, c)), comp_type, normalized);
+            }
+        }
+
         accessors[i] = (gltf_accessor_t) {
             view,
             offset,
@@ -122,57 +394,815 @@ static gltf_accessor_t *parse_accessors(const json_object_t *root, re_arena_t *a
             normalized,
             count,
             type,
+            sparse,
+            has_bounds,
+            {min[0], min[1], min[2], min[3]},
+            {max[0], max[1], max[2], max[3]},
         };
     }
 
     return accessors;
 }
 
-static gltf_mesh_t *parse_meshes(const json_object_t *root, re_arena_t *arena, u32_t *count) {
+static const char *attribute_names[GLTF_ATTRIBUTE_COUNT] = {
+    "POSITION",
+    "NORMAL",
+    "TEXCOORD_0",
+    "TANGENT",
+    "JOINTS_0",
+    "WEIGHTS_0",
+};
+
+i32_t gltf_attribute_from_name(re_str_t name) {
+    for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+        if (re_str_cmp(name, re_str_cstr(attribute_names[attrib])) == 0) {
+            return attrib;
+        }
+    }
+
+    return -1;
+}
+
+static gltf_extension_t extension_from_name(re_str_t name) {
+    if (re_str_cmp(name, re_str_lit("KHR_mesh_quantization")) == 0) {
+        return GLTF_EXTENSION_KHR_MESH_QUANTIZATION;
+    }
+    if (re_str_cmp(name, re_str_lit("EXT_meshopt_compression")) == 0) {
+        return GLTF_EXTENSION_EXT_MESHOPT_COMPRESSION;
+    }
+    if (re_str_cmp(name, re_str_lit("KHR_draco_mesh_compression")) == 0) {
+        return GLTF_EXTENSION_KHR_DRACO_MESH_COMPRESSION;
+    }
+
+    return 0;
+}
+
+// Returns false if the file requires an extension that isn't supported.
+static b8_t parse_extensions(const json_object_t *root, u32_t *extensions) {
+    *extensions = 0;
+
+    json_object_t json_used = json_object(*root, re_str_lit("extensionsUsed"));
+    if (json_used.type == JSON_TYPE_ARRAY) {
+        for (u32_t i = 0; i < json_used.value.array.count; i++) {
+            *extensions |= extension_from_name(json_string(json_array(json_used, i)));
+        }
+    }
+
+    b8_t supported = true;
+    json_object_t json_required = json_object(*root, re_str_lit("extensionsRequired"));
+    if (json_required.type == JSON_TYPE_ARRAY) {
+        for (u32_t i = 0; i < json_required.value.array.count; i++) {
+            re_str_t name = json_string(json_array(json_required, i));
+            gltf_extension_t extension = extension_from_name(name);
+            if (extension == GLTF_EXTENSION_KHR_DRACO_MESH_COMPRESSION && !gltf_draco_available()) {
+                extension = 0;
+            }
+            if (extension == 0) {
+                re_log_error("Required extension %.*s isn't supported.", (i32_t) name.len, name.str);
+                supported = false;
+            }
+            *extensions |= extension;
+        }
+    }
+
+    return supported;
+}
+
+static gltf_mesh_t *parse_meshes(const json_object_t *root, re_arena_t *arena, gltf_primitives_t *primitives, u32_t *count) {
     json_object_t json_meshes = json_object(*root, re_str_lit("meshes"));
 
     *count = json_meshes.value.array.count;
     gltf_mesh_t *meshes = re_arena_push(arena, *count * sizeof(gltf_mesh_t));
 
+    u32_t primitive_count = 0;
+    for (u32_t i = 0; i < *count; i++) {
+        json_object_t json_primitives = json_object(json_array(json_meshes, i), re_str_lit("primitives"));
+        meshes[i] = (gltf_mesh_t) {
+            primitive_count,
+            json_primitives.value.array.count,
+        };
+        primitive_count += json_primitives.value.array.count;
+    }
+
+    gltf_primitives_t prims = {0};
+    prims.count = primitive_count;
+    for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+        prims.attributes[attrib] = re_arena_push(arena, primitive_count * sizeof(i32_t));
+    }
+    prims.indices = re_arena_push(arena, primitive_count * sizeof(i32_t));
+    prims.mode = re_arena_push(arena, primitive_count * sizeof(gltf_primitive_mode_t));
+    prims.material = re_arena_push(arena, primitive_count * sizeof(i32_t));
+    prims.lod_offset = re_arena_push_zero(arena, primitive_count * sizeof(u32_t));
+    prims.lod_count = re_arena_push_zero(arena, primitive_count * sizeof(u32_t));
+    prims.meshlet_offset = re_arena_push_zero(arena, primitive_count * sizeof(u32_t));
+    prims.meshlet_count = re_arena_push_zero(arena, primitive_count * sizeof(u32_t));
+    prims.bounds = re_arena_push(arena, primitive_count * sizeof(gltf_aabb_t));
+
     for (u32_t i = 0; i < *count; i++) {
-        json_object_t json_mesh = json_object(json_array(json_meshes, i), re_str_lit("primitives"));
-        json_mesh = json_array(json_mesh, 0);
+        json_object_t json_primitives = json_object(json_array(json_meshes, i), re_str_lit("primitives"));
+
+        for (u32_t j = 0; j < meshes[i].primitive_count; j++) {
+            u32_t prim = meshes[i].primitive_offset + j;
+            json_object_t json_prim = json_array(json_primitives, j);
+
+            for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+                prims.attributes[attrib][prim] = -1;
+            }
+
+            json_object_t json_attributes = json_object(json_prim, re_str_lit("attributes"));
+            for (u32_t attrib = 0; attrib < json_attributes.value.object.count; attrib++) {
+                i32_t semantic = gltf_attribute_from_name(json_attributes.value.object.keys[attrib]);
+                if (semantic >= 0) {
+                    prims.attributes[semantic][prim] = json_int(json_attributes.value.object.values[attrib]);
+                }
+            }
+
+            prims.indices[prim] = -1;
+            json_object_t json_indices = json_object(json_prim, re_str_lit("indices"));
+            if (json_indices.type != JSON_TYPE_ERROR) {
+                prims.indices[prim] = json_int(json_indices);
+            }
+
+            prims.mode[prim] = GLTF_PRIMITIVE_MODE_TRIANGLES;
+            json_object_t json_mode = json_object(json_prim, re_str_lit("mode"));
+            if (json_mode.type != JSON_TYPE_ERROR) {
+                prims.mode[prim] = json_int(json_mode);
+            }
+
+            prims.material[prim] = -1;
+            json_object_t json_material = json_object(json_prim, re_str_lit("material"));
+            if (json_material.type != JSON_TYPE_ERROR) {
+                prims.material[prim] = json_int(json_material);
+            }
+        }
+    }
+
+    *primitives = prims;
+
+    return meshes;
+}
+
+static void parse_floats(json_object_t array, f32_t *out, u32_t count) {
+    for (u32_t i = 0; i < count && i < array.value.array.count; i++) {
+        out[i] = json_number(json_array(array, i));
+    }
+}
 
-        i32_t position = -1;
-        i32_t normal = -1;
-        i32_t uv = -1;
-        json_object_t json_attributes = json_object(json_mesh, re_str_lit("attributes"));
-        for (u32_t attrib = 0; attrib < json_attributes.value.object.count; attrib++) {
-            re_str_t attrib_str = json_attributes.value.object.keys[attrib];
+// Node matrices are required to be decomposable into TRS.
+static void decompose_matrix(const f32_t m[16], HMM_Vec3 *translation, HMM_Quat *rotation, HMM_Vec3 *scale) {
+    HMM_Vec3 x = HMM_V3(m[0], m[1], m[2]);
+    HMM_Vec3 y = HMM_V3(m[4], m[5], m[6]);
+    HMM_Vec3 z = HMM_V3(m[8], m[9], m[10]);
 
-            if (re_str_cmp(attrib_str, re_str_lit("POSITION")) == 0) {
-                position = json_int(json_attributes.value.object.values[attrib]);
-            } else if (re_str_cmp(attrib_str, re_str_lit("NORMAL")) == 0) {
-                normal = json_int(json_attributes.value.object.values[attrib]);
-            } else if (re_str_cmp(attrib_str, re_str_lit("TEXCOORD_0")) == 0) {
-                uv = json_int(json_attributes.value.object.values[attrib]);
+    HMM_Vec3 s = HMM_V3(HMM_LenV3(x), HMM_LenV3(y), HMM_LenV3(z));
+    if (HMM_DotV3(HMM_Cross(x, y), z) < 0.0f) {
+        s.X = -s.X;
+    }
+
+    HMM_Mat4 rot = HMM_M4D(1.0f);
+    rot.Columns[0] = HMM_V4V(HMM_DivV3F(x, s.X != 0.0f ? s.X : 1.0f), 0.0f);
+    rot.Columns[1] = HMM_V4V(HMM_DivV3F(y, s.Y != 0.0f ? s.Y : 1.0f), 0.0f);
+    rot.Columns[2] = HMM_V4V(HMM_DivV3F(z, s.Z != 0.0f ? s.Z : 1.0f), 0.0f);
+
+    *translation = HMM_V3(m[12], m[13], m[14]);
+    *rotation = HMM_M4ToQ_RH(rot);
+    *scale = s;
+}
+
+// Returns the new index of every node in the file, -1 for nodes that aren't
+// part of the hierarchy.
+static i32_t *parse_nodes(const json_object_t *root, re_arena_t *arena, re_arena_t *scratch, gltf_nodes_t *nodes) {
+    json_object_t json_nodes = json_object(*root, re_str_lit("nodes"));
+    u32_t count = json_nodes.type == JSON_TYPE_ARRAY ? json_nodes.value.array.count : 0;
+
+    i32_t *file_parent = re_arena_push(scratch, count * sizeof(i32_t));
+    for (u32_t i = 0; i < count; i++) {
+        file_parent[i] = -1;
+    }
+
+    for (u32_t i = 0; i < count; i++) {
+        json_object_t children = json_object(json_array(json_nodes, i), re_str_lit("children"));
+        for (u32_t j = 0; children.type == JSON_TYPE_ARRAY && j < children.value.array.count; j++) {
+            i32_t child = json_int(json_array(children, j));
+            if (child < 0 || (u32_t) child >= count || child == (i32_t) i || file_parent[child] != -1) {
+                re_log_error("Node %u has an invalid child %d.", i, child);
+                continue;
             }
+            file_parent[child] = i;
         }
+    }
 
-        i32_t indices = -1;
-        json_object_t json_indices = json_object(json_mesh, re_str_lit("indices"));
-        if (json_indices.type != JSON_TYPE_ERROR) {
-            indices = json_int(json_indices);
+    // Breadth first from the roots gives the depth sorted order.
+    u32_t *order = re_arena_push(scratch, count * sizeof(u32_t));
+    gltf_node_level_t *levels = re_arena_push(scratch, count * sizeof(gltf_node_level_t));
+    u32_t ordered = 0;
+    u32_t level_count = 0;
+
+    for (u32_t i = 0; i < count; i++) {
+        if (file_parent[i] == -1) {
+            order[ordered++] = i;
         }
+    }
 
-        meshes[i] = (gltf_mesh_t) {
-            position,
-            normal,
-            uv,
-            indices,
+    u32_t level_begin = 0;
+    while (level_begin < ordered) {
+        u32_t level_end = ordered;
+        levels[level_count++] = (gltf_node_level_t) {level_begin, level_end - level_begin};
+
+        for (u32_t i = level_begin; i < level_end; i++) {
+            json_object_t children = json_object(json_array(json_nodes, order[i]), re_str_lit("children"));
+            for (u32_t j = 0; children.type == JSON_TYPE_ARRAY && j < children.value.array.count; j++) {
+                i32_t child = json_int(json_array(children, j));
+                if (child >= 0 && (u32_t) child < count && file_parent[child] == (i32_t) order[i]) {
+                    order[ordered++] = child;
+                }
+            }
+        }
+
+        level_begin = level_end;
+    }
+
+    if (ordered != count) {
+        re_log_error("%u nodes are part of a cycle and were skipped.", count - ordered);
+    }
+
+    i32_t *remap = re_arena_push(scratch, count * sizeof(i32_t));
+    for (u32_t i = 0; i < count; i++) {
+        remap[i] = -1;
+    }
+    for (u32_t i = 0; i < ordered; i++) {
+        remap[order[i]] = i;
+    }
+
+    gltf_nodes_t n = {0};
+    n.count = ordered;
+    n.parent = re_arena_push(arena, ordered * sizeof(i32_t));
+    n.mesh = re_arena_push(arena, ordered * sizeof(i32_t));
+    n.translation = gltf_push_aligned(arena, ordered * sizeof(HMM_Vec3));
+    n.rotation = gltf_push_aligned(arena, ordered * sizeof(HMM_Quat));
+    n.scale = gltf_push_aligned(arena, ordered * sizeof(HMM_Vec3));
+    n.world = gltf_push_aligned(arena, ordered * sizeof(HMM_Mat4));
+    n.skin = re_arena_push(arena, ordered * sizeof(i32_t));
+    n.level_count = level_count;
+    n.levels = re_arena_push(arena, level_count * sizeof(gltf_node_level_t));
+    for (u32_t i = 0; i < level_count; i++) {
+        n.levels[i] = levels[i];
+    }
+
+    for (u32_t i = 0; i < ordered; i++) {
+        json_object_t json_node = json_array(json_nodes, order[i]);
+
+        n.parent[i] = file_parent[order[i]] == -1 ? -1 : remap[file_parent[order[i]]];
+
+        n.mesh[i] = -1;
+        json_object_t json_mesh = json_object(json_node, re_str_lit("mesh"));
+        if (json_mesh.type != JSON_TYPE_ERROR) {
+            n.mesh[i] = json_int(json_mesh);
+        }
+
+        n.skin[i] = -1;
+        json_object_t json_skin = json_object(json_node, re_str_lit("skin"));
+        if (json_skin.type != JSON_TYPE_ERROR) {
+            n.skin[i] = json_int(json_skin);
+        }
+
+        HMM_Vec3 translation = HMM_V3(0.0f, 0.0f, 0.0f);
+        HMM_Quat rotation = HMM_Q(0.0f, 0.0f, 0.0f, 1.0f);
+        HMM_Vec3 scale = HMM_V3(1.0f, 1.0f, 1.0f);
+
+        json_object_t json_matrix = json_object(json_node, re_str_lit("matrix"));
+        if (json_matrix.type == JSON_TYPE_ARRAY) {
+            f32_t matrix[16] = {0};
+            parse_floats(json_matrix, matrix, 16);
+            decompose_matrix(matrix, &translation, &rotation, &scale);
+        } else {
+            parse_floats(json_object(json_node, re_str_lit("translation")), translation.Elements, 3);
+            parse_floats(json_object(json_node, re_str_lit("rotation")), rotation.Elements, 4);
+            parse_floats(json_object(json_node, re_str_lit("scale")), scale.Elements, 3);
+        }
+
+        n.translation[i] = translation;
+        n.rotation[i] = rotation;
+        n.scale[i] = scale;
+    }
+
+    gltf_nodes_update(&n);
+    *nodes = n;
+
+    return remap;
+}
+
+// Meshes are only counted once the nodes are parsed. Drawing indexes the
+// meshes with every node's unchecked.
+static void validate_node_meshes(gltf_nodes_t *nodes, u32_t mesh_count) {
+    for (u32_t i = 0; i < nodes->count; i++) {
+        if (nodes->mesh[i] < -1 || nodes->mesh[i] >= (i32_t) mesh_count) {
+            re_log_error("Node %u uses mesh %d, which doesn't exist.", i, nodes->mesh[i]);
+            nodes->mesh[i] = -1;
+        }
+    }
+}
+
+static gltf_scene_t *parse_scenes(const json_object_t *root, const i32_t *node_remap, re_arena_t *arena, u32_t **roots, u32_t *root_count, u32_t *count) {
+    json_object_t json_scenes = json_object(*root, re_str_lit("scenes"));
+    *count = json_scenes.type == JSON_TYPE_ARRAY ? json_scenes.value.array.count : 0;
+
+    json_object_t json_nodes = json_object(*root, re_str_lit("nodes"));
+    i32_t node_count = json_nodes.type == JSON_TYPE_ARRAY ? json_nodes.value.array.count : 0;
+
+    gltf_scene_t *scenes = re_arena_push(arena, *count * sizeof(gltf_scene_t));
+
+    u32_t total = 0;
+    for (u32_t i = 0; i < *count; i++) {
+        json_object_t json_roots = json_object(json_array(json_scenes, i), re_str_lit("nodes"));
+        if (json_roots.type == JSON_TYPE_ARRAY) {
+            total += json_roots.value.array.count;
+        }
+    }
+
+    *roots = re_arena_push(arena, total * sizeof(u32_t));
+    *root_count = 0;
+    for (u32_t i = 0; i < *count; i++) {
+        json_object_t json_roots = json_object(json_array(json_scenes, i), re_str_lit("nodes"));
+
+        scenes[i].root_offset = *root_count;
+        for (u32_t j = 0; json_roots.type == JSON_TYPE_ARRAY && j < json_roots.value.array.count; j++) {
+            i32_t node = json_int(json_array(json_roots, j));
+            if (node < 0 || node >= node_count || node_remap[node] == -1) {
+                continue;
+            }
+            (*roots)[(*root_count)++] = node_remap[node];
+        }
+        scenes[i].root_count = *root_count - scenes[i].root_offset;
+    }
+
+    return scenes;
+}
+
+// Skins are read once buffer views are decoded, their inverse bind matrices
+// come from an accessor. A skin with a joint outside the hierarchy or unusable
+// matrices is left without joints, which leaves its meshes rigid.
+static void parse_skins(const json_object_t *root, const i32_t *node_remap, gltf_model_t *model, re_arena_t *arena) {
+    json_object_t json_skins = json_object(*root, re_str_lit("skins"));
+    u32_t count = json_skins.type == JSON_TYPE_ARRAY ? json_skins.value.array.count : 0;
+
+    json_object_t json_nodes = json_object(*root, re_str_lit("nodes"));
+    i32_t node_count = json_nodes.type == JSON_TYPE_ARRAY ? json_nodes.value.array.count : 0;
+
+    u32_t total = 0;
+    for (u32_t i = 0; i < count; i++) {
+        json_object_t json_joints = json_object(json_array(json_skins, i), re_str_lit("joints"));
+        if (json_joints.type == JSON_TYPE_ARRAY) {
+            total += json_joints.value.array.count;
+        }
+    }
+
+    model->skins = re_arena_push(arena, count * sizeof(gltf_skin_t));
+    model->skin_count = count;
+    model->skin_joints = re_arena_push(arena, total * sizeof(u32_t));
+    model->inverse_binds = gltf_push_aligned(arena, total * sizeof(HMM_Mat4));
+    model->skin_joint_count = 0;
+
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    for (u32_t i = 0; i < count; i++) {
+        json_object_t json_skin = json_array(json_skins, i);
+        json_object_t json_joints = json_object(json_skin, re_str_lit("joints"));
+        u32_t joint_count = json_joints.type == JSON_TYPE_ARRAY ? json_joints.value.array.count : 0;
+        gltf_skin_t skin = {model->skin_joint_count, joint_count};
+
+        b8_t valid = true;
+        for (u32_t j = 0; j < joint_count && valid; j++) {
+            i32_t node = json_int(json_array(json_joints, j));
+            valid = node >= 0 && node < node_count && node_remap[node] != -1;
+            model->skin_joints[skin.joint_offset + j] = valid ? (u32_t) node_remap[node] : 0;
+        }
+
+        json_object_t json_binds = json_object(json_skin, re_str_lit("inverseBindMatrices"));
+        HMM_Mat4 *binds = model->inverse_binds + skin.joint_offset;
+        if (valid && json_binds.type != JSON_TYPE_ERROR) {
+            i32_t accessor = json_int(json_binds);
+            f32_t *matrices = re_arena_push(scratch.arena, (u64_t) joint_count * 16 * sizeof(f32_t));
+            valid = accessor >= 0 && (u32_t) accessor < model->accessor_count &&
+                model->accessors[accessor].type == GLTF_ACCESSOR_TYPE_MAT4 &&
+                model->accessors[accessor].count == joint_count &&
+                gltf_accessor_read_f32(model, accessor, matrices);
+            // Both store matrices column by column.
+            for (u32_t j = 0; j < joint_count && valid; j++) {
+                memcpy(binds[j].Elements, matrices + (u64_t) j * 16, 16 * sizeof(f32_t));
+            }
+        } else {
+            for (u32_t j = 0; j < joint_count; j++) {
+                binds[j] = HMM_M4D(1.0f);
+            }
+        }
+
+        if (!valid) {
+            re_log_error("Skin %u has a joint outside the node hierarchy or unreadable inverse bind matrices.", i);
+            skin.joint_count = 0;
+        }
+        model->skins[i] = skin;
+        model->skin_joint_count += skin.joint_count;
+    }
+    re_arena_scratch_release(&scratch);
+
+    for (u32_t i = 0; i < model->nodes.count; i++) {
+        if (model->nodes.skin[i] != -1 && (u32_t) model->nodes.skin[i] >= count) {
+            re_log_error("Node %u uses skin %d, which doesn't exist.", i, model->nodes.skin[i]);
+            model->nodes.skin[i] = -1;
+        }
+    }
+}
+
+// Accessor a key of obj refers to, -1 if it's missing or out of range.
+static i32_t accessor_key(json_object_t obj, re_str_t key, const gltf_model_t *model) {
+    json_object_t json_accessor = json_object(obj, key);
+    if (json_accessor.type != JSON_TYPE_INTEGER) {
+        return -1;
+    }
+
+    i32_t accessor = json_int(json_accessor);
+    return accessor >= 0 && (u32_t) accessor < model->accessor_count ? accessor : -1;
+}
+
+// Appends a sampler's times and values to the model's arrays and returns its
+// value components, 0 if its accessors can't be read as increasing times and
+// vectors of three or four components of the right count.
+static u32_t parse_sampler(json_object_t json_sampler, gltf_model_t *model, gltf_sampler_t *sampler, re_arena_t *scratch) {
+    i32_t input = accessor_key(json_sampler, re_str_lit("input"), model);
+    i32_t output = accessor_key(json_sampler, re_str_lit("output"), model);
+    if (input < 0 || output < 0 || model->accessors[input].type != GLTF_ACCESSOR_TYPE_SCALAR || model->accessors[input].count == 0) {
+        return 0;
+    }
+
+    re_str_t interpolation = json_string(json_object(json_sampler, re_str_lit("interpolation")));
+    sampler->interpolation = GLTF_INTERPOLATION_LINEAR;
+    if (re_str_cmp(interpolation, re_str_lit("STEP")) == 0) {
+        sampler->interpolation = GLTF_INTERPOLATION_STEP;
+    } else if (re_str_cmp(interpolation, re_str_lit("CUBICSPLINE")) == 0) {
+        sampler->interpolation = GLTF_INTERPOLATION_CUBICSPLINE;
+    } else if (interpolation.len > 0 && re_str_cmp(interpolation, re_str_lit("LINEAR")) != 0) {
+        return 0;
+    }
+
+    u32_t key_count = model->accessors[input].count;
+    u32_t value_count = sampler->interpolation == GLTF_INTERPOLATION_CUBICSPLINE ? key_count * 3 : key_count;
+    gltf_accessor_type_t type = model->accessors[output].type;
+    if ((type != GLTF_ACCESSOR_TYPE_VEC3 && type != GLTF_ACCESSOR_TYPE_VEC4) || model->accessors[output].count != value_count) {
+        return 0;
+    }
+
+    f32_t *times = model->animation_times + model->animation_time_count;
+    u32_t components = gltf_accessor_type_count(type);
+    f32_t *values = re_arena_push(scratch, (u64_t) value_count * components * sizeof(f32_t));
+    if (!gltf_accessor_read_f32(model, input, times) || !gltf_accessor_read_f32(model, output, values)) {
+        return 0;
+    }
+    for (u32_t i = 0; i < key_count; i++) {
+        if (!isfinite(times[i]) || (i > 0 && times[i] < times[i - 1])) {
+            return 0;
+        }
+    }
+
+    // Rotation keyframes are made unit length, which quantized ones rarely
+    // are exactly. Spline tangents are left as they are.
+    HMM_Vec4 *out = model->animation_values + model->animation_value_count;
+    for (u32_t i = 0; i < value_count; i++) {
+        HMM_Vec4 v = HMM_V4(0.0f, 0.0f, 0.0f, 0.0f);
+        for (u32_t c = 0; c < components; c++) {
+            v.Elements[c] = values[(u64_t) i * components + c];
+        }
+        b8_t tangent = sampler->interpolation == GLTF_INTERPOLATION_CUBICSPLINE && i % 3 != 1;
+        if (components == 4 && !tangent && HMM_DotV4(v, v) > 0.0f) {
+            v = HMM_NormV4(v);
+        }
+        out[i] = v;
+    }
+
+    sampler->time_offset = model->animation_time_count;
+    sampler->value_offset = model->animation_value_count;
+    sampler->key_count = key_count;
+    model->animation_time_count += key_count;
+    model->animation_value_count += value_count;
+    return components;
+}
+
+// Channels of morph target weights are dropped, meshes have no targets.
+static void parse_animations(const json_object_t *root, const i32_t *node_remap, gltf_model_t *model, re_arena_t *arena) {
+    json_object_t json_animations = json_object(*root, re_str_lit("animations"));
+    u32_t count = json_animations.type == JSON_TYPE_ARRAY ? json_animations.value.array.count : 0;
+
+    json_object_t json_nodes = json_object(*root, re_str_lit("nodes"));
+    i32_t node_count = json_nodes.type == JSON_TYPE_ARRAY ? json_nodes.value.array.count : 0;
+
+    // Every sampler's accessors bound the keyframes, whether they turn out
+    // valid or not.
+    u32_t channel_total = 0;
+    u32_t sampler_total = 0;
+    u64_t time_total = 0;
+    u64_t value_total = 0;
+    for (u32_t i = 0; i < count; i++) {
+        json_object_t json_animation = json_array(json_animations, i);
+        json_object_t json_channels = json_object(json_animation, re_str_lit("channels"));
+        json_object_t json_samplers = json_object(json_animation, re_str_lit("samplers"));
+        channel_total += json_channels.type == JSON_TYPE_ARRAY ? json_channels.value.array.count : 0;
+        u32_t sampler_count = json_samplers.type == JSON_TYPE_ARRAY ? json_samplers.value.array.count : 0;
+        sampler_total += sampler_count;
+        for (u32_t s = 0; s < sampler_count; s++) {
+            json_object_t json_sampler = json_array(json_samplers, s);
+            i32_t input = accessor_key(json_sampler, re_str_lit("input"), model);
+            i32_t output = accessor_key(json_sampler, re_str_lit("output"), model);
+            time_total += input >= 0 ? model->accessors[input].count : 0;
+            value_total += output >= 0 ? model->accessors[output].count : 0;
+        }
+    }
+
+    model->animations = re_arena_push(arena, count * sizeof(gltf_animation_t));
+    model->animation_count = count;
+    model->channels = re_arena_push(arena, channel_total * sizeof(gltf_channel_t));
+    model->channel_count = 0;
+    model->samplers = re_arena_push(arena, sampler_total * sizeof(gltf_sampler_t));
+    model->sampler_count = 0;
+    model->animation_times = re_arena_push(arena, time_total * sizeof(f32_t));
+    model->animation_time_count = 0;
+    model->animation_values = gltf_push_aligned(arena, value_total * sizeof(HMM_Vec4));
+    model->animation_value_count = 0;
+
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    u32_t *components = re_arena_push(scratch.arena, sampler_total * sizeof(u32_t));
+    u32_t weight_channels = 0;
+    for (u32_t i = 0; i < count; i++) {
+        json_object_t json_animation = json_array(json_animations, i);
+        json_object_t json_samplers = json_object(json_animation, re_str_lit("samplers"));
+        u32_t sampler_count = json_samplers.type == JSON_TYPE_ARRAY ? json_samplers.value.array.count : 0;
+        u32_t sampler_offset = model->sampler_count;
+        for (u32_t s = 0; s < sampler_count; s++) {
+            gltf_sampler_t sampler = {0};
+            components[model->sampler_count] = parse_sampler(json_array(json_samplers, s), model, &sampler, scratch.arena);
+            if (components[model->sampler_count] == 0) {
+                re_log_error("Sampler %u of animation %u doesn't have readable increasing times and matching values.", s, i);
+            }
+            model->samplers[model->sampler_count++] = sampler;
+        }
+
+        gltf_animation_t animation = {model->channel_count, 0, 0.0f};
+        json_object_t json_channels = json_object(json_animation, re_str_lit("channels"));
+        u32_t channel_count = json_channels.type == JSON_TYPE_ARRAY ? json_channels.value.array.count : 0;
+        for (u32_t c = 0; c < channel_count; c++) {
+            json_object_t json_channel = json_array(json_channels, c);
+            json_object_t json_target = json_object(json_channel, re_str_lit("target"));
+            re_str_t path = json_string(json_object(json_target, re_str_lit("path")));
+            if (re_str_cmp(path, re_str_lit("weights")) == 0) {
+                weight_channels++;
+                continue;
+            }
+
+            gltf_channel_t channel = {0};
+            u32_t expected = 3;
+            if (re_str_cmp(path, re_str_lit("translation")) == 0) {
+                channel.path = GLTF_ANIMATION_PATH_TRANSLATION;
+            } else if (re_str_cmp(path, re_str_lit("rotation")) == 0) {
+                channel.path = GLTF_ANIMATION_PATH_ROTATION;
+                expected = 4;
+            } else if (re_str_cmp(path, re_str_lit("scale")) == 0) {
+                channel.path = GLTF_ANIMATION_PATH_SCALE;
+            } else {
+                expected = 0;
+            }
+
+            i32_t sampler = json_int(json_object(json_channel, re_str_lit("sampler")));
+            json_object_t json_node = json_object(json_target, re_str_lit("node"));
+            i32_t node = json_node.type == JSON_TYPE_INTEGER ? json_int(json_node) : -1;
+            if (expected == 0 || sampler < 0 || (u32_t) sampler >= sampler_count ||
+                    components[sampler_offset + sampler] != expected ||
+                    node < 0 || node >= node_count || node_remap[node] == -1) {
+                re_log_error("Channel %u of animation %u has an invalid sampler, target node or path.", c, i);
+                continue;
+            }
+
+            channel.sampler = sampler_offset + sampler;
+            channel.node = node_remap[node];
+            gltf_sampler_t s = model->samplers[channel.sampler];
+            animation.duration = fmaxf(animation.duration, model->animation_times[s.time_offset + s.key_count - 1]);
+            model->channels[model->channel_count++] = channel;
+        }
+
+        animation.channel_count = model->channel_count - animation.channel_offset;
+        model->animations[i] = animation;
+    }
+    re_arena_scratch_release(&scratch);
+
+    if (weight_channels > 0) {
+        re_log_warn("%u animation channels target morph weights, which aren't supported.", weight_channels);
+    }
+}
+
+static void *grow_array(void *array, u32_t count, u32_t *capacity, u64_t stride, re_arena_t *arena) {
+    if (count < *capacity) {
+        return array;
+    }
+
+    u32_t new_capacity = *capacity < 16 ? 16 : *capacity * 2;
+    u8_t *new_array = gltf_push_aligned(arena, new_capacity * stride);
+    const u8_t *old_array = array;
+    for (u64_t i = 0; i < count * stride; i++) {
+        new_array[i] = old_array[i];
+    }
+
+    *capacity = new_capacity;
+    return new_array;
+}
+
+u32_t gltf_push_buffer(gltf_model_t *model, re_str_t data, re_arena_t *arena) {
+    u32_t capacity = model->buffer_capacity;
+    model->buffers = grow_array(model->buffers, model->buffer_count, &capacity, sizeof(re_str_t), arena);
+    model->buffer_uris = grow_array(model->buffer_uris, model->buffer_count, &model->buffer_capacity, sizeof(re_str_t), arena);
+
+    model->buffers[model->buffer_count] = data;
+    model->buffer_uris[model->buffer_count] = re_str_lit("");
+    return model->buffer_count++;
+}
+
+u32_t gltf_push_view(gltf_model_t *model, gltf_buffer_view_t view, re_arena_t *arena) {
+    model->views = grow_array(model->views, model->view_count, &model->view_capacity, sizeof(gltf_buffer_view_t), arena);
+
+    model->views[model->view_count] = view;
+    return model->view_count++;
+}
+
+u32_t gltf_push_accessor(gltf_model_t *model, gltf_accessor_t accessor, re_arena_t *arena) {
+    model->accessors = grow_array(model->accessors, model->accessor_count, &model->accessor_capacity, sizeof(gltf_accessor_t), arena);
+
+    model->accessors[model->accessor_count] = accessor;
+    return model->accessor_count++;
+}
+
+static const gltf_accessor_type_t attribute_types[GLTF_ATTRIBUTE_COUNT] = {
+    GLTF_ACCESSOR_TYPE_VEC3,
+    GLTF_ACCESSOR_TYPE_VEC3,
+    GLTF_ACCESSOR_TYPE_VEC2,
+    GLTF_ACCESSOR_TYPE_VEC4,
+    GLTF_ACCESSOR_TYPE_VEC4,
+    GLTF_ACCESSOR_TYPE_VEC4,
+};
+
+// Component formats allowed for each attribute by the core spec, and the
+// integer formats KHR_mesh_quantization adds on top.
+static b8_t attribute_format_valid(gltf_attribute_t attrib, const gltf_accessor_t *acc, b8_t quantized) {
+    gltf_comp_type_t comp_type = acc->comp_type;
+    if (comp_type == GLTF_COMP_TYPE_FLOAT) {
+        return !acc->normalized;
+    }
+
+    b8_t small_int = comp_type != GLTF_COMP_TYPE_UNSIGNED_INT;
+    b8_t signed_int = comp_type == GLTF_COMP_TYPE_BYTE || comp_type == GLTF_COMP_TYPE_SHORT;
+    switch (attrib) {
+        case GLTF_ATTRIBUTE_POSITION:
+            return quantized && small_int;
+        case GLTF_ATTRIBUTE_NORMAL:
+        case GLTF_ATTRIBUTE_TANGENT:
+            return quantized && signed_int && acc->normalized;
+        case GLTF_ATTRIBUTE_TEXCOORD_0:
+            if (!signed_int && small_int && acc->normalized) {
+                return true;
+            }
+            return quantized && small_int;
+        case GLTF_ATTRIBUTE_WEIGHTS_0:
+            return !signed_int && small_int && acc->normalized;
+        default:
+            return false;
+    }
+}
+
+static b8_t accessor_valid(const gltf_model_t *model, i32_t accessor) {
+    if (accessor < 0 || (u32_t) accessor >= model->accessor_count) {
+        return false;
+    }
+    i32_t view = model->accessors[accessor].view;
+    return view == -1 || (view >= 0 && (u32_t) view < model->view_count);
+}
+
+// Drops primitive references to accessors that don't exist or name a buffer
+// view that doesn't, everything after parsing indexes with them unchecked.
+// Without its indices a primitive can't be drawn at all, so it loses its
+// attributes too, which leaves it empty.
+static void validate_primitive_accessors(gltf_model_t *model) {
+    gltf_primitives_t prims = model->primitives;
+    for (u32_t i = 0; i < prims.count; i++) {
+        for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+            i32_t accessor = prims.attributes[attrib][i];
+            if (accessor != -1 && !accessor_valid(model, accessor)) {
+                re_log_error("Primitive %u has a %s attribute with an invalid accessor %d.", i, attribute_names[attrib], accessor);
+                prims.attributes[attrib][i] = -1;
+            }
+        }
+        if (prims.indices[i] != -1 && !accessor_valid(model, prims.indices[i])) {
+            re_log_error("Primitive %u has an invalid index accessor %d and was skipped.", i, prims.indices[i]);
+            prims.indices[i] = -1;
+            for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+                prims.attributes[attrib][i] = -1;
+            }
+        }
+    }
+}
+
+// Drops attributes of the wrong type and converts formats that aren't allowed
+// to floats, so the renderer can upload every attribute as is. Signed and
+// float indices become 32 bit ones for the same reason, processing also
+// writes indices back in the accessor's type.
+static void validate_attributes(gltf_model_t *model, re_arena_t *arena) {
+    b8_t quantized = (model->extensions & GLTF_EXTENSION_KHR_MESH_QUANTIZATION) != 0;
+
+    gltf_primitives_t prims = model->primitives;
+    for (u32_t i = 0; i < prims.count; i++) {
+        for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+            i32_t accessor = prims.attributes[attrib][i];
+            if (accessor == -1) {
+                continue;
+            }
+
+            const gltf_accessor_t *acc = &model->accessors[accessor];
+            if (acc->type != attribute_types[attrib]) {
+                re_log_error("Primitive %u has a %s attribute of the wrong type.", i, attribute_names[attrib]);
+                prims.attributes[attrib][i] = -1;
+                continue;
+            }
+
+            // Joints are indices, as floats they'd be useless.
+            if (attrib == GLTF_ATTRIBUTE_JOINTS_0) {
+                b8_t valid = !acc->normalized &&
+                    (acc->comp_type == GLTF_COMP_TYPE_UNSIGNED_BYTE || acc->comp_type == GLTF_COMP_TYPE_UNSIGNED_SHORT);
+                if (!valid) {
+                    re_log_error("Primitive %u has JOINTS_0 that aren't unsigned bytes or shorts.", i);
+                    prims.attributes[attrib][i] = -1;
+                }
+                continue;
+            }
+
+            if (attribute_format_valid(attrib, acc, quantized)) {
+                continue;
+            }
+
+            re_log_warn("Accessor %d isn't a valid %s format%s, converting to floats.",
+                    accessor,
+                    attribute_names[attrib],
+                    quantized ? "" : " without KHR_mesh_quantization");
+            if (!gltf_accessor_to_f32(model, accessor, arena)) {
+                re_log_error("Accessor %d couldn't be read.", accessor);
+                prims.attributes[attrib][i] = -1;
+            }
+        }
+
+        i32_t indices = prims.indices[i];
+        if (indices == -1) {
+            continue;
+        }
+        gltf_comp_type_t comp_type = model->accessors[indices].comp_type;
+        if (comp_type == GLTF_COMP_TYPE_UNSIGNED_BYTE || comp_type == GLTF_COMP_TYPE_UNSIGNED_SHORT || comp_type == GLTF_COMP_TYPE_UNSIGNED_INT) {
+            continue;
+        }
+
+        re_log_warn("Accessor %d isn't a valid index format, converting to 32 bit indices.", indices);
+        u32_t count = model->accessors[indices].count;
+        re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+        u32_t *values = re_arena_push(scratch.arena, (u64_t) count * sizeof(u32_t));
+        if (gltf_accessor_read_u32(model, indices, values)) {
+            model->accessors[indices].comp_type = GLTF_COMP_TYPE_UNSIGNED_INT;
+            model->accessors[indices].normalized = false;
+            gltf_accessor_set_indices(model, indices, values, count, arena);
+        } else {
+            re_log_error("Primitive %u has unreadable indices and was skipped.", i);
+            prims.indices[i] = -1;
+            for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+                prims.attributes[attrib][i] = -1;
+            }
+        }
+        re_arena_scratch_release(&scratch);
+    }
+}
+
+static void bounds_job(void *user, u32_t begin, u32_t end) {
+    gltf_model_t *model = user;
+    gltf_primitives_t prims = model->primitives;
+    for (u32_t i = begin; i < end; i++) {
+        f32_t min[3] = {1.0f, 1.0f, 1.0f};
+        f32_t max[3] = {-1.0f, -1.0f, -1.0f};
+        i32_t positions = prims.attributes[GLTF_ATTRIBUTE_POSITION][i];
+        if (positions >= 0 && !gltf_accessor_bounds(model, positions, min, max)) {
+            re_log_error("Accessor %d couldn't be read.", positions);
+        }
+        prims.bounds[i] = (gltf_aabb_t) {
+            HMM_V3(min[0], min[1], min[2]),
+            HMM_V3(max[0], max[1], max[2]),
         };
     }
+}
 
-    return meshes;
+void gltf_update_bounds(gltf_model_t *model) {
+    job_parallel_for(model->primitives.count, 1, bounds_job, model);
 }
 
-static void set_target(gltf_model_t *model, gltf_mesh_t mesh, u32_t accessor, gltf_buffer_target target) {
-    if (accessor == -1) {
+static void set_target(gltf_model_t *model, i32_t accessor, gltf_buffer_target target) {
+    if (accessor < 0 || (u32_t) accessor >= model->accessor_count || model->accessors[accessor].view == -1) {
         return;
     }
 
@@ -183,62 +1213,140 @@ static void set_target(gltf_model_t *model, gltf_mesh_t mesh, u32_t accessor, gl
 }
 
 static void gltf_infer_buffer_view_target(gltf_model_t *model) {
-    for (u32_t i = 0; i < model->mesh_count; i++) {
-        gltf_mesh_t mesh = model->meshes[i];
-        set_target(model, mesh, mesh.position_accessor, GLTF_BUFFER_TARGET_ARRAY);
-        set_target(model, mesh, mesh.normal_accessor, GLTF_BUFFER_TARGET_ARRAY);
-        set_target(model, mesh, mesh.uv_accessor, GLTF_BUFFER_TARGET_ARRAY);
-        set_target(model, mesh, mesh.indices_accessor, GLTF_BUFFER_TARGET_ELEMENT_ARRAY);
+    gltf_primitives_t prims = model->primitives;
+    for (u32_t i = 0; i < prims.count; i++) {
+        for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+            set_target(model, prims.attributes[attrib][i], GLTF_BUFFER_TARGET_ARRAY);
+        }
+        set_target(model, prims.indices[i], GLTF_BUFFER_TARGET_ELEMENT_ARRAY);
     }
 }
 
 gltf_model_t gltf_parse(const char *path, re_arena_t *arena) {
-    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    return gltf_parse_cached(path, NULL, arena);
+}
 
-    re_str_t file = re_file_read(path, scratch.arena);
+gltf_model_t gltf_parse_cached(const char *path, gltf_buffer_cache_t *cache, re_arena_t *arena) {
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
 
-    re_str_t _path = re_str_cstr(path);
-    re_str_t dir = re_str_null;
-    for (u32_t i = _path.len - 1; i > 0; i--) {
-        if (_path.str[i] == '/') {
-            dir = re_str_prefix(_path, i + 1);
-            break;
-        }
+    gltf_source_t source;
+    re_str_t file = gltf_source_read(path, &source, scratch.arena);
+    if (file.str == NULL) {
+        re_log_error("Couldn't open %s.", path);
+        re_arena_scratch_release(&scratch);
+        return (gltf_model_t) {0};
     }
 
-    if (dir.str == NULL) {
-        dir = re_str_lit("");
-    }
+    re_str_t dir = gltf_path_dir(re_str_cstr(path));
 
     json_object_t json = json_parse(file);
 
+    u32_t extensions;
+    if (!parse_extensions(&json, &extensions)) {
+        re_log_error("Can't load %s.", path);
+        json_free(&json);
+        re_arena_scratch_release(&scratch);
+        return (gltf_model_t) {0};
+    }
+
     u32_t buffer_count;
     u32_t view_count;
     u32_t accessor_count;
     u32_t mesh_count;
-    re_str_t *buffers = parse_buffers(&json, dir, arena, &buffer_count);
-    gltf_buffer_view_t *views = parse_views(&json, arena, &view_count);
+    re_str_t *buffer_uris;
+    gltf_source_t *buffer_sources;
+    re_str_t *buffers = parse_buffers(&json, dir, cache, arena, &buffer_uris, &buffer_sources, &buffer_count);
+    meshopt_view_t *meshopt_views;
+    gltf_buffer_view_t *views = parse_views(&json, arena, scratch.arena, &meshopt_views, &view_count);
     gltf_accessor_t *accessors = parse_accessors(&json, arena, &accessor_count);
-    gltf_mesh_t *meshes = parse_meshes(&json, arena, &mesh_count);
+    gltf_primitives_t primitives;
+    gltf_mesh_t *meshes = parse_meshes(&json, arena, &primitives, &mesh_count);
 
-    json_free(&json);
-    re_arena_scratch_release(&scratch);
+    gltf_nodes_t nodes;
+    i32_t *node_remap = parse_nodes(&json, arena, scratch.arena, &nodes);
+
+    u32_t scene_count;
+    u32_t *scene_roots;
+    u32_t scene_root_count;
+    gltf_scene_t *scenes = parse_scenes(&json, node_remap, arena, &scene_roots, &scene_root_count, &scene_count);
+
+    validate_node_meshes(&nodes, mesh_count);
+
+    i32_t scene = scene_count > 0 ? 0 : -1;
+    json_object_t json_scene = json_object(json, re_str_lit("scene"));
+    if (json_scene.type != JSON_TYPE_ERROR) {
+        i32_t file_scene = json_int(json_scene);
+        if (file_scene >= 0 && (u32_t) file_scene < scene_count) {
+            scene = file_scene;
+        } else {
+            re_log_error("Default scene %d doesn't exist.", file_scene);
+        }
+    }
 
     gltf_model_t model = {
-        buffers,
-        buffer_count,
+        .buffers = buffers,
+        .buffer_uris = buffer_uris,
+        .buffer_count = buffer_count,
+        .buffer_capacity = buffer_count,
+
+        .views = views,
+        .view_count = view_count,
+        .view_capacity = view_count,
+
+        .accessors = accessors,
+        .accessor_count = accessor_count,
+        .accessor_capacity = accessor_count,
+
+        .primitives = primitives,
+
+        .meshes = meshes,
+        .mesh_count = mesh_count,
+
+        .nodes = nodes,
+
+        .scenes = scenes,
+        .scene_count = scene_count,
+        .scene_roots = scene_roots,
+        .scene_root_count = scene_root_count,
+        .scene = scene,
 
-        views,
-        view_count,
+        .extensions = extensions,
 
-        accessors,
-        accessor_count,
+        .source = source,
+        .buffer_sources = buffer_sources,
 
-        meshes,
-        mesh_count,
+        .arena = arena,
     };
 
+    validate_primitive_accessors(&model);
+    if (!decode_meshopt_views(&model, meshopt_views, view_count, arena)) {
+        re_log_error("Can't load %s.", path);
+        json_free(&json);
+        re_arena_scratch_release(&scratch);
+        return (gltf_model_t) {0};
+    }
+    gltf_draco_decode(&json, &model, arena);
+    parse_skins(&json, node_remap, &model, arena);
+    parse_animations(&json, node_remap, &model, arena);
+
+    json_free(&json);
+    re_arena_scratch_release(&scratch);
+
+    // Everything a primitive references is needed for upload right away.
+    for (u32_t i = 0; i < primitives.count; i++) {
+        for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+            if (primitives.attributes[attrib][i] != -1) {
+                gltf_accessor_resolve(&model, primitives.attributes[attrib][i], arena);
+            }
+        }
+        if (primitives.indices[i] != -1) {
+            gltf_accessor_resolve(&model, primitives.indices[i], arena);
+        }
+    }
+
+    validate_attributes(&model, arena);
     gltf_infer_buffer_view_target(&model);
+    gltf_update_bounds(&model);
 
     return model;
 }
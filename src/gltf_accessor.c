@@ -0,0 +1,870 @@
+#include "gltf.h"
+#include "gltf_internal.h"
+#include "rebound.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+u32_t gltf_comp_size(gltf_comp_type_t comp_type) {
+    switch (comp_type) {
+        case GLTF_COMP_TYPE_BYTE:           return 1;
+        case GLTF_COMP_TYPE_UNSIGNED_BYTE:  return 1;
+        case GLTF_COMP_TYPE_SHORT:          return 2;
+        case GLTF_COMP_TYPE_UNSIGNED_SHORT: return 2;
+        case GLTF_COMP_TYPE_UNSIGNED_INT:   return 4;
+        case GLTF_COMP_TYPE_FLOAT:          return 4;
+    }
+
+    return 0;
+}
+
+u32_t gltf_accessor_type_count(gltf_accessor_type_t type) {
+    switch (type) {
+        case GLTF_ACCESSOR_TYPE_SCALAR: return 1;
+        case GLTF_ACCESSOR_TYPE_VEC2:   return 2;
+        case GLTF_ACCESSOR_TYPE_VEC3:   return 3;
+        case GLTF_ACCESSOR_TYPE_VEC4:   return 4;
+        case GLTF_ACCESSOR_TYPE_MAT2:   return 4;
+        case GLTF_ACCESSOR_TYPE_MAT3:   return 9;
+        case GLTF_ACCESSOR_TYPE_MAT4:   return 16;
+    }
+
+    return 0;
+}
+
+u32_t gltf_accessor_element_size(const gltf_accessor_t *accessor) {
+    u32_t comp_size = gltf_comp_size(accessor->comp_type);
+
+    // Matrix columns start on 4 byte boundaries.
+    switch (accessor->type) {
+        case GLTF_ACCESSOR_TYPE_MAT2: return 2 * ((2 * comp_size + 3) & ~3u);
+        case GLTF_ACCESSOR_TYPE_MAT3: return 3 * ((3 * comp_size + 3) & ~3u);
+        default: return gltf_accessor_type_count(accessor->type) * comp_size;
+    }
+}
+
+static b8_t view_range_valid(const gltf_model_t *model, u32_t view, u64_t offset, u64_t size) {
+    if (view >= model->view_count) {
+        return false;
+    }
+
+    gltf_buffer_view_t v = model->views[view];
+    return v.buffer < model->buffer_count &&
+        (u64_t) v.offset + v.length <= model->buffers[v.buffer].len &&
+        offset <= v.length &&
+        size <= v.length - offset;
+}
+
+static u32_t view_stride(const gltf_model_t *model, const gltf_accessor_t *acc) {
+    u32_t stride = model->views[acc->view].stride;
+    return stride != 0 ? stride : gltf_accessor_element_size(acc);
+}
+
+// Quantized vertex attributes such as 3 byte positions need padding, index
+// data has to stay packed.
+static u32_t resolved_stride(const gltf_accessor_t *acc) {
+    u32_t element_size = gltf_accessor_element_size(acc);
+    return acc->type != GLTF_ACCESSOR_TYPE_SCALAR ? (element_size + 3) & ~3u : element_size;
+}
+
+// Sparse indices are widened first so patching is a plain gather from the
+// values and scatter into the output. Fails for anything but the unsigned
+// index types.
+static b8_t widen_indices(u32_t *out, const u8_t *src, gltf_comp_type_t comp_type, u32_t count) {
+    switch (comp_type) {
+        case GLTF_COMP_TYPE_UNSIGNED_BYTE:
+            for (u32_t i = 0; i < count; i++) {
+                out[i] = src[i];
+            }
+            break;
+        case GLTF_COMP_TYPE_UNSIGNED_SHORT: {
+            const u16_t *src16 = (const u16_t *) src;
+            for (u32_t i = 0; i < count; i++) {
+                out[i] = src16[i];
+            }
+        } break;
+        case GLTF_COMP_TYPE_UNSIGNED_INT:
+            memcpy(out, src, count * sizeof(u32_t));
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+// Fixed element sizes let the compiler turn every copy into a couple of
+// register moves instead of a memcpy call.
+#define SCATTER(type, words) \
+    do { \
+        type *d = (type *) dst; \
+        const type *v = (const type *) values; \
+        for (u32_t i = 0; i < count; i++) { \
+            for (u32_t w = 0; w < words; w++) { \
+                d[indices[i] * words + w] = v[i * words + w]; \
+            } \
+        } \
+    } while (0)
+
+static void scatter_values(u8_t *dst, const u8_t *values, const u32_t *indices, u32_t count, u32_t element_size) {
+    switch (element_size) {
+        case 1:  SCATTER(u8_t, 1);  break;
+        case 2:  SCATTER(u16_t, 1); break;
+        case 4:  SCATTER(u32_t, 1); break;
+        case 8:  SCATTER(u32_t, 2); break;
+        case 12: SCATTER(u32_t, 3); break;
+        case 16: SCATTER(u32_t, 4); break;
+        default:
+            for (u32_t i = 0; i < count; i++) {
+                memcpy(dst + (u64_t) indices[i] * element_size, values + (u64_t) i * element_size, element_size);
+            }
+            break;
+    }
+}
+
+#undef SCATTER
+
+void gltf_accessor_resolve(gltf_model_t *model, u32_t accessor, re_arena_t *arena) {
+    gltf_accessor_t *acc = &model->accessors[accessor];
+    if (acc->view >= 0 && acc->sparse.count == 0) {
+        return;
+    }
+
+    u32_t element_size = gltf_accessor_element_size(acc);
+    u32_t out_stride = resolved_stride(acc);
+    u64_t size = (u64_t) acc->count * out_stride;
+    u8_t *data = gltf_push_aligned(arena, size);
+
+    // Base data.
+    b8_t base_valid = false;
+    if (acc->view >= 0 && acc->count > 0) {
+        gltf_buffer_view_t view = model->views[acc->view];
+        u32_t stride = view_stride(model, acc);
+        u64_t span = (u64_t) (acc->count - 1) * stride + element_size;
+
+        if (view_range_valid(model, acc->view, acc->offset, span)) {
+            const u8_t *src = model->buffers[view.buffer].str + view.offset + acc->offset;
+            if (stride == out_stride) {
+                memcpy(data, src, span);
+                memset(data + span, 0, size - span);
+            } else {
+                memset(data, 0, size);
+                for (u32_t i = 0; i < acc->count; i++) {
+                    memcpy(data + (u64_t) i * out_stride, src + (u64_t) i * stride, element_size);
+                }
+            }
+            base_valid = true;
+        } else {
+            re_log_error("Accessor %u reads outside of its buffer view.", accessor);
+        }
+    }
+    if (!base_valid) {
+        memset(data, 0, size);
+    }
+
+    gltf_accessor_sparse_t sparse = acc->sparse;
+    if (sparse.count > 0) {
+        u32_t index_size = gltf_comp_size(sparse.indices_comp_type);
+        b8_t valid = view_range_valid(model, sparse.indices_view, sparse.indices_offset, (u64_t) sparse.count * index_size) &&
+            view_range_valid(model, sparse.values_view, sparse.values_offset, (u64_t) sparse.count * element_size);
+
+        re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+        u32_t *indices = re_arena_push(scratch.arena, sparse.count * sizeof(u32_t));
+        if (valid) {
+            gltf_buffer_view_t indices_view = model->views[sparse.indices_view];
+            valid = widen_indices(
+                    indices,
+                    model->buffers[indices_view.buffer].str + indices_view.offset + sparse.indices_offset,
+                    sparse.indices_comp_type,
+                    sparse.count);
+
+            for (u32_t i = 0; i < sparse.count && valid; i++) {
+                valid = indices[i] < acc->count;
+            }
+        }
+
+        if (valid) {
+            gltf_buffer_view_t values_view = model->views[sparse.values_view];
+            const u8_t *values = model->buffers[values_view.buffer].str + values_view.offset + sparse.values_offset;
+            if (out_stride == element_size) {
+                scatter_values(data, values, indices, sparse.count, element_size);
+            } else {
+                for (u32_t i = 0; i < sparse.count; i++) {
+                    memcpy(data + (u64_t) indices[i] * out_stride, values + (u64_t) i * element_size, element_size);
+                }
+            }
+        } else {
+            re_log_error("Accessor %u has invalid sparse data.", accessor);
+        }
+        re_arena_scratch_release(&scratch);
+    }
+
+    u32_t buffer = gltf_push_buffer(model, re_str(data, size), arena);
+    u32_t stride = out_stride == element_size ? 0 : out_stride;
+    u32_t view = gltf_push_view(model, (gltf_buffer_view_t) {buffer, 0, size, stride, 0}, arena);
+
+    acc = &model->accessors[accessor];
+    acc->view = view;
+    acc->offset = 0;
+    acc->sparse = (gltf_accessor_sparse_t) {0};
+}
+
+b8_t gltf_accessor_to_f32(gltf_model_t *model, u32_t accessor, re_arena_t *arena) {
+    gltf_accessor_t *acc = &model->accessors[accessor];
+    u64_t size = (u64_t) acc->count * gltf_accessor_type_count(acc->type) * sizeof(f32_t);
+    f32_t *data = gltf_push_aligned(arena, size);
+    if (!gltf_accessor_read_f32(model, accessor, data)) {
+        return false;
+    }
+
+    u32_t buffer = gltf_push_buffer(model, re_str((u8_t *) data, size), arena);
+    u32_t view = gltf_push_view(model, (gltf_buffer_view_t) {buffer, 0, size, 0, 0}, arena);
+
+    acc = &model->accessors[accessor];
+    acc->view = view;
+    acc->offset = 0;
+    acc->comp_type = GLTF_COMP_TYPE_FLOAT;
+    acc->normalized = false;
+    acc->sparse = (gltf_accessor_sparse_t) {0};
+    return true;
+}
+
+void gltf_accessor_set_indices(gltf_model_t *model, u32_t accessor, const u32_t *indices, u32_t count, re_arena_t *arena) {
+    gltf_comp_type_t comp_type = model->accessors[accessor].comp_type;
+    u32_t index_size = gltf_comp_size(comp_type);
+    u64_t size = (u64_t) count * index_size;
+    u8_t *data = gltf_push_aligned(arena, size);
+
+    for (u32_t i = 0; i < count; i++) {
+        switch (comp_type) {
+            case GLTF_COMP_TYPE_UNSIGNED_BYTE:  data[i] = indices[i]; break;
+            case GLTF_COMP_TYPE_UNSIGNED_SHORT: ((u16_t *) data)[i] = indices[i]; break;
+            default:                            ((u32_t *) data)[i] = indices[i]; break;
+        }
+    }
+
+    u32_t buffer = gltf_push_buffer(model, re_str(data, size), arena);
+    u32_t view = gltf_push_view(model, (gltf_buffer_view_t) {buffer, 0, size, 0, GLTF_BUFFER_TARGET_ELEMENT_ARRAY}, arena);
+
+    gltf_accessor_t *acc = &model->accessors[accessor];
+    acc->view = view;
+    acc->offset = 0;
+    acc->count = count;
+    acc->sparse = (gltf_accessor_sparse_t) {0};
+    acc->has_bounds = false;
+}
+
+void gltf_accessor_remap(gltf_model_t *model, u32_t accessor, const u32_t *remap, u32_t count, re_arena_t *arena) {
+    gltf_accessor_resolve(model, accessor, arena);
+
+    gltf_accessor_t *acc = &model->accessors[accessor];
+    u32_t element_size = gltf_accessor_element_size(acc);
+    u32_t out_stride = resolved_stride(acc);
+    u64_t size = (u64_t) count * out_stride;
+    u8_t *data = gltf_push_aligned(arena, size);
+    memset(data, 0, size);
+
+    u32_t stride;
+    const u8_t *src = gltf_accessor_data(model, accessor, &stride);
+    if (src != NULL) {
+        // Backwards so the first of several elements sharing a target wins.
+        for (u32_t i = acc->count; i-- > 0;) {
+            if (remap[i] < count) {
+                memcpy(data + (u64_t) remap[i] * out_stride, src + (u64_t) i * stride, element_size);
+            }
+        }
+    } else {
+        re_log_error("Accessor %u reads outside of its buffer view.", accessor);
+    }
+
+    u32_t buffer = gltf_push_buffer(model, re_str(data, size), arena);
+    u32_t padded_stride = out_stride == element_size ? 0 : out_stride;
+    u32_t view = gltf_push_view(model, (gltf_buffer_view_t) {buffer, 0, size, padded_stride, GLTF_BUFFER_TARGET_ARRAY}, arena);
+
+    acc = &model->accessors[accessor];
+    acc->view = view;
+    acc->offset = 0;
+    acc->count = count;
+    acc->has_bounds = false;
+}
+
+void gltf_accessor_gather(gltf_model_t *model, u32_t accessor, const u32_t *sources, u32_t count, re_arena_t *arena) {
+    gltf_accessor_resolve(model, accessor, arena);
+
+    gltf_accessor_t *acc = &model->accessors[accessor];
+    u32_t element_size = gltf_accessor_element_size(acc);
+    u32_t out_stride = resolved_stride(acc);
+    u64_t size = (u64_t) count * out_stride;
+    u8_t *data = gltf_push_aligned(arena, size);
+    memset(data, 0, size);
+
+    u32_t stride;
+    const u8_t *src = gltf_accessor_data(model, accessor, &stride);
+    if (src != NULL) {
+        for (u32_t i = 0; i < count; i++) {
+            if (sources[i] < acc->count) {
+                memcpy(data + (u64_t) i * out_stride, src + (u64_t) sources[i] * stride, element_size);
+            }
+        }
+    } else {
+        re_log_error("Accessor %u reads outside of its buffer view.", accessor);
+    }
+
+    u32_t buffer = gltf_push_buffer(model, re_str(data, size), arena);
+    u32_t padded_stride = out_stride == element_size ? 0 : out_stride;
+    u32_t view = gltf_push_view(model, (gltf_buffer_view_t) {buffer, 0, size, padded_stride, GLTF_BUFFER_TARGET_ARRAY}, arena);
+
+    acc = &model->accessors[accessor];
+    acc->view = view;
+    acc->offset = 0;
+    acc->count = count;
+    acc->has_bounds = false;
+}
+
+u32_t gltf_accessor_interleave(gltf_model_t *model, const u32_t *accessors, u32_t accessor_count, re_arena_t *arena) {
+    if (accessor_count == 0) {
+        return 0;
+    }
+
+    // Larger components first, padding each element to 4 bytes then keeps
+    // every component aligned.
+    u32_t order[GLTF_ATTRIBUTE_COUNT];
+    u32_t offsets[GLTF_ATTRIBUTE_COUNT];
+    for (u32_t i = 0; i < accessor_count; i++) {
+        order[i] = i;
+    }
+    for (u32_t i = 1; i < accessor_count; i++) {
+        for (u32_t j = i; j > 0; j--) {
+            u32_t a = gltf_comp_size(model->accessors[accessors[order[j - 1]]].comp_type);
+            u32_t b = gltf_comp_size(model->accessors[accessors[order[j]]].comp_type);
+            if (a >= b) {
+                break;
+            }
+            u32_t t = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = t;
+        }
+    }
+
+    u32_t stride = 0;
+    for (u32_t i = 0; i < accessor_count; i++) {
+        gltf_accessor_resolve(model, accessors[order[i]], arena);
+        offsets[order[i]] = stride;
+        stride += (gltf_accessor_element_size(&model->accessors[accessors[order[i]]]) + 3) & ~3u;
+    }
+
+    u32_t count = model->accessors[accessors[0]].count;
+    u64_t size = (u64_t) count * stride;
+    u8_t *data = gltf_push_aligned(arena, size);
+    memset(data, 0, size);
+
+    for (u32_t i = 0; i < accessor_count; i++) {
+        const gltf_accessor_t *acc = &model->accessors[accessors[i]];
+        u32_t element_size = gltf_accessor_element_size(acc);
+        u32_t src_stride;
+        const u8_t *src = gltf_accessor_data(model, accessors[i], &src_stride);
+        if (src == NULL) {
+            re_log_error("Accessor %u reads outside of its buffer view.", accessors[i]);
+            continue;
+        }
+
+        u8_t *dst = data + offsets[i];
+        for (u32_t v = 0; v < count; v++) {
+            memcpy(dst + (u64_t) v * stride, src + (u64_t) v * src_stride, element_size);
+        }
+    }
+
+    u32_t buffer = gltf_push_buffer(model, re_str(data, size), arena);
+    u32_t view = gltf_push_view(model, (gltf_buffer_view_t) {buffer, 0, size, stride, GLTF_BUFFER_TARGET_ARRAY}, arena);
+
+    for (u32_t i = 0; i < accessor_count; i++) {
+        gltf_accessor_t *acc = &model->accessors[accessors[i]];
+        acc->view = view;
+        acc->offset = offsets[i];
+    }
+
+    return stride;
+}
+
+/*=========================*/
+// Reading
+/*=========================*/
+
+const u8_t *gltf_accessor_data(const gltf_model_t *model, u32_t accessor, u32_t *stride) {
+    const gltf_accessor_t *acc = &model->accessors[accessor];
+    if (acc->view < 0 || acc->sparse.count > 0) {
+        return NULL;
+    }
+
+    gltf_buffer_view_t view = model->views[acc->view];
+    u32_t element_size = gltf_accessor_element_size(acc);
+    *stride = view_stride(model, acc);
+
+    u64_t span = acc->count > 0 ? (u64_t) (acc->count - 1) * *stride + element_size : 0;
+    if (!view_range_valid(model, acc->view, acc->offset, span)) {
+        return NULL;
+    }
+
+    return model->buffers[view.buffer].str + view.offset + acc->offset;
+}
+
+typedef enum {
+    READ_FORMAT_F32,
+    READ_FORMAT_U16,
+    READ_FORMAT_U32,
+} read_format_t;
+
+static u32_t read_format_size(read_format_t format) {
+    return format == READ_FORMAT_U16 ? 2 : 4;
+}
+
+static f32_t comp_to_f32(const u8_t *src, gltf_comp_type_t comp_type, b8_t normalized) {
+    f32_t value = 0.0f;
+    switch (comp_type) {
+        case GLTF_COMP_TYPE_BYTE:
+            value = *(const i8_t *) src;
+            return normalized ? fmaxf(value / 127.0f, -1.0f) : value;
+        case GLTF_COMP_TYPE_UNSIGNED_BYTE:
+            value = *src;
+            return normalized ? value / 255.0f : value;
+        case GLTF_COMP_TYPE_SHORT:
+            value = *(const i16_t *) src;
+            return normalized ? fmaxf(value / 32767.0f, -1.0f) : value;
+        case GLTF_COMP_TYPE_UNSIGNED_SHORT:
+            value = *(const u16_t *) src;
+            return normalized ? value / 65535.0f : value;
+        case GLTF_COMP_TYPE_UNSIGNED_INT:
+            return *(const u32_t *) src;
+        case GLTF_COMP_TYPE_FLOAT:
+            return *(const f32_t *) src;
+    }
+
+    return value;
+}
+
+// Signed and float components convert as long as they hold a non-negative
+// whole number that fits, normalization is ignored.
+static b8_t comp_to_u32(const u8_t *src, gltf_comp_type_t comp_type, u32_t *out) {
+    switch (comp_type) {
+        case GLTF_COMP_TYPE_UNSIGNED_BYTE:  *out = *src; return true;
+        case GLTF_COMP_TYPE_UNSIGNED_SHORT: *out = *(const u16_t *) src; return true;
+        case GLTF_COMP_TYPE_UNSIGNED_INT:   *out = *(const u32_t *) src; return true;
+        case GLTF_COMP_TYPE_BYTE: {
+            i8_t value = *(const i8_t *) src;
+            *out = value;
+            return value >= 0;
+        }
+        case GLTF_COMP_TYPE_SHORT: {
+            i16_t value = *(const i16_t *) src;
+            *out = value;
+            return value >= 0;
+        }
+        case GLTF_COMP_TYPE_FLOAT: {
+            f32_t value = *(const f32_t *) src;
+            if (!(value >= 0.0f && value < 4294967296.0f) || value != floorf(value)) {
+                return false;
+            }
+            *out = (u32_t) value;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Kernels for tightly packed data, which covers nearly every vertex and index
+// stream. The SSE2 paths convert 16 bytes of input per iteration.
+
+static void flat_to_f32(const u8_t *src, gltf_comp_type_t comp_type, b8_t normalized, u64_t count, f32_t *out) {
+    u64_t i = 0;
+
+    if (comp_type == GLTF_COMP_TYPE_FLOAT) {
+        memcpy(out, src, count * sizeof(f32_t));
+        return;
+    }
+
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    switch (comp_type) {
+        case GLTF_COMP_TYPE_UNSIGNED_BYTE:
+        case GLTF_COMP_TYPE_BYTE: {
+            b8_t is_signed = comp_type == GLTF_COMP_TYPE_BYTE;
+            __m128 scale = _mm_set1_ps(normalized ? (is_signed ? 1.0f / 127.0f : 1.0f / 255.0f) : 1.0f);
+            __m128 min = _mm_set1_ps(normalized && is_signed ? -1.0f : -128.0f);
+            for (; i + 16 <= count; i += 16) {
+                __m128i bytes = _mm_loadu_si128((const __m128i *) (src + i));
+                __m128i lo, hi;
+                if (is_signed) {
+                    lo = _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8);
+                    hi = _mm_srai_epi16(_mm_unpackhi_epi8(bytes, bytes), 8);
+                } else {
+                    lo = _mm_unpacklo_epi8(bytes, zero);
+                    hi = _mm_unpackhi_epi8(bytes, zero);
+                }
+                __m128i words[2] = {lo, hi};
+                for (u32_t w = 0; w < 2; w++) {
+                    __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(words[w], words[w]), 16);
+                    __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(words[w], words[w]), 16);
+                    _mm_storeu_ps(out + i + w * 8, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(a), scale), min));
+                    _mm_storeu_ps(out + i + w * 8 + 4, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(b), scale), min));
+                }
+            }
+        } break;
+        case GLTF_COMP_TYPE_UNSIGNED_SHORT:
+        case GLTF_COMP_TYPE_SHORT: {
+            b8_t is_signed = comp_type == GLTF_COMP_TYPE_SHORT;
+            __m128 scale = _mm_set1_ps(normalized ? (is_signed ? 1.0f / 32767.0f : 1.0f / 65535.0f) : 1.0f);
+            __m128 min = _mm_set1_ps(normalized && is_signed ? -1.0f : -32768.0f);
+            for (; i + 8 <= count; i += 8) {
+                __m128i words = _mm_loadu_si128((const __m128i *) (src + i * 2));
+                __m128i a, b;
+                if (is_signed) {
+                    a = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16);
+                    b = _mm_srai_epi32(_mm_unpackhi_epi16(words, words), 16);
+                } else {
+                    a = _mm_unpacklo_epi16(words, zero);
+                    b = _mm_unpackhi_epi16(words, zero);
+                }
+                _mm_storeu_ps(out + i, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(a), scale), min));
+                _mm_storeu_ps(out + i + 4, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(b), scale), min));
+            }
+        } break;
+        default:
+            break;
+    }
+#endif
+
+    u32_t comp_size = gltf_comp_size(comp_type);
+    for (; i < count; i++) {
+        out[i] = comp_to_f32(src + i * comp_size, comp_type, normalized);
+    }
+}
+
+static b8_t flat_to_u32(const u8_t *src, gltf_comp_type_t comp_type, u64_t count, u32_t *out) {
+    u64_t i = 0;
+
+    switch (comp_type) {
+        case GLTF_COMP_TYPE_UNSIGNED_INT:
+            memcpy(out, src, count * sizeof(u32_t));
+            return true;
+        case GLTF_COMP_TYPE_UNSIGNED_SHORT:
+#if defined(__SSE2__)
+            for (; i + 8 <= count; i += 8) {
+                __m128i words = _mm_loadu_si128((const __m128i *) (src + i * 2));
+                _mm_storeu_si128((__m128i *) (out + i), _mm_unpacklo_epi16(words, _mm_setzero_si128()));
+                _mm_storeu_si128((__m128i *) (out + i + 4), _mm_unpackhi_epi16(words, _mm_setzero_si128()));
+            }
+#endif
+            for (; i < count; i++) {
+                out[i] = ((const u16_t *) src)[i];
+            }
+            return true;
+        case GLTF_COMP_TYPE_UNSIGNED_BYTE:
+            for (; i < count; i++) {
+                out[i] = src[i];
+            }
+            return true;
+        default: {
+            u32_t comp_size = gltf_comp_size(comp_type);
+            for (; i < count; i++) {
+                if (!comp_to_u32(src + i * comp_size, comp_type, &out[i])) {
+                    return false;
+                }
+            }
+            return comp_size != 0;
+        }
+    }
+}
+
+static b8_t flat_to_u16(const u8_t *src, gltf_comp_type_t comp_type, u64_t count, u16_t *out) {
+    switch (comp_type) {
+        case GLTF_COMP_TYPE_UNSIGNED_SHORT:
+            memcpy(out, src, count * sizeof(u16_t));
+            return true;
+        case GLTF_COMP_TYPE_UNSIGNED_BYTE:
+            for (u64_t i = 0; i < count; i++) {
+                out[i] = src[i];
+            }
+            return true;
+        case GLTF_COMP_TYPE_UNSIGNED_INT: {
+            u32_t max = 0;
+            for (u64_t i = 0; i < count; i++) {
+                u32_t value = ((const u32_t *) src)[i];
+                max = value > max ? value : max;
+                out[i] = value;
+            }
+            return max <= 0xffff;
+        }
+        default: {
+            u32_t comp_size = gltf_comp_size(comp_type);
+            for (u64_t i = 0; i < count; i++) {
+                u32_t value;
+                if (!comp_to_u32(src + i * comp_size, comp_type, &value) || value > 0xffff) {
+                    return false;
+                }
+                out[i] = value;
+            }
+            return comp_size != 0;
+        }
+    }
+}
+
+// Converts count elements of comps components each. Elements are stride bytes
+// apart and the components of one element are at offsets[].
+static b8_t convert_elements(
+        const u8_t *src,
+        u32_t stride,
+        const u32_t *offsets,
+        b8_t packed,
+        u32_t comps,
+        u32_t count,
+        gltf_comp_type_t comp_type,
+        b8_t normalized,
+        read_format_t format,
+        void *out) {
+    u64_t total = (u64_t) count * comps;
+
+    if (packed) {
+        switch (format) {
+            case READ_FORMAT_F32: flat_to_f32(src, comp_type, normalized, total, out); return true;
+            case READ_FORMAT_U16: return flat_to_u16(src, comp_type, total, out);
+            case READ_FORMAT_U32: return flat_to_u32(src, comp_type, total, out);
+        }
+    }
+
+    for (u32_t i = 0; i < count; i++) {
+        const u8_t *element = src + (u64_t) i * stride;
+        for (u32_t c = 0; c < comps; c++) {
+            u64_t dst = (u64_t) i * comps + c;
+            if (format == READ_FORMAT_F32) {
+                ((f32_t *) out)[dst] = comp_to_f32(element + offsets[c], comp_type, normalized);
+                continue;
+            }
+
+            u32_t value;
+            if (!comp_to_u32(element + offsets[c], comp_type, &value)) {
+                return false;
+            }
+            if (format == READ_FORMAT_U32) {
+                ((u32_t *) out)[dst] = value;
+            } else if (value <= 0xffff) {
+                ((u16_t *) out)[dst] = value;
+            } else {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Byte offsets of the components inside one element. Returns false when they
+// aren't contiguous, which only happens for padded matrix columns.
+static b8_t component_offsets(const gltf_accessor_t *acc, u32_t *offsets) {
+    u32_t comp_size = gltf_comp_size(acc->comp_type);
+    u32_t comps = gltf_accessor_type_count(acc->type);
+
+    u32_t rows = 0;
+    switch (acc->type) {
+        case GLTF_ACCESSOR_TYPE_MAT2: rows = 2; break;
+        case GLTF_ACCESSOR_TYPE_MAT3: rows = 3; break;
+        case GLTF_ACCESSOR_TYPE_MAT4: rows = 4; break;
+        default: break;
+    }
+
+    if (rows == 0) {
+        for (u32_t c = 0; c < comps; c++) {
+            offsets[c] = c * comp_size;
+        }
+        return true;
+    }
+
+    u32_t column_size = (rows * comp_size + 3) & ~3u;
+    for (u32_t c = 0; c < comps; c++) {
+        offsets[c] = (c / rows) * column_size + (c % rows) * comp_size;
+    }
+    return column_size == rows * comp_size;
+}
+
+static b8_t read_accessor(const gltf_model_t *model, u32_t accessor, read_format_t format, void *out) {
+    if (accessor >= model->accessor_count) {
+        return false;
+    }
+
+    const gltf_accessor_t *acc = &model->accessors[accessor];
+    u32_t comps = gltf_accessor_type_count(acc->type);
+    u32_t element_size = gltf_accessor_element_size(acc);
+    u32_t out_element_size = comps * read_format_size(format);
+
+    u32_t offsets[16];
+    b8_t contiguous = component_offsets(acc, offsets);
+
+    if (acc->view >= 0) {
+        u32_t stride = view_stride(model, acc);
+        u64_t span = acc->count > 0 ? (u64_t) (acc->count - 1) * stride + element_size : 0;
+        if (!view_range_valid(model, acc->view, acc->offset, span)) {
+            return false;
+        }
+
+        gltf_buffer_view_t view = model->views[acc->view];
+        const u8_t *src = model->buffers[view.buffer].str + view.offset + acc->offset;
+        b8_t packed = contiguous && stride == element_size;
+        if (!convert_elements(src, stride, offsets, packed, comps, acc->count, acc->comp_type, acc->normalized, format, out)) {
+            return false;
+        }
+    } else {
+        memset(out, 0, (u64_t) acc->count * out_element_size);
+    }
+
+    gltf_accessor_sparse_t sparse = acc->sparse;
+    if (sparse.count == 0) {
+        return true;
+    }
+
+    u32_t index_size = gltf_comp_size(sparse.indices_comp_type);
+    if (!view_range_valid(model, sparse.indices_view, sparse.indices_offset, (u64_t) sparse.count * index_size) ||
+            !view_range_valid(model, sparse.values_view, sparse.values_offset, (u64_t) sparse.count * element_size)) {
+        return false;
+    }
+
+    re_arena_t *arena = model->arena;
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    u32_t *indices = re_arena_push(scratch.arena, sparse.count * sizeof(u32_t));
+    u8_t *values = re_arena_push(scratch.arena, (u64_t) sparse.count * out_element_size);
+
+    gltf_buffer_view_t indices_view = model->views[sparse.indices_view];
+    gltf_buffer_view_t values_view = model->views[sparse.values_view];
+    b8_t valid = widen_indices(
+            indices,
+            model->buffers[indices_view.buffer].str + indices_view.offset + sparse.indices_offset,
+            sparse.indices_comp_type,
+            sparse.count);
+    valid = valid && convert_elements(
+            model->buffers[values_view.buffer].str + values_view.offset + sparse.values_offset,
+            element_size,
+            offsets,
+            contiguous,
+            comps,
+            sparse.count,
+            acc->comp_type,
+            acc->normalized,
+            format,
+            values);
+
+    for (u32_t i = 0; i < sparse.count && valid; i++) {
+        valid = indices[i] < acc->count;
+    }
+    if (valid) {
+        scatter_values(out, values, indices, sparse.count, out_element_size);
+    }
+
+    re_arena_scratch_release(&scratch);
+    return valid;
+}
+
+b8_t gltf_accessor_read_f32(const gltf_model_t *model, u32_t accessor, f32_t *out) {
+    return read_accessor(model, accessor, READ_FORMAT_F32, out);
+}
+
+b8_t gltf_accessor_read_u16(const gltf_model_t *model, u32_t accessor, u16_t *out) {
+    return read_accessor(model, accessor, READ_FORMAT_U16, out);
+}
+
+b8_t gltf_accessor_read_u32(const gltf_model_t *model, u32_t accessor, u32_t *out) {
+    return read_accessor(model, accessor, READ_FORMAT_U32, out);
+}
+
+/*=========================*/
+// Bounds
+/*=========================*/
+
+// Folds count xyz floats, stride bytes apart, into min and max. The SSE2 path
+// loads 16 bytes per element and keeps four running boxes to hide the
+// latency, the last element is done on its own so no load reads past it.
+static void reduce_bounds(const u8_t *data, u32_t stride, u32_t count, f32_t min[3], f32_t max[3]) {
+    u32_t i = 0;
+
+#if defined(__SSE2__)
+    if (count > 1) {
+        __m128 lo[4];
+        __m128 hi[4];
+        for (u32_t k = 0; k < 4; k++) {
+            lo[k] = hi[k] = _mm_loadu_ps((const f32_t *) data);
+        }
+
+        for (; i + 4 < count; i += 4) {
+            for (u32_t k = 0; k < 4; k++) {
+                __m128 v = _mm_loadu_ps((const f32_t *) (data + (u64_t) (i + k) * stride));
+                lo[k] = _mm_min_ps(lo[k], v);
+                hi[k] = _mm_max_ps(hi[k], v);
+            }
+        }
+        for (; i + 1 < count; i++) {
+            __m128 v = _mm_loadu_ps((const f32_t *) (data + (u64_t) i * stride));
+            lo[0] = _mm_min_ps(lo[0], v);
+            hi[0] = _mm_max_ps(hi[0], v);
+        }
+
+        f32_t lanes[2][4];
+        _mm_storeu_ps(lanes[0], _mm_min_ps(_mm_min_ps(lo[0], lo[1]), _mm_min_ps(lo[2], lo[3])));
+        _mm_storeu_ps(lanes[1], _mm_max_ps(_mm_max_ps(hi[0], hi[1]), _mm_max_ps(hi[2], hi[3])));
+        memcpy(min, lanes[0], 3 * sizeof(f32_t));
+        memcpy(max, lanes[1], 3 * sizeof(f32_t));
+    }
+#endif
+
+    for (; i < count; i++) {
+        f32_t v[3];
+        memcpy(v, data + (u64_t) i * stride, sizeof(v));
+        for (u32_t axis = 0; axis < 3; axis++) {
+            min[axis] = i == 0 || v[axis] < min[axis] ? v[axis] : min[axis];
+            max[axis] = i == 0 || v[axis] > max[axis] ? v[axis] : max[axis];
+        }
+    }
+}
+
+b8_t gltf_accessor_bounds(const gltf_model_t *model, u32_t accessor, f32_t min[3], f32_t max[3]) {
+    const gltf_accessor_t *acc = &model->accessors[accessor];
+    if (acc->has_bounds) {
+        memcpy(min, acc->min, 3 * sizeof(f32_t));
+        memcpy(max, acc->max, 3 * sizeof(f32_t));
+        return true;
+    }
+
+    if (acc->count == 0) {
+        for (u32_t axis = 0; axis < 3; axis++) {
+            min[axis] = 1.0f;
+            max[axis] = -1.0f;
+        }
+        return true;
+    }
+
+    // Float positions are read in place, anything else is converted first.
+    u32_t components = gltf_accessor_type_count(acc->type);
+    u32_t stride;
+    const u8_t *data = gltf_accessor_data(model, accessor, &stride);
+    if (data != NULL && acc->comp_type == GLTF_COMP_TYPE_FLOAT && components >= 3) {
+        reduce_bounds(data, stride, acc->count, min, max);
+        return true;
+    }
+
+    re_arena_t *arena = model->arena;
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    f32_t *values = re_arena_push(scratch.arena, (u64_t) acc->count * components * sizeof(f32_t));
+    b8_t valid = gltf_accessor_read_f32(model, accessor, values);
+    if (valid && components >= 3) {
+        reduce_bounds((const u8_t *) values, components * sizeof(f32_t), acc->count, min, max);
+    } else if (valid) {
+        // Pad to xyz so the missing components come out as 0.
+        f32_t *padded = re_arena_push_zero(scratch.arena, (u64_t) acc->count * 3 * sizeof(f32_t));
+        for (u32_t i = 0; i < acc->count; i++) {
+            memcpy(padded + (u64_t) i * 3, values + (u64_t) i * components, components * sizeof(f32_t));
+        }
+        reduce_bounds((const u8_t *) padded, 3 * sizeof(f32_t), acc->count, min, max);
+    }
+
+    re_arena_scratch_release(&scratch);
+    return valid;
+}
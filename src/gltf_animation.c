@@ -0,0 +1,158 @@
+#include "gltf.h"
+#include "gltf_internal.h"
+#include "job.h"
+#include "rebound.h"
+
+// Keyframes a cursor steps forward before searching instead, so seeking far
+// ahead stays logarithmic.
+#define CURSOR_MAX_STEPS 4
+
+// Instances per job batch of gltf_animation_sample_batch.
+#define ANIMATION_BATCH_SIZE 64
+
+// The last keyframe at or before time, at most the second to last one, found
+// by stepping forward from the cursor or by binary search if time went back
+// or too far ahead. time must not be before the first keyframe.
+static u32_t find_key(const f32_t *times, u32_t key_count, u32_t cursor, f32_t time) {
+    u32_t last = key_count - 2;
+    if (cursor <= last && times[cursor] <= time) {
+        for (u32_t step = 0; step < CURSOR_MAX_STEPS; step++) {
+            if (cursor == last || time < times[cursor + 1]) {
+                return cursor;
+            }
+            cursor++;
+        }
+    }
+
+    u32_t low = 0;
+    u32_t high = last;
+    while (low < high) {
+        u32_t mid = (low + high + 1) / 2;
+        if (times[mid] <= time) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+// nlerp along the shorter arc with t adjusted so the rotation keeps close to
+// the constant speed of slerp without its trigonometry, within 1e-3 radians
+// for keyframes up to half a turn apart where plain nlerp is off by 0.14.
+// Kapoulkine, "Approximating slerp", 2015.
+static HMM_Vec4 rotation_lerp(HMM_Vec4 a, HMM_Vec4 b, f32_t t) {
+    f32_t d = HMM_DotV4(a, b);
+    if (d < 0.0f) {
+        b = HMM_MulV4F(b, -1.0f);
+        d = -d;
+    }
+
+    f32_t scale = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+    f32_t offset = 0.848013f + d * (-1.06021f + d * 0.215638f);
+    f32_t k = scale * (t - 0.5f) * (t - 0.5f) + offset;
+    f32_t adjusted = t + t * (t - 0.5f) * (t - 1.0f) * k;
+    return HMM_NormV4(HMM_LerpV4(a, adjusted, b));
+}
+
+static HMM_Vec4 sample_channel(const gltf_model_t *model, gltf_channel_t channel, f32_t time, u32_t *cursor) {
+    gltf_sampler_t sampler = model->samplers[channel.sampler];
+    const f32_t *times = model->animation_times + sampler.time_offset;
+    const HMM_Vec4 *values = model->animation_values + sampler.value_offset;
+
+    // Spline keyframes are in tangent, value, out tangent.
+    b8_t cubic = sampler.interpolation == GLTF_INTERPOLATION_CUBICSPLINE;
+    u32_t stride = cubic ? 3 : 1;
+    u32_t value = cubic ? 1 : 0;
+    if (sampler.key_count == 1 || time <= times[0]) {
+        *cursor = 0;
+        return values[value];
+    }
+
+    u32_t key = find_key(times, sampler.key_count, *cursor, time);
+    *cursor = key;
+    if (time >= times[key + 1]) {
+        return values[(key + 1) * stride + value];
+    }
+
+    // Times increase, so the interval containing time isn't empty.
+    f32_t duration = times[key + 1] - times[key];
+    f32_t t = (time - times[key]) / duration;
+    b8_t rotation = channel.path == GLTF_ANIMATION_PATH_ROTATION;
+    switch (sampler.interpolation) {
+        case GLTF_INTERPOLATION_STEP:
+            return values[key];
+        case GLTF_INTERPOLATION_CUBICSPLINE: {
+            const HMM_Vec4 *k0 = values + key * 3;
+            const HMM_Vec4 *k1 = k0 + 3;
+            f32_t t2 = t * t;
+            f32_t t3 = t2 * t;
+            HMM_Vec4 result = HMM_AddV4(
+                    HMM_AddV4(HMM_MulV4F(k0[1], 2.0f * t3 - 3.0f * t2 + 1.0f), HMM_MulV4F(k0[2], duration * (t3 - 2.0f * t2 + t))),
+                    HMM_AddV4(HMM_MulV4F(k1[1], -2.0f * t3 + 3.0f * t2), HMM_MulV4F(k1[0], duration * (t3 - t2))));
+            return rotation && HMM_DotV4(result, result) > 0.0f ? HMM_NormV4(result) : result;
+        }
+        case GLTF_INTERPOLATION_LINEAR:
+        default:
+            return rotation ? rotation_lerp(values[key], values[key + 1], t) : HMM_LerpV4(values[key], t, values[key + 1]);
+    }
+}
+
+void gltf_animation_sample(const gltf_model_t *model, u32_t animation, f32_t time, u32_t *cursors, HMM_Vec4 *values) {
+    gltf_animation_t a = model->animations[animation];
+    const gltf_channel_t *channels = model->channels + a.channel_offset;
+    for (u32_t i = 0; i < a.channel_count; i++) {
+        values[i] = sample_channel(model, channels[i], time, &cursors[i]);
+    }
+}
+
+gltf_animation_player_t gltf_animation_player_new(const gltf_model_t *model, u32_t animation, u32_t count, re_arena_t *arena) {
+    u64_t channels = (u64_t) count * model->animations[animation].channel_count;
+    return (gltf_animation_player_t) {
+        animation,
+        count,
+        re_arena_push_zero(arena, count * sizeof(f32_t)),
+        re_arena_push_zero(arena, channels * sizeof(u32_t)),
+        gltf_push_aligned(arena, channels * sizeof(HMM_Vec4)),
+    };
+}
+
+typedef struct animation_job_t animation_job_t;
+struct animation_job_t {
+    const gltf_model_t *model;
+    gltf_animation_player_t *player;
+};
+
+static void sample_range(void *user, u32_t begin, u32_t end) {
+    animation_job_t *job = user;
+    gltf_animation_player_t *player = job->player;
+    u32_t channel_count = job->model->animations[player->animation].channel_count;
+    for (u32_t i = begin; i < end; i++) {
+        u64_t offset = (u64_t) i * channel_count;
+        gltf_animation_sample(job->model, player->animation, player->times[i], player->cursors + offset, player->values + offset);
+    }
+}
+
+void gltf_animation_sample_batch(const gltf_model_t *model, gltf_animation_player_t *player) {
+    animation_job_t job = {model, player};
+    job_parallel_for(player->count, ANIMATION_BATCH_SIZE, sample_range, &job);
+}
+
+void gltf_animation_apply(const gltf_model_t *model, u32_t animation, const HMM_Vec4 *values, gltf_nodes_t *nodes) {
+    gltf_animation_t a = model->animations[animation];
+    for (u32_t i = 0; i < a.channel_count; i++) {
+        gltf_channel_t channel = model->channels[a.channel_offset + i];
+        HMM_Vec4 v = values[i];
+        switch (channel.path) {
+            case GLTF_ANIMATION_PATH_TRANSLATION:
+                nodes->translation[channel.node] = v.XYZ;
+                break;
+            case GLTF_ANIMATION_PATH_ROTATION:
+                nodes->rotation[channel.node] = HMM_Q(v.X, v.Y, v.Z, v.W);
+                break;
+            case GLTF_ANIMATION_PATH_SCALE:
+                nodes->scale[channel.node] = v.XYZ;
+                break;
+        }
+    }
+}
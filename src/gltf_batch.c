@@ -0,0 +1,239 @@
+#define _XOPEN_SOURCE 700
+
+#include "gltf.h"
+#include "gltf_internal.h"
+#include "job.h"
+#include "rebound.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*=========================*/
+// Buffer cache
+/*=========================*/
+
+typedef struct buffer_entry_t buffer_entry_t;
+struct buffer_entry_t {
+    const char *path;
+    u64_t path_hash;
+    gltf_source_t source;
+    re_str_t data;
+    // First entry with this content, the one the content table points at.
+    b8_t owner;
+};
+
+struct gltf_buffer_cache_t {
+    pthread_mutex_t lock;
+    re_arena_t *arena;
+
+    buffer_entry_t *entries;
+    u32_t entry_count;
+    u32_t entry_capacity;
+
+    // Open addressing tables of entry index + 1, 0 marks an empty slot. Twice
+    // the entry capacity so they never fill up more than half way.
+    u32_t *by_path;
+    u32_t *by_content;
+    u32_t slot_count;
+
+    gltf_batch_stats_t stats;
+};
+
+static i32_t find_path(const gltf_buffer_cache_t *cache, const char *path, u64_t hash) {
+    if (cache->slot_count == 0) {
+        return -1;
+    }
+
+    u32_t mask = cache->slot_count - 1;
+    for (u32_t slot = hash & mask; cache->by_path[slot] != 0; slot = (slot + 1) & mask) {
+        const buffer_entry_t *entry = &cache->entries[cache->by_path[slot] - 1];
+        if (entry->path_hash == hash && strcmp(entry->path, path) == 0) {
+            return cache->by_path[slot] - 1;
+        }
+    }
+    return -1;
+}
+
+static i32_t find_content(const gltf_buffer_cache_t *cache, re_str_t data, u64_t hash) {
+    if (cache->slot_count == 0) {
+        return -1;
+    }
+
+    u32_t mask = cache->slot_count - 1;
+    for (u32_t slot = hash & mask; cache->by_content[slot] != 0; slot = (slot + 1) & mask) {
+        const buffer_entry_t *entry = &cache->entries[cache->by_content[slot] - 1];
+        if (entry->source.hash == hash && entry->data.len == data.len && memcmp(entry->data.str, data.str, data.len) == 0) {
+            return cache->by_content[slot] - 1;
+        }
+    }
+    return -1;
+}
+
+static void insert_slot(u32_t *table, u32_t slot_count, u64_t hash, u32_t entry) {
+    u32_t slot = hash & (slot_count - 1);
+    while (table[slot] != 0) {
+        slot = (slot + 1) & (slot_count - 1);
+    }
+    table[slot] = entry + 1;
+}
+
+// Old arrays stay in the arena, like everything grown through arenas here.
+static void grow_entries(gltf_buffer_cache_t *cache) {
+    u32_t capacity = cache->entry_capacity == 0 ? 64 : cache->entry_capacity * 2;
+    buffer_entry_t *entries = re_arena_push(cache->arena, capacity * sizeof(buffer_entry_t));
+    if (cache->entry_count > 0) {
+        memcpy(entries, cache->entries, cache->entry_count * sizeof(buffer_entry_t));
+    }
+    cache->entries = entries;
+    cache->entry_capacity = capacity;
+
+    cache->slot_count = capacity * 2;
+    cache->by_path = re_arena_push_zero(cache->arena, cache->slot_count * sizeof(u32_t));
+    cache->by_content = re_arena_push_zero(cache->arena, cache->slot_count * sizeof(u32_t));
+    for (u32_t i = 0; i < cache->entry_count; i++) {
+        insert_slot(cache->by_path, cache->slot_count, entries[i].path_hash, i);
+        if (entries[i].owner) {
+            insert_slot(cache->by_content, cache->slot_count, entries[i].source.hash, i);
+        }
+    }
+}
+
+re_str_t gltf_buffer_cache_read(gltf_buffer_cache_t *cache, const char *path, gltf_source_t *source) {
+    // Different relative paths to one file share an entry.
+    char resolved[PATH_MAX];
+    if (realpath(path, resolved) != NULL) {
+        path = resolved;
+    }
+    u64_t path_hash = gltf_hash(path, strlen(path), 0);
+
+    pthread_mutex_lock(&cache->lock);
+    i32_t entry = find_path(cache, path, path_hash);
+    if (entry >= 0) {
+        re_str_t data = cache->entries[entry].data;
+        *source = cache->entries[entry].source;
+        cache->stats.path_hits++;
+        cache->stats.bytes_shared += data.len;
+        pthread_mutex_unlock(&cache->lock);
+        return data;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    // Read without holding the lock so other threads can use the cache
+    // meanwhile. Two threads may both read a new file, the second one then
+    // finds the first one's entry below.
+    re_arena_temp_t scratch = re_arena_scratch_get(&cache->arena, 1);
+    re_str_t content = gltf_source_read(path, source, scratch.arena);
+    if (content.str == NULL) {
+        re_arena_scratch_release(&scratch);
+        return content;
+    }
+    u64_t content_hash = source->hash;
+
+    pthread_mutex_lock(&cache->lock);
+    cache->stats.buffer_reads++;
+    cache->stats.bytes_read += content.len;
+
+    entry = find_path(cache, path, path_hash);
+    if (entry < 0) {
+        if (cache->entry_count == cache->entry_capacity) {
+            grow_entries(cache);
+        }
+
+        buffer_entry_t new_entry = {
+            .path = gltf_path_join(re_str_lit(""), re_str_cstr(path), cache->arena),
+            .path_hash = path_hash,
+            .source = *source,
+        };
+
+        i32_t same = find_content(cache, content, content_hash);
+        if (same >= 0) {
+            new_entry.data = cache->entries[same].data;
+            cache->stats.content_hits++;
+            cache->stats.bytes_shared += content.len;
+        } else {
+            u8_t *data = gltf_push_aligned(cache->arena, content.len);
+            memcpy(data, content.str, content.len);
+            new_entry.data = re_str(data, content.len);
+            new_entry.owner = true;
+        }
+
+        entry = cache->entry_count++;
+        cache->entries[entry] = new_entry;
+        insert_slot(cache->by_path, cache->slot_count, path_hash, entry);
+        if (new_entry.owner) {
+            insert_slot(cache->by_content, cache->slot_count, content_hash, entry);
+        }
+    }
+    re_str_t data = cache->entries[entry].data;
+    *source = cache->entries[entry].source;
+    pthread_mutex_unlock(&cache->lock);
+
+    re_arena_scratch_release(&scratch);
+    return data;
+}
+
+/*=========================*/
+// Batch
+/*=========================*/
+
+typedef struct batch_t batch_t;
+struct batch_t {
+    const char **paths;
+    u32_t process;
+    gltf_batch_fn_t fn;
+    void *user;
+    gltf_buffer_cache_t *cache;
+
+    // Accessed atomically.
+    u32_t loaded;
+    u32_t failed;
+};
+
+static void load_batch(void *user, u32_t begin, u32_t end) {
+    batch_t *batch = user;
+
+    for (u32_t i = begin; i < end; i++) {
+        // Every model this thread loads reuses the same scratch memory, never
+        // the arena shared buffers are pushed to.
+        re_arena_temp_t scratch = re_arena_scratch_get(&batch->cache->arena, 1);
+        gltf_model_t model = gltf_load_cached(batch->paths[i], batch->process, batch->cache, scratch.arena);
+
+        if (model.buffers != NULL) {
+            batch->fn(batch->user, i, &model);
+            __atomic_fetch_add(&batch->loaded, 1, __ATOMIC_RELAXED);
+        } else {
+            __atomic_fetch_add(&batch->failed, 1, __ATOMIC_RELAXED);
+        }
+
+        gltf_unload(&model);
+        re_arena_scratch_release(&scratch);
+    }
+}
+
+gltf_batch_stats_t gltf_load_batch(const char **paths, u32_t count, u32_t process, gltf_batch_fn_t fn, void *user, re_arena_t *arena) {
+    f64_t start = re_os_get_time();
+
+    gltf_buffer_cache_t cache = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .arena = arena,
+    };
+    batch_t batch = {paths, process, fn, user, &cache, 0, 0};
+
+    // One model per job, models differ too much in size for larger batches
+    // to balance.
+    job_parallel_for(count, 1, load_batch, &batch);
+
+    gltf_batch_stats_t stats = cache.stats;
+    stats.loaded = batch.loaded;
+    stats.failed = batch.failed;
+    stats.seconds = re_os_get_time() - start;
+
+    re_log_info("Loaded %u of %u models in %.2f s, %.1f models per second.",
+            stats.loaded, count, stats.seconds, stats.seconds > 0.0 ? stats.loaded / stats.seconds : 0.0);
+    re_log_info("Read %u buffer files, %.2f MB. Shared %u by path and %u by content, %.2f MB.",
+            stats.buffer_reads, (f64_t) stats.bytes_read / MB(1), stats.path_hits, stats.content_hits, (f64_t) stats.bytes_shared / MB(1));
+
+    return stats;
+}
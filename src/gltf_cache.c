@@ -0,0 +1,654 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "gltf.h"
+#include "gltf_internal.h"
+#include "mesh.h"
+#include "rebound.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define GLTF_CACHE_MAGIC 0x43544c47
+#define GLTF_CACHE_VERSION 17
+#define GLTF_CACHE_ALIGN 16
+
+// Every plain array in gltf_model_t that gets stored in the cache.
+// Adding an array to the model only requires adding it here.
+#define GLTF_CACHE_SECTIONS(X) \
+    X(views, views, view_count) \
+    X(accessors, accessors, accessor_count) \
+    X(positions, primitives.attributes[GLTF_ATTRIBUTE_POSITION], primitives.count) \
+    X(normals, primitives.attributes[GLTF_ATTRIBUTE_NORMAL], primitives.count) \
+    X(uvs, primitives.attributes[GLTF_ATTRIBUTE_TEXCOORD_0], primitives.count) \
+    X(tangents, primitives.attributes[GLTF_ATTRIBUTE_TANGENT], primitives.count) \
+    X(joints, primitives.attributes[GLTF_ATTRIBUTE_JOINTS_0], primitives.count) \
+    X(weights, primitives.attributes[GLTF_ATTRIBUTE_WEIGHTS_0], primitives.count) \
+    X(indices, primitives.indices, primitives.count) \
+    X(modes, primitives.mode, primitives.count) \
+    X(materials, primitives.material, primitives.count) \
+    X(lod_offsets, primitives.lod_offset, primitives.count) \
+    X(lod_counts, primitives.lod_count, primitives.count) \
+    X(lods, lods, lod_count) \
+    X(meshlet_offsets, primitives.meshlet_offset, primitives.count) \
+    X(meshlet_counts, primitives.meshlet_count, primitives.count) \
+    X(meshlets, meshlets, meshlet_count) \
+    X(meshlet_vertices, meshlet_vertices, meshlet_vertex_count) \
+    X(meshlet_indices, meshlet_indices, meshlet_index_count) \
+    X(primitive_bounds, primitives.bounds, primitives.count) \
+    X(mesh_bvhs, mesh_bvhs, mesh_bvh_count) \
+    X(scene_bvhs, scene_bvhs, scene_bvh_count) \
+    X(bvh_nodes, bvh_nodes, bvh_node_count) \
+    X(bvh_items, bvh_items, bvh_item_count) \
+    X(meshes, meshes, mesh_count) \
+    X(node_parents, nodes.parent, nodes.count) \
+    X(node_meshes, nodes.mesh, nodes.count) \
+    X(node_translations, nodes.translation, nodes.count) \
+    X(node_rotations, nodes.rotation, nodes.count) \
+    X(node_scales, nodes.scale, nodes.count) \
+    X(node_worlds, nodes.world, nodes.count) \
+    X(node_skins, nodes.skin, nodes.count) \
+    X(node_levels, nodes.levels, nodes.level_count) \
+    X(scenes, scenes, scene_count) \
+    X(scene_roots, scene_roots, scene_root_count) \
+    X(skins, skins, skin_count) \
+    X(skin_joints, skin_joints, skin_joint_count) \
+    X(inverse_binds, inverse_binds, skin_joint_count) \
+    X(animations, animations, animation_count) \
+    X(channels, channels, channel_count) \
+    X(samplers, samplers, sampler_count) \
+    X(animation_times, animation_times, animation_time_count) \
+    X(animation_values, animation_values, animation_value_count)
+
+typedef enum {
+#define X(name, field, field_count) GLTF_CACHE_SECTION_##name,
+    GLTF_CACHE_SECTIONS(X)
+#undef X
+    GLTF_CACHE_SECTION_COUNT,
+} gltf_cache_section_kind_t;
+
+typedef struct gltf_cache_blob_t gltf_cache_blob_t;
+struct gltf_cache_blob_t {
+    u64_t offset;
+    u64_t size;
+};
+
+typedef struct gltf_cache_section_t gltf_cache_section_t;
+struct gltf_cache_section_t {
+    gltf_cache_blob_t blob;
+    u32_t count;
+    u32_t stride;
+};
+
+typedef struct gltf_cache_buffer_t gltf_cache_buffer_t;
+struct gltf_cache_buffer_t {
+    gltf_cache_blob_t data;
+    gltf_cache_blob_t uri;
+};
+
+// A buffer holding one index accessor, stored with mesh_encode_indices.
+typedef struct gltf_cache_index_stream_t gltf_cache_index_stream_t;
+struct gltf_cache_index_stream_t {
+    u32_t buffer;
+    gltf_comp_type_t comp_type;
+    u32_t count;
+    gltf_cache_blob_t data;
+};
+
+// A source file the cache was built from. Dependency 0 is the .gltf itself,
+// the rest are the buffers loaded from files.
+typedef struct gltf_cache_dep_t gltf_cache_dep_t;
+struct gltf_cache_dep_t {
+    gltf_cache_blob_t uri;
+    u64_t size;
+    i64_t mtime;
+    u64_t hash;
+};
+
+typedef struct gltf_cache_header_t gltf_cache_header_t;
+struct gltf_cache_header_t {
+    u32_t magic;
+    u32_t version;
+    u64_t size;
+
+    u32_t dep_count;
+    u32_t buffer_count;
+    i32_t scene;
+    u32_t extensions;
+    // Draco primitives were decoded instead of falling back, the cache is
+    // stale once a decoder is set if they weren't.
+    u32_t draco_decoded;
+    // gltf_process_t bits the model was processed with.
+    u32_t process;
+    // LOD settings of the build, see GLTF_LOD_MAX_LEVELS.
+    u32_t lod_levels;
+    f32_t lod_ratio;
+    f32_t lod_max_error;
+    u32_t meshlet_max_vertices;
+    u32_t meshlet_max_triangles;
+    f32_t normal_crease_angle;
+    gltf_cache_blob_t deps;
+    gltf_cache_blob_t buffers;
+    u32_t index_stream_count;
+    gltf_cache_blob_t index_streams;
+
+    gltf_cache_section_t sections[GLTF_CACHE_SECTION_COUNT];
+};
+
+/*=========================*/
+// Dependencies
+/*=========================*/
+
+typedef struct file_stat_t file_stat_t;
+struct file_stat_t {
+    b8_t exists;
+    u64_t size;
+    i64_t mtime;
+};
+
+static file_stat_t file_stat(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return (file_stat_t) {0};
+    }
+
+    return (file_stat_t) {
+        true,
+        st.st_size,
+        (i64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec,
+    };
+}
+
+// mtime is set to the file's current one when it is still valid.
+static b8_t dep_valid(const gltf_cache_dep_t *dep, const char *path, i64_t *mtime, re_arena_t *arena) {
+    file_stat_t st = file_stat(path);
+    if (!st.exists || st.size != dep->size) {
+        return false;
+    }
+
+    *mtime = st.mtime;
+    if (st.mtime == dep->mtime) {
+        return true;
+    }
+
+    // The file was touched, only the content decides if it changed.
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    re_str_t content = re_file_read(path, scratch.arena);
+    b8_t valid = content.str != NULL && gltf_hash(content.str, content.len, 0) == dep->hash;
+    re_arena_scratch_release(&scratch);
+
+    return valid;
+}
+
+// Stats before reading, a write in between leaves a newer mtime than the
+// one kept and only costs a hash on the next load.
+re_str_t gltf_source_read(const char *path, gltf_source_t *source, re_arena_t *arena) {
+    file_stat_t st = file_stat(path);
+    re_str_t content = re_file_read(path, arena);
+    if (content.str == NULL) {
+        *source = (gltf_source_t) {0};
+        return content;
+    }
+
+    *source = (gltf_source_t) {
+        content.len,
+        st.mtime,
+        gltf_hash(content.str, content.len, 0),
+    };
+    return content;
+}
+
+// Stores the mtimes of dependencies that were touched without changing, so
+// later loads compare them again instead of hashing. Only done while the
+// cache is still the file that was mapped, a writer may have renamed a new
+// one over it. A failed or torn write only costs the hash again.
+static void refresh_dep_mtimes(const char *cache_path, const struct stat *mapped, u64_t deps_offset, const gltf_cache_dep_t *deps, const i64_t *mtimes, u32_t count) {
+    i32_t fd = open(cache_path, O_WRONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_dev == mapped->st_dev && st.st_ino == mapped->st_ino) {
+        for (u32_t i = 0; i < count; i++) {
+            u64_t offset = deps_offset + i * sizeof(gltf_cache_dep_t) + offsetof(gltf_cache_dep_t, mtime);
+            if (mtimes[i] != deps[i].mtime && pwrite(fd, &mtimes[i], sizeof(i64_t), offset) != sizeof(i64_t)) {
+                break;
+            }
+        }
+    }
+    close(fd);
+}
+
+// Sources are described as read, before the loaded buffers are modified in
+// place.
+static gltf_cache_dep_t dep_from_source(gltf_source_t source) {
+    return (gltf_cache_dep_t) {
+        .size = source.size,
+        .mtime = source.mtime,
+        .hash = source.hash,
+    };
+}
+
+/*=========================*/
+// Reading
+/*=========================*/
+
+static b8_t blob_in_bounds(gltf_cache_blob_t blob, u64_t size) {
+    return blob.offset <= size && blob.size <= size - blob.offset;
+}
+
+static b8_t decode_index_stream(const gltf_cache_index_stream_t *stream, const u8_t *base, re_str_t *buffer, re_arena_t *arena) {
+    u32_t index_size = gltf_comp_size(stream->comp_type);
+    u8_t *data = gltf_push_aligned(arena, (u64_t) stream->count * index_size);
+
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    u32_t *indices = re_arena_push(scratch.arena, stream->count * sizeof(u32_t));
+    b8_t valid = mesh_decode_indices(indices, stream->count, base + stream->data.offset, stream->data.size);
+    for (u32_t i = 0; i < stream->count && valid; i++) {
+        switch (stream->comp_type) {
+            case GLTF_COMP_TYPE_UNSIGNED_BYTE:  data[i] = indices[i]; break;
+            case GLTF_COMP_TYPE_UNSIGNED_SHORT: ((u16_t *) data)[i] = indices[i]; break;
+            default:                            ((u32_t *) data)[i] = indices[i]; break;
+        }
+    }
+    re_arena_scratch_release(&scratch);
+
+    *buffer = re_str(data, (u64_t) stream->count * index_size);
+    return valid;
+}
+
+static b8_t gltf_cache_read(const char *path, const char *cache_path, u32_t process, gltf_model_t *model, re_arena_t *arena) {
+    i32_t fd = open(cache_path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (u64_t) st.st_size < sizeof(gltf_cache_header_t)) {
+        close(fd);
+        return false;
+    }
+
+    // Private mapping so the model can be modified in place without touching
+    // the file.
+    u8_t *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    const gltf_cache_header_t *header = (const gltf_cache_header_t *) base;
+    u64_t size = st.st_size;
+
+    b8_t valid = header->magic == GLTF_CACHE_MAGIC &&
+        header->version == GLTF_CACHE_VERSION &&
+        header->size == size &&
+        blob_in_bounds(header->deps, size) &&
+        blob_in_bounds(header->buffers, size) &&
+        header->deps.size == header->dep_count * sizeof(gltf_cache_dep_t) &&
+        header->buffers.size == header->buffer_count * sizeof(gltf_cache_buffer_t) &&
+        blob_in_bounds(header->index_streams, size) &&
+        header->index_streams.size == header->index_stream_count * sizeof(gltf_cache_index_stream_t) &&
+        header->dep_count > 0 &&
+        header->process == process &&
+        header->lod_levels == GLTF_LOD_MAX_LEVELS &&
+        header->lod_ratio == GLTF_LOD_RATIO &&
+        header->lod_max_error == GLTF_LOD_MAX_ERROR &&
+        header->meshlet_max_vertices == GLTF_MESHLET_MAX_VERTICES &&
+        header->meshlet_max_triangles == GLTF_MESHLET_MAX_TRIANGLES &&
+        header->normal_crease_angle == GLTF_NORMAL_CREASE_ANGLE &&
+        (header->draco_decoded || !(header->extensions & GLTF_EXTENSION_KHR_DRACO_MESH_COMPRESSION) || !gltf_draco_available());
+
+#define X(name, field, field_count) \
+    valid = valid && \
+        blob_in_bounds(header->sections[GLTF_CACHE_SECTION_##name].blob, size) && \
+        header->sections[GLTF_CACHE_SECTION_##name].stride == sizeof(*model->field) && \
+        header->sections[GLTF_CACHE_SECTION_##name].blob.size == \
+            (u64_t) header->sections[GLTF_CACHE_SECTION_##name].count * sizeof(*model->field);
+    GLTF_CACHE_SECTIONS(X)
+#undef X
+
+    // Sections sharing a count, like every primitive array, must agree on
+    // it, the model only keeps one.
+    gltf_model_t counts = {0};
+#define X(name, field, field_count) \
+    counts.field_count = header->sections[GLTF_CACHE_SECTION_##name].count;
+    GLTF_CACHE_SECTIONS(X)
+#undef X
+#define X(name, field, field_count) \
+    valid = valid && header->sections[GLTF_CACHE_SECTION_##name].count == counts.field_count;
+    GLTF_CACHE_SECTIONS(X)
+#undef X
+
+    if (!valid) {
+        munmap(base, size);
+        return false;
+    }
+
+    const gltf_cache_dep_t *deps = (const gltf_cache_dep_t *) (base + header->deps.offset);
+    const gltf_cache_buffer_t *buffers = (const gltf_cache_buffer_t *) (base + header->buffers.offset);
+
+    for (u32_t i = 0; i < header->buffer_count && valid; i++) {
+        valid = blob_in_bounds(buffers[i].data, size) && blob_in_bounds(buffers[i].uri, size);
+    }
+
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    re_str_t dir = gltf_path_dir(re_str_cstr(path));
+    i64_t *mtimes = re_arena_push(scratch.arena, header->dep_count * sizeof(i64_t));
+    b8_t touched = false;
+    for (u32_t i = 0; i < header->dep_count && valid; i++) {
+        if (!blob_in_bounds(deps[i].uri, size)) {
+            valid = false;
+        } else if (i == 0) {
+            valid = dep_valid(&deps[i], path, &mtimes[i], arena);
+        } else {
+            re_str_t uri = re_str(base + deps[i].uri.offset, deps[i].uri.size);
+            valid = dep_valid(&deps[i], gltf_path_join(dir, uri, scratch.arena), &mtimes[i], arena);
+        }
+        touched |= valid && mtimes[i] != deps[i].mtime;
+    }
+    if (valid && touched) {
+        refresh_dep_mtimes(cache_path, &st, header->deps.offset, deps, mtimes, header->dep_count);
+    }
+    re_arena_scratch_release(&scratch);
+
+    if (!valid) {
+        munmap(base, size);
+        return false;
+    }
+
+    // The mapping stays alive for as long as the model, the same way arena
+    // memory does.
+    gltf_model_t result = {0};
+
+    result.scene = header->scene;
+    result.extensions = header->extensions;
+    result.buffer_count = header->buffer_count;
+    result.buffers = re_arena_push(arena, result.buffer_count * sizeof(re_str_t));
+    result.buffer_uris = re_arena_push(arena, result.buffer_count * sizeof(re_str_t));
+    for (u32_t i = 0; i < result.buffer_count; i++) {
+        result.buffers[i] = re_str(base + buffers[i].data.offset, buffers[i].data.size);
+        result.buffer_uris[i] = re_str(base + buffers[i].uri.offset, buffers[i].uri.size);
+    }
+
+    const gltf_cache_index_stream_t *streams = (const gltf_cache_index_stream_t *) (base + header->index_streams.offset);
+    for (u32_t i = 0; i < header->index_stream_count && valid; i++) {
+        valid = streams[i].buffer < result.buffer_count &&
+            blob_in_bounds(streams[i].data, size) &&
+            decode_index_stream(&streams[i], base, &result.buffers[streams[i].buffer], arena);
+    }
+    if (!valid) {
+        munmap(base, size);
+        return false;
+    }
+
+#define X(name, field, field_count) \
+    result.field = (void *) (base + header->sections[GLTF_CACHE_SECTION_##name].blob.offset); \
+    result.field_count = header->sections[GLTF_CACHE_SECTION_##name].count;
+    GLTF_CACHE_SECTIONS(X)
+#undef X
+
+    result.cache_mapping = re_str(base, size);
+    result.arena = arena;
+    *model = result;
+    return true;
+}
+
+/*=========================*/
+// Writing
+/*=========================*/
+
+typedef struct cache_writer_t cache_writer_t;
+struct cache_writer_t {
+    FILE *file;
+    u64_t pos;
+    b8_t failed;
+};
+
+static gltf_cache_blob_t cache_write(cache_writer_t *writer, const void *data, u64_t size) {
+    static const u8_t padding[GLTF_CACHE_ALIGN] = {0};
+
+    u64_t aligned = (writer->pos + GLTF_CACHE_ALIGN - 1) & ~(u64_t) (GLTF_CACHE_ALIGN - 1);
+    if (aligned != writer->pos) {
+        writer->failed |= fwrite(padding, aligned - writer->pos, 1, writer->file) != 1;
+        writer->pos = aligned;
+    }
+
+    if (size > 0) {
+        writer->failed |= fwrite(data, size, 1, writer->file) != 1;
+    }
+
+    gltf_cache_blob_t blob = {writer->pos, size};
+    writer->pos += size;
+    return blob;
+}
+
+// Buffers only holding index data are stored encoded, one index accessor
+// each, or left out once no accessor reads them. Processing leaves the index
+// buffers it replaced behind.
+#define BUFFER_RAW -1
+#define BUFFER_UNUSED -2
+
+static void classify_buffers(const gltf_model_t *model, i32_t *kinds, re_arena_t *arena) {
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+
+    // Accessor reading each view, -2 when several do.
+    i32_t *view_accessor = re_arena_push(scratch.arena, model->view_count * sizeof(i32_t));
+    for (u32_t i = 0; i < model->view_count; i++) {
+        view_accessor[i] = -1;
+    }
+    for (u32_t i = 0; i < model->accessor_count; i++) {
+        const gltf_accessor_t *acc = &model->accessors[i];
+        if (acc->view >= 0 && (u32_t) acc->view < model->view_count) {
+            view_accessor[acc->view] = view_accessor[acc->view] == -1 ? (i32_t) i : -2;
+        }
+        if (acc->sparse.count > 0 && acc->sparse.indices_view < model->view_count && acc->sparse.values_view < model->view_count) {
+            view_accessor[acc->sparse.indices_view] = -2;
+            view_accessor[acc->sparse.values_view] = -2;
+        }
+    }
+
+    u32_t *view_counts = re_arena_push_zero(scratch.arena, model->buffer_count * sizeof(u32_t));
+    i32_t *buffer_view = re_arena_push(scratch.arena, model->buffer_count * sizeof(i32_t));
+    b8_t *read = re_arena_push_zero(scratch.arena, model->buffer_count * sizeof(b8_t));
+    b8_t *indices_only = re_arena_push(scratch.arena, model->buffer_count * sizeof(b8_t));
+    for (u32_t i = 0; i < model->buffer_count; i++) {
+        indices_only[i] = true;
+    }
+    for (u32_t i = 0; i < model->view_count; i++) {
+        gltf_buffer_view_t view = model->views[i];
+        if (view.buffer >= model->buffer_count) {
+            continue;
+        }
+        indices_only[view.buffer] &= view.target == GLTF_BUFFER_TARGET_ELEMENT_ARRAY;
+        read[view.buffer] |= view_accessor[i] != -1;
+        view_counts[view.buffer]++;
+        buffer_view[view.buffer] = i;
+    }
+
+    for (u32_t i = 0; i < model->buffer_count; i++) {
+        kinds[i] = BUFFER_RAW;
+        if (!indices_only[i] || view_counts[i] == 0) {
+            continue;
+        }
+        if (!read[i]) {
+            kinds[i] = BUFFER_UNUSED;
+            continue;
+        }
+
+        gltf_buffer_view_t view = model->views[buffer_view[i]];
+        i32_t accessor = view_accessor[buffer_view[i]];
+        if (view_counts[i] != 1 || accessor < 0 || view.offset != 0 || view.length != model->buffers[i].len) {
+            continue;
+        }
+
+        const gltf_accessor_t *acc = &model->accessors[accessor];
+        b8_t index_type = acc->comp_type == GLTF_COMP_TYPE_UNSIGNED_BYTE ||
+            acc->comp_type == GLTF_COMP_TYPE_UNSIGNED_SHORT ||
+            acc->comp_type == GLTF_COMP_TYPE_UNSIGNED_INT;
+        if (index_type && acc->type == GLTF_ACCESSOR_TYPE_SCALAR && acc->offset == 0 && view.stride == 0 &&
+                (u64_t) acc->count * gltf_comp_size(acc->comp_type) == view.length) {
+            kinds[i] = accessor;
+        }
+    }
+
+    re_arena_scratch_release(&scratch);
+}
+
+static void gltf_cache_write(const char *cache_path, u32_t process, const gltf_model_t *model) {
+    re_arena_t *arena = model->arena;
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+
+    // Write to a temporary file and rename it over the old cache so a reader
+    // never sees a half written file. Every writer gets its own, a batch may
+    // load the same model on several threads.
+    static u32_t temp_counter = 0;
+    u64_t temp_len = strlen(cache_path) + 32;
+    char *temp_path = re_arena_push(scratch.arena, temp_len);
+    snprintf(temp_path, temp_len, "%s.%ld.%u.tmp", cache_path, (long) getpid(), __atomic_fetch_add(&temp_counter, 1, __ATOMIC_RELAXED));
+    cache_writer_t writer = {fopen(temp_path, "wb"), 0, false};
+    if (writer.file == NULL) {
+        re_log_error("Couldn't create model cache %s.", temp_path);
+        re_arena_scratch_release(&scratch);
+        return;
+    }
+
+    gltf_cache_header_t header = {
+        .magic = GLTF_CACHE_MAGIC,
+        .version = GLTF_CACHE_VERSION,
+        .buffer_count = model->buffer_count,
+        .scene = model->scene,
+        .extensions = model->extensions,
+        .draco_decoded = gltf_draco_available(),
+        .process = process,
+        .lod_levels = GLTF_LOD_MAX_LEVELS,
+        .lod_ratio = GLTF_LOD_RATIO,
+        .lod_max_error = GLTF_LOD_MAX_ERROR,
+        .meshlet_max_vertices = GLTF_MESHLET_MAX_VERTICES,
+        .meshlet_max_triangles = GLTF_MESHLET_MAX_TRIANGLES,
+        .normal_crease_angle = GLTF_NORMAL_CREASE_ANGLE,
+    };
+    cache_write(&writer, &header, sizeof(header));
+
+    gltf_cache_dep_t *deps = re_arena_push_zero(scratch.arena, (model->buffer_count + 1) * sizeof(gltf_cache_dep_t));
+    gltf_cache_buffer_t *buffers = re_arena_push_zero(scratch.arena, header.buffer_count * sizeof(gltf_cache_buffer_t));
+
+    i32_t *kinds = re_arena_push(scratch.arena, model->buffer_count * sizeof(i32_t));
+    classify_buffers(model, kinds, scratch.arena);
+    gltf_cache_index_stream_t *streams = re_arena_push(scratch.arena, model->buffer_count * sizeof(gltf_cache_index_stream_t));
+    u64_t raw_index_bytes = 0;
+    u64_t encoded_index_bytes = 0;
+    u64_t unused_bytes = 0;
+
+    deps[header.dep_count++] = dep_from_source(model->source);
+    for (u32_t i = 0; i < model->buffer_count; i++) {
+        re_str_t uri = model->buffer_uris[i];
+        // Index orders the codec doesn't suit, like ones not optimized for
+        // vertex fetch, can come out larger and stay raw.
+        b8_t encoded = false;
+        if (kinds[i] >= 0) {
+            const gltf_accessor_t *acc = &model->accessors[kinds[i]];
+            re_arena_temp_t temp = re_arena_scratch_get(&arena, 1);
+            u32_t *indices = re_arena_push(temp.arena, acc->count * sizeof(u32_t));
+            u8_t *data = re_arena_push(temp.arena, mesh_encode_indices_bound(acc->count));
+            gltf_accessor_read_u32(model, kinds[i], indices);
+            u64_t encoded_size = mesh_encode_indices(data, indices, acc->count);
+
+            if (encoded_size < model->buffers[i].len) {
+                streams[header.index_stream_count++] = (gltf_cache_index_stream_t) {
+                    i,
+                    acc->comp_type,
+                    acc->count,
+                    cache_write(&writer, data, encoded_size),
+                };
+                buffers[i].data = cache_write(&writer, NULL, 0);
+                raw_index_bytes += model->buffers[i].len;
+                encoded_index_bytes += encoded_size;
+                encoded = true;
+            }
+            re_arena_scratch_release(&temp);
+        }
+
+        if (kinds[i] == BUFFER_UNUSED) {
+            buffers[i].data = cache_write(&writer, NULL, 0);
+            unused_bytes += model->buffers[i].len;
+        } else if (!encoded) {
+            buffers[i].data = cache_write(&writer, model->buffers[i].str, model->buffers[i].len);
+        }
+        buffers[i].uri = cache_write(&writer, uri.str, uri.len);
+
+        // Buffers created while loading have no file to depend on.
+        if (uri.len > 0) {
+            deps[header.dep_count] = dep_from_source(model->buffer_sources[i]);
+            deps[header.dep_count].uri = buffers[i].uri;
+            header.dep_count++;
+        }
+    }
+
+    header.deps = cache_write(&writer, deps, header.dep_count * sizeof(gltf_cache_dep_t));
+    header.buffers = cache_write(&writer, buffers, header.buffer_count * sizeof(gltf_cache_buffer_t));
+    header.index_streams = cache_write(&writer, streams, header.index_stream_count * sizeof(gltf_cache_index_stream_t));
+
+#define X(name, field, field_count) \
+    header.sections[GLTF_CACHE_SECTION_##name] = (gltf_cache_section_t) { \
+        cache_write(&writer, model->field, model->field_count * sizeof(*model->field)), \
+        model->field_count, \
+        sizeof(*model->field), \
+    };
+    GLTF_CACHE_SECTIONS(X)
+#undef X
+
+    header.size = writer.pos;
+    writer.failed |= fseek(writer.file, 0, SEEK_SET) != 0;
+    writer.failed |= fwrite(&header, sizeof(header), 1, writer.file) != 1;
+    writer.failed |= fclose(writer.file) != 0;
+
+    if (writer.failed || rename(temp_path, cache_path) != 0) {
+        re_log_error("Couldn't write model cache %s.", cache_path);
+        remove(temp_path);
+    } else if (header.index_stream_count > 0 || unused_bytes > 0) {
+        re_log_info("Cached %u index buffers in %.2f MB instead of %.2f MB, left out %.2f MB of unused index buffers.",
+                header.index_stream_count,
+                (f64_t) encoded_index_bytes / MB(1),
+                (f64_t) raw_index_bytes / MB(1),
+                (f64_t) unused_bytes / MB(1));
+    }
+
+    re_arena_scratch_release(&scratch);
+}
+
+gltf_model_t gltf_load(const char *path, u32_t process, re_arena_t *arena) {
+    return gltf_load_cached(path, process, NULL, arena);
+}
+
+gltf_model_t gltf_load_cached(const char *path, u32_t process, gltf_buffer_cache_t *cache, re_arena_t *arena) {
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    char *cache_path = gltf_path_join(re_str_cstr(path), re_str_lit(".cache"), scratch.arena);
+
+    gltf_model_t model;
+    if (gltf_cache_read(path, cache_path, process, &model, arena)) {
+        re_arena_scratch_release(&scratch);
+        return model;
+    }
+
+    model = gltf_parse_cached(path, cache, arena);
+    if (model.buffers != NULL) {
+        gltf_process(&model, process, arena);
+        gltf_cache_write(cache_path, process, &model);
+    }
+
+    re_arena_scratch_release(&scratch);
+    return model;
+}
+
+void gltf_unload(gltf_model_t *model) {
+    if (model->cache_mapping.str != NULL) {
+        munmap(model->cache_mapping.str, model->cache_mapping.len);
+    }
+    *model = (gltf_model_t) {0};
+}
@@ -0,0 +1,194 @@
+#include "gltf.h"
+#include "gltf_internal.h"
+#include "job.h"
+#include "rebound.h"
+
+#include "json.h"
+
+// Accessed atomically, it may be set while other threads are loading.
+static gltf_draco_decoder_t draco_decoder = NULL;
+
+void gltf_set_draco_decoder(gltf_draco_decoder_t decoder) {
+    __atomic_store_n(&draco_decoder, decoder, __ATOMIC_RELEASE);
+}
+
+b8_t gltf_draco_available(void) {
+    return __atomic_load_n(&draco_decoder, __ATOMIC_ACQUIRE) != NULL;
+}
+
+// Accessors that receive the decoded data of one primitive.
+typedef struct draco_target_t draco_target_t;
+struct draco_target_t {
+    u32_t primitive;
+    i32_t attributes[GLTF_ATTRIBUTE_COUNT];
+    i32_t indices;
+};
+
+typedef struct draco_job_t draco_job_t;
+struct draco_job_t {
+    gltf_draco_decoder_t decoder;
+    const gltf_draco_primitive_t *primitives;
+    b8_t *decoded;
+    f64_t *times;
+};
+
+static void draco_job(void *user, u32_t begin, u32_t end) {
+    draco_job_t *job = user;
+    for (u32_t i = begin; i < end; i++) {
+        f64_t start = re_os_get_time();
+        job->decoded[i] = job->decoder(&job->primitives[i]);
+        job->times[i] = re_os_get_time() - start;
+    }
+}
+
+static json_object_t draco_extension(json_object_t json_prim) {
+    return json_object(json_object(json_prim, re_str_lit("extensions")), re_str_lit("KHR_draco_mesh_compression"));
+}
+
+// Sets up the decoder input of one primitive, with outputs allocated in the
+// arena. Returns false if the compressed data can't be located.
+static b8_t setup_primitive(
+        json_object_t ext,
+        const gltf_model_t *model,
+        u32_t prim,
+        gltf_draco_primitive_t *out,
+        draco_target_t *target,
+        re_arena_t *arena) {
+    i32_t view_index = json_int(json_object(ext, re_str_lit("bufferView")));
+    if (view_index < 0 || (u32_t) view_index >= model->view_count) {
+        return false;
+    }
+
+    gltf_buffer_view_t view = model->views[view_index];
+    if (view.buffer >= model->buffer_count ||
+            (u64_t) view.offset + view.length > model->buffers[view.buffer].len) {
+        return false;
+    }
+
+    *out = (gltf_draco_primitive_t) {0};
+    out->data = model->buffers[view.buffer].str + view.offset;
+    out->size = view.length;
+
+    target->primitive = prim;
+    for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+        out->attribute_ids[attrib] = -1;
+        target->attributes[attrib] = -1;
+    }
+
+    json_object_t json_attributes = json_object(ext, re_str_lit("attributes"));
+    for (u32_t i = 0; i < json_attributes.value.object.count; i++) {
+        i32_t attrib = gltf_attribute_from_name(json_attributes.value.object.keys[i]);
+        if (attrib < 0) {
+            continue;
+        }
+
+        i32_t accessor = model->primitives.attributes[attrib][prim];
+        if (accessor < 0) {
+            continue;
+        }
+
+        const gltf_accessor_t *acc = &model->accessors[accessor];
+        out->attribute_ids[attrib] = json_int(json_attributes.value.object.values[i]);
+        out->attributes[attrib] = acc;
+        out->attribute_data[attrib] = gltf_push_aligned(arena, (u64_t) acc->count * gltf_accessor_element_size(acc));
+        target->attributes[attrib] = accessor;
+    }
+
+    target->indices = model->primitives.indices[prim];
+    if (target->indices >= 0) {
+        const gltf_accessor_t *acc = &model->accessors[target->indices];
+        out->indices = acc;
+        out->index_data = gltf_push_aligned(arena, (u64_t) acc->count * gltf_accessor_element_size(acc));
+    }
+
+    return true;
+}
+
+static void point_accessor_at(gltf_model_t *model, u32_t accessor, void *data, re_arena_t *arena) {
+    gltf_accessor_t *acc = &model->accessors[accessor];
+    u64_t size = (u64_t) acc->count * gltf_accessor_element_size(acc);
+
+    u32_t buffer = gltf_push_buffer(model, re_str(data, size), arena);
+    u32_t view = gltf_push_view(model, (gltf_buffer_view_t) {buffer, 0, size, 0, 0}, arena);
+
+    acc = &model->accessors[accessor];
+    acc->view = view;
+    acc->offset = 0;
+    acc->sparse = (gltf_accessor_sparse_t) {0};
+}
+
+void gltf_draco_decode(const json_object_t *root, gltf_model_t *model, re_arena_t *arena) {
+    json_object_t json_meshes = json_object(*root, re_str_lit("meshes"));
+
+    u32_t count = 0;
+    for (u32_t i = 0; i < model->mesh_count; i++) {
+        json_object_t json_primitives = json_object(json_array(json_meshes, i), re_str_lit("primitives"));
+        for (u32_t j = 0; j < model->meshes[i].primitive_count; j++) {
+            count += draco_extension(json_array(json_primitives, j)).type == JSON_TYPE_OBJECT;
+        }
+    }
+
+    if (count == 0) {
+        return;
+    }
+    // Read once so the whole file is decoded by the same decoder.
+    gltf_draco_decoder_t decoder = __atomic_load_n(&draco_decoder, __ATOMIC_ACQUIRE);
+    if (decoder == NULL) {
+        re_log_warn("%u primitives are Draco compressed and no decoder is set, using their fallback data.", count);
+        return;
+    }
+
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    gltf_draco_primitive_t *primitives = re_arena_push(scratch.arena, count * sizeof(gltf_draco_primitive_t));
+    draco_target_t *targets = re_arena_push(scratch.arena, count * sizeof(draco_target_t));
+    b8_t *decoded = re_arena_push(scratch.arena, count * sizeof(b8_t));
+    f64_t *times = re_arena_push(scratch.arena, count * sizeof(f64_t));
+
+    u32_t job_count = 0;
+    for (u32_t i = 0; i < model->mesh_count; i++) {
+        json_object_t json_primitives = json_object(json_array(json_meshes, i), re_str_lit("primitives"));
+        for (u32_t j = 0; j < model->meshes[i].primitive_count; j++) {
+            json_object_t ext = draco_extension(json_array(json_primitives, j));
+            if (ext.type != JSON_TYPE_OBJECT) {
+                continue;
+            }
+
+            u32_t prim = model->meshes[i].primitive_offset + j;
+            if (setup_primitive(ext, model, prim, &primitives[job_count], &targets[job_count], arena)) {
+                job_count++;
+            } else {
+                re_log_error("Draco primitive %u has an invalid buffer view.", prim);
+            }
+        }
+    }
+
+    // Primitives are independent, one per batch since decode times vary a lot.
+    f64_t start = re_os_get_time();
+    draco_job_t job = {decoder, primitives, decoded, times};
+    job_parallel_for(job_count, 1, draco_job, &job);
+    f64_t wall_time = re_os_get_time() - start;
+
+    f64_t decode_time = 0.0;
+    for (u32_t i = 0; i < job_count; i++) {
+        draco_target_t target = targets[i];
+        decode_time += times[i];
+
+        if (!decoded[i]) {
+            re_log_error("Couldn't decode Draco primitive %u, using its fallback data.", target.primitive);
+            continue;
+        }
+        re_log_debug("Decoded Draco primitive %u in %.2f ms.", target.primitive, times[i] * 1000.0);
+
+        for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+            if (target.attributes[attrib] >= 0) {
+                point_accessor_at(model, target.attributes[attrib], primitives[i].attribute_data[attrib], arena);
+            }
+        }
+        if (target.indices >= 0) {
+            point_accessor_at(model, target.indices, primitives[i].index_data, arena);
+        }
+    }
+
+    re_log_info("Decoded %u Draco primitives in %.2f ms, %.2f ms spent decoding.", job_count, wall_time * 1000.0, decode_time * 1000.0);
+    re_arena_scratch_release(&scratch);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <rebound.h>
+
+#include "gltf.h"
+#include "json.h"
+
+// Directory part of a path including the trailing slash, empty if there is none.
+extern re_str_t gltf_path_dir(re_str_t path);
+
+// Joins a directory and a relative path into a null terminated string.
+extern char *gltf_path_join(re_str_t dir, re_str_t file, re_arena_t *arena);
+
+extern u64_t gltf_hash(const void *data, u64_t size, u64_t seed);
+// Reads the file at path into arena and describes it in source, so a cache
+// written later doesn't have to read it again. Returns an empty string if it
+// can't be read.
+extern re_str_t gltf_source_read(const char *path, gltf_source_t *source, re_arena_t *arena);
+
+// Pushes memory aligned for the SSE backed HandmadeMath types.
+extern void *gltf_push_aligned(re_arena_t *arena, u64_t size);
+
+// Attribute with the given glTF name, -1 for attributes that aren't loaded.
+extern i32_t gltf_attribute_from_name(re_str_t name);
+
+// Triangles a primitive adds to its mesh's hierarchy, only full detail
+// triangle lists with positions count.
+extern u32_t gltf_primitive_triangle_count(const gltf_model_t *model, u32_t prim);
+
+// Recomputes gltf_primitives_t.bounds, one primitive per job batch.
+extern void gltf_update_bounds(gltf_model_t *model);
+
+extern b8_t gltf_draco_available(void);
+// Decodes the KHR_draco_mesh_compression primitives of the file into the
+// accessors they reference.
+extern void gltf_draco_decode(const json_object_t *root, gltf_model_t *model, re_arena_t *arena);
+
+// Buffer files shared by the models of a batch, see gltf_load_batch.
+typedef struct gltf_buffer_cache_t gltf_buffer_cache_t;
+
+// Returns the contents of the buffer file at path, reading it only if no
+// file with the same path or contents was read before. The data belongs to
+// the cache and must not be modified, source describes the file.
+extern re_str_t gltf_buffer_cache_read(gltf_buffer_cache_t *cache, const char *path, gltf_source_t *source);
+
+// gltf_parse and gltf_load reading buffer files through cache, which may be
+// NULL.
+extern gltf_model_t gltf_parse_cached(const char *path, gltf_buffer_cache_t *cache, re_arena_t *arena);
+extern gltf_model_t gltf_load_cached(const char *path, u32_t process, gltf_buffer_cache_t *cache, re_arena_t *arena);
@@ -0,0 +1,51 @@
+#include "gltf.h"
+#include "job.h"
+#include "rebound.h"
+
+// Levels narrower than this are cheaper to update on one thread.
+#define GLTF_NODES_PARALLEL_MIN 4096
+#define GLTF_NODES_BATCH_SIZE 1024
+
+static HMM_Mat4 node_local(HMM_Vec3 translation, HMM_Quat rotation, HMM_Vec3 scale) {
+    HMM_Mat4 local = HMM_QToM4(rotation);
+    local.Columns[0] = HMM_MulV4F(local.Columns[0], scale.X);
+    local.Columns[1] = HMM_MulV4F(local.Columns[1], scale.Y);
+    local.Columns[2] = HMM_MulV4F(local.Columns[2], scale.Z);
+    local.Columns[3] = HMM_V4V(translation, 1.0f);
+
+    return local;
+}
+
+void gltf_nodes_update_range(gltf_nodes_t *nodes, u32_t begin, u32_t end) {
+    for (u32_t i = begin; i < end; i++) {
+        HMM_Mat4 local = node_local(nodes->translation[i], nodes->rotation[i], nodes->scale[i]);
+
+        i32_t parent = nodes->parent[i];
+        nodes->world[i] = parent < 0 ? local : HMM_MulM4(nodes->world[parent], local);
+    }
+}
+
+typedef struct level_job_t level_job_t;
+struct level_job_t {
+    gltf_nodes_t *nodes;
+    u32_t offset;
+};
+
+static void level_job(void *user, u32_t begin, u32_t end) {
+    level_job_t *job = user;
+    gltf_nodes_update_range(job->nodes, job->offset + begin, job->offset + end);
+}
+
+void gltf_nodes_update(gltf_nodes_t *nodes) {
+    for (u32_t i = 0; i < nodes->level_count; i++) {
+        gltf_node_level_t level = nodes->levels[i];
+
+        if (level.count < GLTF_NODES_PARALLEL_MIN) {
+            gltf_nodes_update_range(nodes, level.offset, level.offset + level.count);
+            continue;
+        }
+
+        level_job_t job = {nodes, level.offset};
+        job_parallel_for(level.count, GLTF_NODES_BATCH_SIZE, level_job, &job);
+    }
+}
@@ -0,0 +1,1896 @@
+#include "bvh.h"
+#include "gltf.h"
+#include "gltf_internal.h"
+#include "job.h"
+#include "mesh.h"
+#include "rebound.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+typedef struct process_stats_t process_stats_t;
+struct process_stats_t {
+    u64_t merged_before;
+    u64_t merged_after;
+    f64_t merge_time;
+
+    u64_t triangles;
+    u64_t vertices;
+    f64_t acmr_before;
+    f64_t acmr_after;
+    f64_t atvr_before;
+    f64_t atvr_after;
+
+    u64_t covered_before;
+    u64_t shaded_before;
+    u64_t covered_after;
+    u64_t shaded_after;
+    u64_t overdraw_triangles;
+    f64_t overdraw_acmr_before;
+    f64_t overdraw_acmr_after;
+
+    f64_t referenced_before;
+    f64_t referenced_after;
+    u64_t fetched_before;
+    u64_t fetched_after;
+    u64_t vertices_before;
+    u64_t vertices_after;
+};
+
+static void optimize_vertex_cache(u32_t *indices, u32_t index_count, u32_t vertex_count, process_stats_t *stats) {
+    mesh_cache_stats_t before = mesh_analyze_vertex_cache(indices, index_count, vertex_count, MESH_VERTEX_CACHE_SIZE, MESH_CACHE_FIFO);
+    mesh_optimize_vertex_cache(indices, indices, index_count, vertex_count, MESH_VERTEX_CACHE_SIZE);
+    mesh_cache_stats_t after = mesh_analyze_vertex_cache(indices, index_count, vertex_count, MESH_VERTEX_CACHE_SIZE, MESH_CACHE_FIFO);
+
+    // Weighted so the totals are averages over the whole model.
+    u32_t triangle_count = index_count / 3;
+    stats->triangles += triangle_count;
+    stats->vertices += vertex_count;
+    stats->acmr_before += before.acmr * triangle_count;
+    stats->acmr_after += after.acmr * triangle_count;
+    stats->atvr_before += before.atvr * vertex_count;
+    stats->atvr_after += after.atvr * vertex_count;
+}
+
+static void optimize_overdraw(u32_t *indices, u32_t index_count, const f32_t *positions, u32_t vertex_count, process_stats_t *stats) {
+    mesh_overdraw_stats_t before = mesh_analyze_overdraw(indices, index_count, positions, vertex_count);
+    mesh_cache_stats_t cache_before = mesh_analyze_vertex_cache(indices, index_count, vertex_count, MESH_VERTEX_CACHE_SIZE, MESH_CACHE_FIFO);
+    mesh_optimize_overdraw(indices, indices, index_count, positions, vertex_count, MESH_VERTEX_CACHE_SIZE, MESH_OVERDRAW_THRESHOLD);
+    mesh_overdraw_stats_t after = mesh_analyze_overdraw(indices, index_count, positions, vertex_count);
+    mesh_cache_stats_t cache_after = mesh_analyze_vertex_cache(indices, index_count, vertex_count, MESH_VERTEX_CACHE_SIZE, MESH_CACHE_FIFO);
+
+    // The vertex cache cost the new order paid, weighted like
+    // optimize_vertex_cache.
+    u32_t triangle_count = index_count / 3;
+    stats->covered_before += before.covered;
+    stats->shaded_before += before.shaded;
+    stats->covered_after += after.covered;
+    stats->shaded_after += after.shaded;
+    stats->overdraw_triangles += triangle_count;
+    stats->overdraw_acmr_before += cache_before.acmr * triangle_count;
+    stats->overdraw_acmr_after += cache_after.acmr * triangle_count;
+}
+
+// Vertex data can only be renumbered when no other primitive reads it and
+// every attribute has one element per vertex.
+static b8_t owns_vertices(const gltf_model_t *model, u32_t prim, const u32_t *uses, u32_t vertex_count) {
+    const gltf_primitives_t *prims = &model->primitives;
+    if (uses[prims->indices[prim]] > 1) {
+        return false;
+    }
+
+    for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+        i32_t accessor = prims->attributes[attrib][prim];
+        if (accessor >= 0 && (uses[accessor] > 1 || model->accessors[accessor].count != vertex_count)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Merges identical vertices, or ones within GLTF_WELD_TOLERANCE of each other
+// when welding, and returns the new vertex count.
+static u32_t merge_vertices(gltf_model_t *model, u32_t prim, u32_t *indices, u32_t index_count, u32_t vertex_count, b8_t weld, process_stats_t *stats, re_arena_t *arena) {
+    const gltf_primitives_t *prims = &model->primitives;
+
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    u32_t *remap = re_arena_push(scratch.arena, vertex_count * sizeof(u32_t));
+
+    i32_t accessors[GLTF_ATTRIBUTE_COUNT];
+    u32_t accessor_count = 0;
+    for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+        if (prims->attributes[attrib][prim] >= 0) {
+            accessors[accessor_count++] = prims->attributes[attrib][prim];
+        }
+    }
+
+    f64_t start = re_os_get_time();
+    u32_t unique = vertex_count;
+    if (weld) {
+        // Attributes are interleaved into one float tuple per vertex, position
+        // first.
+        u32_t vertex_floats = 0;
+        for (u32_t i = 0; i < accessor_count; i++) {
+            vertex_floats += gltf_accessor_type_count(model->accessors[accessors[i]].type);
+        }
+
+        f32_t *vertices = re_arena_push(scratch.arena, (u64_t) vertex_count * vertex_floats * sizeof(f32_t));
+        f32_t *tolerances = re_arena_push(scratch.arena, vertex_floats * sizeof(f32_t));
+        b8_t valid = true;
+        u32_t offset = 0;
+        for (u32_t i = 0; i < accessor_count && valid; i++) {
+            u32_t comps = gltf_accessor_type_count(model->accessors[accessors[i]].type);
+            f32_t *values = re_arena_push(scratch.arena, (u64_t) vertex_count * comps * sizeof(f32_t));
+            valid = gltf_accessor_read_f32(model, accessors[i], values);
+            for (u32_t v = 0; v < vertex_count && valid; v++) {
+                memcpy(vertices + (u64_t) v * vertex_floats + offset, values + (u64_t) v * comps, comps * sizeof(f32_t));
+            }
+            for (u32_t c = 0; c < comps; c++) {
+                tolerances[offset + c] = GLTF_WELD_TOLERANCE;
+            }
+            offset += comps;
+        }
+
+        if (valid) {
+            // Position tolerances scale with the size of the mesh.
+            HMM_Vec3 min = HMM_V3(FLT_MAX, FLT_MAX, FLT_MAX);
+            HMM_Vec3 max = HMM_V3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+            for (u32_t v = 0; v < vertex_count; v++) {
+                const f32_t *p = vertices + (u64_t) v * vertex_floats;
+                for (u32_t axis = 0; axis < 3; axis++) {
+                    min.Elements[axis] = fminf(min.Elements[axis], p[axis]);
+                    max.Elements[axis] = fmaxf(max.Elements[axis], p[axis]);
+                }
+            }
+            f32_t diagonal = HMM_LenV3(HMM_SubV3(max, min));
+            f32_t tolerance = diagonal > 0.0f && diagonal < FLT_MAX ? diagonal * GLTF_WELD_TOLERANCE : GLTF_WELD_TOLERANCE;
+            tolerances[0] = tolerances[1] = tolerances[2] = tolerance;
+
+            unique = mesh_weld(remap, vertices, vertex_count, vertex_floats, tolerances);
+        }
+    } else {
+        mesh_stream_t streams[GLTF_ATTRIBUTE_COUNT];
+        b8_t valid = true;
+        for (u32_t i = 0; i < accessor_count && valid; i++) {
+            gltf_accessor_resolve(model, accessors[i], arena);
+            const gltf_accessor_t *acc = &model->accessors[accessors[i]];
+            streams[i].size = gltf_accessor_element_size(acc);
+            streams[i].data = gltf_accessor_data(model, accessors[i], &streams[i].stride);
+            valid = streams[i].data != NULL;
+        }
+
+        if (valid) {
+            unique = mesh_deduplicate(remap, streams, accessor_count, vertex_count);
+        }
+    }
+    stats->merge_time += re_os_get_time() - start;
+    stats->merged_before += vertex_count;
+    stats->merged_after += unique;
+
+    if (unique < vertex_count) {
+        mesh_remap_indices(indices, indices, index_count, remap);
+        for (u32_t i = 0; i < accessor_count; i++) {
+            gltf_accessor_remap(model, accessors[i], remap, unique, arena);
+        }
+    }
+
+    re_arena_scratch_release(&scratch);
+    return unique;
+}
+
+// Renumbers the vertices of one primitive in first use order, rewriting every
+// attribute and the indices in place.
+static void optimize_vertex_fetch(gltf_model_t *model, u32_t prim, u32_t *indices, u32_t index_count, u32_t vertex_count, process_stats_t *stats, re_arena_t *arena) {
+    const gltf_primitives_t *prims = &model->primitives;
+
+    // Analyzed as if the attributes were interleaved.
+    u32_t vertex_size = 0;
+    for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+        i32_t accessor = prims->attributes[attrib][prim];
+        if (accessor >= 0) {
+            vertex_size += gltf_accessor_element_size(&model->accessors[accessor]);
+        }
+    }
+
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    u32_t *remap = re_arena_push(scratch.arena, vertex_count * sizeof(u32_t));
+
+    mesh_fetch_stats_t before = mesh_analyze_vertex_fetch(indices, index_count, vertex_count, vertex_size);
+    u32_t kept = mesh_optimize_vertex_fetch(remap, indices, index_count, vertex_count);
+    mesh_remap_indices(indices, indices, index_count, remap);
+    mesh_fetch_stats_t after = mesh_analyze_vertex_fetch(indices, index_count, kept, vertex_size);
+
+    for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+        i32_t accessor = prims->attributes[attrib][prim];
+        if (accessor >= 0) {
+            gltf_accessor_remap(model, accessor, remap, kept, arena);
+        }
+    }
+
+    re_arena_scratch_release(&scratch);
+
+    stats->referenced_before += before.efficiency * before.bytes_fetched;
+    stats->referenced_after += after.efficiency * after.bytes_fetched;
+    stats->fetched_before += before.bytes_fetched;
+    stats->fetched_after += after.bytes_fetched;
+    stats->vertices_before += vertex_count;
+    stats->vertices_after += kept;
+}
+
+/*=========================*/
+// Splitting
+/*=========================*/
+
+// Vertices 16 bit indices can address, glTF reserves the largest value.
+#define SPLIT_MAX_VERTICES 65535
+
+// Cuts the triangles of a primitive into runs with at most SPLIT_MAX_VERTICES
+// vertices each, keeping their order. Writes the first triangle of every run
+// to starts and returns the run count.
+static u32_t split_runs(const u32_t *indices, u32_t triangle_count, u32_t vertex_count, u32_t *starts, re_arena_t *arena) {
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    // Run a vertex was last seen in, plus one.
+    u32_t *seen = re_arena_push_zero(scratch.arena, vertex_count * sizeof(u32_t));
+
+    u32_t run_count = 0;
+    u32_t run_vertices = 0;
+    for (u32_t t = 0; t < triangle_count; t++) {
+        const u32_t *tri = indices + t * 3;
+        u32_t added = 0;
+        for (u32_t k = 0; k < 3; k++) {
+            added += seen[tri[k]] != run_count && (k == 0 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1]);
+        }
+
+        if (run_count == 0 || run_vertices + added > SPLIT_MAX_VERTICES) {
+            starts[run_count++] = t;
+            run_vertices = 0;
+            added = 3 - (tri[1] == tri[0]) - (tri[2] == tri[0] || tri[2] == tri[1]);
+        }
+
+        run_vertices += added;
+        for (u32_t k = 0; k < 3; k++) {
+            seen[tri[k]] = run_count;
+        }
+    }
+
+    re_arena_scratch_release(&scratch);
+    return run_count;
+}
+
+// Copies the vertices and triangles of one run into new accessors, with
+// vertices numbered in first use order and 16 bit indices.
+static void split_run(gltf_model_t *model, u32_t prim, const u32_t *indices, u32_t index_count, u32_t vertex_count, i32_t *accessors, re_arena_t *arena) {
+    const gltf_primitives_t *prims = &model->primitives;
+
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    u32_t *remap = re_arena_push(scratch.arena, vertex_count * sizeof(u32_t));
+    u32_t *local = re_arena_push(scratch.arena, index_count * sizeof(u32_t));
+    u32_t kept = mesh_optimize_vertex_fetch(remap, indices, index_count, vertex_count);
+    mesh_remap_indices(local, indices, index_count, remap);
+
+    for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+        i32_t source = prims->attributes[attrib][prim];
+        accessors[attrib] = -1;
+        if (source >= 0) {
+            accessors[attrib] = gltf_push_accessor(model, model->accessors[source], arena);
+            gltf_accessor_remap(model, accessors[attrib], remap, kept, arena);
+        }
+    }
+
+    gltf_accessor_t index_acc = model->accessors[prims->indices[prim]];
+    index_acc.comp_type = GLTF_COMP_TYPE_UNSIGNED_SHORT;
+    accessors[GLTF_ATTRIBUTE_COUNT] = gltf_push_accessor(model, index_acc, arena);
+    gltf_accessor_set_indices(model, accessors[GLTF_ATTRIBUTE_COUNT], local, index_count, arena);
+
+    re_arena_scratch_release(&scratch);
+}
+
+// Replaces every triangle list with more vertices than 16 bit indices can
+// address by several primitives that fit, in the same mesh and material.
+static void split_primitives(gltf_model_t *model, re_arena_t *arena) {
+    gltf_primitives_t prims = model->primitives;
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+
+    // Runs of every primitive, one for those left alone.
+    u32_t *run_offset = re_arena_push(scratch.arena, (prims.count + 1) * sizeof(u32_t));
+    u32_t **run_starts = re_arena_push_zero(scratch.arena, prims.count * sizeof(u32_t *));
+    u32_t **prim_indices = re_arena_push_zero(scratch.arena, prims.count * sizeof(u32_t *));
+    u32_t split_count = 0;
+
+    run_offset[0] = 0;
+    for (u32_t i = 0; i < prims.count; i++) {
+        i32_t index_accessor = prims.indices[i];
+        i32_t position_accessor = prims.attributes[GLTF_ATTRIBUTE_POSITION][i];
+        u32_t runs = 1;
+
+        if (prims.mode[i] == GLTF_PRIMITIVE_MODE_TRIANGLES && index_accessor >= 0 && position_accessor >= 0 &&
+                model->accessors[position_accessor].count > SPLIT_MAX_VERTICES && model->accessors[index_accessor].count >= 3) {
+            u32_t index_count = model->accessors[index_accessor].count;
+            u32_t vertex_count = model->accessors[position_accessor].count;
+            u32_t *indices = re_arena_push(scratch.arena, index_count * sizeof(u32_t));
+            b8_t valid = gltf_accessor_read_u32(model, index_accessor, indices);
+            for (u32_t j = 0; j < index_count && valid; j++) {
+                valid = indices[j] < vertex_count;
+            }
+
+            if (valid) {
+                run_starts[i] = re_arena_push(scratch.arena, (index_count / 3 + 1) * sizeof(u32_t));
+                runs = split_runs(indices, index_count / 3, vertex_count, run_starts[i], arena);
+                run_starts[i][runs] = index_count / 3;
+                prim_indices[i] = indices;
+                split_count++;
+            } else {
+                re_log_warn("Primitive %u has invalid indices and wasn't split.", i);
+            }
+        }
+
+        run_offset[i + 1] = run_offset[i] + runs;
+    }
+
+    if (split_count == 0) {
+        re_arena_scratch_release(&scratch);
+        return;
+    }
+
+    u32_t count = run_offset[prims.count];
+    gltf_primitives_t split = {.count = count};
+    for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+        split.attributes[attrib] = re_arena_push(arena, count * sizeof(i32_t));
+    }
+    split.indices = re_arena_push(arena, count * sizeof(i32_t));
+    split.mode = re_arena_push(arena, count * sizeof(gltf_primitive_mode_t));
+    split.material = re_arena_push(arena, count * sizeof(i32_t));
+    split.lod_offset = re_arena_push_zero(arena, count * sizeof(u32_t));
+    split.lod_count = re_arena_push_zero(arena, count * sizeof(u32_t));
+    split.meshlet_offset = re_arena_push_zero(arena, count * sizeof(u32_t));
+    split.meshlet_count = re_arena_push_zero(arena, count * sizeof(u32_t));
+    split.bounds = re_arena_push(arena, count * sizeof(gltf_aabb_t));
+
+    for (u32_t i = 0; i < prims.count; i++) {
+        for (u32_t p = run_offset[i]; p < run_offset[i + 1]; p++) {
+            for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+                split.attributes[attrib][p] = prims.attributes[attrib][i];
+            }
+            split.indices[p] = prims.indices[i];
+            split.mode[p] = prims.mode[i];
+            split.material[p] = prims.material[i];
+        }
+
+        if (prim_indices[i] == NULL) {
+            continue;
+        }
+
+        u32_t vertex_count = model->accessors[prims.attributes[GLTF_ATTRIBUTE_POSITION][i]].count;
+        for (u32_t run = 0; run < run_offset[i + 1] - run_offset[i]; run++) {
+            u32_t begin = run_starts[i][run] * 3;
+            u32_t end = run_starts[i][run + 1] * 3;
+
+            i32_t accessors[GLTF_ATTRIBUTE_COUNT + 1];
+            split_run(model, i, prim_indices[i] + begin, end - begin, vertex_count, accessors, arena);
+
+            u32_t p = run_offset[i] + run;
+            for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+                split.attributes[attrib][p] = accessors[attrib];
+            }
+            split.indices[p] = accessors[GLTF_ATTRIBUTE_COUNT];
+        }
+    }
+
+    for (u32_t i = 0; i < model->mesh_count; i++) {
+        gltf_mesh_t *mesh = &model->meshes[i];
+        u32_t end = mesh->primitive_offset + mesh->primitive_count;
+        mesh->primitive_offset = run_offset[mesh->primitive_offset];
+        mesh->primitive_count = run_offset[end] - mesh->primitive_offset;
+    }
+
+    model->primitives = split;
+    re_log_info("Split %u primitives over %u vertices into %u.", split_count, SPLIT_MAX_VERTICES, split_count + count - prims.count);
+    re_arena_scratch_release(&scratch);
+}
+
+/*=========================*/
+// LOD
+/*=========================*/
+
+// One primitive's LOD chain, built on a worker.
+typedef struct lod_chain_t lod_chain_t;
+struct lod_chain_t {
+    u32_t prim;
+    const u32_t *indices;
+    u32_t index_count;
+    const f32_t *positions;
+    u32_t vertex_count;
+    f32_t max_error;
+
+    // Levels are written one after another, each at most as long as the last.
+    u32_t *lod_indices;
+    u32_t lod_index_counts[GLTF_LOD_MAX_LEVELS];
+    f32_t lod_errors[GLTF_LOD_MAX_LEVELS];
+    u32_t level_count;
+    f64_t time;
+};
+
+typedef struct lod_job_t lod_job_t;
+struct lod_job_t {
+    lod_chain_t *chains;
+    b8_t vertex_cache;
+};
+
+// Every level simplifies the one before, which is cheaper than starting from
+// full detail and keeps the levels nested. Errors are measured against the
+// previous level, so they add up.
+static void build_lod_chain(lod_chain_t *chain, b8_t vertex_cache) {
+    f64_t start = re_os_get_time();
+
+    const u32_t *source = chain->indices;
+    u32_t source_count = chain->index_count;
+    u32_t *out = chain->lod_indices;
+    f32_t error = 0.0f;
+
+    for (u32_t level = 0; level < GLTF_LOD_MAX_LEVELS; level++) {
+        u32_t target = (u32_t) (source_count / 3 * GLTF_LOD_RATIO) * 3;
+        f32_t level_error = 0.0f;
+        u32_t count = mesh_simplify(out, source, source_count, chain->positions, chain->vertex_count, target, chain->max_error - error, &level_error);
+
+        // Locked vertices, borders and the error limit can stop the collapses
+        // early, a level that barely changed isn't worth switching to.
+        if (count == 0 || (u64_t) count * 10 > (u64_t) source_count * 9) {
+            break;
+        }
+
+        if (vertex_cache) {
+            mesh_optimize_vertex_cache(out, out, count, chain->vertex_count, MESH_VERTEX_CACHE_SIZE);
+        }
+
+        error += level_error;
+        chain->lod_index_counts[level] = count;
+        chain->lod_errors[level] = error;
+        chain->level_count++;
+
+        source = out;
+        source_count = count;
+        out += count;
+    }
+
+    chain->time = re_os_get_time() - start;
+}
+
+static void lod_job(void *user, u32_t begin, u32_t end) {
+    lod_job_t *job = user;
+    for (u32_t i = begin; i < end; i++) {
+        build_lod_chain(&job->chains[i], job->vertex_cache);
+    }
+}
+
+// Builds the LOD chains of all indexed triangle lists. Each level gets its own
+// index accessor, a copy of the full detail one, and uses the same vertices.
+static void build_lods(gltf_model_t *model, u32_t process, re_arena_t *arena) {
+    gltf_primitives_t prims = model->primitives;
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+
+    // Primitives drawing the same indices and positions share a chain.
+    u32_t base_accessor_count = model->accessor_count;
+    i32_t *chain_of = re_arena_push(scratch.arena, base_accessor_count * sizeof(i32_t));
+    memset(chain_of, 0xff, base_accessor_count * sizeof(i32_t));
+
+    lod_chain_t *chains = re_arena_push_zero(scratch.arena, prims.count * sizeof(lod_chain_t));
+    u32_t chain_count = 0;
+    for (u32_t i = 0; i < prims.count; i++) {
+        i32_t index_accessor = prims.indices[i];
+        i32_t position_accessor = prims.attributes[GLTF_ATTRIBUTE_POSITION][i];
+        if (prims.mode[i] != GLTF_PRIMITIVE_MODE_TRIANGLES || index_accessor < 0 || position_accessor < 0 || chain_of[index_accessor] >= 0) {
+            continue;
+        }
+
+        lod_chain_t *chain = &chains[chain_count];
+        chain->prim = i;
+        chain->index_count = model->accessors[index_accessor].count / 3 * 3;
+        chain->vertex_count = model->accessors[position_accessor].count;
+        if (chain->index_count == 0) {
+            continue;
+        }
+
+        u32_t *indices = re_arena_push(scratch.arena, model->accessors[index_accessor].count * sizeof(u32_t));
+        f32_t *positions = re_arena_push(scratch.arena, (u64_t) chain->vertex_count * 3 * sizeof(f32_t));
+        if (!gltf_accessor_read_u32(model, index_accessor, indices) || !gltf_accessor_read_f32(model, position_accessor, positions)) {
+            re_log_warn("Primitive %u has unreadable indices or positions, no LODs were built.", i);
+            continue;
+        }
+
+        HMM_Vec3 min = HMM_V3(FLT_MAX, FLT_MAX, FLT_MAX);
+        HMM_Vec3 max = HMM_V3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (u32_t v = 0; v < chain->vertex_count; v++) {
+            for (u32_t axis = 0; axis < 3; axis++) {
+                min.Elements[axis] = fminf(min.Elements[axis], positions[v * 3 + axis]);
+                max.Elements[axis] = fmaxf(max.Elements[axis], positions[v * 3 + axis]);
+            }
+        }
+
+        chain->indices = indices;
+        chain->positions = positions;
+        chain->max_error = HMM_LenV3(HMM_SubV3(max, min)) * GLTF_LOD_MAX_ERROR;
+        chain->lod_indices = re_arena_push(scratch.arena, (u64_t) chain->index_count * GLTF_LOD_MAX_LEVELS * sizeof(u32_t));
+        chain_of[index_accessor] = chain_count++;
+    }
+
+    // Chains are independent and vary a lot in size, one per batch.
+    f64_t start = re_os_get_time();
+    lod_job_t job = {chains, (process & GLTF_PROCESS_VERTEX_CACHE) != 0};
+    job_parallel_for(chain_count, 1, lod_job, &job);
+    f64_t wall_time = re_os_get_time() - start;
+
+    u32_t lod_count = 0;
+    for (u32_t i = 0; i < chain_count; i++) {
+        lod_count += chains[i].level_count;
+    }
+    model->lods = re_arena_push(arena, lod_count * sizeof(gltf_lod_t));
+    model->lod_count = 0;
+
+    u64_t level_triangles[GLTF_LOD_MAX_LEVELS] = {0};
+    f32_t level_errors[GLTF_LOD_MAX_LEVELS] = {0};
+    u32_t level_chains[GLTF_LOD_MAX_LEVELS] = {0};
+    u64_t base_triangles = 0;
+    f64_t simplify_time = 0.0;
+
+    for (u32_t i = 0; i < chain_count; i++) {
+        lod_chain_t *chain = &chains[i];
+        u32_t prim = chain->prim;
+        i32_t index_accessor = prims.indices[prim];
+
+        prims.lod_offset[prim] = model->lod_count;
+        prims.lod_count[prim] = chain->level_count;
+        base_triangles += chain->index_count / 3;
+        simplify_time += chain->time;
+
+        const u32_t *lod_indices = chain->lod_indices;
+        for (u32_t level = 0; level < chain->level_count; level++) {
+            u32_t count = chain->lod_index_counts[level];
+            u32_t accessor = gltf_push_accessor(model, model->accessors[index_accessor], arena);
+            gltf_accessor_set_indices(model, accessor, lod_indices, count, arena);
+            lod_indices += count;
+
+            model->lods[model->lod_count++] = (gltf_lod_t) {accessor, chain->lod_errors[level]};
+            level_triangles[level] += count / 3;
+            level_errors[level] = fmaxf(level_errors[level], chain->lod_errors[level]);
+            level_chains[level]++;
+        }
+
+        re_log_debug("Primitive %u: %u LODs in %.2f ms.", prim, chain->level_count, chain->time * 1000.0);
+    }
+
+    for (u32_t i = 0; i < prims.count; i++) {
+        i32_t index_accessor = prims.indices[i];
+        if (index_accessor < 0 || (u32_t) index_accessor >= base_accessor_count || chain_of[index_accessor] < 0) {
+            continue;
+        }
+
+        u32_t source = chains[chain_of[index_accessor]].prim;
+        if (prims.attributes[GLTF_ATTRIBUTE_POSITION][i] == prims.attributes[GLTF_ATTRIBUTE_POSITION][source]) {
+            prims.lod_offset[i] = prims.lod_offset[source];
+            prims.lod_count[i] = prims.lod_count[source];
+        }
+    }
+
+    for (u32_t level = 0; level < GLTF_LOD_MAX_LEVELS && level_chains[level] > 0; level++) {
+        re_log_info("LOD %u: %llu of %llu triangles over %u primitives, max error %g.",
+                level + 1,
+                (unsigned long long) level_triangles[level],
+                (unsigned long long) base_triangles,
+                level_chains[level],
+                level_errors[level]);
+    }
+    if (chain_count > 0) {
+            re_log_info("Built %u LODs for %u primitives in %.2f ms, %.2f ms spent simplifying.", lod_count, chain_count, wall_time * 1000.0, simplify_time * 1000.0);
+    }
+
+    re_arena_scratch_release(&scratch);
+}
+
+/*=========================*/
+// Meshlets
+/*=========================*/
+
+// One primitive's meshlets, built on a worker.
+typedef struct meshlet_split_t meshlet_split_t;
+struct meshlet_split_t {
+    u32_t prim;
+    const u32_t *indices;
+    u32_t index_count;
+    const f32_t *positions;
+    u32_t vertex_count;
+
+    mesh_meshlet_t *meshlets;
+    mesh_bounds_t *bounds;
+    u32_t *meshlet_vertices;
+    u8_t *meshlet_indices;
+    u32_t meshlet_count;
+    f64_t time;
+};
+
+static void meshlet_job(void *user, u32_t begin, u32_t end) {
+    meshlet_split_t *splits = user;
+    for (u32_t i = begin; i < end; i++) {
+        meshlet_split_t *split = &splits[i];
+        f64_t start = re_os_get_time();
+
+        split->meshlet_count = mesh_build_meshlets(
+                split->meshlets,
+                split->meshlet_vertices,
+                split->meshlet_indices,
+                split->indices,
+                split->index_count,
+                split->positions,
+                split->vertex_count,
+                GLTF_MESHLET_MAX_VERTICES,
+                GLTF_MESHLET_MAX_TRIANGLES);
+
+        for (u32_t m = 0; m < split->meshlet_count; m++) {
+            mesh_meshlet_t meshlet = split->meshlets[m];
+            split->bounds[m] = mesh_compute_meshlet_bounds(
+                    split->meshlet_vertices + meshlet.vertex_offset,
+                    split->meshlet_indices + meshlet.triangle_offset * 3,
+                    meshlet.triangle_count,
+                    split->positions);
+        }
+
+        split->time = re_os_get_time() - start;
+    }
+}
+
+// Splits the full detail triangles of all indexed triangle lists into
+// meshlets, stored back to back in the model with offsets relative to it.
+static void build_meshlets(gltf_model_t *model, re_arena_t *arena) {
+    gltf_primitives_t prims = model->primitives;
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+
+    // Primitives drawing the same indices and positions share meshlets.
+    i32_t *split_of = re_arena_push(scratch.arena, model->accessor_count * sizeof(i32_t));
+    memset(split_of, 0xff, model->accessor_count * sizeof(i32_t));
+
+    meshlet_split_t *splits = re_arena_push_zero(scratch.arena, prims.count * sizeof(meshlet_split_t));
+    u32_t split_count = 0;
+    for (u32_t i = 0; i < prims.count; i++) {
+        i32_t index_accessor = prims.indices[i];
+        i32_t position_accessor = prims.attributes[GLTF_ATTRIBUTE_POSITION][i];
+        if (prims.mode[i] != GLTF_PRIMITIVE_MODE_TRIANGLES || index_accessor < 0 || position_accessor < 0 || split_of[index_accessor] >= 0) {
+            continue;
+        }
+
+        meshlet_split_t *split = &splits[split_count];
+        split->prim = i;
+        split->index_count = model->accessors[index_accessor].count / 3 * 3;
+        split->vertex_count = model->accessors[position_accessor].count;
+        if (split->index_count == 0) {
+            continue;
+        }
+
+        u32_t *indices = re_arena_push(scratch.arena, model->accessors[index_accessor].count * sizeof(u32_t));
+        f32_t *positions = re_arena_push(scratch.arena, (u64_t) split->vertex_count * 3 * sizeof(f32_t));
+        if (!gltf_accessor_read_u32(model, index_accessor, indices) || !gltf_accessor_read_f32(model, position_accessor, positions)) {
+            re_log_warn("Primitive %u has unreadable indices or positions, no meshlets were built.", i);
+            continue;
+        }
+
+        u32_t bound = mesh_meshlet_bound(split->index_count, GLTF_MESHLET_MAX_VERTICES, GLTF_MESHLET_MAX_TRIANGLES);
+        split->indices = indices;
+        split->positions = positions;
+        split->meshlets = re_arena_push(scratch.arena, bound * sizeof(mesh_meshlet_t));
+        split->bounds = re_arena_push(scratch.arena, bound * sizeof(mesh_bounds_t));
+        split->meshlet_vertices = re_arena_push(scratch.arena, split->index_count * sizeof(u32_t));
+        split->meshlet_indices = re_arena_push(scratch.arena, split->index_count);
+        split_of[index_accessor] = split_count++;
+    }
+
+    // Splits are independent and vary a lot in size, one per batch.
+    f64_t start = re_os_get_time();
+    job_parallel_for(split_count, 1, meshlet_job, splits);
+    f64_t wall_time = re_os_get_time() - start;
+
+    u32_t meshlet_count = 0;
+    u32_t vertex_count = 0;
+    u32_t triangle_count = 0;
+    for (u32_t i = 0; i < split_count; i++) {
+        meshlet_split_t *split = &splits[i];
+        if (split->meshlet_count > 0) {
+            mesh_meshlet_t last = split->meshlets[split->meshlet_count - 1];
+            meshlet_count += split->meshlet_count;
+            vertex_count += last.vertex_offset + last.vertex_count;
+            triangle_count += last.triangle_offset + last.triangle_count;
+        }
+    }
+
+    model->meshlets = re_arena_push(arena, meshlet_count * sizeof(gltf_meshlet_t));
+    model->meshlet_vertices = re_arena_push(arena, vertex_count * sizeof(u32_t));
+    model->meshlet_indices = re_arena_push(arena, triangle_count * 3);
+    model->meshlet_count = 0;
+    model->meshlet_vertex_count = 0;
+    model->meshlet_index_count = 0;
+
+    f64_t build_time = 0.0;
+    u32_t open_cones = 0;
+    for (u32_t i = 0; i < split_count; i++) {
+        meshlet_split_t *split = &splits[i];
+        prims.meshlet_offset[split->prim] = model->meshlet_count;
+        prims.meshlet_count[split->prim] = split->meshlet_count;
+        build_time += split->time;
+
+        u32_t vertex_base = model->meshlet_vertex_count;
+        u32_t triangle_base = model->meshlet_index_count / 3;
+        for (u32_t m = 0; m < split->meshlet_count; m++) {
+            mesh_meshlet_t meshlet = split->meshlets[m];
+            mesh_bounds_t bounds = split->bounds[m];
+            model->meshlets[model->meshlet_count++] = (gltf_meshlet_t) {
+                vertex_base + meshlet.vertex_offset,
+                triangle_base + meshlet.triangle_offset,
+                meshlet.vertex_count,
+                meshlet.triangle_count,
+                HMM_V3(bounds.center[0], bounds.center[1], bounds.center[2]),
+                bounds.radius,
+                HMM_V3(bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2]),
+                bounds.cone_cutoff,
+            };
+            open_cones += bounds.cone_cutoff >= 1.0f;
+        }
+
+        if (split->meshlet_count > 0) {
+            mesh_meshlet_t last = split->meshlets[split->meshlet_count - 1];
+            u32_t split_vertices = last.vertex_offset + last.vertex_count;
+            u32_t split_indices = (last.triangle_offset + last.triangle_count) * 3;
+            memcpy(model->meshlet_vertices + vertex_base, split->meshlet_vertices, split_vertices * sizeof(u32_t));
+            memcpy(model->meshlet_indices + model->meshlet_index_count, split->meshlet_indices, split_indices);
+            model->meshlet_vertex_count += split_vertices;
+            model->meshlet_index_count += split_indices;
+        }
+
+        re_log_debug("Primitive %u: %u meshlets in %.2f ms.", split->prim, split->meshlet_count, split->time * 1000.0);
+    }
+
+    for (u32_t i = 0; i < prims.count; i++) {
+        i32_t index_accessor = prims.indices[i];
+        if (index_accessor < 0 || split_of[index_accessor] < 0) {
+            continue;
+        }
+
+        u32_t source = splits[split_of[index_accessor]].prim;
+        if (prims.attributes[GLTF_ATTRIBUTE_POSITION][i] == prims.attributes[GLTF_ATTRIBUTE_POSITION][source]) {
+            prims.meshlet_offset[i] = prims.meshlet_offset[source];
+            prims.meshlet_count[i] = prims.meshlet_count[source];
+        }
+    }
+
+    if (meshlet_count > 0) {
+        re_log_info("Built %u meshlets for %u primitives in %.2f ms, %.2f ms spent building. %.1f vertices and %.1f triangles per meshlet, %u without a normal cone.",
+                meshlet_count,
+                split_count,
+                wall_time * 1000.0,
+                build_time * 1000.0,
+                (f64_t) vertex_count / meshlet_count,
+                (f64_t) triangle_count / meshlet_count,
+                open_cones);
+    }
+
+    re_arena_scratch_release(&scratch);
+}
+
+/*=========================*/
+// Normals
+/*=========================*/
+
+typedef struct normal_job_t normal_job_t;
+struct normal_job_t {
+    // Arena the model is pushed to, the job's scratch memory stays out of it.
+    re_arena_t *arena;
+    u32_t prim;
+    const u32_t *indices;
+    u32_t index_count;
+    const f32_t *positions;
+    u32_t vertex_count;
+    b8_t indexed;
+
+    f32_t *corner_normals;
+    // Normals of the original vertices followed by those of the vertices
+    // split off them, room for one per corner.
+    f32_t *vertex_normals;
+    // Vertex of every corner and original vertex of every vertex, only
+    // filled when vertices were split.
+    u32_t *remap;
+    u32_t *sources;
+    u32_t new_vertex_count;
+    b8_t valid;
+
+    b8_t pushed;
+    i32_t accessors[GLTF_ATTRIBUTE_COUNT + 1];
+};
+
+static void generate_primitive_normals(normal_job_t *job) {
+    job->valid = mesh_generate_normals(
+            job->corner_normals,
+            job->indices,
+            job->index_count,
+            job->positions,
+            job->vertex_count,
+            GLTF_NORMAL_CREASE_ANGLE * (3.14159265f / 180.0f));
+    job->new_vertex_count = job->vertex_count;
+    if (!job->valid) {
+        return;
+    }
+
+    // Non-indexed corners are their own vertices.
+    if (!job->indexed) {
+        job->vertex_normals = job->corner_normals;
+        return;
+    }
+
+    // A corner keeps its vertex if it got the same normal as the vertex's
+    // first corner, in smooth meshes all of them do. Others share a new
+    // vertex with the corners of that vertex that got the same normal.
+    re_arena_temp_t scratch = re_arena_scratch_get(&job->arena, 1);
+    u32_t vertex_count = job->vertex_count;
+    b8_t *seen = re_arena_push_zero(scratch.arena, vertex_count * sizeof(b8_t));
+    // First new vertex split off every vertex, the rest linked through next.
+    u32_t *first_split = re_arena_push(scratch.arena, vertex_count * sizeof(u32_t));
+    u32_t *next = re_arena_push(scratch.arena, job->index_count * sizeof(u32_t));
+    memset(first_split, 0xff, vertex_count * sizeof(u32_t));
+
+    for (u32_t c = 0; c < job->index_count; c++) {
+        u32_t v = job->indices[c];
+        const f32_t *normal = job->corner_normals + (u64_t) c * 3;
+        if (!seen[v]) {
+            seen[v] = true;
+            memcpy(job->vertex_normals + (u64_t) v * 3, normal, 3 * sizeof(f32_t));
+            job->remap[c] = v;
+            continue;
+        }
+
+        u32_t target = v;
+        while (target != 0xffffffffu && memcmp(job->vertex_normals + (u64_t) target * 3, normal, 3 * sizeof(f32_t)) != 0) {
+            target = target == v ? first_split[v] : next[target - vertex_count];
+        }
+        if (target == 0xffffffffu) {
+            target = job->new_vertex_count++;
+            memcpy(job->vertex_normals + (u64_t) target * 3, normal, 3 * sizeof(f32_t));
+            job->sources[target] = v;
+            next[target - vertex_count] = first_split[v];
+            first_split[v] = target;
+        }
+        job->remap[c] = target;
+    }
+
+    // Unused vertices still need some normal.
+    for (u32_t v = 0; v < vertex_count; v++) {
+        job->sources[v] = v;
+        if (!seen[v]) {
+            memcpy(job->vertex_normals + (u64_t) v * 3, (f32_t[3]) {0.0f, 0.0f, 1.0f}, 3 * sizeof(f32_t));
+        }
+    }
+    re_arena_scratch_release(&scratch);
+}
+
+static void normal_job(void *user, u32_t begin, u32_t end) {
+    normal_job_t *jobs = user;
+    for (u32_t i = begin; i < end; i++) {
+        generate_primitive_normals(&jobs[i]);
+    }
+}
+
+// Index accessor of a split primitive, widened if the new vertex count no
+// longer fits its component type.
+static u32_t push_split_indices(gltf_model_t *model, u32_t prim, const u32_t *remap, u32_t index_count, u32_t vertex_count, re_arena_t *arena) {
+    gltf_accessor_t index_acc = model->accessors[model->primitives.indices[prim]];
+    if (vertex_count > 0xffff) {
+        index_acc.comp_type = GLTF_COMP_TYPE_UNSIGNED_INT;
+    } else if (vertex_count > 0xff && index_acc.comp_type == GLTF_COMP_TYPE_UNSIGNED_BYTE) {
+        index_acc.comp_type = GLTF_COMP_TYPE_UNSIGNED_SHORT;
+    }
+    u32_t accessor = gltf_push_accessor(model, index_acc, arena);
+    gltf_accessor_set_indices(model, accessor, remap, index_count, arena);
+    return accessor;
+}
+
+// The primitive's attribute accessors followed by its index accessor. If
+// vertices were split, copies with one element per vertex of sources and
+// indices from remap.
+static void split_accessors(
+        gltf_model_t *model,
+        u32_t prim,
+        const u32_t *remap,
+        u32_t index_count,
+        const u32_t *sources,
+        u32_t vertex_count,
+        u32_t new_vertex_count,
+        i32_t *accessors,
+        re_arena_t *arena) {
+    gltf_primitives_t prims = model->primitives;
+    b8_t split = new_vertex_count > vertex_count;
+    for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+        i32_t source = prims.attributes[attrib][prim];
+        accessors[attrib] = source;
+        if (split && source >= 0) {
+            accessors[attrib] = gltf_push_accessor(model, model->accessors[source], arena);
+            gltf_accessor_gather(model, accessors[attrib], sources, new_vertex_count, arena);
+        }
+    }
+    accessors[GLTF_ATTRIBUTE_COUNT] = split ? (i32_t) push_split_indices(model, prim, remap, index_count, new_vertex_count, arena) : prims.indices[prim];
+}
+
+// Adds a NORMAL attribute to every triangle list that lacks one. Vertices on
+// edges sharper than GLTF_NORMAL_CREASE_ANGLE are split, the primitive then
+// gets copies of its other attributes and indices. Primitives drawing the
+// same indices and attributes share the result.
+static void generate_normals(gltf_model_t *model, re_arena_t *arena) {
+    gltf_primitives_t prims = model->primitives;
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+
+    normal_job_t *jobs = re_arena_push_zero(scratch.arena, prims.count * sizeof(normal_job_t));
+    // Job generating the normals of every primitive, -1 for none.
+    i32_t *job_of = re_arena_push(scratch.arena, prims.count * sizeof(i32_t));
+    u32_t job_count = 0;
+    u64_t triangle_total = 0;
+    for (u32_t i = 0; i < prims.count; i++) {
+        job_of[i] = -1;
+        i32_t position_accessor = prims.attributes[GLTF_ATTRIBUTE_POSITION][i];
+        if (prims.mode[i] != GLTF_PRIMITIVE_MODE_TRIANGLES || prims.attributes[GLTF_ATTRIBUTE_NORMAL][i] >= 0 || position_accessor < 0) {
+            continue;
+        }
+
+        for (u32_t j = 0; j < i && job_of[i] < 0; j++) {
+            b8_t same = job_of[j] >= 0 && prims.indices[j] == prims.indices[i];
+            for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT && same; attrib++) {
+                same = prims.attributes[attrib][j] == prims.attributes[attrib][i];
+            }
+            if (same) {
+                job_of[i] = job_of[j];
+            }
+        }
+        if (job_of[i] >= 0) {
+            continue;
+        }
+
+        u32_t vertex_count = model->accessors[position_accessor].count;
+        normal_job_t *job = &jobs[job_count];
+        job->arena = arena;
+        job->prim = i;
+        job->vertex_count = vertex_count;
+        job->indexed = prims.indices[i] >= 0;
+
+        u32_t *indices;
+        if (job->indexed) {
+            job->index_count = model->accessors[prims.indices[i]].count / 3 * 3;
+            indices = re_arena_push(scratch.arena, model->accessors[prims.indices[i]].count * sizeof(u32_t));
+            if (!gltf_accessor_read_u32(model, prims.indices[i], indices)) {
+                re_log_warn("Primitive %u has unreadable indices, no normals were generated.", i);
+                continue;
+            }
+        } else {
+            // Leftover vertices would get no normal.
+            if (vertex_count % 3 != 0) {
+                continue;
+            }
+            job->index_count = vertex_count;
+            indices = re_arena_push(scratch.arena, job->index_count * sizeof(u32_t));
+            for (u32_t v = 0; v < job->index_count; v++) {
+                indices[v] = v;
+            }
+        }
+
+        f32_t *positions = re_arena_push(scratch.arena, (u64_t) vertex_count * 3 * sizeof(f32_t));
+        if (!gltf_accessor_read_f32(model, position_accessor, positions)) {
+            re_log_warn("Primitive %u has unreadable positions, no normals were generated.", i);
+            continue;
+        }
+
+        job->indices = indices;
+        job->positions = positions;
+        job->corner_normals = re_arena_push(scratch.arena, (u64_t) job->index_count * 3 * sizeof(f32_t));
+        if (job->indexed) {
+            u64_t max_vertices = (u64_t) vertex_count + job->index_count;
+            job->vertex_normals = re_arena_push(scratch.arena, max_vertices * 3 * sizeof(f32_t));
+            job->remap = re_arena_push(scratch.arena, job->index_count * sizeof(u32_t));
+            job->sources = re_arena_push(scratch.arena, max_vertices * sizeof(u32_t));
+        }
+        job_of[i] = job_count++;
+        triangle_total += job->index_count / 3;
+    }
+
+    // One primitive per batch, like tangents.
+    f64_t start = re_os_get_time();
+    job_parallel_for(job_count, 1, normal_job, jobs);
+    f64_t time = re_os_get_time() - start;
+
+    u32_t generated = 0;
+    u32_t split_count = 0;
+    u64_t vertices_before = 0;
+    u64_t vertices_after = 0;
+    for (u32_t i = 0; i < prims.count; i++) {
+        if (job_of[i] < 0) {
+            continue;
+        }
+
+        normal_job_t *job = &jobs[job_of[i]];
+        if (!job->valid) {
+            if (job->prim == i) {
+                re_log_warn("Primitive %u has out of range indices, no normals were generated.", i);
+            }
+            continue;
+        }
+
+        if (!job->pushed) {
+            job->pushed = true;
+            b8_t split = job->new_vertex_count > job->vertex_count;
+            split_accessors(model, i, job->remap, job->index_count, job->sources, job->vertex_count, job->new_vertex_count, job->accessors, arena);
+
+            u64_t size = (u64_t) job->new_vertex_count * 3 * sizeof(f32_t);
+            u8_t *data = gltf_push_aligned(arena, size);
+            memcpy(data, job->vertex_normals, size);
+            u32_t buffer = gltf_push_buffer(model, re_str(data, size), arena);
+            u32_t view = gltf_push_view(model, (gltf_buffer_view_t) {buffer, 0, size, 0, GLTF_BUFFER_TARGET_ARRAY}, arena);
+            job->accessors[GLTF_ATTRIBUTE_NORMAL] = gltf_push_accessor(model, (gltf_accessor_t) {
+                .view = view,
+                .comp_type = GLTF_COMP_TYPE_FLOAT,
+                .count = job->new_vertex_count,
+                .type = GLTF_ACCESSOR_TYPE_VEC3,
+            }, arena);
+
+            split_count += split;
+            vertices_before += job->vertex_count;
+            vertices_after += job->new_vertex_count;
+        }
+
+        for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+            prims.attributes[attrib][i] = job->accessors[attrib];
+        }
+        prims.indices[i] = job->accessors[GLTF_ATTRIBUTE_COUNT];
+        generated++;
+    }
+
+    if (job_count > 0) {
+        re_log_info("Generated normals for %u primitives, %llu triangles, in %.2f ms, %.1f M triangles/s. Split %u primitives along creases, %llu -> %llu vertices.",
+                generated,
+                (unsigned long long) triangle_total,
+                time * 1000.0,
+                time > 0.0 ? triangle_total / time / 1e6 : 0.0,
+                split_count,
+                (unsigned long long) vertices_before,
+                (unsigned long long) vertices_after);
+    }
+
+    re_arena_scratch_release(&scratch);
+}
+
+/*=========================*/
+// Tangents
+/*=========================*/
+
+typedef struct tangent_job_t tangent_job_t;
+struct tangent_job_t {
+    u32_t prim;
+    const u32_t *indices;
+    u32_t index_count;
+    const f32_t *positions;
+    const f32_t *normals;
+    const f32_t *uvs;
+    u32_t vertex_count;
+
+    // Tangents and original vertices, room for every vertex to be split off
+    // a mirror seam once, and the vertex of every corner.
+    f32_t *tangents;
+    u32_t *sources;
+    u32_t *remap;
+    u32_t new_vertex_count;
+    b8_t valid;
+
+    b8_t pushed;
+    i32_t accessors[GLTF_ATTRIBUTE_COUNT + 1];
+};
+
+static void tangent_job(void *user, u32_t begin, u32_t end) {
+    tangent_job_t *jobs = user;
+    for (u32_t i = begin; i < end; i++) {
+        tangent_job_t *job = &jobs[i];
+        job->valid = mesh_generate_tangents(
+                job->tangents,
+                job->remap,
+                job->sources,
+                &job->new_vertex_count,
+                job->indices,
+                job->index_count,
+                job->positions,
+                job->normals,
+                job->uvs,
+                job->vertex_count);
+    }
+}
+
+// Adds a TANGENT attribute to every triangle list with normals and uvs that
+// lacks one. Vertices on mirror seams are split, the primitive then gets
+// copies of its other attributes and indices. Primitives drawing the same
+// indices and attributes share the result.
+static void generate_tangents(gltf_model_t *model, re_arena_t *arena) {
+    gltf_primitives_t prims = model->primitives;
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+
+    tangent_job_t *jobs = re_arena_push_zero(scratch.arena, prims.count * sizeof(tangent_job_t));
+    // Job generating the tangents of every primitive, -1 for none.
+    i32_t *job_of = re_arena_push(scratch.arena, prims.count * sizeof(i32_t));
+    u32_t job_count = 0;
+    u32_t vertex_total = 0;
+    for (u32_t i = 0; i < prims.count; i++) {
+        job_of[i] = -1;
+        i32_t position_accessor = prims.attributes[GLTF_ATTRIBUTE_POSITION][i];
+        i32_t normal_accessor = prims.attributes[GLTF_ATTRIBUTE_NORMAL][i];
+        i32_t uv_accessor = prims.attributes[GLTF_ATTRIBUTE_TEXCOORD_0][i];
+        if (prims.mode[i] != GLTF_PRIMITIVE_MODE_TRIANGLES || prims.attributes[GLTF_ATTRIBUTE_TANGENT][i] >= 0 ||
+                position_accessor < 0 || normal_accessor < 0 || uv_accessor < 0) {
+            continue;
+        }
+
+        for (u32_t j = 0; j < i && job_of[i] < 0; j++) {
+            b8_t same = job_of[j] >= 0 && prims.indices[j] == prims.indices[i];
+            for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT && same; attrib++) {
+                same = prims.attributes[attrib][j] == prims.attributes[attrib][i];
+            }
+            if (same) {
+                job_of[i] = job_of[j];
+            }
+        }
+        if (job_of[i] >= 0) {
+            continue;
+        }
+
+        u32_t vertex_count = model->accessors[position_accessor].count;
+        if (model->accessors[normal_accessor].count != vertex_count || model->accessors[uv_accessor].count != vertex_count) {
+            continue;
+        }
+
+        tangent_job_t *job = &jobs[job_count];
+        job->prim = i;
+        job->vertex_count = vertex_count;
+
+        u32_t *indices;
+        if (prims.indices[i] >= 0) {
+            job->index_count = model->accessors[prims.indices[i]].count / 3 * 3;
+            indices = re_arena_push(scratch.arena, model->accessors[prims.indices[i]].count * sizeof(u32_t));
+            if (!gltf_accessor_read_u32(model, prims.indices[i], indices)) {
+                re_log_warn("Primitive %u has unreadable indices, no tangents were generated.", i);
+                continue;
+            }
+        } else {
+            // Every corner is its own vertex, so none is ever split.
+            job->index_count = vertex_count / 3 * 3;
+            indices = re_arena_push(scratch.arena, job->index_count * sizeof(u32_t));
+            for (u32_t v = 0; v < job->index_count; v++) {
+                indices[v] = v;
+            }
+        }
+
+        f32_t *positions = re_arena_push(scratch.arena, (u64_t) vertex_count * 3 * sizeof(f32_t));
+        f32_t *normals = re_arena_push(scratch.arena, (u64_t) vertex_count * 3 * sizeof(f32_t));
+        f32_t *uvs = re_arena_push(scratch.arena, (u64_t) vertex_count * 2 * sizeof(f32_t));
+        if (!gltf_accessor_read_f32(model, position_accessor, positions) ||
+                !gltf_accessor_read_f32(model, normal_accessor, normals) ||
+                !gltf_accessor_read_f32(model, uv_accessor, uvs)) {
+            re_log_warn("Primitive %u has unreadable attributes, no tangents were generated.", i);
+            continue;
+        }
+
+        u64_t max_vertices = (u64_t) vertex_count * 2;
+        job->indices = indices;
+        job->positions = positions;
+        job->normals = normals;
+        job->uvs = uvs;
+        job->tangents = re_arena_push(scratch.arena, max_vertices * 4 * sizeof(f32_t));
+        job->sources = re_arena_push(scratch.arena, max_vertices * sizeof(u32_t));
+        job->remap = re_arena_push(scratch.arena, job->index_count * sizeof(u32_t));
+        job_of[i] = job_count++;
+        vertex_total += vertex_count;
+    }
+
+    // One primitive per batch, like meshlets.
+    f64_t start = re_os_get_time();
+    job_parallel_for(job_count, 1, tangent_job, jobs);
+    f64_t time = re_os_get_time() - start;
+
+    u32_t generated = 0;
+    u32_t split_count = 0;
+    u64_t vertices_before = 0;
+    u64_t vertices_after = 0;
+    for (u32_t i = 0; i < prims.count; i++) {
+        if (job_of[i] < 0) {
+            continue;
+        }
+
+        tangent_job_t *job = &jobs[job_of[i]];
+        if (!job->valid) {
+            if (job->prim == i) {
+                re_log_warn("Primitive %u has out of range indices, no tangents were generated.", i);
+            }
+            continue;
+        }
+
+        if (!job->pushed) {
+            job->pushed = true;
+            split_accessors(model, i, job->remap, job->index_count, job->sources, job->vertex_count, job->new_vertex_count, job->accessors, arena);
+
+            u64_t size = (u64_t) job->new_vertex_count * 4 * sizeof(f32_t);
+            u8_t *data = gltf_push_aligned(arena, size);
+            memcpy(data, job->tangents, size);
+            u32_t buffer = gltf_push_buffer(model, re_str(data, size), arena);
+            u32_t view = gltf_push_view(model, (gltf_buffer_view_t) {buffer, 0, size, 0, GLTF_BUFFER_TARGET_ARRAY}, arena);
+            job->accessors[GLTF_ATTRIBUTE_TANGENT] = gltf_push_accessor(model, (gltf_accessor_t) {
+                .view = view,
+                .comp_type = GLTF_COMP_TYPE_FLOAT,
+                .count = job->new_vertex_count,
+                .type = GLTF_ACCESSOR_TYPE_VEC4,
+            }, arena);
+
+            split_count += job->new_vertex_count > job->vertex_count;
+            vertices_before += job->vertex_count;
+            vertices_after += job->new_vertex_count;
+        }
+
+        for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+            prims.attributes[attrib][i] = job->accessors[attrib];
+        }
+        prims.indices[i] = job->accessors[GLTF_ATTRIBUTE_COUNT];
+        generated++;
+    }
+
+    if (job_count > 0) {
+        re_log_info("Generated tangents for %u primitives, %u vertices, in %.2f ms, %.1f M vertices/s. Split %u primitives along mirror seams, %llu -> %llu vertices.",
+                generated,
+                vertex_total,
+                time * 1000.0,
+                time > 0.0 ? vertex_total / time / 1e6 : 0.0,
+                split_count,
+                (unsigned long long) vertices_before,
+                (unsigned long long) vertices_after);
+    }
+
+    re_arena_scratch_release(&scratch);
+}
+
+/*=========================*/
+// Interleaving
+/*=========================*/
+
+// Attributes are in the same stream when they share a buffer view and their
+// elements are less than a stride apart.
+static u32_t count_streams(const gltf_model_t *model, u32_t prim) {
+    const gltf_accessor_t *streams[GLTF_ATTRIBUTE_COUNT];
+    u32_t stream_count = 0;
+    for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+        i32_t accessor = model->primitives.attributes[attrib][prim];
+        if (accessor < 0) {
+            continue;
+        }
+
+        const gltf_accessor_t *acc = &model->accessors[accessor];
+        u32_t stride = acc->view >= 0 ? model->views[acc->view].stride : 0;
+        u32_t s = 0;
+        while (s < stream_count && !(acc->view >= 0 && streams[s]->view == acc->view &&
+                    (acc->offset > streams[s]->offset ? acc->offset - streams[s]->offset : streams[s]->offset - acc->offset) < stride)) {
+            s++;
+        }
+        if (s == stream_count) {
+            streams[stream_count++] = acc;
+        }
+    }
+
+    return stream_count;
+}
+
+// True if the accessor's elements are plain and back to back.
+static b8_t tightly_packed(const gltf_model_t *model, u32_t accessor) {
+    const gltf_accessor_t *acc = &model->accessors[accessor];
+    if (acc->view < 0 || acc->sparse.count > 0) {
+        return false;
+    }
+
+    u32_t stride = model->views[acc->view].stride;
+    return stride == 0 || stride == gltf_accessor_element_size(acc);
+}
+
+// Interleaves the attributes of every primitive, positions excluded when
+// position_stream is set. Primitives with the same attributes share the
+// result, ones sharing only some of them are left alone since the shared
+// data would have to be copied.
+static void interleave_attributes(gltf_model_t *model, b8_t position_stream, re_arena_t *arena) {
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    gltf_primitives_t prims = model->primitives;
+
+    // Primitive that interleaved each accessor.
+    i32_t *owner = re_arena_push(scratch.arena, model->accessor_count * sizeof(i32_t));
+    memset(owner, 0xff, model->accessor_count * sizeof(i32_t));
+
+    u32_t interleaved = 0;
+    u32_t skipped = 0;
+    u32_t streams_before = 0;
+    u32_t streams_after = 0;
+    u64_t stride_sum = 0;
+    for (u32_t i = 0; i < prims.count; i++) {
+        u32_t accessors[GLTF_ATTRIBUTE_COUNT];
+        u32_t accessor_count = 0;
+        i32_t position = position_stream ? prims.attributes[GLTF_ATTRIBUTE_POSITION][i] : -1;
+        i32_t first = -1;
+        b8_t shared = true;
+        b8_t valid = true;
+        for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+            i32_t accessor = prims.attributes[attrib][i];
+            if (accessor < 0) {
+                continue;
+            }
+
+            first = first < 0 ? accessor : first;
+            shared &= owner[accessor] == owner[first];
+            valid &= model->accessors[accessor].count == model->accessors[first].count;
+            if (accessor != position) {
+                accessors[accessor_count++] = accessor;
+            }
+        }
+
+        if (first < 0) {
+            continue;
+        }
+        if (owner[first] >= 0) {
+            // Already done through a primitive with exactly these attributes.
+            for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT && shared; attrib++) {
+                shared = prims.attributes[attrib][i] == prims.attributes[attrib][owner[first]];
+            }
+            skipped += !shared;
+            continue;
+        }
+        if (!shared || !valid) {
+            skipped++;
+            continue;
+        }
+
+        streams_before += count_streams(model, i);
+
+        // Positions read from an interleaved view in the file get packed,
+        // as does a single other attribute.
+        if (position >= 0) {
+            if (!tightly_packed(model, position)) {
+                u32_t packed = position;
+                gltf_accessor_interleave(model, &packed, 1, arena);
+            }
+            owner[position] = i;
+        }
+
+        if (accessor_count > 1 || (accessor_count == 1 && !tightly_packed(model, accessors[0]))) {
+            stride_sum += gltf_accessor_interleave(model, accessors, accessor_count, arena);
+        } else if (accessor_count == 1) {
+            stride_sum += gltf_accessor_element_size(&model->accessors[accessors[0]]);
+        }
+        for (u32_t j = 0; j < accessor_count; j++) {
+            owner[accessors[j]] = i;
+        }
+
+        streams_after += count_streams(model, i);
+        interleaved++;
+    }
+
+    if (interleaved > 0) {
+        re_log_info("Interleaved %u primitives, %u -> %u vertex streams, %.1f bytes per vertex%s.",
+                interleaved, streams_before, streams_after, (f64_t) stride_sum / interleaved,
+                position_stream ? " besides positions" : "");
+    }
+    if (skipped > 0) {
+        re_log_debug("Left %u primitives sharing some of their attributes separate.", skipped);
+    }
+    re_arena_scratch_release(&scratch);
+}
+
+/*=========================*/
+// Index narrowing
+/*=========================*/
+
+// Rewrites 32 bit index accessors of primitives and LODs whose indices all fit
+// 16 bits, leaving the largest value free as glTF requires.
+static void narrow_indices(gltf_model_t *model, re_arena_t *arena) {
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    gltf_primitives_t prims = model->primitives;
+
+    u32_t candidate_count = 0;
+    u32_t *candidates = re_arena_push(scratch.arena, (prims.count + model->lod_count) * sizeof(u32_t));
+    b8_t *seen = re_arena_push_zero(scratch.arena, model->accessor_count * sizeof(b8_t));
+    for (u32_t i = 0; i < prims.count + model->lod_count; i++) {
+        i32_t accessor = i < prims.count ? prims.indices[i] : (i32_t) model->lods[i - prims.count].indices;
+        if (accessor >= 0 && !seen[accessor]) {
+            seen[accessor] = true;
+            candidates[candidate_count++] = accessor;
+        }
+    }
+
+    u64_t bytes_before = 0;
+    u64_t bytes_after = 0;
+    u32_t narrowed = 0;
+    for (u32_t i = 0; i < candidate_count; i++) {
+        gltf_accessor_t *acc = &model->accessors[candidates[i]];
+        u64_t size = (u64_t) acc->count * gltf_comp_size(acc->comp_type);
+        bytes_before += size;
+        bytes_after += size;
+        if (acc->comp_type != GLTF_COMP_TYPE_UNSIGNED_INT) {
+            continue;
+        }
+
+        re_arena_temp_t temp = re_arena_scratch_get(&arena, 1);
+        u32_t *indices = re_arena_push(temp.arena, acc->count * sizeof(u32_t));
+        b8_t fits = gltf_accessor_read_u32(model, candidates[i], indices);
+        for (u32_t j = 0; j < acc->count && fits; j++) {
+            fits = indices[j] < 0xffff;
+        }
+
+        if (fits) {
+            acc->comp_type = GLTF_COMP_TYPE_UNSIGNED_SHORT;
+            gltf_accessor_set_indices(model, candidates[i], indices, acc->count, arena);
+            bytes_after -= size / 2;
+            narrowed++;
+        }
+        re_arena_scratch_release(&temp);
+    }
+
+    if (narrowed > 0) {
+        re_log_info("Narrowed %u of %u index accessors to 16 bits, %.2f -> %.2f MB.",
+                narrowed, candidate_count, (f64_t) bytes_before / MB(1), (f64_t) bytes_after / MB(1));
+    }
+    re_arena_scratch_release(&scratch);
+}
+
+/*=========================*/
+// BVH
+/*=========================*/
+
+u32_t gltf_primitive_triangle_count(const gltf_model_t *model, u32_t prim) {
+    gltf_primitives_t prims = model->primitives;
+    i32_t position_accessor = prims.attributes[GLTF_ATTRIBUTE_POSITION][prim];
+    if (prims.mode[prim] != GLTF_PRIMITIVE_MODE_TRIANGLES || position_accessor < 0) {
+        return 0;
+    }
+
+    i32_t index_accessor = prims.indices[prim];
+    u32_t count = index_accessor >= 0 ? model->accessors[index_accessor].count : model->accessors[position_accessor].count;
+    return count / 3;
+}
+
+// One mesh's hierarchy. Small meshes are built one per worker, large ones
+// one after another with each build spread over the pool.
+typedef struct bvh_mesh_t bvh_mesh_t;
+struct bvh_mesh_t {
+    const gltf_model_t *model;
+    u32_t mesh;
+    u32_t triangle_count;
+
+    bvh_node_t *nodes;
+    u32_t *items;
+    u32_t node_count;
+    f64_t time;
+};
+
+// Writes the boxes of the primitive's triangles, returning false if its
+// indices or positions can't be used.
+static b8_t triangle_boxes(const gltf_model_t *model, u32_t prim, f32_t *boxes) {
+    gltf_primitives_t prims = model->primitives;
+    i32_t index_accessor = prims.indices[prim];
+    i32_t position_accessor = prims.attributes[GLTF_ATTRIBUTE_POSITION][prim];
+    u32_t vertex_count = model->accessors[position_accessor].count;
+    u32_t triangle_count = gltf_primitive_triangle_count(model, prim);
+
+    re_arena_t *arena = model->arena;
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    f32_t *positions = re_arena_push(scratch.arena, (u64_t) vertex_count * 3 * sizeof(f32_t));
+    u32_t *indices = NULL;
+    b8_t valid = gltf_accessor_read_f32(model, position_accessor, positions);
+    if (valid && index_accessor >= 0) {
+        indices = re_arena_push(scratch.arena, model->accessors[index_accessor].count * sizeof(u32_t));
+        valid = gltf_accessor_read_u32(model, index_accessor, indices);
+    }
+
+    for (u32_t t = 0; valid && t < triangle_count; t++) {
+        f32_t *box = boxes + (u64_t) t * 6;
+        for (u32_t c = 0; c < 3; c++) {
+            u32_t vertex = indices != NULL ? indices[t * 3 + c] : t * 3 + c;
+            if (vertex >= vertex_count) {
+                valid = false;
+                break;
+            }
+
+            const f32_t *p = positions + (u64_t) vertex * 3;
+            for (u32_t axis = 0; axis < 3; axis++) {
+                box[axis] = c == 0 || p[axis] < box[axis] ? p[axis] : box[axis];
+                box[3 + axis] = c == 0 || p[axis] > box[3 + axis] ? p[axis] : box[3 + axis];
+            }
+        }
+    }
+
+    re_arena_scratch_release(&scratch);
+    return valid;
+}
+
+static void build_mesh_bvh(bvh_mesh_t *job) {
+    f64_t start = re_os_get_time();
+    const gltf_model_t *model = job->model;
+    gltf_mesh_t mesh = model->meshes[job->mesh];
+
+    re_arena_t *arena = model->arena;
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    f32_t *boxes = re_arena_push(scratch.arena, (u64_t) job->triangle_count * 6 * sizeof(f32_t));
+    u32_t triangle = 0;
+    for (u32_t p = mesh.primitive_offset; p < mesh.primitive_offset + mesh.primitive_count; p++) {
+        u32_t count = gltf_primitive_triangle_count(model, p);
+        if (count > 0 && !triangle_boxes(model, p, boxes + (u64_t) triangle * 6)) {
+            re_log_warn("Primitive %u has unreadable or out of range indices, mesh %u gets no BVH.", p, job->mesh);
+            re_arena_scratch_release(&scratch);
+            return;
+        }
+        triangle += count;
+    }
+
+    job->node_count = bvh_build(job->nodes, job->items, boxes, job->triangle_count);
+    re_arena_scratch_release(&scratch);
+    job->time = re_os_get_time() - start;
+}
+
+static void bvh_mesh_job(void *user, u32_t begin, u32_t end) {
+    bvh_mesh_t **jobs = user;
+    for (u32_t i = begin; i < end; i++) {
+        build_mesh_bvh(jobs[i]);
+    }
+}
+
+// One scene's hierarchy over its mesh instances, items are node indices.
+typedef struct bvh_scene_t bvh_scene_t;
+struct bvh_scene_t {
+    bvh_node_t *nodes;
+    u32_t *items;
+    u32_t node_count;
+    u32_t item_count;
+};
+
+// Boxes every node with a mesh below the scene's roots by its mesh's bounds
+// transformed by the node's world matrix. roots holds the root of every node.
+static bvh_scene_t build_scene_bvh(const gltf_model_t *model, u32_t scene, const gltf_aabb_t *mesh_bounds, const u32_t *roots, re_arena_t *arena) {
+    gltf_nodes_t nodes = model->nodes;
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+
+    b8_t *in_scene = re_arena_push_zero(scratch.arena, nodes.count * sizeof(b8_t));
+    gltf_scene_t s = model->scenes[scene];
+    for (u32_t r = s.root_offset; r < s.root_offset + s.root_count; r++) {
+        in_scene[model->scene_roots[r]] = true;
+    }
+
+    f32_t *boxes = re_arena_push(scratch.arena, (u64_t) nodes.count * 6 * sizeof(f32_t));
+    u32_t *instances = re_arena_push(scratch.arena, nodes.count * sizeof(u32_t));
+    u32_t instance_count = 0;
+    for (u32_t n = 0; n < nodes.count; n++) {
+        i32_t mesh = nodes.mesh[n];
+        if (!in_scene[roots[n]] || mesh < 0 || mesh_bounds[mesh].min.X > mesh_bounds[mesh].max.X) {
+            continue;
+        }
+
+        gltf_aabb_t local = mesh_bounds[mesh];
+        f32_t *box = boxes + (u64_t) instance_count * 6;
+        for (u32_t c = 0; c < 8; c++) {
+            HMM_Vec4 corner = HMM_V4(
+                    c & 1 ? local.max.X : local.min.X,
+                    c & 2 ? local.max.Y : local.min.Y,
+                    c & 4 ? local.max.Z : local.min.Z,
+                    1.0f);
+            HMM_Vec4 world = HMM_MulM4V4(nodes.world[n], corner);
+            for (u32_t axis = 0; axis < 3; axis++) {
+                box[axis] = c == 0 || world.Elements[axis] < box[axis] ? world.Elements[axis] : box[axis];
+                box[3 + axis] = c == 0 || world.Elements[axis] > box[3 + axis] ? world.Elements[axis] : box[3 + axis];
+            }
+        }
+        instances[instance_count++] = n;
+    }
+
+    bvh_scene_t bvh = {
+        .nodes = re_arena_push(arena, (u64_t) bvh_node_bound(instance_count) * sizeof(bvh_node_t)),
+        .items = re_arena_push(arena, instance_count * sizeof(u32_t)),
+        .item_count = instance_count,
+    };
+    bvh.node_count = bvh_build(bvh.nodes, bvh.items, boxes, instance_count);
+    for (u32_t i = 0; i < instance_count; i++) {
+        bvh.items[i] = instances[bvh.items[i]];
+    }
+
+    re_arena_scratch_release(&scratch);
+    return bvh;
+}
+
+// Appends a finished hierarchy to the model's node and item arrays.
+static gltf_bvh_t push_bvh(gltf_model_t *model, const bvh_node_t *nodes, u32_t node_count, const u32_t *items, u32_t item_count) {
+    gltf_bvh_t bvh = {model->bvh_node_count, node_count, model->bvh_item_count, item_count};
+    for (u32_t n = 0; n < node_count; n++) {
+        const bvh_node_t *node = &nodes[n];
+        model->bvh_nodes[model->bvh_node_count++] = (gltf_bvh_node_t) {
+            HMM_V3(node->min[0], node->min[1], node->min[2]),
+            node->first,
+            HMM_V3(node->max[0], node->max[1], node->max[2]),
+            node->count,
+        };
+    }
+    if (item_count > 0) {
+        memcpy(model->bvh_items + model->bvh_item_count, items, item_count * sizeof(u32_t));
+        model->bvh_item_count += item_count;
+    }
+    return bvh;
+}
+
+// Builds a hierarchy over the triangles of every mesh, then one over the mesh
+// instances of every scene, stored back to back in the model.
+static void build_bvhs(gltf_model_t *model, re_arena_t *arena) {
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+
+    bvh_mesh_t *meshes = re_arena_push_zero(scratch.arena, model->mesh_count * sizeof(bvh_mesh_t));
+    bvh_mesh_t **small = re_arena_push(scratch.arena, model->mesh_count * sizeof(bvh_mesh_t *));
+    u32_t small_count = 0;
+    for (u32_t i = 0; i < model->mesh_count; i++) {
+        bvh_mesh_t *job = &meshes[i];
+        job->model = model;
+        job->mesh = i;
+        gltf_mesh_t mesh = model->meshes[i];
+        u64_t triangle_count = 0;
+        for (u32_t p = mesh.primitive_offset; p < mesh.primitive_offset + mesh.primitive_count; p++) {
+            triangle_count += gltf_primitive_triangle_count(model, p);
+        }
+        if (triangle_count == 0 || triangle_count > 0x7fffffffu) {
+            continue;
+        }
+
+        job->triangle_count = (u32_t) triangle_count;
+        job->nodes = re_arena_push(scratch.arena, (u64_t) bvh_node_bound(job->triangle_count) * sizeof(bvh_node_t));
+        job->items = re_arena_push(scratch.arena, (u64_t) job->triangle_count * sizeof(u32_t));
+        if (job->triangle_count < BVH_PARALLEL_MIN) {
+            small[small_count++] = job;
+        }
+    }
+
+    f64_t start = re_os_get_time();
+    job_parallel_for(small_count, 1, bvh_mesh_job, small);
+    for (u32_t i = 0; i < model->mesh_count; i++) {
+        if (meshes[i].triangle_count >= BVH_PARALLEL_MIN) {
+            build_mesh_bvh(&meshes[i]);
+        }
+    }
+    f64_t mesh_time = re_os_get_time() - start;
+
+    // Scenes box whole meshes, whatever their primitives draw.
+    start = re_os_get_time();
+    gltf_aabb_t *mesh_bounds = re_arena_push(scratch.arena, model->mesh_count * sizeof(gltf_aabb_t));
+    for (u32_t i = 0; i < model->mesh_count; i++) {
+        gltf_mesh_t mesh = model->meshes[i];
+        gltf_aabb_t box = {HMM_V3(FLT_MAX, FLT_MAX, FLT_MAX), HMM_V3(-FLT_MAX, -FLT_MAX, -FLT_MAX)};
+        for (u32_t p = mesh.primitive_offset; p < mesh.primitive_offset + mesh.primitive_count; p++) {
+            gltf_aabb_t prim = model->primitives.bounds[p];
+            if (prim.min.X <= prim.max.X) {
+                box.min = HMM_V3(fminf(box.min.X, prim.min.X), fminf(box.min.Y, prim.min.Y), fminf(box.min.Z, prim.min.Z));
+                box.max = HMM_V3(fmaxf(box.max.X, prim.max.X), fmaxf(box.max.Y, prim.max.Y), fmaxf(box.max.Z, prim.max.Z));
+            }
+        }
+        mesh_bounds[i] = box;
+    }
+
+    // Parents come first, so a node's root is known before its children's.
+    u32_t *roots = re_arena_push(scratch.arena, model->nodes.count * sizeof(u32_t));
+    for (u32_t n = 0; n < model->nodes.count; n++) {
+        i32_t parent = model->nodes.parent[n];
+        roots[n] = parent < 0 ? n : roots[parent];
+    }
+
+    bvh_scene_t *scenes = re_arena_push(scratch.arena, model->scene_count * sizeof(bvh_scene_t));
+    for (u32_t s = 0; s < model->scene_count; s++) {
+        scenes[s] = build_scene_bvh(model, s, mesh_bounds, roots, scratch.arena);
+    }
+    f64_t scene_time = re_os_get_time() - start;
+
+    u64_t node_count = 0;
+    u64_t item_count = 0;
+    u32_t triangle_count = 0;
+    u32_t instance_count = 0;
+    for (u32_t i = 0; i < model->mesh_count; i++) {
+        node_count += meshes[i].node_count;
+        triangle_count += meshes[i].node_count > 0 ? meshes[i].triangle_count : 0;
+    }
+    for (u32_t s = 0; s < model->scene_count; s++) {
+        node_count += scenes[s].node_count;
+        instance_count += scenes[s].item_count;
+    }
+    item_count = (u64_t) triangle_count + instance_count;
+
+    model->bvh_nodes = re_arena_push(arena, node_count * sizeof(gltf_bvh_node_t));
+    model->bvh_items = re_arena_push(arena, item_count * sizeof(u32_t));
+    model->bvh_node_count = 0;
+    model->bvh_item_count = 0;
+    model->mesh_bvhs = re_arena_push(arena, model->mesh_count * sizeof(gltf_bvh_t));
+    model->mesh_bvh_count = model->mesh_count;
+    model->scene_bvhs = re_arena_push(arena, model->scene_count * sizeof(gltf_bvh_t));
+    model->scene_bvh_count = model->scene_count;
+
+    f64_t cost = 0.0;
+    u32_t mesh_node_count = 0;
+    for (u32_t i = 0; i < model->mesh_count; i++) {
+        bvh_mesh_t *job = &meshes[i];
+        if (job->node_count == 0) {
+            model->mesh_bvhs[i] = push_bvh(model, NULL, 0, NULL, 0);
+            continue;
+        }
+
+        model->mesh_bvhs[i] = push_bvh(model, job->nodes, job->node_count, job->items, job->triangle_count);
+        mesh_node_count += job->node_count;
+        f32_t mesh_cost = bvh_sah_cost(job->nodes, job->node_count);
+        cost += (f64_t) mesh_cost * job->triangle_count;
+        re_log_debug("Mesh %u: %u nodes over %u triangles in %.2f ms, SAH cost %.2f.",
+                i, job->node_count, job->triangle_count, job->time * 1000.0, mesh_cost);
+    }
+    for (u32_t s = 0; s < model->scene_count; s++) {
+        model->scene_bvhs[s] = push_bvh(model, scenes[s].nodes, scenes[s].node_count, scenes[s].items, scenes[s].item_count);
+    }
+
+    if (triangle_count > 0) {
+        re_log_info("Built BVHs for %u meshes, %u triangles, in %.2f ms, %.1f M triangles/s. %u nodes, SAH cost %.2f.",
+                model->mesh_count,
+                triangle_count,
+                mesh_time * 1000.0,
+                mesh_time > 0.0 ? triangle_count / mesh_time / 1e6 : 0.0,
+                mesh_node_count,
+                cost / triangle_count);
+    }
+    if (instance_count > 0) {
+        re_log_info("Built BVHs for %u scenes, %u mesh instances, in %.2f ms.",
+                model->scene_count,
+                instance_count,
+                scene_time * 1000.0);
+    }
+
+    re_arena_scratch_release(&scratch);
+}
+
+void gltf_process(gltf_model_t *model, u32_t process, re_arena_t *arena) {
+    if (process == 0) {
+        return;
+    }
+
+    // First, so merging and renumbering vertices carry the new attributes
+    // along, normals before the tangents built on them.
+    if (process & GLTF_PROCESS_NORMALS) {
+        generate_normals(model, arena);
+    }
+    if (process & GLTF_PROCESS_TANGENTS) {
+        generate_tangents(model, arena);
+    }
+
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+
+    // Index accessors shared between primitives are only processed once.
+    b8_t *done = re_arena_push_zero(scratch.arena, model->accessor_count * sizeof(b8_t));
+    process_stats_t stats = {0};
+
+    u32_t *uses = re_arena_push_zero(scratch.arena, model->accessor_count * sizeof(u32_t));
+    for (u32_t i = 0; i < model->primitives.count; i++) {
+        for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+            i32_t accessor = model->primitives.attributes[attrib][i];
+            if (accessor >= 0) {
+                uses[accessor]++;
+            }
+        }
+        if (model->primitives.indices[i] >= 0) {
+            uses[model->primitives.indices[i]]++;
+        }
+    }
+
+    gltf_primitives_t prims = model->primitives;
+    for (u32_t i = 0; i < prims.count; i++) {
+        i32_t index_accessor = prims.indices[i];
+        i32_t position_accessor = prims.attributes[GLTF_ATTRIBUTE_POSITION][i];
+        if (prims.mode[i] != GLTF_PRIMITIVE_MODE_TRIANGLES || index_accessor < 0 || position_accessor < 0 || done[index_accessor]) {
+            continue;
+        }
+        done[index_accessor] = true;
+
+        u32_t index_count = model->accessors[index_accessor].count;
+        u32_t vertex_count = model->accessors[position_accessor].count;
+
+        re_arena_temp_t temp = re_arena_scratch_get(&arena, 1);
+        u32_t *indices = re_arena_push(temp.arena, index_count * sizeof(u32_t));
+        if (!gltf_accessor_read_u32(model, index_accessor, indices)) {
+            re_log_warn("Primitive %u has unreadable indices and wasn't processed.", i);
+            re_arena_scratch_release(&temp);
+            continue;
+        }
+
+        // Merging vertices connects triangles, so it runs before the passes
+        // that reorder them.
+        b8_t owned = owns_vertices(model, i, uses, vertex_count);
+        if ((process & (GLTF_PROCESS_DEDUPLICATE | GLTF_PROCESS_WELD)) && owned) {
+            b8_t weld = (process & GLTF_PROCESS_WELD) != 0;
+            vertex_count = merge_vertices(model, i, indices, index_count, vertex_count, weld, &stats, arena);
+        }
+
+        if (process & GLTF_PROCESS_VERTEX_CACHE) {
+            optimize_vertex_cache(indices, index_count, vertex_count, &stats);
+        }
+
+        if (process & GLTF_PROCESS_OVERDRAW) {
+            f32_t *positions = re_arena_push(temp.arena, vertex_count * 3 * sizeof(f32_t));
+            if (gltf_accessor_read_f32(model, position_accessor, positions)) {
+                optimize_overdraw(indices, index_count, positions, vertex_count, &stats);
+            }
+        }
+
+        if ((process & GLTF_PROCESS_VERTEX_FETCH) && owned) {
+            optimize_vertex_fetch(model, i, indices, index_count, vertex_count, &stats, arena);
+        }
+
+        gltf_accessor_set_indices(model, index_accessor, indices, index_count, arena);
+        re_arena_scratch_release(&temp);
+    }
+
+    if (stats.merged_before > 0) {
+        re_log_info("%s %llu -> %llu vertices in %.2f ms, %.1f M vertices/s.",
+                (process & GLTF_PROCESS_WELD) ? "Welded" : "Deduplicated",
+                (unsigned long long) stats.merged_before,
+                (unsigned long long) stats.merged_after,
+                stats.merge_time * 1000.0,
+                stats.merge_time > 0.0 ? stats.merged_before / stats.merge_time / 1e6 : 0.0);
+    }
+
+    if ((process & GLTF_PROCESS_VERTEX_CACHE) && stats.triangles > 0) {
+        re_log_info("Vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f over %llu triangles.",
+                stats.acmr_before / stats.triangles,
+                stats.acmr_after / stats.triangles,
+                stats.atvr_before / stats.vertices,
+                stats.atvr_after / stats.vertices,
+                (unsigned long long) stats.triangles);
+    }
+
+    if ((process & GLTF_PROCESS_OVERDRAW) && stats.covered_before > 0 && stats.covered_after > 0) {
+        re_log_info("Overdraw: %.3f -> %.3f, ACMR %.3f -> %.3f.",
+                (f64_t) stats.shaded_before / stats.covered_before,
+                (f64_t) stats.shaded_after / stats.covered_after,
+                stats.overdraw_acmr_before / stats.overdraw_triangles,
+                stats.overdraw_acmr_after / stats.overdraw_triangles);
+    }
+
+    if ((process & GLTF_PROCESS_VERTEX_FETCH) && stats.fetched_before > 0 && stats.fetched_after > 0) {
+        re_log_info("Vertex fetch: efficiency %.3f -> %.3f, %llu of %llu vertices kept.",
+                stats.referenced_before / stats.fetched_before,
+                stats.referenced_after / stats.fetched_after,
+                (unsigned long long) stats.vertices_after,
+                (unsigned long long) stats.vertices_before);
+    }
+
+    re_arena_scratch_release(&scratch);
+
+    // After the other passes, so the pieces, LODs and meshlets index the
+    // final vertices.
+    if (process & GLTF_PROCESS_SPLIT) {
+        split_primitives(model, arena);
+    }
+
+    if (process & GLTF_PROCESS_LOD) {
+        build_lods(model, process, arena);
+    }
+
+    if (process & GLTF_PROCESS_MESHLETS) {
+        build_meshlets(model, arena);
+    }
+
+    if (process & GLTF_PROCESS_INTERLEAVE) {
+        interleave_attributes(model, (process & GLTF_PROCESS_POSITION_STREAM) != 0, arena);
+    }
+
+    // Last, so LOD indices get narrowed too.
+    if (process & GLTF_PROCESS_NARROW_INDICES) {
+        narrow_indices(model, arena);
+    }
+
+    // Vertices may have moved between primitives or been dropped.
+    gltf_update_bounds(model);
+
+    if (process & GLTF_PROCESS_BVH) {
+        build_bvhs(model, arena);
+    }
+}
@@ -0,0 +1,622 @@
+#include "gltf.h"
+#include "gltf_internal.h"
+#include "job.h"
+#include "rebound.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Rays per job batch of gltf_raycast_scene_batch.
+#define RAY_BATCH_SIZE 64
+
+/*=========================*/
+// Packing
+/*=========================*/
+
+// Reads the corners of the mesh's triangles, numbered like its hierarchy's
+// items, with the primitive and triangle each came from. Returns false if a
+// primitive's indices or positions can't be used.
+static b8_t mesh_triangles(const gltf_model_t *model, u32_t mesh, f32_t *corners, i32_t *prims, u32_t *triangles) {
+    gltf_mesh_t m = model->meshes[mesh];
+    u32_t first = 0;
+    for (u32_t p = m.primitive_offset; p < m.primitive_offset + m.primitive_count; p++) {
+        u32_t triangle_count = gltf_primitive_triangle_count(model, p);
+        if (triangle_count == 0) {
+            continue;
+        }
+
+        i32_t index_accessor = model->primitives.indices[p];
+        i32_t position_accessor = model->primitives.attributes[GLTF_ATTRIBUTE_POSITION][p];
+        u32_t vertex_count = model->accessors[position_accessor].count;
+
+        re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+        f32_t *positions = re_arena_push(scratch.arena, (u64_t) vertex_count * 3 * sizeof(f32_t));
+        u32_t *indices = NULL;
+        b8_t valid = gltf_accessor_read_f32(model, position_accessor, positions);
+        if (valid && index_accessor >= 0) {
+            indices = re_arena_push(scratch.arena, model->accessors[index_accessor].count * sizeof(u32_t));
+            valid = gltf_accessor_read_u32(model, index_accessor, indices);
+        }
+
+        for (u32_t t = 0; valid && t < triangle_count; t++) {
+            f32_t *out = corners + (u64_t) (first + t) * 9;
+            for (u32_t c = 0; c < 3 && valid; c++) {
+                u32_t vertex = indices != NULL ? indices[t * 3 + c] : t * 3 + c;
+                valid = vertex < vertex_count;
+                if (valid) {
+                    memcpy(out + c * 3, positions + (u64_t) vertex * 3, 3 * sizeof(f32_t));
+                }
+            }
+            prims[first + t] = (i32_t) p;
+            triangles[first + t] = t;
+        }
+
+        re_arena_scratch_release(&scratch);
+        if (!valid) {
+            return false;
+        }
+        first += triangle_count;
+    }
+    return true;
+}
+
+// Items below every node of a hierarchy, which are always contiguous.
+// Children come after their parent, so walking backwards sees them first.
+static void subtree_ranges(const gltf_bvh_node_t *nodes, u32_t node_count, u32_t *first, u32_t *count) {
+    for (u32_t n = node_count; n-- > 0;) {
+        if (nodes[n].count > 0) {
+            first[n] = nodes[n].first;
+            count[n] = nodes[n].count;
+        } else {
+            u32_t left = nodes[n].first;
+            first[n] = first[left] < first[left + 1] ? first[left] : first[left + 1];
+            count[n] = count[left] + count[left + 1];
+        }
+    }
+}
+
+static f32_t node_area(const gltf_bvh_node_t *node) {
+    HMM_Vec3 d = HMM_SubV3(node->max, node->min);
+    return d.X * d.Y + d.Y * d.Z + d.Z * d.X;
+}
+
+// Packs count items of the mesh's hierarchy starting at first, returning the
+// first pack.
+static u32_t pack_items(gltf_raycaster_t *raycaster, const u32_t *items, u32_t first, u32_t count, const f32_t *corners, const i32_t *prims, const u32_t *triangles) {
+    u32_t first_pack = raycaster->pack_count;
+    raycaster->pack_count += (count + 3) / 4;
+    for (u32_t i = 0; corners != NULL && i < count; i++) {
+        gltf_triangle_pack_t *pack = &raycaster->packs[first_pack + i / 4];
+        u32_t lane = i % 4;
+        u32_t item = items[first + i];
+        const f32_t *c = corners + (u64_t) item * 9;
+        for (u32_t axis = 0; axis < 3; axis++) {
+            pack->corner[axis][lane] = c[axis];
+            pack->edge1[axis][lane] = c[3 + axis] - c[axis];
+            pack->edge2[axis][lane] = c[6 + axis] - c[axis];
+        }
+        pack->primitive[lane] = prims[item];
+        pack->triangle[lane] = triangles[item];
+    }
+    return first_pack;
+}
+
+// A node of the mesh's hierarchy and the four wide node it becomes.
+typedef struct widen_task_t widen_task_t;
+struct widen_task_t {
+    u32_t source;
+    u32_t node;
+};
+
+// Widens the mesh's hierarchy by pulling the children of the largest inner
+// child up until a node has four, and packs the triangles of its leaves.
+static void widen_mesh(gltf_raycaster_t *raycaster, u32_t mesh) {
+    const gltf_model_t *model = raycaster->model;
+    gltf_bvh_t bvh = model->mesh_bvhs[mesh];
+    if (bvh.node_count == 0) {
+        raycaster->mesh_roots[mesh] = -1;
+        return;
+    }
+
+    const gltf_bvh_node_t *nodes = model->bvh_nodes + bvh.node_offset;
+    const u32_t *items = model->bvh_items + bvh.item_offset;
+
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    f32_t *corners = re_arena_push(scratch.arena, (u64_t) bvh.item_count * 9 * sizeof(f32_t));
+    i32_t *prims = re_arena_push(scratch.arena, bvh.item_count * sizeof(i32_t));
+    u32_t *triangles = re_arena_push(scratch.arena, bvh.item_count * sizeof(u32_t));
+    if (!mesh_triangles(model, mesh, corners, prims, triangles)) {
+        re_log_warn("Mesh %u has unreadable or out of range indices, rays miss it.", mesh);
+        corners = NULL;
+    }
+
+    u32_t *first = re_arena_push(scratch.arena, bvh.node_count * sizeof(u32_t));
+    u32_t *count = re_arena_push(scratch.arena, bvh.node_count * sizeof(u32_t));
+    subtree_ranges(nodes, bvh.node_count, first, count);
+
+    widen_task_t *tasks = re_arena_push(scratch.arena, bvh.node_count * sizeof(widen_task_t));
+    u32_t task_count = 0;
+    raycaster->mesh_roots[mesh] = (i32_t) raycaster->node_count;
+    tasks[task_count++] = (widen_task_t) {0, raycaster->node_count++};
+    while (task_count > 0) {
+        widen_task_t task = tasks[--task_count];
+
+        // Subtrees that fit in a pack end the descent, however they split.
+        u32_t children[4];
+        u32_t child_count = 0;
+        if (nodes[task.source].count > 0 || count[task.source] <= 4) {
+            children[child_count++] = task.source;
+        } else {
+            children[child_count++] = nodes[task.source].first;
+            children[child_count++] = nodes[task.source].first + 1;
+        }
+        while (child_count < 4) {
+            i32_t largest = -1;
+            f32_t largest_area = -1.0f;
+            for (u32_t c = 0; c < child_count; c++) {
+                const gltf_bvh_node_t *child = &nodes[children[c]];
+                if (child->count == 0 && count[children[c]] > 4 && node_area(child) > largest_area) {
+                    largest = (i32_t) c;
+                    largest_area = node_area(child);
+                }
+            }
+            if (largest < 0) {
+                break;
+            }
+            u32_t left = nodes[children[largest]].first;
+            children[largest] = left;
+            children[child_count++] = left + 1;
+        }
+
+        gltf_ray_node_t *node = &raycaster->nodes[task.node];
+        for (u32_t c = 0; c < 4; c++) {
+            if (c >= child_count) {
+                for (u32_t axis = 0; axis < 3; axis++) {
+                    node->min[axis][c] = INFINITY;
+                    node->max[axis][c] = INFINITY;
+                }
+                node->child[c] = 0;
+                node->count[c] = 0;
+                continue;
+            }
+
+            const gltf_bvh_node_t *child = &nodes[children[c]];
+            for (u32_t axis = 0; axis < 3; axis++) {
+                node->min[axis][c] = child->min.Elements[axis];
+                node->max[axis][c] = child->max.Elements[axis];
+            }
+            if (child->count > 0 || count[children[c]] <= 4) {
+                u32_t n = children[c];
+                node->child[c] = pack_items(raycaster, items, first[n], count[n], corners, prims, triangles);
+                node->count[c] = (count[n] + 3) / 4;
+            } else {
+                node->child[c] = raycaster->node_count++;
+                node->count[c] = 0;
+                tasks[task_count++] = (widen_task_t) {children[c], node->child[c]};
+            }
+        }
+    }
+    re_arena_scratch_release(&scratch);
+}
+
+// Deepest leaf of a hierarchy. Children always come after their parent.
+static u32_t bvh_depth(const gltf_bvh_node_t *nodes, gltf_bvh_t bvh) {
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    u32_t *depths = re_arena_push_zero(scratch.arena, bvh.node_count * sizeof(u32_t));
+    u32_t depth = 0;
+    for (u32_t n = 0; n < bvh.node_count; n++) {
+        const gltf_bvh_node_t *node = &nodes[bvh.node_offset + n];
+        if (node->count == 0) {
+            depths[node->first] = depths[n] + 1;
+            depths[node->first + 1] = depths[n] + 1;
+        }
+        depth = depths[n] > depth ? depths[n] : depth;
+    }
+    re_arena_scratch_release(&scratch);
+    return depth;
+}
+
+gltf_raycaster_t gltf_raycaster_new(const gltf_model_t *model, re_arena_t *arena) {
+    gltf_raycaster_t raycaster = {.model = model};
+
+    // Every wide node but the roots takes the place of at least one inner
+    // node, packs hold at least one triangle.
+    u32_t node_bound = 0;
+    u32_t pack_bound = 0;
+    for (u32_t m = 0; m < model->mesh_bvh_count; m++) {
+        gltf_bvh_t bvh = model->mesh_bvhs[m];
+        node_bound += bvh.node_count / 2 + 1;
+        pack_bound += bvh.item_count;
+        u32_t depth = bvh_depth(model->bvh_nodes, bvh);
+        raycaster.depth = depth > raycaster.depth ? depth : raycaster.depth;
+    }
+    for (u32_t s = 0; s < model->scene_bvh_count; s++) {
+        u32_t depth = bvh_depth(model->bvh_nodes, model->scene_bvhs[s]);
+        raycaster.depth = depth > raycaster.depth ? depth : raycaster.depth;
+    }
+
+    // Lanes no triangle fills stay zero, their determinant never passes.
+    raycaster.nodes = gltf_push_aligned(arena, (u64_t) node_bound * sizeof(gltf_ray_node_t));
+    raycaster.packs = gltf_push_aligned(arena, (u64_t) pack_bound * sizeof(gltf_triangle_pack_t));
+    memset(raycaster.packs, 0, (u64_t) pack_bound * sizeof(gltf_triangle_pack_t));
+    for (u32_t p = 0; p < pack_bound; p++) {
+        for (u32_t lane = 0; lane < 4; lane++) {
+            raycaster.packs[p].primitive[lane] = -1;
+        }
+    }
+    raycaster.mesh_roots = re_arena_push(arena, model->mesh_count * sizeof(i32_t));
+    for (u32_t m = 0; m < model->mesh_count; m++) {
+        raycaster.mesh_roots[m] = -1;
+    }
+    for (u32_t m = 0; m < model->mesh_bvh_count; m++) {
+        widen_mesh(&raycaster, m);
+    }
+
+    raycaster.inverse_world = gltf_push_aligned(arena, model->nodes.count * sizeof(HMM_Mat4));
+    for (u32_t n = 0; n < model->nodes.count; n++) {
+        raycaster.inverse_world[n] = HMM_InvGeneralM4(model->nodes.world[n]);
+    }
+
+    return raycaster;
+}
+
+/*=========================*/
+// Traversal
+/*=========================*/
+
+// A ray prepared for box and triangle tests. t_max shrinks to the closest
+// hit so far.
+typedef struct trace_t trace_t;
+struct trace_t {
+    f32_t origin[3];
+    f32_t direction[3];
+    f32_t inverse[3];
+    f32_t t_max;
+};
+
+// A node still to visit and where the ray enters its box.
+typedef struct stack_entry_t stack_entry_t;
+struct stack_entry_t {
+    u32_t node;
+    f32_t t;
+};
+
+static trace_t trace_of(HMM_Vec3 origin, HMM_Vec3 direction, f32_t t_max) {
+    trace_t trace = {.t_max = t_max};
+    for (u32_t axis = 0; axis < 3; axis++) {
+        trace.origin[axis] = origin.Elements[axis];
+        trace.direction[axis] = direction.Elements[axis];
+        // Axis parallel rays divide by zero on purpose, the infinities keep
+        // the slab test working.
+        trace.inverse[axis] = 1.0f / direction.Elements[axis];
+    }
+    return trace;
+}
+
+// Distance at which the ray enters the box, FLT_MAX if it misses it or only
+// enters beyond t_max.
+static inline f32_t box_enter(const gltf_bvh_node_t *node, const trace_t *trace) {
+    f32_t enter = 0.0f;
+    f32_t leave = trace->t_max;
+    for (u32_t axis = 0; axis < 3; axis++) {
+        f32_t t0 = (node->min.Elements[axis] - trace->origin[axis]) * trace->inverse[axis];
+        f32_t t1 = (node->max.Elements[axis] - trace->origin[axis]) * trace->inverse[axis];
+        enter = t0 < t1 ? (t0 > enter ? t0 : enter) : (t1 > enter ? t1 : enter);
+        leave = t0 < t1 ? (t1 < leave ? t1 : leave) : (t0 < leave ? t0 : leave);
+    }
+    return enter <= leave ? enter : FLT_MAX;
+}
+
+// Where the ray enters each child box of a node, as a bit per child it
+// enters before t_max. NaNs from rays starting on an axis parallel slab lose
+// every min and max against the running bounds.
+static inline u32_t children_enter(const gltf_ray_node_t *node, const trace_t *trace, f32_t enter[4]) {
+#if defined(__SSE2__)
+    __m128 near = _mm_setzero_ps();
+    __m128 far = _mm_set1_ps(trace->t_max);
+    for (u32_t axis = 0; axis < 3; axis++) {
+        __m128 origin = _mm_set1_ps(trace->origin[axis]);
+        __m128 inverse = _mm_set1_ps(trace->inverse[axis]);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node->min[axis]), origin), inverse);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node->max[axis]), origin), inverse);
+        near = _mm_max_ps(_mm_min_ps(t0, t1), near);
+        far = _mm_min_ps(_mm_max_ps(t0, t1), far);
+    }
+    _mm_storeu_ps(enter, near);
+    return (u32_t) _mm_movemask_ps(_mm_cmple_ps(near, far));
+#else
+    u32_t mask = 0;
+    for (u32_t c = 0; c < 4; c++) {
+        f32_t near = 0.0f;
+        f32_t far = trace->t_max;
+        for (u32_t axis = 0; axis < 3; axis++) {
+            f32_t t0 = (node->min[axis][c] - trace->origin[axis]) * trace->inverse[axis];
+            f32_t t1 = (node->max[axis][c] - trace->origin[axis]) * trace->inverse[axis];
+            f32_t low = t0 < t1 ? t0 : t1;
+            f32_t high = t0 < t1 ? t1 : t0;
+            near = low > near ? low : near;
+            far = high < far ? high : far;
+        }
+        enter[c] = near;
+        mask |= (u32_t) (near <= far) << c;
+    }
+    return mask;
+#endif
+}
+
+// Möller, Trumbore, "Fast, Minimum Storage Ray/Triangle Intersection", 1997,
+// on the four triangles of a pack at once. Takes the closest hit before
+// t_max, returning the lane or -1.
+static i32_t intersect_pack(const gltf_triangle_pack_t *pack, trace_t *trace, f32_t *u_out, f32_t *v_out) {
+    f32_t t[4];
+    f32_t u[4];
+    f32_t v[4];
+    u32_t hits = 0;
+#if defined(__SSE2__)
+    __m128 dx = _mm_set1_ps(trace->direction[0]);
+    __m128 dy = _mm_set1_ps(trace->direction[1]);
+    __m128 dz = _mm_set1_ps(trace->direction[2]);
+    __m128 e1x = _mm_load_ps(pack->edge1[0]);
+    __m128 e1y = _mm_load_ps(pack->edge1[1]);
+    __m128 e1z = _mm_load_ps(pack->edge1[2]);
+    __m128 e2x = _mm_load_ps(pack->edge2[0]);
+    __m128 e2y = _mm_load_ps(pack->edge2[1]);
+    __m128 e2z = _mm_load_ps(pack->edge2[2]);
+
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    __m128 sx = _mm_sub_ps(_mm_set1_ps(trace->origin[0]), _mm_load_ps(pack->corner[0]));
+    __m128 sy = _mm_sub_ps(_mm_set1_ps(trace->origin[1]), _mm_load_ps(pack->corner[1]));
+    __m128 sz = _mm_sub_ps(_mm_set1_ps(trace->origin[2]), _mm_load_ps(pack->corner[2]));
+    __m128 u4 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv);
+
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+    __m128 v4 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv);
+    __m128 t4 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv);
+
+    // Degenerate lanes divide by zero, the NaNs and infinities fail the
+    // comparisons.
+    __m128 zero = _mm_setzero_ps();
+    __m128 mask = _mm_cmpneq_ps(det, zero);
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(u4, zero));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(v4, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u4, v4), _mm_set1_ps(1.0f)));
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(t4, zero));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(t4, _mm_set1_ps(trace->t_max)));
+    hits = (u32_t) _mm_movemask_ps(mask);
+    if (hits == 0) {
+        return -1;
+    }
+    _mm_storeu_ps(t, t4);
+    _mm_storeu_ps(u, u4);
+    _mm_storeu_ps(v, v4);
+#else
+    const f32_t *d = trace->direction;
+    for (u32_t lane = 0; lane < 4; lane++) {
+        f32_t e1[3] = {pack->edge1[0][lane], pack->edge1[1][lane], pack->edge1[2][lane]};
+        f32_t e2[3] = {pack->edge2[0][lane], pack->edge2[1][lane], pack->edge2[2][lane]};
+        f32_t p[3] = {d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0]};
+        f32_t det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        if (det == 0.0f) {
+            continue;
+        }
+
+        f32_t inv = 1.0f / det;
+        f32_t s[3];
+        for (u32_t axis = 0; axis < 3; axis++) {
+            s[axis] = trace->origin[axis] - pack->corner[axis][lane];
+        }
+        f32_t q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0]};
+        u[lane] = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+        v[lane] = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inv;
+        t[lane] = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+        if (u[lane] >= 0.0f && v[lane] >= 0.0f && u[lane] + v[lane] <= 1.0f && t[lane] > 0.0f && t[lane] < trace->t_max) {
+            hits |= 1u << lane;
+        }
+    }
+    if (hits == 0) {
+        return -1;
+    }
+#endif
+
+    i32_t closest = -1;
+    for (u32_t lane = 0; lane < 4; lane++) {
+        if ((hits >> lane & 1) && t[lane] < trace->t_max) {
+            trace->t_max = t[lane];
+            closest = (i32_t) lane;
+        }
+    }
+    *u_out = u[closest];
+    *v_out = v[closest];
+    return closest;
+}
+
+// Visits the children of an inner node nearest first, pushing the far one.
+// Returns the node to visit next, or -1 to pop one.
+static inline i32_t visit_children(const gltf_bvh_node_t *nodes, u32_t base, const gltf_bvh_node_t *node, const trace_t *trace, stack_entry_t *stack, u32_t *top) {
+    u32_t left = base + node->first;
+    u32_t right = left + 1;
+    f32_t t_left = box_enter(&nodes[left], trace);
+    f32_t t_right = box_enter(&nodes[right], trace);
+    if (t_right < t_left) {
+        u32_t node_swap = left;
+        left = right;
+        right = node_swap;
+        f32_t t_swap = t_left;
+        t_left = t_right;
+        t_right = t_swap;
+    }
+
+    if (t_right != FLT_MAX) {
+        stack[(*top)++] = (stack_entry_t) {right, t_right};
+    }
+    return t_left != FLT_MAX ? (i32_t) left : -1;
+}
+
+// Pops nodes the ray still enters before its closest hit, -1 once empty.
+static inline i32_t pop(const stack_entry_t *stack, u32_t *top, const trace_t *trace) {
+    while (*top > 0) {
+        stack_entry_t entry = stack[--(*top)];
+        if (entry.t < trace->t_max) {
+            return (i32_t) entry.node;
+        }
+    }
+    return -1;
+}
+
+// A wide node is no deeper than the two wide one it came from and leaves at
+// most three children on the stack.
+static u32_t mesh_stack_size(const gltf_raycaster_t *raycaster) {
+    return raycaster->depth * 3 + 1;
+}
+
+// Closest hit against the mesh's packs, updating hit and trace->t_max.
+// Returns true if the mesh was hit before the previous t_max.
+static b8_t intersect_mesh(const gltf_raycaster_t *raycaster, u32_t mesh, trace_t *trace, gltf_ray_hit_t *hit, stack_entry_t *stack) {
+    if (mesh >= raycaster->model->mesh_count || raycaster->mesh_roots[mesh] < 0) {
+        return false;
+    }
+
+    b8_t found = false;
+    u32_t top = 0;
+    i32_t current = raycaster->mesh_roots[mesh];
+    while (current >= 0) {
+        const gltf_ray_node_t *node = &raycaster->nodes[current];
+        f32_t enter[4];
+        u32_t mask = children_enter(node, trace, enter);
+
+        // Leaves are tested first, their hits may cull the inner children.
+        u32_t inner[4];
+        f32_t inner_enter[4];
+        u32_t inner_count = 0;
+        for (; mask != 0; mask &= mask - 1) {
+            u32_t c = __builtin_ctz(mask);
+            if (node->count[c] == 0) {
+                // Sorted by distance, farthest first.
+                u32_t i = inner_count++;
+                for (; i > 0 && inner_enter[i - 1] < enter[c]; i--) {
+                    inner[i] = inner[i - 1];
+                    inner_enter[i] = inner_enter[i - 1];
+                }
+                inner[i] = node->child[c];
+                inner_enter[i] = enter[c];
+                continue;
+            }
+
+            for (u32_t p = node->child[c]; p < node->child[c] + node->count[c]; p++) {
+                const gltf_triangle_pack_t *pack = &raycaster->packs[p];
+                f32_t u;
+                f32_t v;
+                i32_t lane = intersect_pack(pack, trace, &u, &v);
+                if (lane >= 0) {
+                    *hit = (gltf_ray_hit_t) {trace->t_max, u, v, -1, pack->primitive[lane], pack->triangle[lane]};
+                    found = true;
+                }
+            }
+        }
+
+        // The nearest child is visited next, the others wait on the stack.
+        for (u32_t i = 0; i + 1 < inner_count; i++) {
+            if (inner_enter[i] < trace->t_max) {
+                stack[top++] = (stack_entry_t) {inner[i], inner_enter[i]};
+            }
+        }
+        b8_t descend = inner_count > 0 && inner_enter[inner_count - 1] < trace->t_max;
+        current = descend ? (i32_t) inner[inner_count - 1] : pop(stack, &top, trace);
+    }
+    return found;
+}
+
+static gltf_ray_hit_t miss(void) {
+    return (gltf_ray_hit_t) {FLT_MAX, 0.0f, 0.0f, -1, -1, 0};
+}
+
+gltf_ray_hit_t gltf_raycast_mesh(const gltf_raycaster_t *raycaster, u32_t mesh, gltf_ray_t ray) {
+    gltf_ray_hit_t hit = miss();
+    trace_t trace = trace_of(ray.origin, ray.direction, ray.t_max);
+
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    stack_entry_t *stack = re_arena_push(scratch.arena, mesh_stack_size(raycaster) * sizeof(stack_entry_t));
+    intersect_mesh(raycaster, mesh, &trace, &hit, stack);
+    re_arena_scratch_release(&scratch);
+    return hit;
+}
+
+gltf_ray_hit_t gltf_raycast_scene(const gltf_raycaster_t *raycaster, u32_t scene, gltf_ray_t ray) {
+    gltf_ray_hit_t hit = miss();
+    const gltf_model_t *model = raycaster->model;
+    if (scene >= model->scene_bvh_count || model->scene_bvhs[scene].node_count == 0) {
+        return hit;
+    }
+
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    stack_entry_t *stack = re_arena_push(scratch.arena, (raycaster->depth + 1) * sizeof(stack_entry_t));
+    stack_entry_t *mesh_stack = re_arena_push(scratch.arena, mesh_stack_size(raycaster) * sizeof(stack_entry_t));
+
+    // Instances are tested in mesh space. The direction isn't renormalized,
+    // so distances carry over between the spaces.
+    gltf_bvh_t bvh = model->scene_bvhs[scene];
+    const gltf_bvh_node_t *nodes = model->bvh_nodes;
+    const u32_t *items = model->bvh_items + bvh.item_offset;
+    u32_t base = bvh.node_offset;
+    trace_t trace = trace_of(ray.origin, ray.direction, ray.t_max);
+    u32_t top = 0;
+    i32_t current = box_enter(&nodes[base], &trace) != FLT_MAX ? (i32_t) base : -1;
+    while (current >= 0) {
+        const gltf_bvh_node_t *node = &nodes[current];
+        if (node->count == 0) {
+            current = visit_children(nodes, base, node, &trace, stack, &top);
+            if (current < 0) {
+                current = pop(stack, &top, &trace);
+            }
+            continue;
+        }
+
+        for (u32_t i = node->first; i < node->first + node->count; i++) {
+            u32_t instance = items[i];
+            const HMM_Mat4 *inverse = &raycaster->inverse_world[instance];
+            HMM_Vec3 origin = HMM_MulM4V4(*inverse, HMM_V4V(ray.origin, 1.0f)).XYZ;
+            HMM_Vec3 direction = HMM_MulM4V4(*inverse, HMM_V4V(ray.direction, 0.0f)).XYZ;
+            trace_t local = trace_of(origin, direction, trace.t_max);
+            if (intersect_mesh(raycaster, (u32_t) model->nodes.mesh[instance], &local, &hit, mesh_stack)) {
+                hit.node = (i32_t) instance;
+                trace.t_max = local.t_max;
+            }
+        }
+        current = pop(stack, &top, &trace);
+    }
+
+    re_arena_scratch_release(&scratch);
+    return hit;
+}
+
+typedef struct ray_job_t ray_job_t;
+struct ray_job_t {
+    const gltf_raycaster_t *raycaster;
+    u32_t scene;
+    const gltf_ray_t *rays;
+    gltf_ray_hit_t *hits;
+};
+
+static void ray_batch(void *user, u32_t begin, u32_t end) {
+    ray_job_t *job = user;
+    for (u32_t i = begin; i < end; i++) {
+        job->hits[i] = gltf_raycast_scene(job->raycaster, job->scene, job->rays[i]);
+    }
+}
+
+void gltf_raycast_scene_batch(const gltf_raycaster_t *raycaster, u32_t scene, const gltf_ray_t *rays, gltf_ray_hit_t *hits, u32_t count) {
+    ray_job_t job = {raycaster, scene, rays, hits};
+    job_parallel_for(count, RAY_BATCH_SIZE, ray_batch, &job);
+}
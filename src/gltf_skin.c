@@ -0,0 +1,110 @@
+#include "gltf.h"
+#include "job.h"
+#include "mesh.h"
+#include "rebound.h"
+
+// Vertices per job batch of gltf_skin_apply, enough to keep the palette in
+// cache for a while.
+#define SKIN_BATCH_SIZE 4096
+
+b8_t gltf_skin_vertices(const gltf_model_t *model, u32_t prim, u32_t skin, gltf_skin_vertices_t *out, re_arena_t *arena) {
+    gltf_primitives_t prims = model->primitives;
+    i32_t position_accessor = prims.attributes[GLTF_ATTRIBUTE_POSITION][prim];
+    i32_t normal_accessor = prims.attributes[GLTF_ATTRIBUTE_NORMAL][prim];
+    i32_t joint_accessor = prims.attributes[GLTF_ATTRIBUTE_JOINTS_0][prim];
+    i32_t weight_accessor = prims.attributes[GLTF_ATTRIBUTE_WEIGHTS_0][prim];
+    u32_t joint_count = model->skins[skin].joint_count;
+    if (position_accessor < 0 || joint_accessor < 0 || weight_accessor < 0 || joint_count == 0) {
+        return false;
+    }
+
+    u32_t count = model->accessors[position_accessor].count;
+    if (model->accessors[joint_accessor].count != count || model->accessors[weight_accessor].count != count) {
+        return false;
+    }
+
+    gltf_skin_vertices_t v = {0};
+    v.count = count;
+    v.positions = re_arena_push(arena, (u64_t) count * 3 * sizeof(f32_t));
+    v.joints = re_arena_push(arena, (u64_t) count * 4 * sizeof(u16_t));
+    v.weights = re_arena_push(arena, (u64_t) count * 4 * sizeof(f32_t));
+    if (!gltf_accessor_read_f32(model, position_accessor, v.positions) ||
+            !gltf_accessor_read_u16(model, joint_accessor, v.joints) ||
+            !gltf_accessor_read_f32(model, weight_accessor, v.weights)) {
+        return false;
+    }
+    if (normal_accessor >= 0 && model->accessors[normal_accessor].count == count) {
+        v.normals = re_arena_push(arena, (u64_t) count * 3 * sizeof(f32_t));
+        if (!gltf_accessor_read_f32(model, normal_accessor, v.normals)) {
+            v.normals = NULL;
+        }
+    }
+
+    // Quantized weights rarely add up to exactly one, and the kernel indexes
+    // the palette without checking the joints.
+    for (u32_t i = 0; i < count; i++) {
+        u16_t *joints = v.joints + (u64_t) i * 4;
+        f32_t *weights = v.weights + (u64_t) i * 4;
+        f32_t sum = 0.0f;
+        for (u32_t k = 0; k < 4; k++) {
+            if (joints[k] >= joint_count || !(weights[k] > 0.0f)) {
+                joints[k] = 0;
+                weights[k] = 0.0f;
+            }
+            sum += weights[k];
+        }
+
+        if (sum > 0.0f) {
+            for (u32_t k = 0; k < 4; k++) {
+                weights[k] /= sum;
+            }
+        } else {
+            weights[0] = 1.0f;
+        }
+    }
+
+    *out = v;
+    return true;
+}
+
+void gltf_skin_palette(const gltf_model_t *model, u32_t skin, f32_t *palette) {
+    gltf_skin_t s = model->skins[skin];
+    for (u32_t j = 0; j < s.joint_count; j++) {
+        u32_t joint = s.joint_offset + j;
+        HMM_Mat4 m = HMM_MulM4(model->nodes.world[model->skin_joints[joint]], model->inverse_binds[joint]);
+        f32_t *columns = palette + (u64_t) j * MESH_SKIN_JOINT_FLOATS;
+        for (u32_t c = 0; c < 4; c++) {
+            columns[c * 4] = m.Columns[c].X;
+            columns[c * 4 + 1] = m.Columns[c].Y;
+            columns[c * 4 + 2] = m.Columns[c].Z;
+            columns[c * 4 + 3] = 0.0f;
+        }
+    }
+}
+
+typedef struct skin_job_t skin_job_t;
+struct skin_job_t {
+    const gltf_skin_vertices_t *vertices;
+    const f32_t *palette;
+    f32_t *positions;
+    f32_t *normals;
+};
+
+static void skin_range(void *user, u32_t begin, u32_t end) {
+    skin_job_t *job = user;
+    const gltf_skin_vertices_t *v = job->vertices;
+    mesh_skin(
+            job->positions + (u64_t) begin * 3,
+            job->normals ? job->normals + (u64_t) begin * 3 : NULL,
+            v->positions + (u64_t) begin * 3,
+            v->normals ? v->normals + (u64_t) begin * 3 : NULL,
+            v->joints + (u64_t) begin * 4,
+            v->weights + (u64_t) begin * 4,
+            end - begin,
+            job->palette);
+}
+
+void gltf_skin_apply(const gltf_skin_vertices_t *vertices, const f32_t *palette, f32_t *positions, f32_t *normals) {
+    skin_job_t job = {vertices, palette, positions, vertices->normals ? normals : NULL};
+    job_parallel_for(vertices->count, SKIN_BATCH_SIZE, skin_range, &job);
+}
@@ -0,0 +1,322 @@
+#include "heap.h"
+#include "rebound.h"
+
+#include <string.h>
+
+/*=========================*/
+// Size classes
+/*=========================*/
+
+// Sizes are counted in granules. Below HEAP_SL_COUNT granules every size has
+// its own list, above that each power of two range is split evenly.
+static void size_class(u64_t granules, u32_t *fl, u32_t *sl) {
+    if (granules < HEAP_SL_COUNT) {
+        *fl = 0;
+        *sl = granules;
+        return;
+    }
+
+    u32_t log = 63 - __builtin_clzll(granules);
+    *fl = log - HEAP_SL_BITS + 1;
+    *sl = (granules >> (log - HEAP_SL_BITS)) - HEAP_SL_COUNT;
+}
+
+// Class of the smallest list whose blocks are all at least granules large.
+static void search_class(u64_t granules, u32_t *fl, u32_t *sl) {
+    if (granules >= HEAP_SL_COUNT) {
+        u32_t log = 63 - __builtin_clzll(granules);
+        granules += (1ull << (log - HEAP_SL_BITS)) - 1;
+    }
+    size_class(granules, fl, sl);
+}
+
+/*=========================*/
+// Block lists
+/*=========================*/
+
+static u32_t new_block(heap_t *heap) {
+    u32_t block = heap->unused;
+    if (block != HEAP_NONE) {
+        heap->unused = heap->blocks[block].next_free;
+    }
+    return block;
+}
+
+static void release_block(heap_t *heap, u32_t block) {
+    heap->blocks[block].next_free = heap->unused;
+    heap->unused = block;
+}
+
+static void insert_free(heap_t *heap, u32_t block) {
+    heap_block_t *b = &heap->blocks[block];
+    u32_t fl, sl;
+    size_class(b->size / HEAP_GRANULARITY, &fl, &sl);
+
+    u32_t *head = &heap->heads[fl * HEAP_SL_COUNT + sl];
+    b->free = true;
+    b->prev_free = HEAP_NONE;
+    b->next_free = *head;
+    if (*head != HEAP_NONE) {
+        heap->blocks[*head].prev_free = block;
+    }
+    *head = block;
+
+    heap->fl_bitmap |= 1ull << fl;
+    heap->sl_bitmap[fl] |= 1u << sl;
+}
+
+static void remove_free(heap_t *heap, u32_t block) {
+    heap_block_t *b = &heap->blocks[block];
+    u32_t fl, sl;
+    size_class(b->size / HEAP_GRANULARITY, &fl, &sl);
+
+    if (b->prev_free != HEAP_NONE) {
+        heap->blocks[b->prev_free].next_free = b->next_free;
+    } else {
+        heap->heads[fl * HEAP_SL_COUNT + sl] = b->next_free;
+    }
+    if (b->next_free != HEAP_NONE) {
+        heap->blocks[b->next_free].prev_free = b->prev_free;
+    }
+    b->free = false;
+
+    if (heap->heads[fl * HEAP_SL_COUNT + sl] == HEAP_NONE) {
+        heap->sl_bitmap[fl] &= ~(1u << sl);
+        if (heap->sl_bitmap[fl] == 0) {
+            heap->fl_bitmap &= ~(1ull << fl);
+        }
+    }
+}
+
+// Cuts the first size bytes off a block, returning the block holding the
+// rest, or HEAP_NONE when nothing is left or no node is available.
+static u32_t split_block(heap_t *heap, u32_t block, u64_t size) {
+    if (heap->blocks[block].size <= size) {
+        return HEAP_NONE;
+    }
+
+    u32_t rest = new_block(heap);
+    if (rest == HEAP_NONE) {
+        return HEAP_NONE;
+    }
+
+    heap_block_t *b = &heap->blocks[block];
+    heap->blocks[rest] = (heap_block_t) {
+        .offset = b->offset + size,
+        .size = b->size - size,
+        .prev_phys = block,
+        .next_phys = b->next_phys,
+    };
+    if (b->next_phys != HEAP_NONE) {
+        heap->blocks[b->next_phys].prev_phys = rest;
+    }
+    b->next_phys = rest;
+    b->size = size;
+    return rest;
+}
+
+// Folds next, a free block not in any list, into block.
+static void merge_next(heap_t *heap, u32_t block, u32_t next) {
+    heap_block_t *b = &heap->blocks[block];
+    heap_block_t *n = &heap->blocks[next];
+    b->size += n->size;
+    b->next_phys = n->next_phys;
+    if (n->next_phys != HEAP_NONE) {
+        heap->blocks[n->next_phys].prev_phys = block;
+    }
+    release_block(heap, next);
+}
+
+/*=========================*/
+// Interface
+/*=========================*/
+
+heap_t heap_new(u64_t size, u32_t max_allocations, re_arena_t *arena) {
+    heap_t heap = {
+        .size = size / HEAP_GRANULARITY * HEAP_GRANULARITY,
+        // Every allocation splits off at most an alignment gap and a rest.
+        .block_capacity = max_allocations * 2 + 1,
+        .unused = HEAP_NONE,
+    };
+    heap.blocks = re_arena_push(arena, heap.block_capacity * sizeof(heap_block_t));
+    heap.heads = re_arena_push(arena, HEAP_FL_COUNT * HEAP_SL_COUNT * sizeof(u32_t));
+    memset(heap.heads, 0xff, HEAP_FL_COUNT * HEAP_SL_COUNT * sizeof(u32_t));
+
+    for (u32_t i = heap.block_capacity; i-- > 0;) {
+        release_block(&heap, i);
+    }
+
+    heap.first = HEAP_NONE;
+    if (heap.size > 0) {
+        heap.first = new_block(&heap);
+        heap.blocks[heap.first] = (heap_block_t) {0, heap.size, HEAP_NONE, HEAP_NONE, HEAP_NONE, HEAP_NONE, false};
+        insert_free(&heap, heap.first);
+    }
+
+    return heap;
+}
+
+b8_t heap_alloc(heap_t *heap, u64_t size, u64_t alignment, heap_allocation_t *allocation) {
+    if (size == 0 || size > heap->size) {
+        return false;
+    }
+
+    size = (size + HEAP_GRANULARITY - 1) / HEAP_GRANULARITY * HEAP_GRANULARITY;
+    alignment = alignment > HEAP_GRANULARITY ? alignment : HEAP_GRANULARITY;
+    // Room to move the start up to the next aligned offset.
+    u64_t search = size + alignment - HEAP_GRANULARITY;
+
+    u32_t fl, sl;
+    search_class(search / HEAP_GRANULARITY, &fl, &sl);
+    if (fl >= HEAP_FL_COUNT) {
+        return false;
+    }
+
+    u32_t sl_map = heap->sl_bitmap[fl] & (~0u << sl);
+    if (sl_map == 0) {
+        u64_t fl_map = fl + 1 < HEAP_FL_COUNT ? heap->fl_bitmap & (~0ull << (fl + 1)) : 0;
+        if (fl_map == 0) {
+            return false;
+        }
+        fl = __builtin_ctzll(fl_map);
+        sl_map = heap->sl_bitmap[fl];
+    }
+    sl = __builtin_ctz(sl_map);
+
+    u32_t block = heap->heads[fl * HEAP_SL_COUNT + sl];
+    // Splits need up to two nodes, checked up front so a failed split never
+    // leaves a block half taken.
+    u32_t spare = heap->unused;
+    if (spare == HEAP_NONE || heap->blocks[spare].next_free == HEAP_NONE) {
+        return false;
+    }
+    remove_free(heap, block);
+
+    u64_t offset = heap->blocks[block].offset;
+    u64_t gap = (offset + alignment - 1) / alignment * alignment - offset;
+    if (gap > 0) {
+        u32_t aligned = split_block(heap, block, gap);
+        insert_free(heap, block);
+        block = aligned;
+    }
+
+    u32_t rest = split_block(heap, block, size);
+    if (rest != HEAP_NONE) {
+        insert_free(heap, rest);
+    }
+
+    heap->used += heap->blocks[block].size;
+    heap->allocation_count++;
+    *allocation = (heap_allocation_t) {heap->blocks[block].offset, heap->blocks[block].size, block};
+    return true;
+}
+
+void heap_free(heap_t *heap, heap_allocation_t allocation) {
+    u32_t block = allocation.block;
+    heap->used -= heap->blocks[block].size;
+    heap->allocation_count--;
+
+    u32_t next = heap->blocks[block].next_phys;
+    if (next != HEAP_NONE && heap->blocks[next].free) {
+        remove_free(heap, next);
+        merge_next(heap, block, next);
+    }
+
+    u32_t prev = heap->blocks[block].prev_phys;
+    if (prev != HEAP_NONE && heap->blocks[prev].free) {
+        remove_free(heap, prev);
+        merge_next(heap, prev, block);
+        block = prev;
+    }
+
+    insert_free(heap, block);
+}
+
+heap_stats_t heap_stats(const heap_t *heap) {
+    heap_stats_t stats = {.used = heap->used, .allocation_count = heap->allocation_count};
+
+    for (u32_t block = heap->first; block != HEAP_NONE; block = heap->blocks[block].next_phys) {
+        const heap_block_t *b = &heap->blocks[block];
+        if (b->free) {
+            stats.free += b->size;
+            stats.largest_free = b->size > stats.largest_free ? b->size : stats.largest_free;
+            stats.free_block_count++;
+        }
+    }
+
+    return stats;
+}
+
+b8_t heap_validate(const heap_t *heap) {
+    u64_t offset = 0;
+    u64_t used = 0;
+    u32_t allocations = 0;
+    u32_t free_blocks = 0;
+    u32_t steps = 0;
+    u32_t prev = HEAP_NONE;
+    for (u32_t block = heap->first; block != HEAP_NONE; block = heap->blocks[block].next_phys) {
+        const heap_block_t *b = &heap->blocks[block];
+        if (++steps > heap->block_capacity || b->offset != offset || b->prev_phys != prev ||
+                b->size == 0 || b->size % HEAP_GRANULARITY != 0) {
+            re_log_error("Heap block %u at %llu doesn't follow the block before it at %llu.",
+                    block, (unsigned long long) b->offset, (unsigned long long) offset);
+            return false;
+        }
+        if (b->free && prev != HEAP_NONE && heap->blocks[prev].free) {
+            re_log_error("Heap blocks %u and %u are free neighbours.", prev, block);
+            return false;
+        }
+
+        if (b->free) {
+            free_blocks++;
+        } else {
+            used += b->size;
+            allocations++;
+        }
+        offset += b->size;
+        prev = block;
+    }
+
+    if (offset != heap->size || used != heap->used || allocations != heap->allocation_count) {
+        re_log_error("Heap blocks cover %llu of %llu bytes with %u allocations of %llu bytes, counted %u of %llu.",
+                (unsigned long long) offset, (unsigned long long) heap->size, allocations, (unsigned long long) used,
+                heap->allocation_count, (unsigned long long) heap->used);
+        return false;
+    }
+
+    u32_t listed = 0;
+    for (u32_t fl = 0; fl < HEAP_FL_COUNT; fl++) {
+        if (((heap->fl_bitmap >> fl) & 1) != (heap->sl_bitmap[fl] != 0)) {
+            re_log_error("Heap first level %u bit disagrees with its second level bitmap.", fl);
+            return false;
+        }
+
+        for (u32_t sl = 0; sl < HEAP_SL_COUNT; sl++) {
+            u32_t head = heap->heads[fl * HEAP_SL_COUNT + sl];
+            if (((heap->sl_bitmap[fl] >> sl) & 1) != (head != HEAP_NONE)) {
+                re_log_error("Heap size class %u, %u bit disagrees with its list.", fl, sl);
+                return false;
+            }
+
+            u32_t prev_free = HEAP_NONE;
+            for (u32_t block = head; block != HEAP_NONE; block = heap->blocks[block].next_free) {
+                const heap_block_t *b = &heap->blocks[block];
+                u32_t block_fl, block_sl;
+                size_class(b->size / HEAP_GRANULARITY, &block_fl, &block_sl);
+                if (++listed > free_blocks || !b->free || b->prev_free != prev_free || block_fl != fl || block_sl != sl) {
+                    re_log_error("Heap block %u of %llu bytes is misplaced in the list of size class %u, %u.",
+                            block, (unsigned long long) b->size, fl, sl);
+                    return false;
+                }
+                prev_free = block;
+            }
+        }
+    }
+
+    if (listed != free_blocks) {
+        re_log_error("Heap lists %u of its %u free blocks.", listed, free_blocks);
+        return false;
+    }
+
+    return true;
+}
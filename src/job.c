@@ -0,0 +1,201 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "job.h"
+#include "rebound.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#define JOB_MAX_THREADS 64
+
+typedef struct job_system_t job_system_t;
+struct job_system_t {
+    pthread_t threads[JOB_MAX_THREADS];
+    u32_t thread_count;
+    b8_t running;
+
+    // Only one parallel for is in flight at a time.
+    pthread_mutex_t submit_lock;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    u64_t generation;
+    b8_t quit;
+    // Workers currently inside job_run_batches. The job description is only
+    // rewritten once this drops to zero.
+    u32_t active_workers;
+
+    job_fn_t fn;
+    void *user;
+    u32_t count;
+    u32_t batch_size;
+    u32_t batch_count;
+
+    // Accessed atomically.
+    u32_t next_batch;
+    u32_t finished_batches;
+};
+
+static job_system_t job_system = {
+    .submit_lock = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+static __thread b8_t job_is_worker = false;
+
+static void job_run_batches(void) {
+    job_system_t *js = &job_system;
+
+    for (;;) {
+        u32_t batch = __atomic_fetch_add(&js->next_batch, 1, __ATOMIC_ACQ_REL);
+        if (batch >= js->batch_count) {
+            break;
+        }
+
+        u32_t begin = batch * js->batch_size;
+        u32_t end = begin + js->batch_size;
+        if (end > js->count) {
+            end = js->count;
+        }
+        js->fn(js->user, begin, end);
+
+        if (__atomic_add_fetch(&js->finished_batches, 1, __ATOMIC_ACQ_REL) == js->batch_count) {
+            pthread_mutex_lock(&js->lock);
+            pthread_cond_broadcast(&js->done);
+            pthread_mutex_unlock(&js->lock);
+        }
+    }
+}
+
+static void *job_worker(void *arg) {
+    (void) arg;
+    job_system_t *js = &job_system;
+    job_is_worker = true;
+
+    u64_t seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&js->lock);
+        while (!js->quit && js->generation == seen) {
+            pthread_cond_wait(&js->wake, &js->lock);
+        }
+        seen = js->generation;
+        if (js->quit) {
+            pthread_mutex_unlock(&js->lock);
+            break;
+        }
+        js->active_workers++;
+        pthread_mutex_unlock(&js->lock);
+
+        job_run_batches();
+
+        pthread_mutex_lock(&js->lock);
+        js->active_workers--;
+        if (js->active_workers == 0) {
+            pthread_cond_broadcast(&js->done);
+        }
+        pthread_mutex_unlock(&js->lock);
+    }
+
+    return NULL;
+}
+
+void job_system_init(u32_t thread_count) {
+    job_system_t *js = &job_system;
+    if (js->running) {
+        return;
+    }
+
+    if (thread_count == 0) {
+        i64_t cores = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cores > 0 ? cores : 1;
+    }
+    if (thread_count > JOB_MAX_THREADS) {
+        thread_count = JOB_MAX_THREADS;
+    }
+
+    js->quit = false;
+    js->thread_count = 1;
+    for (u32_t i = 1; i < thread_count; i++) {
+        if (pthread_create(&js->threads[i], NULL, job_worker, NULL) != 0) {
+            re_log_error("Failed to create job worker thread.");
+            break;
+        }
+        js->thread_count++;
+    }
+    js->running = true;
+}
+
+void job_system_terminate(void) {
+    job_system_t *js = &job_system;
+    if (!js->running) {
+        return;
+    }
+
+    pthread_mutex_lock(&js->lock);
+    js->quit = true;
+    pthread_cond_broadcast(&js->wake);
+    pthread_mutex_unlock(&js->lock);
+
+    for (u32_t i = 1; i < js->thread_count; i++) {
+        pthread_join(js->threads[i], NULL);
+    }
+
+    js->thread_count = 0;
+    js->running = false;
+}
+
+u32_t job_thread_count(void) {
+    return job_system.running ? job_system.thread_count : 1;
+}
+
+void job_parallel_for(u32_t count, u32_t batch_size, job_fn_t fn, void *user) {
+    job_system_t *js = &job_system;
+    if (count == 0) {
+        return;
+    }
+    if (batch_size == 0) {
+        batch_size = 1;
+    }
+
+    u32_t batch_count = (count + batch_size - 1) / batch_size;
+    if (!js->running || js->thread_count == 1 || job_is_worker || batch_count == 1) {
+        fn(user, 0, count);
+        return;
+    }
+
+    pthread_mutex_lock(&js->submit_lock);
+
+    pthread_mutex_lock(&js->lock);
+    while (js->active_workers != 0) {
+        pthread_cond_wait(&js->done, &js->lock);
+    }
+
+    js->fn = fn;
+    js->user = user;
+    js->count = count;
+    js->batch_size = batch_size;
+    js->batch_count = batch_count;
+    __atomic_store_n(&js->finished_batches, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&js->next_batch, 0, __ATOMIC_RELEASE);
+
+    js->generation++;
+    pthread_cond_broadcast(&js->wake);
+    pthread_mutex_unlock(&js->lock);
+
+    // The caller works too instead of just waiting, and like the workers runs
+    // nested calls inline rather than submitting them again.
+    job_is_worker = true;
+    job_run_batches();
+    job_is_worker = false;
+
+    pthread_mutex_lock(&js->lock);
+    while (__atomic_load_n(&js->finished_batches, __ATOMIC_ACQUIRE) != batch_count) {
+        pthread_cond_wait(&js->done, &js->lock);
+    }
+    pthread_mutex_unlock(&js->lock);
+
+    pthread_mutex_unlock(&js->submit_lock);
+}
@@ -114,7 +114,7 @@ static json_object_t parse_number(parser_t *parser) {
     };
     u32_t start = parser->i;
     while (is_digit(peek(*parser, 0)) || peek(*parser, 0) == '-' || peek(*parser, 0) == '.' || peek(*parser, 0) == 'e' || peek(*parser, 0) == 'E') {
-        if (peek(*parser, 0) == '.') {
+        if (peek(*parser, 0) == '.' || peek(*parser, 0) == 'e' || peek(*parser, 0) == 'E') {
             obj.type = JSON_TYPE_FLOATING;
         }
         skip(parser, 1);
@@ -357,11 +357,14 @@ i32_t json_int(json_object_t obj) {
 }
 
 f32_t json_number(json_object_t obj) {
-    if (obj.type != JSON_TYPE_INTEGER && obj.type != JSON_TYPE_FLOATING) {
-        return 0.0f;
+    switch (obj.type) {
+        case JSON_TYPE_INTEGER:
+            return obj.value.integer;
+        case JSON_TYPE_FLOATING:
+            return obj.value.floating;
+        default:
+            return 0.0f;
     }
-
-    return obj.value.floating;
 }
 
 json_object_t json_object(json_object_t obj, re_str_t key) {
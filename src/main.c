@@ -8,117 +8,1331 @@
 
 #include "json.h"
 #include "gltf.h"
+#include "job.h"
+#include "mesh.h"
+
+#include <float.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
 
 static void resize_callback(GLFWwindow *window, i32_t width, i32_t height) {
     (void) window;
     glViewport(0, 0, width, height);
 }
 
-typedef struct mesh_t mesh_t;
-struct mesh_t {
+// Largest screen space error of a LOD, in pixels, before a finer one is drawn.
+#define LOD_PIXEL_ERROR 1.0f
+
+// Sizes of the GL buffers vertex and index data is sub-allocated from, and
+// the allocations each can hold.
+#define VERTEX_POOL_PAGE_SIZE MB(64)
+#define INDEX_POOL_PAGE_SIZE MB(32)
+#define POOL_MAX_ALLOCATIONS 16384
+
+// A simplified index buffer, drawn with the vertices of its primitive.
+typedef struct draw_lod_t draw_lod_t;
+struct draw_lod_t {
+    u32_t index_buffer;
+    u32_t count;
+    u64_t index_offset;
+    f32_t error;
+};
+
+// Everything needed to issue the draw call for one primitive.
+typedef struct draw_t draw_t;
+struct draw_t {
     u32_t vao;
+    u32_t mode;
     b8_t indexed;
-    u32_t ebo;
-    u32_t index_count;
+    u32_t count;
+    u32_t index_buffer;
     u64_t index_offset;
     u32_t index_type;
+    // Range of model_t.lods, from fine to coarse.
+    u32_t lod_offset;
+    u32_t lod_count;
+    // Range of model_t.meshlets, drawn instead of the full detail indices.
+    u32_t meshlet_offset;
+    u32_t meshlet_count;
+};
+
+// A primitive of a skinned node. Its VAO reads positions and normals from a
+// buffer of its own, posed on the CPU every frame, and the other attributes
+// from the primitive's views.
+typedef struct skinned_draw_t skinned_draw_t;
+struct skinned_draw_t {
+    u32_t node;
+    u32_t skin;
+    // No vertices if the primitive can't be skinned, it's drawn rigidly.
+    gltf_skin_vertices_t vertices;
+    u32_t buffer;
+    // Posed positions followed by posed normals, staged for upload.
+    f32_t *posed;
+    draw_t draw;
 };
 
 typedef struct model_t model_t;
 struct model_t {
-    u32_t *buffers;
-    u32_t buffer_count;
+    // Where every used view was uploaded, in the vertex or index pool, and
+    // which one, NULL for views that weren't uploaded.
+    gl_buffer_slice_t *views;
+    gl_buffer_pool_t **view_pools;
+    u32_t view_count;
     u32_t *vaos;
     u32_t vao_count;
 
-    // There is one mesh per VAO.
-    mesh_t *meshes;
+    // One draw per primitive, in primitive order, so a mesh's draws are the
+    // range given by its primitives.
+    draw_t *draws;
+    u32_t draw_count;
+
+    draw_lod_t *lods;
+    u32_t lod_count;
+
+    // Meshlet triangles as 32 bit indices of their primitive's vertices, in
+    // meshlet order, so every meshlet is one range of the slice.
+    const gltf_meshlet_t *meshlets;
+    gl_buffer_slice_t meshlet_indices;
+    gl_buffer_pool_t *meshlet_pool;
+
+    // Primitives of skinned nodes, drawn in world space instead of their
+    // node's draws. Every skin's palette starts at its first joint times
+    // MESH_SKIN_JOINT_FLOATS.
+    skinned_draw_t *skinned;
+    u32_t skinned_count;
+    f32_t *palettes;
 };
 
-static void set_vertex_attribute(gltf_model_t model, u32_t *buffers, i32_t accessor, u32_t index) {
+// Camera state for LOD selection and culling, with counters for the log.
+typedef struct draw_view_t draw_view_t;
+struct draw_view_t {
+    HMM_Mat4 view_projection;
+    HMM_Vec3 camera;
+    // Pixels per unit one unit in front of the camera.
+    f32_t pixel_scale;
+
+    u64_t meshlets_tested;
+    u64_t meshlets_drawn;
+};
+
+static void set_vertex_attribute(gltf_model_t model, const gl_buffer_slice_t *views, i32_t accessor, u32_t index) {
     if (accessor < 0) {
         return;
     }
 
     gltf_accessor_t acc = model.accessors[accessor];
     gltf_buffer_view_t view = model.views[acc.view];
-    glBindBuffer(view.target, buffers[acc.view]);
-
-    u32_t count = 0;
-    switch (acc.type) {
-        case GLTF_ACCESSOR_TYPE_SCALAR: count = 1;  break;
-        case GLTF_ACCESSOR_TYPE_VEC2:   count = 2;  break;
-        case GLTF_ACCESSOR_TYPE_VEC3:   count = 3;  break;
-        case GLTF_ACCESSOR_TYPE_VEC4:   count = 4;  break;
-        case GLTF_ACCESSOR_TYPE_MAT2:   count = 4;  break;
-        case GLTF_ACCESSOR_TYPE_MAT3:   count = 9;  break;
-        case GLTF_ACCESSOR_TYPE_MAT4:   count = 16; break;
-    }
+    glBindBuffer(GL_ARRAY_BUFFER, views[acc.view].handle);
 
     glVertexAttribPointer(
             index,
-            count,
+            gltf_accessor_type_count(acc.type),
             acc.comp_type,
             acc.normalized,
             view.stride,
-            (const void *) acc.offset);
+            (const void *) (views[acc.view].offset + acc.offset));
     glEnableVertexAttribArray(index);
 
-    glBindBuffer(view.target, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-model_t gltf_to_model(gltf_model_t model, re_arena_t *arena) {
+// Gives every primitive of a skinned node a buffer to pose its positions and
+// normals into and a VAO reading them from there.
+static void skinned_draws_new(model_t *m, const gltf_model_t *model, re_arena_t *arena) {
+    const gltf_nodes_t *nodes = &model->nodes;
+    u32_t count = 0;
+    for (u32_t i = 0; i < nodes->count; i++) {
+        if (nodes->skin[i] >= 0 && nodes->mesh[i] >= 0) {
+            count += model->meshes[nodes->mesh[i]].primitive_count;
+        }
+    }
+
+    m->skinned = re_arena_push_zero(arena, count * sizeof(skinned_draw_t));
+    m->skinned_count = count;
+    m->palettes = re_arena_push(arena, (u64_t) model->skin_joint_count * MESH_SKIN_JOINT_FLOATS * sizeof(f32_t));
+
+    u32_t s = 0;
+    for (u32_t i = 0; i < nodes->count; i++) {
+        if (nodes->skin[i] < 0 || nodes->mesh[i] < 0) {
+            continue;
+        }
+
+        gltf_mesh_t mesh = model->meshes[nodes->mesh[i]];
+        for (u32_t p = mesh.primitive_offset; p < mesh.primitive_offset + mesh.primitive_count; p++) {
+            skinned_draw_t *skinned = &m->skinned[s++];
+            skinned->node = i;
+            skinned->skin = (u32_t) nodes->skin[i];
+            skinned->draw = m->draws[p];
+            if (skinned->draw.count == 0) {
+                continue;
+            }
+            if (!gltf_skin_vertices(model, p, skinned->skin, &skinned->vertices, arena)) {
+                re_log_warn("Primitive %u of node %u has no usable joints or weights, drawing it rigidly.", p, i);
+                skinned->vertices.count = 0;
+                continue;
+            }
+
+            gltf_skin_vertices_t v = skinned->vertices;
+            u64_t position_bytes = (u64_t) v.count * 3 * sizeof(f32_t);
+            u64_t size = v.normals ? position_bytes * 2 : position_bytes;
+            skinned->posed = re_arena_push(arena, size);
+            glGenBuffers(1, &skinned->buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, skinned->buffer);
+            glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+
+            // Meshlet bounds and cones only hold in the bind pose.
+            skinned->draw.meshlet_count = 0;
+            glGenVertexArrays(1, &skinned->draw.vao);
+            glBindVertexArray(skinned->draw.vao);
+            for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+                if (attrib == GLTF_ATTRIBUTE_POSITION || (attrib == GLTF_ATTRIBUTE_NORMAL && v.normals)) {
+                    glBindBuffer(GL_ARRAY_BUFFER, skinned->buffer);
+                    glVertexAttribPointer(attrib, 3, GL_FLOAT, false, 0, (const void *) (attrib == GLTF_ATTRIBUTE_POSITION ? 0 : position_bytes));
+                    glEnableVertexAttribArray(attrib);
+                    glBindBuffer(GL_ARRAY_BUFFER, 0);
+                } else {
+                    set_vertex_attribute(*model, m->views, model->primitives.attributes[attrib][p], attrib);
+                }
+            }
+            if (skinned->draw.indexed) {
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, skinned->draw.index_buffer);
+            }
+        }
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// Poses every skinned primitive for the current world matrices of the nodes
+// and uploads the result.
+static void skin_model(model_t *m, const gltf_model_t *model) {
+    for (u32_t i = 0; i < model->skin_count; i++) {
+        gltf_skin_palette(model, i, m->palettes + (u64_t) model->skins[i].joint_offset * MESH_SKIN_JOINT_FLOATS);
+    }
+
+    for (u32_t i = 0; i < m->skinned_count; i++) {
+        skinned_draw_t *skinned = &m->skinned[i];
+        gltf_skin_vertices_t v = skinned->vertices;
+        if (v.count == 0) {
+            continue;
+        }
+
+        const f32_t *palette = m->palettes + (u64_t) model->skins[skinned->skin].joint_offset * MESH_SKIN_JOINT_FLOATS;
+        gltf_skin_apply(&v, palette, skinned->posed, skinned->posed + (u64_t) v.count * 3);
+
+        u64_t size = (u64_t) v.count * 3 * sizeof(f32_t) * (v.normals ? 2 : 1);
+        glBindBuffer(GL_ARRAY_BUFFER, skinned->buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, skinned->posed);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// An accessor whose view didn't make it into a pool, reading it would read
+// whatever sits at the start of buffer 0.
+static b8_t accessor_missing(const model_t *m, const gltf_model_t *model, i32_t accessor) {
+    if (accessor < 0) {
+        return false;
+    }
+    i32_t view = model->accessors[accessor].view;
+    return view < 0 || m->view_pools[view] == NULL;
+}
+
+// Views are uploaded into slices of the shared pools instead of buffers of
+// their own, so all models together use a few GL buffers. Primitives and LODs
+// reading a view that couldn't be uploaded aren't drawn.
+model_t gltf_to_model(gltf_model_t model, gl_buffer_pool_t *vertex_pool, gl_buffer_pool_t *index_pool, re_arena_t *arena) {
     model_t m = {0};
 
-    m.meshes = re_arena_push(arena, model.mesh_count * sizeof(mesh_t));
-    m.vaos = re_arena_push(arena, model.mesh_count * sizeof(u32_t));
-    m.buffers = re_arena_push(arena, model.view_count * sizeof(u32_t));
+    gltf_primitives_t prims = model.primitives;
+
+    m.draws = re_arena_push_zero(arena, prims.count * sizeof(draw_t));
+    m.vaos = re_arena_push(arena, prims.count * sizeof(u32_t));
+    m.views = re_arena_push_zero(arena, model.view_count * sizeof(gl_buffer_slice_t));
+    m.view_pools = re_arena_push_zero(arena, model.view_count * sizeof(gl_buffer_pool_t *));
 
-    m.vao_count = model.mesh_count;
-    m.buffer_count = model.view_count;
+    m.draw_count = prims.count;
+    m.vao_count = prims.count;
+    m.view_count = model.view_count;
 
-    glGenVertexArrays(model.mesh_count, m.vaos);
-    glGenBuffers(model.view_count, m.buffers);
+    glGenVertexArrays(prims.count, m.vaos);
 
+    // Processing leaves the views it replaced behind, only the ones primitives
+    // still read are uploaded.
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    b8_t *used = re_arena_push_zero(scratch.arena, model.view_count * sizeof(b8_t));
+    for (u32_t i = 0; i < prims.count; i++) {
+        for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+            i32_t accessor = prims.attributes[attrib][i];
+            if (accessor >= 0 && model.accessors[accessor].view >= 0) {
+                used[model.accessors[accessor].view] = true;
+            }
+        }
+        if (prims.indices[i] >= 0 && model.accessors[prims.indices[i]].view >= 0) {
+            used[model.accessors[prims.indices[i]].view] = true;
+        }
+    }
+    for (u32_t i = 0; i < model.lod_count; i++) {
+        if (model.accessors[model.lods[i].indices].view >= 0) {
+            used[model.accessors[model.lods[i].indices].view] = true;
+        }
+    }
+
+    // Attributes are uploaded in their stored format, quantized data stays
+    // quantized on the GPU. Offsets into the pools keep every component
+    // aligned.
+    u64_t vertex_bytes = 0;
     for (u32_t i = 0; i < model.view_count; i++) {
-        if (model.views[i].target == 0) {
+        if (model.views[i].target == 0 || !used[i]) {
             continue;
         }
 
         gltf_buffer_view_t view = model.views[i];
         re_str_t buffer = model.buffers[view.buffer];
 
-        glBindBuffer(view.target, m.buffers[i]);
-        glBufferData(view.target, view.length, buffer.str + view.offset, GL_STATIC_DRAW);
-        glBindBuffer(view.target, 0);
+        b8_t vertices = view.target == GLTF_BUFFER_TARGET_ARRAY;
+        gl_buffer_pool_t *pool = vertices ? vertex_pool : index_pool;
+        if (!gl_buffer_pool_alloc(pool, view.length, 16, buffer.str + view.offset, &m.views[i])) {
+            re_log_error("Out of GPU buffer pool space for view %u.", i);
+            continue;
+        }
+        m.view_pools[i] = pool;
+
+        if (vertices) {
+            vertex_bytes += view.length;
+        }
     }
+    re_log_info("Uploaded %.2f MB of vertex data.", (f64_t) vertex_bytes / MB(1));
+    re_arena_scratch_release(&scratch);
+
+    for (u32_t i = 0; i < prims.count; i++) {
+        draw_t *draw = &m.draws[i];
+        draw->vao = m.vaos[i];
+        draw->mode = prims.mode[i];
+
+        // Left with a count of 0, which draw_primitives skips.
+        b8_t missing = accessor_missing(&m, &model, prims.indices[i]);
+        for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+            missing |= accessor_missing(&m, &model, prims.attributes[attrib][i]);
+        }
+        if (missing) {
+            re_log_error("Primitive %u reads data that wasn't uploaded and won't be drawn.", i);
+            continue;
+        }
 
-    for (u32_t i = 0; i < model.mesh_count; i++) {
-        m.meshes[i].vao = m.vaos[i];
         glBindVertexArray(m.vaos[i]);
 
-        set_vertex_attribute(model, m.buffers, model.meshes[i].position_accessor, 0);
-        set_vertex_attribute(model, m.buffers, model.meshes[i].normal_accessor, 1);
-        set_vertex_attribute(model, m.buffers, model.meshes[i].uv_accessor, 2);
+        for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+            set_vertex_attribute(model, m.views, prims.attributes[attrib][i], attrib);
+        }
+
+        if (prims.indices[i] != -1) {
+            gltf_accessor_t acc = model.accessors[prims.indices[i]];
 
-        if (model.meshes[i].indices_accessor != -1) {
-            gltf_accessor_t acc = model.accessors[model.meshes[i].indices_accessor];
+            // The element buffer binding is part of the VAO state.
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.views[acc.view].handle);
 
-            m.meshes[i].indexed = true;
-            m.meshes[i].ebo = m.buffers[acc.view];
-            m.meshes[i].index_count = acc.count;
-            m.meshes[i].index_offset = acc.offset;
-            m.meshes[i].index_type = acc.comp_type;
+            draw->indexed = true;
+            draw->count = acc.count;
+            draw->index_buffer = m.views[acc.view].handle;
+            draw->index_offset = m.views[acc.view].offset + acc.offset;
+            draw->index_type = acc.comp_type;
+            draw->lod_offset = prims.lod_offset[i];
+            draw->lod_count = prims.lod_count[i];
+            draw->meshlet_offset = prims.meshlet_offset[i];
+            draw->meshlet_count = prims.meshlet_count[i];
+        } else if (prims.attributes[GLTF_ATTRIBUTE_POSITION][i] != -1) {
+            draw->count = model.accessors[prims.attributes[GLTF_ATTRIBUTE_POSITION][i]].count;
         }
     }
     glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    // LOD index accessors are copies of the primitive's, in the same format.
+    m.lods = re_arena_push(arena, model.lod_count * sizeof(draw_lod_t));
+    m.lod_count = model.lod_count;
+    for (u32_t i = 0; i < model.lod_count; i++) {
+        if (accessor_missing(&m, &model, (i32_t) model.lods[i].indices)) {
+            m.lods[i] = (draw_lod_t) {0};
+            continue;
+        }
+        gltf_accessor_t acc = model.accessors[model.lods[i].indices];
+        m.lods[i] = (draw_lod_t) {m.views[acc.view].handle, acc.count, m.views[acc.view].offset + acc.offset, model.lods[i].error};
+    }
+    // A chain with a level missing falls back to full detail only.
+    for (u32_t i = 0; i < m.draw_count; i++) {
+        draw_t *draw = &m.draws[i];
+        for (u32_t l = draw->lod_offset; l < draw->lod_offset + draw->lod_count; l++) {
+            if (accessor_missing(&m, &model, (i32_t) model.lods[l].indices)) {
+                re_log_error("LODs of primitive %u weren't uploaded and won't be drawn.", i);
+                draw->lod_count = 0;
+                break;
+            }
+        }
+    }
+
+    m.meshlets = model.meshlets;
+    if (model.meshlet_count > 0) {
+        scratch = re_arena_scratch_get(&arena, 1);
+        u32_t *indices = re_arena_push(scratch.arena, model.meshlet_index_count * sizeof(u32_t));
+        for (u32_t i = 0; i < model.meshlet_count; i++) {
+            gltf_meshlet_t meshlet = model.meshlets[i];
+            for (u32_t j = meshlet.triangle_offset * 3; j < (meshlet.triangle_offset + meshlet.triangle_count) * 3; j++) {
+                indices[j] = model.meshlet_vertices[meshlet.vertex_offset + model.meshlet_indices[j]];
+            }
+        }
+
+        if (!gl_buffer_pool_alloc(index_pool, model.meshlet_index_count * sizeof(u32_t), 16, indices, &m.meshlet_indices)) {
+            re_log_error("Out of GPU buffer pool space for meshlets.");
+            m.meshlets = NULL;
+            for (u32_t i = 0; i < m.draw_count; i++) {
+                m.draws[i].meshlet_count = 0;
+            }
+        } else {
+            m.meshlet_pool = index_pool;
+        }
+        re_arena_scratch_release(&scratch);
+    }
+
+    skinned_draws_new(&m, &model, arena);
 
     return m;
 }
 
-i32_t main(void) {
+// Returns the model's slices to their pools, whose buffers stay for the next
+// model, and deletes its VAOs and skinning buffers.
+void model_free(model_t *m) {
+    for (u32_t i = 0; i < m->view_count; i++) {
+        if (m->view_pools[i] != NULL) {
+            gl_buffer_pool_release(m->view_pools[i], m->views[i]);
+        }
+    }
+    if (m->meshlet_pool != NULL) {
+        gl_buffer_pool_release(m->meshlet_pool, m->meshlet_indices);
+    }
+
+    // Primitives that couldn't be skinned use their rigid draw's VAO.
+    for (u32_t i = 0; i < m->skinned_count; i++) {
+        if (m->skinned[i].vertices.count > 0) {
+            glDeleteBuffers(1, &m->skinned[i].buffer);
+            glDeleteVertexArrays(1, &m->skinned[i].draw.vao);
+        }
+    }
+    glDeleteVertexArrays(m->vao_count, m->vaos);
+
+    *m = (model_t) {0};
+}
+
+// Pixels a unit of error at the origin of transform covers on screen, scaled
+// like the transform's largest axis and measured at its distance from the
+// camera.
+static f32_t lod_pixels_per_unit(HMM_Mat4 transform, const draw_view_t *view) {
+    f32_t scale = 0.0f;
+    for (u32_t axis = 0; axis < 3; axis++) {
+        scale = fmaxf(scale, HMM_LenV3(transform.Columns[axis].XYZ));
+    }
+
+    f32_t distance = HMM_LenV3(HMM_SubV3(transform.Columns[3].XYZ, view->camera));
+    return view->pixel_scale * scale / fmaxf(distance, 0.1f);
+}
+
+// Index of the coarsest LOD whose error, times pixels per unit of error,
+// stays under LOD_PIXEL_ERROR, -1 for full detail.
+static i32_t select_lod(model_t model, draw_t draw, f32_t pixels_per_unit) {
+    for (u32_t l = draw.lod_count; l-- > 0;) {
+        if (model.lods[draw.lod_offset + l].error * pixels_per_unit <= LOD_PIXEL_ERROR) {
+            return draw.lod_offset + l;
+        }
+    }
+    return -1;
+}
+
+// Clip space planes of a view projection matrix as (normal, distance), in the
+// space the matrix transforms from. Gribb, Hartmann, "Fast Extraction of
+// Viewing Frustum Planes from the World-View-Projection Matrix", 2001.
+static void frustum_planes(HMM_Mat4 m, HMM_Vec4 *planes) {
+    HMM_Vec4 rows[4];
+    for (u32_t i = 0; i < 4; i++) {
+        rows[i] = HMM_V4(m.Elements[0][i], m.Elements[1][i], m.Elements[2][i], m.Elements[3][i]);
+    }
+    for (u32_t i = 0; i < 3; i++) {
+        planes[i * 2 + 0] = HMM_AddV4(rows[3], rows[i]);
+        planes[i * 2 + 1] = HMM_SubV4(rows[3], rows[i]);
+    }
+}
+
+// Meshlets are culled in their primitive's space, against the frustum and
+// their normal cone, and the visible ones are drawn with one call.
+static void draw_meshlets(model_t model, draw_t draw, const HMM_Vec4 *planes, HMM_Vec3 camera, draw_view_t *view) {
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    GLsizei *counts = re_arena_push(scratch.arena, draw.meshlet_count * sizeof(GLsizei));
+    const void **offsets = re_arena_push(scratch.arena, draw.meshlet_count * sizeof(void *));
+
+    u32_t visible = 0;
+    for (u32_t i = draw.meshlet_offset; i < draw.meshlet_offset + draw.meshlet_count; i++) {
+        gltf_meshlet_t meshlet = model.meshlets[i];
+
+        b8_t inside = true;
+        for (u32_t p = 0; p < 6 && inside; p++) {
+            inside = HMM_DotV3(planes[p].XYZ, meshlet.center) + planes[p].W >= -meshlet.radius * HMM_LenV3(planes[p].XYZ);
+        }
+
+        mesh_bounds_t bounds = {
+            {meshlet.center.X, meshlet.center.Y, meshlet.center.Z},
+            meshlet.radius,
+            {meshlet.cone_axis.X, meshlet.cone_axis.Y, meshlet.cone_axis.Z},
+            meshlet.cone_cutoff,
+        };
+        if (inside && !mesh_meshlet_backfacing(&bounds, camera.Elements)) {
+            counts[visible] = meshlet.triangle_count * 3;
+            offsets[visible] = (const void *) (model.meshlet_indices.offset + (u64_t) meshlet.triangle_offset * 3 * sizeof(u32_t));
+            visible++;
+        }
+    }
+
+    // Usually the same pool buffer the primitive's indices are in.
+    if (model.meshlet_indices.handle != draw.index_buffer) {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.meshlet_indices.handle);
+    }
+    glMultiDrawElements(draw.mode, counts, GL_UNSIGNED_INT, offsets, visible);
+    if (model.meshlet_indices.handle != draw.index_buffer) {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, draw.index_buffer);
+    }
+
+    view->meshlets_tested += draw.meshlet_count;
+    view->meshlets_drawn += visible;
+    re_arena_scratch_release(&scratch);
+}
+
+static void draw_primitives(model_t model, const draw_t *draws, u32_t count, HMM_Mat4 world, draw_view_t *view) {
+    f32_t pixels_per_unit = lod_pixels_per_unit(world, view);
+
+    HMM_Vec4 planes[6];
+    frustum_planes(HMM_MulM4(view->view_projection, world), planes);
+    HMM_Vec3 camera = HMM_MulM4V4(HMM_InvGeneralM4(world), HMM_V4V(view->camera, 1.0f)).XYZ;
+
+    for (u32_t i = 0; i < count; i++) {
+        draw_t draw = draws[i];
+        if (draw.count == 0) {
+            continue;
+        }
+
+        glBindVertexArray(draw.vao);
+        if (!draw.indexed) {
+            glDrawArrays(draw.mode, 0, draw.count);
+            continue;
+        }
+
+        i32_t lod = select_lod(model, draw, pixels_per_unit);
+        if (lod < 0 && draw.meshlet_count > 0) {
+            draw_meshlets(model, draw, planes, camera, view);
+            continue;
+        }
+
+        draw_lod_t indices = lod >= 0 ? model.lods[lod] : (draw_lod_t) {draw.index_buffer, draw.count, draw.index_offset, 0.0f};
+
+        // LOD indices share the pool buffer of the full detail ones unless
+        // it filled up in between. The element buffer is part of the VAO
+        // state, so a different one is set back after drawing.
+        if (indices.index_buffer != draw.index_buffer) {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices.index_buffer);
+        }
+        glDrawElements(draw.mode, indices.count, draw.index_type, (const void *) indices.index_offset);
+        if (indices.index_buffer != draw.index_buffer) {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, draw.index_buffer);
+        }
+    }
+}
+
+static void draw_model(model_t model, const gltf_model_t *gltf_model, u32_t transform_loc, draw_view_t *view) {
+    const gltf_nodes_t *nodes = &gltf_model->nodes;
+
+    // Models without a node hierarchy are drawn as is.
+    if (nodes->count == 0) {
+        HMM_Mat4 transform = HMM_M4D(1.0f);
+        glUniformMatrix4fv(transform_loc, 1, false, &transform.Elements[0][0]);
+        draw_primitives(model, model.draws, model.draw_count, transform, view);
+    }
+
+    for (u32_t i = 0; i < nodes->count; i++) {
+        if (nodes->mesh[i] < 0 || nodes->skin[i] >= 0) {
+            continue;
+        }
+
+        gltf_mesh_t mesh = gltf_model->meshes[nodes->mesh[i]];
+        glUniformMatrix4fv(transform_loc, 1, false, &nodes->world[i].Elements[0][0]);
+        draw_primitives(model, model.draws + mesh.primitive_offset, mesh.primitive_count, nodes->world[i], view);
+    }
+
+    // Posed vertices are in world space already.
+    for (u32_t i = 0; i < model.skinned_count; i++) {
+        skinned_draw_t skinned = model.skinned[i];
+        HMM_Mat4 transform = skinned.vertices.count > 0 ? HMM_M4D(1.0f) : nodes->world[skinned.node];
+        glUniformMatrix4fv(transform_loc, 1, false, &transform.Elements[0][0]);
+        draw_primitives(model, &skinned.draw, 1, transform, view);
+    }
+
+    glBindVertexArray(0);
+}
+
+// Casts a ray from the camera through a pixel of the window at the model,
+// in the world space it's drawn in.
+static gltf_ray_hit_t pick(const gltf_raycaster_t *raycaster, HMM_Mat4 view_projection, f64_t x, f64_t y, f32_t width, f32_t height) {
+    HMM_Mat4 inverse = HMM_InvGeneralM4(view_projection);
+    f32_t ndc_x = 2.0f * (f32_t) x / width - 1.0f;
+    f32_t ndc_y = 1.0f - 2.0f * (f32_t) y / height;
+    HMM_Vec4 near = HMM_MulM4V4(inverse, HMM_V4(ndc_x, ndc_y, -1.0f, 1.0f));
+    HMM_Vec4 far = HMM_MulM4V4(inverse, HMM_V4(ndc_x, ndc_y, 1.0f, 1.0f));
+    HMM_Vec3 origin = HMM_DivV3F(near.XYZ, near.W);
+    gltf_ray_t ray = {origin, HMM_SubV3(HMM_DivV3F(far.XYZ, far.W), origin), 1.0f};
+
+    // Models without a node hierarchy are drawn as is, like draw_model.
+    const gltf_model_t *model = raycaster->model;
+    if (model->nodes.count > 0) {
+        return model->scene >= 0 ? gltf_raycast_scene(raycaster, (u32_t) model->scene, ray) : (gltf_ray_hit_t) {.primitive = -1};
+    }
+
+    gltf_ray_hit_t closest = {.primitive = -1};
+    for (u32_t m = 0; m < model->mesh_count; m++) {
+        gltf_ray_hit_t hit = gltf_raycast_mesh(raycaster, m, ray);
+        if (hit.primitive >= 0) {
+            closest = hit;
+            ray.t_max = hit.t;
+        }
+    }
+    return closest;
+}
+
+// Cone culls the meshlets of a primitive from cameras on the six axes, twice
+// the bounding radius away from its center, and logs how many were culled and
+// how long a test took.
+static void analyze_meshlets(const gltf_model_t *model, u32_t prim) {
+    const gltf_meshlet_t *meshlets = model->meshlets + model->primitives.meshlet_offset[prim];
+    u32_t meshlet_count = model->primitives.meshlet_count[prim];
+
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    mesh_bounds_t *bounds = re_arena_push(scratch.arena, meshlet_count * sizeof(mesh_bounds_t));
+    HMM_Vec3 min = HMM_V3(FLT_MAX, FLT_MAX, FLT_MAX);
+    HMM_Vec3 max = HMM_V3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    u32_t triangle_count = 0;
+    for (u32_t i = 0; i < meshlet_count; i++) {
+        gltf_meshlet_t m = meshlets[i];
+        bounds[i] = (mesh_bounds_t) {
+            {m.center.X, m.center.Y, m.center.Z},
+            m.radius,
+            {m.cone_axis.X, m.cone_axis.Y, m.cone_axis.Z},
+            m.cone_cutoff,
+        };
+        for (u32_t axis = 0; axis < 3; axis++) {
+            min.Elements[axis] = fminf(min.Elements[axis], m.center.Elements[axis] - m.radius);
+            max.Elements[axis] = fmaxf(max.Elements[axis], m.center.Elements[axis] + m.radius);
+        }
+        triangle_count += m.triangle_count;
+    }
+
+    HMM_Vec3 center = HMM_MulV3F(HMM_AddV3(min, max), 0.5f);
+    f32_t distance = HMM_LenV3(HMM_SubV3(max, min));
+
+    // Repeated so the timing isn't dominated by the clock.
+    const u32_t repeats = 100;
+    u64_t culled = 0;
+    f64_t start = re_os_get_time();
+    for (u32_t r = 0; r < repeats; r++) {
+        for (u32_t view = 0; view < 6; view++) {
+            HMM_Vec3 camera = center;
+            camera.Elements[view / 2] += view % 2 == 0 ? distance : -distance;
+            for (u32_t i = 0; i < meshlet_count; i++) {
+                culled += mesh_meshlet_backfacing(&bounds[i], camera.Elements);
+            }
+        }
+    }
+    f64_t time = re_os_get_time() - start;
+    re_arena_scratch_release(&scratch);
+
+    u64_t tests = (u64_t) repeats * 6 * meshlet_count;
+    re_log_info("Primitive %u, %u meshlets of %.1f triangles: %.1f%% cone culled, %.1f ns per meshlet.",
+            prim, meshlet_count, (f64_t) triangle_count / meshlet_count, 100.0 * culled / tests, time * 1e9 / tests);
+}
+
+// Rays per side of the grids analyze_rays casts.
+#define RAY_GRID_SIZE 256
+
+// Casts a grid of parallel rays from each of the six axis directions at the
+// default scene, on one thread and across the job system, and logs how many
+// hit and how fast they were.
+static void analyze_rays(const gltf_model_t *model) {
+    if (model->scene < 0 || (u32_t) model->scene >= model->scene_bvh_count || model->scene_bvhs[model->scene].node_count == 0) {
+        return;
+    }
+
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    f64_t start = re_os_get_time();
+    gltf_raycaster_t raycaster = gltf_raycaster_new(model, scratch.arena);
+    f64_t pack_time = re_os_get_time() - start;
+
+    gltf_bvh_node_t root = model->bvh_nodes[model->scene_bvhs[model->scene].node_offset];
+    HMM_Vec3 size = HMM_SubV3(root.max, root.min);
+    u32_t ray_count = 6 * RAY_GRID_SIZE * RAY_GRID_SIZE;
+    gltf_ray_t *rays = re_arena_push(scratch.arena, ray_count * sizeof(gltf_ray_t));
+    gltf_ray_hit_t *hits = re_arena_push(scratch.arena, ray_count * sizeof(gltf_ray_hit_t));
+    for (u32_t view = 0; view < 6; view++) {
+        u32_t axis = view / 2;
+        u32_t u_axis = (axis + 1) % 3;
+        u32_t v_axis = (axis + 2) % 3;
+        for (u32_t i = 0; i < RAY_GRID_SIZE * RAY_GRID_SIZE; i++) {
+            gltf_ray_t *ray = &rays[view * RAY_GRID_SIZE * RAY_GRID_SIZE + i];
+            ray->origin.Elements[axis] = view % 2 == 0 ? root.min.Elements[axis] - size.Elements[axis] : root.max.Elements[axis] + size.Elements[axis];
+            ray->origin.Elements[u_axis] = root.min.Elements[u_axis] + size.Elements[u_axis] * (i % RAY_GRID_SIZE + 0.5f) / RAY_GRID_SIZE;
+            ray->origin.Elements[v_axis] = root.min.Elements[v_axis] + size.Elements[v_axis] * (i / RAY_GRID_SIZE + 0.5f) / RAY_GRID_SIZE;
+            ray->direction = HMM_V3(0.0f, 0.0f, 0.0f);
+            ray->direction.Elements[axis] = view % 2 == 0 ? 1.0f : -1.0f;
+            ray->t_max = FLT_MAX;
+        }
+    }
+
+    start = re_os_get_time();
+    for (u32_t i = 0; i < ray_count; i++) {
+        hits[i] = gltf_raycast_scene(&raycaster, (u32_t) model->scene, rays[i]);
+    }
+    f64_t serial_time = re_os_get_time() - start;
+
+    start = re_os_get_time();
+    gltf_raycast_scene_batch(&raycaster, (u32_t) model->scene, rays, hits, ray_count);
+    f64_t batch_time = re_os_get_time() - start;
+
+    u32_t hit_count = 0;
+    for (u32_t i = 0; i < ray_count; i++) {
+        hit_count += hits[i].primitive >= 0;
+    }
+    re_log_info("Scene %d, %u rays: %.1f%% hit, %.2f M rays/s on one thread, %.2f M rays/s on %u, packed in %.2f ms.",
+            model->scene, ray_count, 100.0 * hit_count / ray_count,
+            ray_count / serial_time / 1e6, ray_count / batch_time / 1e6, job_thread_count(), pack_time * 1e3);
+    re_arena_scratch_release(&scratch);
+}
+
+// Poses the primitives of every skinned node as the nodes stand, on one
+// thread and across the job system, and logs how many vertices were skinned
+// per millisecond.
+static void analyze_skins(const gltf_model_t *model) {
+    const gltf_nodes_t *nodes = &model->nodes;
+    for (u32_t i = 0; i < nodes->count; i++) {
+        if (nodes->skin[i] < 0 || nodes->mesh[i] < 0) {
+            continue;
+        }
+
+        u32_t skin = (u32_t) nodes->skin[i];
+        gltf_mesh_t mesh = model->meshes[nodes->mesh[i]];
+        for (u32_t p = mesh.primitive_offset; p < mesh.primitive_offset + mesh.primitive_count; p++) {
+            re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+            gltf_skin_vertices_t v;
+            if (!gltf_skin_vertices(model, p, skin, &v, scratch.arena)) {
+                re_arena_scratch_release(&scratch);
+                continue;
+            }
+
+            f32_t *palette = re_arena_push(scratch.arena, (u64_t) model->skins[skin].joint_count * MESH_SKIN_JOINT_FLOATS * sizeof(f32_t));
+            f32_t *positions = re_arena_push(scratch.arena, (u64_t) v.count * 3 * sizeof(f32_t));
+            f32_t *normals = re_arena_push(scratch.arena, (u64_t) v.count * 3 * sizeof(f32_t));
+            gltf_skin_palette(model, skin, palette);
+
+            // Repeated so the timing isn't dominated by the clock.
+            const u32_t repeats = 100;
+            f64_t start = re_os_get_time();
+            for (u32_t r = 0; r < repeats; r++) {
+                mesh_skin(positions, v.normals ? normals : NULL, v.positions, v.normals, v.joints, v.weights, v.count, palette);
+            }
+            f64_t serial_time = re_os_get_time() - start;
+
+            start = re_os_get_time();
+            for (u32_t r = 0; r < repeats; r++) {
+                gltf_skin_apply(&v, palette, positions, normals);
+            }
+            f64_t batch_time = re_os_get_time() - start;
+
+            f64_t vertices = (f64_t) repeats * v.count;
+            re_log_info("Node %u, primitive %u, %u vertices of %u joints: %.0f vertices/ms skinned on one thread, %.0f vertices/ms on %u.",
+                    i, p, v.count, model->skins[skin].joint_count,
+                    vertices / serial_time / 1e3, vertices / batch_time / 1e3, job_thread_count());
+            re_arena_scratch_release(&scratch);
+        }
+    }
+}
+
+// Instances analyze_animations plays of every animation.
+#define ANIMATION_PROPS 4096
+
+// Plays every animation on ANIMATION_PROPS instances spread over its
+// duration for a second at 60 frames per second, and logs the cost of
+// sampling a frame, with the cursors kept between frames and restarted from
+// the first keyframe every frame.
+static void analyze_animations(const gltf_model_t *model) {
+    const u32_t frames = 60;
+    for (u32_t a = 0; a < model->animation_count; a++) {
+        gltf_animation_t animation = model->animations[a];
+        if (animation.channel_count == 0) {
+            continue;
+        }
+
+        re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+        gltf_animation_player_t player = gltf_animation_player_new(model, a, ANIMATION_PROPS, scratch.arena);
+        f64_t times[2];
+        for (u32_t restart = 0; restart < 2; restart++) {
+            for (u32_t i = 0; i < player.count; i++) {
+                player.times[i] = animation.duration * i / player.count;
+            }
+            gltf_animation_sample_batch(model, &player);
+
+            f64_t start = re_os_get_time();
+            for (u32_t f = 0; f < frames; f++) {
+                for (u32_t i = 0; i < player.count; i++) {
+                    player.times[i] = animation.duration > 0.0f ? fmodf(player.times[i] + 1.0f / 60.0f, animation.duration) : 0.0f;
+                }
+                if (restart) {
+                    memset(player.cursors, 0, (u64_t) player.count * animation.channel_count * sizeof(u32_t));
+                }
+                gltf_animation_sample_batch(model, &player);
+            }
+            times[restart] = (re_os_get_time() - start) / frames;
+        }
+
+        u64_t samples = (u64_t) player.count * animation.channel_count;
+        re_log_info("Animation %u, %u props of %u channels: %.3f ms per frame, %.1f ns per channel, %.1f ns restarting every frame, on %u threads.",
+                a, player.count, animation.channel_count, times[0] * 1e3, times[0] * 1e9 / samples, times[1] * 1e9 / samples, job_thread_count());
+        re_arena_scratch_release(&scratch);
+    }
+}
+
+// Elements of the sparse accessor analyze_sparse expands, and how many of them
+// its sparse data replaces.
+#define SPARSE_ELEMENT_COUNT (1u << 20)
+#define SPARSE_UPDATE_COUNT (SPARSE_ELEMENT_COUNT / 100)
+
+// Builds a position accessor of SPARSE_ELEMENT_COUNT elements with
+// SPARSE_UPDATE_COUNT of them replaced by sparse data, spread evenly, and
+// logs how long expanding it and reading it as floats took against copying
+// its base data.
+static void analyze_sparse(void) {
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    u64_t base_size = (u64_t) SPARSE_ELEMENT_COUNT * 3 * sizeof(f32_t);
+    f32_t *base = re_arena_push(scratch.arena, base_size);
+    for (u64_t i = 0; i < (u64_t) SPARSE_ELEMENT_COUNT * 3; i++) {
+        base[i] = (f32_t) i;
+    }
+    u32_t *indices = re_arena_push(scratch.arena, SPARSE_UPDATE_COUNT * sizeof(u32_t));
+    f32_t *values = re_arena_push(scratch.arena, SPARSE_UPDATE_COUNT * 3 * sizeof(f32_t));
+    for (u32_t i = 0; i < SPARSE_UPDATE_COUNT; i++) {
+        indices[i] = i * (SPARSE_ELEMENT_COUNT / SPARSE_UPDATE_COUNT);
+        values[i * 3] = values[i * 3 + 1] = values[i * 3 + 2] = -1.0f;
+    }
+
+    gltf_model_t model = {.arena = scratch.arena};
+    u32_t base_buffer = gltf_push_buffer(&model, re_str((u8_t *) base, base_size), scratch.arena);
+    u32_t index_buffer = gltf_push_buffer(&model, re_str((u8_t *) indices, SPARSE_UPDATE_COUNT * sizeof(u32_t)), scratch.arena);
+    u32_t value_buffer = gltf_push_buffer(&model, re_str((u8_t *) values, SPARSE_UPDATE_COUNT * 3 * sizeof(f32_t)), scratch.arena);
+    gltf_accessor_t sparse = {
+        .view = (i32_t) gltf_push_view(&model, (gltf_buffer_view_t) {base_buffer, 0, base_size, 0, GLTF_BUFFER_TARGET_ARRAY}, scratch.arena),
+        .comp_type = GLTF_COMP_TYPE_FLOAT,
+        .count = SPARSE_ELEMENT_COUNT,
+        .type = GLTF_ACCESSOR_TYPE_VEC3,
+        .sparse = {
+            .count = SPARSE_UPDATE_COUNT,
+            .indices_view = gltf_push_view(&model, (gltf_buffer_view_t) {.buffer = index_buffer, .length = SPARSE_UPDATE_COUNT * sizeof(u32_t)}, scratch.arena),
+            .indices_comp_type = GLTF_COMP_TYPE_UNSIGNED_INT,
+            .values_view = gltf_push_view(&model, (gltf_buffer_view_t) {.buffer = value_buffer, .length = SPARSE_UPDATE_COUNT * 3 * sizeof(f32_t)}, scratch.arena),
+        },
+    };
+    u32_t accessor = gltf_push_accessor(&model, sparse, scratch.arena);
+    f32_t *out = re_arena_push(scratch.arena, base_size);
+
+    // Repeated so the timing isn't dominated by the clock. Every resolve
+    // expands a fresh copy of the accessor.
+    const u32_t repeats = 10;
+    f64_t resolve_time = 0.0;
+    for (u32_t r = 0; r < repeats; r++) {
+        u32_t copy = gltf_push_accessor(&model, sparse, scratch.arena);
+        f64_t start = re_os_get_time();
+        gltf_accessor_resolve(&model, copy, scratch.arena);
+        resolve_time += re_os_get_time() - start;
+    }
+
+    f64_t start = re_os_get_time();
+    for (u32_t r = 0; r < repeats; r++) {
+        gltf_accessor_read_f32(&model, accessor, out);
+    }
+    f64_t read_time = re_os_get_time() - start;
+
+    start = re_os_get_time();
+    for (u32_t r = 0; r < repeats; r++) {
+        memcpy(out, base, base_size);
+    }
+    f64_t copy_time = re_os_get_time() - start;
+
+    // The first element is replaced, the second one isn't.
+    if (!gltf_accessor_read_f32(&model, accessor, out) || out[0] != -1.0f || out[3] != 3.0f) {
+        re_log_error("Sparse accessor read back wrong values.");
+    }
+    re_log_info("Sparse accessor of %u elements, %u replaced: %.2f ms to resolve, %.2f ms to read as floats, %.2f ms to copy the base data.",
+            SPARSE_ELEMENT_COUNT, SPARSE_UPDATE_COUNT, resolve_time * 1e3 / repeats, read_time * 1e3 / repeats, copy_time * 1e3 / repeats);
+    re_arena_scratch_release(&scratch);
+}
+
+// A model of one triangle list with positions and 32 bit indices, the data
+// staying where it is, for the analyses of generated meshes.
+static gltf_model_t synthetic_model(u32_t *indices, u32_t index_count, f32_t *positions, u32_t vertex_count, re_arena_t *arena) {
+    gltf_model_t model = {.arena = arena};
+    u64_t index_size = (u64_t) index_count * sizeof(u32_t);
+    u64_t position_size = (u64_t) vertex_count * 3 * sizeof(f32_t);
+    u32_t index_buffer = gltf_push_buffer(&model, re_str((u8_t *) indices, index_size), arena);
+    u32_t position_buffer = gltf_push_buffer(&model, re_str((u8_t *) positions, position_size), arena);
+    u32_t index_accessor = gltf_push_accessor(&model, (gltf_accessor_t) {
+        .view = (i32_t) gltf_push_view(&model, (gltf_buffer_view_t) {index_buffer, 0, index_size, 0, GLTF_BUFFER_TARGET_ELEMENT_ARRAY}, arena),
+        .comp_type = GLTF_COMP_TYPE_UNSIGNED_INT,
+        .count = index_count,
+        .type = GLTF_ACCESSOR_TYPE_SCALAR,
+    }, arena);
+    u32_t position_accessor = gltf_push_accessor(&model, (gltf_accessor_t) {
+        .view = (i32_t) gltf_push_view(&model, (gltf_buffer_view_t) {position_buffer, 0, position_size, 0, GLTF_BUFFER_TARGET_ARRAY}, arena),
+        .comp_type = GLTF_COMP_TYPE_FLOAT,
+        .count = vertex_count,
+        .type = GLTF_ACCESSOR_TYPE_VEC3,
+    }, arena);
+
+    gltf_primitives_t *prims = &model.primitives;
+    prims->count = 1;
+    for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+        prims->attributes[attrib] = re_arena_push(arena, sizeof(i32_t));
+        prims->attributes[attrib][0] = -1;
+    }
+    prims->attributes[GLTF_ATTRIBUTE_POSITION][0] = (i32_t) position_accessor;
+    prims->indices = re_arena_push(arena, sizeof(i32_t));
+    prims->indices[0] = (i32_t) index_accessor;
+    prims->mode = re_arena_push(arena, sizeof(gltf_primitive_mode_t));
+    prims->mode[0] = GLTF_PRIMITIVE_MODE_TRIANGLES;
+    prims->material = re_arena_push(arena, sizeof(i32_t));
+    prims->material[0] = -1;
+    prims->lod_offset = re_arena_push_zero(arena, sizeof(u32_t));
+    prims->lod_count = re_arena_push_zero(arena, sizeof(u32_t));
+    prims->meshlet_offset = re_arena_push_zero(arena, sizeof(u32_t));
+    prims->meshlet_count = re_arena_push_zero(arena, sizeof(u32_t));
+    prims->bounds = re_arena_push_zero(arena, sizeof(gltf_aabb_t));
+    return model;
+}
+
+// Vertices per side of the height field analyze_normals generates normals
+// for, about 10M triangles.
+#define HEIGHT_FIELD_SIZE 2237
+
+// Generates normals for a rolling height field of HEIGHT_FIELD_SIZE squared
+// vertices with mesh_generate_normals alone, and through gltf_process with
+// the accessor reads, vertex splitting and copies around it, and logs the
+// throughput of both.
+static void analyze_normals(void) {
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    u32_t side = HEIGHT_FIELD_SIZE;
+    u32_t vertex_count = side * side;
+    u32_t index_count = (side - 1) * (side - 1) * 6;
+    f32_t *positions = re_arena_push(scratch.arena, (u64_t) vertex_count * 3 * sizeof(f32_t));
+    u32_t *indices = re_arena_push(scratch.arena, (u64_t) index_count * sizeof(u32_t));
+    for (u32_t y = 0; y < side; y++) {
+        for (u32_t x = 0; x < side; x++) {
+            f32_t *p = positions + ((u64_t) y * side + x) * 3;
+            p[0] = (f32_t) x;
+            p[1] = (f32_t) y;
+            p[2] = 8.0f * sinf(x * 0.05f) * cosf(y * 0.07f);
+        }
+    }
+    u32_t *index = indices;
+    for (u32_t y = 0; y + 1 < side; y++) {
+        for (u32_t x = 0; x + 1 < side; x++) {
+            u32_t v = y * side + x;
+            u32_t quad[6] = {v, v + 1, v + side + 1, v, v + side + 1, v + side};
+            memcpy(index, quad, sizeof(quad));
+            index += 6;
+        }
+    }
+
+    f32_t *normals = re_arena_push(scratch.arena, (u64_t) index_count * 3 * sizeof(f32_t));
+    f64_t start = re_os_get_time();
+    mesh_generate_normals(normals, indices, index_count, positions, vertex_count, GLTF_NORMAL_CREASE_ANGLE * (3.14159265f / 180.0f));
+    f64_t kernel_time = re_os_get_time() - start;
+
+    gltf_model_t model = synthetic_model(indices, index_count, positions, vertex_count, scratch.arena);
+    start = re_os_get_time();
+    gltf_process(&model, GLTF_PROCESS_NORMALS, scratch.arena);
+    f64_t pass_time = re_os_get_time() - start;
+
+    u32_t triangle_count = index_count / 3;
+    re_log_info("Height field of %u triangles: %.1f M triangles/s generating normals, %.1f M triangles/s through gltf_process.",
+            triangle_count, triangle_count / kernel_time / 1e6, triangle_count / pass_time / 1e6);
+    re_arena_scratch_release(&scratch);
+}
+
+// Quads per side of the grid analyze_merging merges, four vertices each,
+// about 17M vertices.
+#define MERGE_GRID_SIZE 2062
+
+// Merges a grid of MERGE_GRID_SIZE squared quads that don't share vertices
+// through gltf_process, exact copies with GLTF_PROCESS_DEDUPLICATE and copies
+// moved by a fraction of the weld tolerance with GLTF_PROCESS_WELD, and logs
+// the vertices left and the throughput of both.
+static void analyze_merging(void) {
+    u32_t side = MERGE_GRID_SIZE;
+    u32_t vertex_count = side * side * 4;
+    u32_t index_count = side * side * 6;
+    for (u32_t weld = 0; weld < 2; weld++) {
+        re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+        f32_t *positions = re_arena_push(scratch.arena, (u64_t) vertex_count * 3 * sizeof(f32_t));
+        u32_t *indices = re_arena_push(scratch.arena, (u64_t) index_count * sizeof(u32_t));
+        for (u32_t y = 0; y < side; y++) {
+            for (u32_t x = 0; x < side; x++) {
+                u32_t quad = y * side + x;
+                for (u32_t corner = 0; corner < 4; corner++) {
+                    u32_t v = quad * 4 + corner;
+                    // Far below the tolerance, which is relative to the grid's
+                    // diagonal.
+                    f32_t offset = weld ? (f32_t) ((v * 2654435761u) >> 24) * (0.01f / 255.0f) : 0.0f;
+                    f32_t *p = positions + (u64_t) v * 3;
+                    p[0] = (f32_t) (x + (corner & 1)) + offset;
+                    p[1] = (f32_t) (y + (corner >> 1)) - offset;
+                    p[2] = offset;
+                }
+
+                u32_t v = quad * 4;
+                u32_t triangles[6] = {v, v + 1, v + 3, v, v + 3, v + 2};
+                memcpy(indices + (u64_t) quad * 6, triangles, sizeof(triangles));
+            }
+        }
+
+        gltf_model_t model = synthetic_model(indices, index_count, positions, vertex_count, scratch.arena);
+        f64_t start = re_os_get_time();
+        gltf_process(&model, weld ? GLTF_PROCESS_WELD : GLTF_PROCESS_DEDUPLICATE, scratch.arena);
+        f64_t time = re_os_get_time() - start;
+
+        u32_t merged = model.accessors[model.primitives.attributes[GLTF_ATTRIBUTE_POSITION][0]].count;
+        re_log_info("Grid of %u vertices: %s to %u vertices at %.1f M vertices/s.",
+                vertex_count, weld ? "welded" : "deduplicated", merged, vertex_count / time / 1e6);
+        re_arena_scratch_release(&scratch);
+    }
+}
+
+// Logs vertex cache, overdraw and vertex fetch statistics of every indexed
+// triangle list, and culling statistics of its meshlets. Adds the bytes of
+// all index accessors, and what they would take as 32 bit indices, to
+// index_bytes and wide_bytes.
+static void analyze_model(const gltf_model_t *model, u64_t *index_bytes, u64_t *wide_bytes) {
+    gltf_primitives_t prims = model->primitives;
+    for (u32_t i = 0; i < prims.count; i++) {
+        i32_t index_accessor = prims.indices[i];
+        if (index_accessor >= 0) {
+            *index_bytes += (u64_t) model->accessors[index_accessor].count * gltf_accessor_element_size(&model->accessors[index_accessor]);
+            *wide_bytes += (u64_t) model->accessors[index_accessor].count * sizeof(u32_t);
+        }
+        for (u32_t l = prims.lod_offset[i]; l < prims.lod_offset[i] + prims.lod_count[i]; l++) {
+            const gltf_accessor_t *lod = &model->accessors[model->lods[l].indices];
+            *index_bytes += (u64_t) lod->count * gltf_accessor_element_size(lod);
+            *wide_bytes += (u64_t) lod->count * sizeof(u32_t);
+        }
+
+        i32_t position_accessor = prims.attributes[GLTF_ATTRIBUTE_POSITION][i];
+        if (prims.mode[i] != GLTF_PRIMITIVE_MODE_TRIANGLES || index_accessor < 0 || position_accessor < 0) {
+            continue;
+        }
+
+        u32_t index_count = model->accessors[index_accessor].count;
+        u32_t vertex_count = model->accessors[position_accessor].count;
+
+        // Fetches are analyzed in the layout the attributes are stored in,
+        // attributes of one buffer view less than a stride apart sharing a
+        // stream, and for a depth prepass that only reads positions.
+        u32_t strides[GLTF_ATTRIBUTE_COUNT];
+        const gltf_accessor_t *streams[GLTF_ATTRIBUTE_COUNT];
+        u32_t stream_count = 0;
+        u32_t position_stride = 0;
+        for (u32_t attrib = 0; attrib < GLTF_ATTRIBUTE_COUNT; attrib++) {
+            i32_t accessor = prims.attributes[attrib][i];
+            if (accessor < 0) {
+                continue;
+            }
+
+            const gltf_accessor_t *acc = &model->accessors[accessor];
+            u32_t stride = acc->view >= 0 && model->views[acc->view].stride != 0 ?
+                model->views[acc->view].stride : gltf_accessor_element_size(acc);
+            u32_t s = 0;
+            while (s < stream_count && !(acc->view >= 0 && streams[s]->view == acc->view &&
+                        (acc->offset > streams[s]->offset ? acc->offset - streams[s]->offset : streams[s]->offset - acc->offset) < stride)) {
+                s++;
+            }
+            if (s == stream_count) {
+                streams[stream_count] = acc;
+                strides[stream_count++] = stride;
+            }
+            if (attrib == GLTF_ATTRIBUTE_POSITION) {
+                position_stride = stride;
+            }
+        }
+
+        re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+        u32_t *indices = re_arena_push(scratch.arena, index_count * sizeof(u32_t));
+        f32_t *positions = re_arena_push(scratch.arena, vertex_count * 3 * sizeof(f32_t));
+        if (gltf_accessor_read_u32(model, index_accessor, indices) &&
+                gltf_accessor_read_f32(model, position_accessor, positions)) {
+            mesh_cache_stats_t fifo = mesh_analyze_vertex_cache(indices, index_count, vertex_count, MESH_VERTEX_CACHE_SIZE, MESH_CACHE_FIFO);
+            mesh_cache_stats_t lru = mesh_analyze_vertex_cache(indices, index_count, vertex_count, MESH_VERTEX_CACHE_SIZE, MESH_CACHE_LRU);
+            mesh_overdraw_stats_t overdraw = mesh_analyze_overdraw(indices, index_count, positions, vertex_count);
+            mesh_fetch_stats_t fetch = mesh_analyze_vertex_fetch_streams(indices, index_count, vertex_count, strides, stream_count);
+            mesh_fetch_stats_t depth = mesh_analyze_vertex_fetch(indices, index_count, vertex_count, position_stride);
+            re_log_info("Primitive %u, %u triangles: ACMR %.3f FIFO %.3f LRU, ATVR %.3f FIFO %.3f LRU, overdraw %.3f.",
+                    i, index_count / 3, fifo.acmr, lru.acmr, fifo.atvr, lru.atvr, overdraw.overdraw);
+            re_log_info("Primitive %u, %u vertices: fetch %.2f lines per vertex from %u streams, efficiency %.3f, depth only %.2f lines per vertex, efficiency %.3f.",
+                    i, vertex_count,
+                    (f64_t) fetch.bytes_fetched / MESH_FETCH_CACHE_LINE / vertex_count, stream_count, fetch.efficiency,
+                    (f64_t) depth.bytes_fetched / MESH_FETCH_CACHE_LINE / vertex_count, depth.efficiency);
+        }
+        re_arena_scratch_release(&scratch);
+
+        if (prims.meshlet_count[i] > 0) {
+            analyze_meshlets(model, i);
+        }
+    }
+}
+
+// Counts of every model of a batch, added to from several threads.
+typedef struct batch_counts_t batch_counts_t;
+struct batch_counts_t {
+    u32_t primitives;
+    u64_t triangles;
+};
+
+static void count_model(void *user, u32_t index, gltf_model_t *model) {
+    (void) index;
+    batch_counts_t *counts = user;
+
+    u64_t triangles = 0;
+    gltf_primitives_t prims = model->primitives;
+    for (u32_t i = 0; i < prims.count; i++) {
+        i32_t accessor = prims.indices[i] >= 0 ? prims.indices[i] : prims.attributes[GLTF_ATTRIBUTE_POSITION][i];
+        if (accessor >= 0 && prims.mode[i] == GLTF_PRIMITIVE_MODE_TRIANGLES) {
+            triangles += model->accessors[accessor].count / 3;
+        }
+    }
+
+    __atomic_fetch_add(&counts->primitives, prims.count, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counts->triangles, triangles, __ATOMIC_RELAXED);
+}
+
+// Threads --stress loads on at most.
+#define STRESS_MAX_THREADS 64
+
+// One thread of --stress, going through the models starting at its own index
+// so threads work on different models at once.
+typedef struct stress_thread_t stress_thread_t;
+struct stress_thread_t {
+    pthread_t thread;
+    u32_t index;
+    const char **paths;
+    u32_t path_count;
+    u32_t process;
+    u32_t failed;
+};
+
+static void *stress_thread(void *user) {
+    stress_thread_t *t = user;
+    for (u32_t i = 0; i < t->path_count; i++) {
+        // Parsed rather than loaded, a valid cache would skip processing.
+        re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+        gltf_model_t model = gltf_parse(t->paths[(t->index + i) % t->path_count], scratch.arena);
+        if (model.buffers != NULL) {
+            gltf_process(&model, t->process, scratch.arena);
+        } else {
+            t->failed++;
+        }
+        gltf_unload(&model);
+        re_arena_scratch_release(&scratch);
+    }
+    return NULL;
+}
+
+// Parses and processes every model on thread_count threads at once, all
+// sharing the job system, and returns how many loads failed. Built with make
+// tsan, ThreadSanitizer reports any race between them.
+static u32_t stress(const char **paths, u32_t path_count, u32_t process, u32_t thread_count) {
+    f64_t start = re_os_get_time();
+    stress_thread_t threads[STRESS_MAX_THREADS];
+    for (u32_t i = 0; i < thread_count; i++) {
+        threads[i] = (stress_thread_t) {.index = i, .paths = paths, .path_count = path_count, .process = process};
+        pthread_create(&threads[i].thread, NULL, stress_thread, &threads[i]);
+    }
+
+    u32_t failed = 0;
+    for (u32_t i = 0; i < thread_count; i++) {
+        pthread_join(threads[i].thread, NULL);
+        failed += threads[i].failed;
+    }
+
+    re_log_info("Loaded %u models on %u threads in %.2f s, %u failed.",
+            path_count * thread_count, thread_count, re_os_get_time() - start, failed);
+    return failed;
+}
+
+// Usage: gltf_viewer [--dedup | --weld] [--vcache] [--overdraw] [--vfetch] [--lod] [--meshlets] [--split] [--narrow] [--interleave [--position-stream]] [--tangents] [--no-normals] [--bvh] [--analyze | --bench | --batch | --stress threads] [model.gltf...]
+//   --dedup            merge vertices with identical attributes while loading
+//   --weld             merge vertices that are nearly identical while loading
+//   --vcache           reorder triangles for the vertex cache while loading
+//   --overdraw         reorder triangle clusters to reduce overdraw while loading
+//   --vfetch           renumber vertices in use order and drop unused ones
+//   --lod              build simplified LODs, drawn by their screen space error
+//   --meshlets         build meshlets and cull them on the CPU when drawing
+//   --split            split primitives 16 bit indices can't address
+//   --narrow           store indices in 16 bits where they fit
+//   --interleave       interleave the attributes of every primitive
+//   --position-stream  keep positions apart from the other attributes
+//   --tangents         generate missing tangents for normal mapping
+//   --no-normals       leave primitives without normals unlit instead of
+//                      generating them
+//   --bvh              build BVHs over the triangles of every mesh and the
+//                      mesh instances of every scene, clicking logs the
+//                      triangle under the cursor
+//   --analyze          log mesh statistics of every model, skinning and
+//                      animation throughput, ray query throughput with
+//                      --bvh, and exit without opening a window, the viewer
+//                      shows the last model and plays its first animation
+//   --bench            log sparse accessor expansion throughput and normal
+//                      generation and vertex merging throughput on 10M
+//                      triangle and 17M vertex grids, all generated, and
+//                      exit, ignoring the models
+//   --batch            load every model on all cores with shared buffer
+//                      files, log the throughput and exit
+//   --stress threads   parse and process every model on that many threads at
+//                      once and exit, failing if a load did, make stress runs
+//                      it under ThreadSanitizer
+i32_t main(i32_t argc, char **argv) {
     re_init();
     re_arena_t *arena = re_arena_create(GB(4));
+    job_system_init(0);
+
+    // const char *path = "resources/models/box/Box.gltf";
+    // const char *path = "resources/models/box_interleaved/BoxInterleaved.gltf";
+    // const char *path = "resources/models/suzanne/Suzanne.gltf";
+    // const char *path = "resources/models/avocado/Avocado.gltf";
+    const char *path = "resources/models/damaged_helmet/DamagedHelmet.gltf";
+    // Lighting needs normals, primitives that have them are left alone.
+    u32_t process = GLTF_PROCESS_NORMALS;
+    b8_t analyze = false;
+    b8_t bench = false;
+    b8_t batch = false;
+    u32_t stress_threads = 0;
+    const char **paths = re_arena_push(arena, argc * sizeof(const char *));
+    u32_t path_count = 0;
+
+    for (i32_t i = 1; i < argc; i++) {
+        re_str_t arg = re_str_cstr(argv[i]);
+        if (re_str_cmp(arg, re_str_lit("--dedup")) == 0) {
+            process |= GLTF_PROCESS_DEDUPLICATE;
+        } else if (re_str_cmp(arg, re_str_lit("--weld")) == 0) {
+            process |= GLTF_PROCESS_WELD;
+        } else if (re_str_cmp(arg, re_str_lit("--vcache")) == 0) {
+            process |= GLTF_PROCESS_VERTEX_CACHE;
+        } else if (re_str_cmp(arg, re_str_lit("--overdraw")) == 0) {
+            process |= GLTF_PROCESS_OVERDRAW;
+        } else if (re_str_cmp(arg, re_str_lit("--vfetch")) == 0) {
+            process |= GLTF_PROCESS_VERTEX_FETCH;
+        } else if (re_str_cmp(arg, re_str_lit("--lod")) == 0) {
+            process |= GLTF_PROCESS_LOD;
+        } else if (re_str_cmp(arg, re_str_lit("--meshlets")) == 0) {
+            process |= GLTF_PROCESS_MESHLETS;
+        } else if (re_str_cmp(arg, re_str_lit("--split")) == 0) {
+            process |= GLTF_PROCESS_SPLIT;
+        } else if (re_str_cmp(arg, re_str_lit("--narrow")) == 0) {
+            process |= GLTF_PROCESS_NARROW_INDICES;
+        } else if (re_str_cmp(arg, re_str_lit("--interleave")) == 0) {
+            process |= GLTF_PROCESS_INTERLEAVE;
+        } else if (re_str_cmp(arg, re_str_lit("--position-stream")) == 0) {
+            process |= GLTF_PROCESS_POSITION_STREAM;
+        } else if (re_str_cmp(arg, re_str_lit("--tangents")) == 0) {
+            process |= GLTF_PROCESS_TANGENTS;
+        } else if (re_str_cmp(arg, re_str_lit("--no-normals")) == 0) {
+            process &= ~GLTF_PROCESS_NORMALS;
+        } else if (re_str_cmp(arg, re_str_lit("--bvh")) == 0) {
+            process |= GLTF_PROCESS_BVH;
+        } else if (re_str_cmp(arg, re_str_lit("--analyze")) == 0) {
+            analyze = true;
+        } else if (re_str_cmp(arg, re_str_lit("--bench")) == 0) {
+            bench = true;
+        } else if (re_str_cmp(arg, re_str_lit("--batch")) == 0) {
+            batch = true;
+        } else if (re_str_cmp(arg, re_str_lit("--stress")) == 0) {
+            stress_threads = i + 1 < argc ? (u32_t) strtoul(argv[++i], NULL, 10) : 0;
+            if (stress_threads == 0 || stress_threads > STRESS_MAX_THREADS) {
+                re_log_error("--stress takes 1 to %u threads.", STRESS_MAX_THREADS);
+                return 1;
+            }
+        } else if (arg.len > 1 && arg.str[0] == '-') {
+            re_log_error("Unknown option %s.", argv[i]);
+            return 1;
+        } else {
+            path = argv[i];
+            paths[path_count++] = path;
+        }
+    }
+
+    if (stress_threads > 0) {
+        if (path_count == 0) {
+            paths[path_count++] = path;
+        }
+
+        u32_t failed = stress(paths, path_count, process, stress_threads);
+
+        job_system_terminate();
+        re_terminate();
+        return failed > 0;
+    }
+
+    if (batch) {
+        if (path_count == 0) {
+            paths[path_count++] = path;
+        }
+
+        batch_counts_t counts = {0};
+        gltf_load_batch(paths, path_count, process, count_model, &counts, arena);
+        re_log_info("Batch held %u primitives, %llu triangles.", counts.primitives, (unsigned long long) counts.triangles);
+
+        job_system_terminate();
+        re_terminate();
+        return 0;
+    }
+
+    if (bench) {
+        analyze_sparse();
+        analyze_normals();
+        analyze_merging();
+
+        job_system_terminate();
+        re_terminate();
+        return 0;
+    }
+
+    if (analyze) {
+        if (path_count == 0) {
+            paths[path_count++] = path;
+        }
+
+        u64_t index_bytes = 0;
+        u64_t wide_bytes = 0;
+        for (u32_t i = 0; i < path_count; i++) {
+            re_log_info("Analyzing %s.", paths[i]);
+            gltf_model_t gltf_model = gltf_load(paths[i], process, arena);
+            analyze_model(&gltf_model, &index_bytes, &wide_bytes);
+            analyze_rays(&gltf_model);
+            analyze_skins(&gltf_model);
+            analyze_animations(&gltf_model);
+        }
+        re_log_info("Index data of %u models: %.2f MB, %.2f MB as 32 bit indices.",
+                path_count, index_bytes / (1024.0 * 1024.0), wide_bytes / (1024.0 * 1024.0));
+
+        job_system_terminate();
+        re_terminate();
+        return 0;
+    }
 
     if (!glfwInit()) {
         re_log_error("Failed to init GLFW.");
@@ -148,16 +1362,33 @@ i32_t main(void) {
         return 1;
     }
 
-    // gltf_model_t gltf_model = gltf_parse("resources/models/box/Box.gltf", arena);
-    // gltf_model_t gltf_model = gltf_parse("resources/models/box_interleaved/BoxInterleaved.gltf", arena);
-    // gltf_model_t gltf_model = gltf_parse("resources/models/suzanne/Suzanne.gltf", arena);
-    // gltf_model_t gltf_model = gltf_parse("resources/models/avocado/Avocado.gltf", arena);
-    gltf_model_t gltf_model = gltf_parse("resources/models/damaged_helmet/DamagedHelmet.gltf", arena);
-    model_t model = gltf_to_model(gltf_model, arena);
+    gltf_model_t gltf_model = gltf_load(path, process, arena);
+    gl_buffer_pool_t vertex_pool = gl_buffer_pool_new(VERTEX_POOL_PAGE_SIZE, POOL_MAX_ALLOCATIONS, arena);
+    gl_buffer_pool_t index_pool = gl_buffer_pool_new(INDEX_POOL_PAGE_SIZE, POOL_MAX_ALLOCATIONS, arena);
+    model_t model = gltf_to_model(gltf_model, &vertex_pool, &index_pool, arena);
+    // Clicks pick triangles once there are hierarchies to cast rays against.
+    gltf_raycaster_t raycaster = gltf_raycaster_new(&gltf_model, arena);
+    b8_t was_pressed = false;
+    // The first animation loops, picking still sees the nodes as loaded.
+    gltf_animation_player_t player = {0};
+    if (gltf_model.animation_count > 0) {
+        player = gltf_animation_player_new(&gltf_model, 0, 1, arena);
+    }
+
+    heap_stats_t vertex_stats = gl_buffer_pool_stats(&vertex_pool);
+    heap_stats_t index_stats = gl_buffer_pool_stats(&index_pool);
+    re_log_info("GPU buffer pools: %u vertex and %u index buffers, %u slices, %.2f of %.2f MB used.",
+            vertex_pool.page_count, index_pool.page_count,
+            vertex_stats.allocation_count + index_stats.allocation_count,
+            (f64_t) (vertex_stats.used + index_stats.used) / MB(1),
+            (f64_t) (vertex_stats.used + vertex_stats.free + index_stats.used + index_stats.free) / MB(1));
 
     gl_shader_t shader = gl_shader_file("resources/shaders/vert.glsl", "resources/shaders/frag.glsl");
 
     HMM_Mat4 projection = HMM_Perspective_LH_NO(90.0f, 800.0f/600.0f, 0.1f, 10.0f);
+    // Pixel scale from the vertical field of view the projection ended up
+    // with.
+    draw_view_t draw_view = {.pixel_scale = 600.0f * 0.5f * projection.Elements[1][1]};
 
     f32_t last = re_os_get_time();
     f32_t dt = 0.0f;
@@ -179,6 +1410,13 @@ i32_t main(void) {
         fps_timer += dt;
         if (fps_timer >= 1.0f) {
             re_log_info("FPS: %d", fps);
+            if (draw_view.meshlets_tested > 0) {
+                re_log_info("Drew %.1f%% of %llu meshlets.",
+                        100.0 * draw_view.meshlets_drawn / draw_view.meshlets_tested,
+                        (unsigned long long) draw_view.meshlets_tested / fps);
+                draw_view.meshlets_tested = 0;
+                draw_view.meshlets_drawn = 0;
+            }
             fps_timer = 0.0f;
             fps = 0;
         }
@@ -213,35 +1451,46 @@ i32_t main(void) {
         loc = glGetUniformLocation(shader.handle, "view");
         glUniformMatrix4fv(loc, 1, false, &view.Elements[0][0]);
 
-        {
-            HMM_Mat4 translation = HMM_Translate(HMM_V3(0.0f, 0.0f, 0.0f));
-            HMM_Mat4 rotation = HMM_QToM4(HMM_Q(0.7f, 0.0f, 0.0f, 0.7f));
-            // HMM_Mat4 rotation = HMM_M4D(1.0f);
-            HMM_Mat4 scale = HMM_Scale(HMM_MulV3F(HMM_V3(1.0f, 1.0f, 1.0f), 1.0f));
+        draw_view.view_projection = HMM_MulM4(projection, view);
+        draw_view.camera = HMM_InvGeneralM4(view).Columns[3].XYZ;
 
-            HMM_Mat4 transform = HMM_MulM4(translation, rotation);
-            transform = HMM_MulM4(transform, scale);
-
-            loc = glGetUniformLocation(shader.handle, "transform");
-            glUniformMatrix4fv(loc, 1, false, &transform.Elements[0][0]);
-
-            glBindVertexArray(model.meshes[0].vao);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.meshes[0].ebo);
+        if (player.count > 0) {
+            f32_t duration = gltf_model.animations[player.animation].duration;
+            player.times[0] = duration > 0.0f ? (f32_t) fmod(re_os_get_time(), duration) : 0.0f;
+            gltf_animation_sample_batch(&gltf_model, &player);
+            gltf_animation_apply(&gltf_model, player.animation, player.values, &gltf_model.nodes);
+            gltf_nodes_update(&gltf_model.nodes);
+        }
+        skin_model(&model, &gltf_model);
+        loc = glGetUniformLocation(shader.handle, "transform");
+        draw_model(model, &gltf_model, loc, &draw_view);
 
-            glDrawElements(
-                    GL_TRIANGLES,
-                    model.meshes[0].index_count,
-                    model.meshes[0].index_type,
-                    (const void *) model.meshes[0].index_offset);
+        b8_t pressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        if (pressed && !was_pressed && (process & GLTF_PROCESS_BVH)) {
+            f64_t x;
+            f64_t y;
+            glfwGetCursorPos(window, &x, &y);
+            gltf_ray_hit_t hit = pick(&raycaster, draw_view.view_projection, x, y, 800.0f, 600.0f);
+            if (hit.primitive >= 0) {
+                re_log_info("Picked node %d, primitive %d, triangle %u at u %.3f v %.3f.", hit.node, hit.primitive, hit.triangle, hit.u, hit.v);
+            } else {
+                re_log_info("Picked nothing.");
+            }
         }
+        was_pressed = pressed;
 
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    model_free(&model);
+    gl_buffer_pool_free(&vertex_pool);
+    gl_buffer_pool_free(&index_pool);
+
     glfwDestroyWindow(window);
     glfwTerminate();
 
+    job_system_terminate();
     re_terminate();
     return 0;
 }
@@ -0,0 +1,303 @@
+#include "mesh.h"
+#include "rebound.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PREFETCH(address) _mm_prefetch((const char *) (address), _MM_HINT_T0)
+#else
+#define PREFETCH(address) ((void) (address))
+#endif
+
+#define EMPTY 0xffffffffu
+#define DEDUP_BATCH 32
+
+// Open addressing with linear probing, at most half full.
+static u32_t table_capacity(u32_t count) {
+    u32_t capacity = 16;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+// MurmurHash3 finalizer.
+static u32_t hash_mix(u32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static u32_t hash_bytes(u32_t h, const u8_t *data, u32_t size) {
+    u32_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        u32_t word;
+        memcpy(&word, data + i, 4);
+        h = (h ^ hash_mix(word)) * 0x9e3779b1u;
+    }
+    for (; i < size; i++) {
+        h = (h ^ data[i]) * 0x01000193u;
+    }
+    return h;
+}
+
+static u32_t hash_vertex(const mesh_stream_t *streams, u32_t stream_count, u32_t v) {
+    u32_t h = 0;
+    for (u32_t s = 0; s < stream_count; s++) {
+        h = hash_bytes(h, (const u8_t *) streams[s].data + (u64_t) v * streams[s].stride, streams[s].size);
+    }
+    return hash_mix(h);
+}
+
+static b8_t vertex_equal(const mesh_stream_t *streams, u32_t stream_count, u32_t a, u32_t b) {
+    for (u32_t s = 0; s < stream_count; s++) {
+        const u8_t *data = streams[s].data;
+        if (memcmp(data + (u64_t) a * streams[s].stride, data + (u64_t) b * streams[s].stride, streams[s].size) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+u32_t mesh_deduplicate(
+        u32_t *remap,
+        const mesh_stream_t *streams,
+        u32_t stream_count,
+        u32_t vertex_count) {
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    u32_t capacity = table_capacity(vertex_count);
+    u32_t *table = re_arena_push(scratch.arena, capacity * sizeof(u32_t));
+    memset(table, 0xff, capacity * sizeof(u32_t));
+
+    // Large meshes are bound by the cache misses on the table and on the
+    // vertex found there. Hashing a batch up front lets those loads overlap.
+    u32_t slots[DEDUP_BATCH];
+    u32_t unique = 0;
+    for (u32_t batch = 0; batch < vertex_count; batch += DEDUP_BATCH) {
+        u32_t batch_count = vertex_count - batch < DEDUP_BATCH ? vertex_count - batch : DEDUP_BATCH;
+        for (u32_t i = 0; i < batch_count; i++) {
+            slots[i] = hash_vertex(streams, stream_count, batch + i) & (capacity - 1);
+            PREFETCH(&table[slots[i]]);
+        }
+        for (u32_t i = 0; i < batch_count; i++) {
+            if (table[slots[i]] != EMPTY) {
+                PREFETCH((const u8_t *) streams[0].data + (u64_t) table[slots[i]] * streams[0].stride);
+            }
+        }
+
+        for (u32_t i = 0; i < batch_count; i++) {
+            u32_t v = batch + i;
+            u32_t slot = slots[i];
+            while (table[slot] != EMPTY && !vertex_equal(streams, stream_count, table[slot], v)) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+
+            if (table[slot] == EMPTY) {
+                table[slot] = v;
+                remap[v] = unique++;
+            } else {
+                remap[v] = remap[table[slot]];
+            }
+        }
+    }
+
+    re_arena_scratch_release(&scratch);
+    return unique;
+}
+
+/*=========================*/
+// Welding
+/*=========================*/
+
+// Cells are four tolerances wide, so a vertex only has to look into a
+// neighbouring cell along an axis when it's within one tolerance of that
+// side, on average 3.4 cells instead of 27.
+#define CELL_TOLERANCES 4.0f
+
+typedef struct weld_cell_t weld_cell_t;
+struct weld_cell_t {
+    i32_t key[3];
+    // First representative vertex in the cell, further ones through next.
+    u32_t head;
+};
+
+typedef struct weld_t weld_t;
+struct weld_t {
+    const f32_t *vertices;
+    u32_t vertex_floats;
+    const f32_t *tolerances;
+
+    weld_cell_t *cells;
+    u32_t capacity;
+    u32_t cell_count;
+    u32_t *next;
+    re_arena_t *arena;
+};
+
+static i32_t cell_coord(f32_t value, f32_t size) {
+    f32_t cell = floorf(value / size);
+    // Far away or non-finite values all land in the outermost cells.
+    if (!(cell > -2e9f)) {
+        return -2000000000;
+    }
+    return cell < 2e9f ? (i32_t) cell : 2000000000;
+}
+
+static u32_t cell_hash(const i32_t *key) {
+    return hash_mix((u32_t) key[0] * 73856093u ^ (u32_t) key[1] * 19349663u ^ (u32_t) key[2] * 83492791u);
+}
+
+static void weld_alloc_cells(weld_t *weld, u32_t capacity) {
+    weld->capacity = capacity;
+    weld->cells = re_arena_push(weld->arena, capacity * sizeof(weld_cell_t));
+    for (u32_t i = 0; i < capacity; i++) {
+        weld->cells[i].head = EMPTY;
+    }
+}
+
+static weld_cell_t *find_cell(weld_t *weld, const i32_t *key, b8_t insert);
+
+// Cells are only created for unique vertices, so the table starts small and
+// doubles once it's half full instead of being sized for every vertex.
+static void weld_grow(weld_t *weld) {
+    weld_cell_t *cells = weld->cells;
+    u32_t capacity = weld->capacity;
+    weld_alloc_cells(weld, capacity * 2);
+    for (u32_t i = 0; i < capacity; i++) {
+        if (cells[i].head != EMPTY) {
+            find_cell(weld, cells[i].key, true)->head = cells[i].head;
+        }
+    }
+}
+
+static weld_cell_t *find_cell(weld_t *weld, const i32_t *key, b8_t insert) {
+    u32_t slot = cell_hash(key) & (weld->capacity - 1);
+    for (;;) {
+        weld_cell_t *cell = &weld->cells[slot];
+        if (cell->head == EMPTY) {
+            if (!insert) {
+                return NULL;
+            }
+            if (weld->cell_count * 2 >= weld->capacity) {
+                weld_grow(weld);
+                return find_cell(weld, key, true);
+            }
+            memcpy(cell->key, key, sizeof(cell->key));
+            weld->cell_count++;
+            return cell;
+        }
+        if (cell->key[0] == key[0] && cell->key[1] == key[1] && cell->key[2] == key[2]) {
+            return cell;
+        }
+        slot = (slot + 1) & (weld->capacity - 1);
+    }
+}
+
+static b8_t vertex_near(const weld_t *weld, u32_t a, u32_t b) {
+    const f32_t *va = weld->vertices + (u64_t) a * weld->vertex_floats;
+    const f32_t *vb = weld->vertices + (u64_t) b * weld->vertex_floats;
+    for (u32_t i = 0; i < weld->vertex_floats; i++) {
+        if (!(fabsf(va[i] - vb[i]) <= weld->tolerances[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static i32_t find_in_cell(weld_t *weld, u32_t v, const i32_t *key) {
+    weld_cell_t *cell = find_cell(weld, key, false);
+    for (u32_t r = cell != NULL ? cell->head : EMPTY; r != EMPTY; r = weld->next[r]) {
+        if (vertex_near(weld, r, v)) {
+            return r;
+        }
+    }
+    return -1;
+}
+
+static i32_t find_near(weld_t *weld, u32_t v, const i32_t *key) {
+    // The vertex's own cell first, that's where exact duplicates are.
+    i32_t match = find_in_cell(weld, v, key);
+    if (match >= 0) {
+        return match;
+    }
+
+    const f32_t *position = weld->vertices + (u64_t) v * weld->vertex_floats;
+    i32_t lo[3], hi[3];
+    for (u32_t axis = 0; axis < 3; axis++) {
+        f32_t size = weld->tolerances[axis] * CELL_TOLERANCES;
+        f32_t offset = position[axis] - (f32_t) key[axis] * size;
+        lo[axis] = offset < weld->tolerances[axis] ? -1 : 0;
+        hi[axis] = offset > size - weld->tolerances[axis] ? 1 : 0;
+    }
+
+    for (i32_t x = lo[0]; x <= hi[0]; x++) {
+        for (i32_t y = lo[1]; y <= hi[1]; y++) {
+            for (i32_t z = lo[2]; z <= hi[2]; z++) {
+                if (x == 0 && y == 0 && z == 0) {
+                    continue;
+                }
+
+                i32_t neighbour[3] = {key[0] + x, key[1] + y, key[2] + z};
+                match = find_in_cell(weld, v, neighbour);
+                if (match >= 0) {
+                    return match;
+                }
+            }
+        }
+    }
+
+    return -1;
+}
+
+u32_t mesh_weld(
+        u32_t *remap,
+        const f32_t *vertices,
+        u32_t vertex_count,
+        u32_t vertex_floats,
+        const f32_t *tolerances) {
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    weld_t weld = {
+        .vertices = vertices,
+        .vertex_floats = vertex_floats,
+        .tolerances = tolerances,
+        .next = re_arena_push(scratch.arena, vertex_count * sizeof(u32_t)),
+        .arena = scratch.arena,
+    };
+    weld_alloc_cells(&weld, table_capacity(vertex_count < 4096 ? vertex_count : 4096));
+
+    // Batched like mesh_deduplicate, prefetching the vertex's own cell.
+    i32_t keys[DEDUP_BATCH][3];
+    u32_t unique = 0;
+    for (u32_t batch = 0; batch < vertex_count; batch += DEDUP_BATCH) {
+        u32_t batch_count = vertex_count - batch < DEDUP_BATCH ? vertex_count - batch : DEDUP_BATCH;
+        for (u32_t i = 0; i < batch_count; i++) {
+            const f32_t *position = vertices + (u64_t) (batch + i) * vertex_floats;
+            for (u32_t axis = 0; axis < 3; axis++) {
+                keys[i][axis] = cell_coord(position[axis], tolerances[axis] * CELL_TOLERANCES);
+            }
+            PREFETCH(&weld.cells[cell_hash(keys[i]) & (weld.capacity - 1)]);
+        }
+
+        for (u32_t i = 0; i < batch_count; i++) {
+            u32_t v = batch + i;
+            i32_t match = find_near(&weld, v, keys[i]);
+            if (match >= 0) {
+                remap[v] = remap[match];
+                continue;
+            }
+
+            weld_cell_t *cell = find_cell(&weld, keys[i], true);
+            weld.next[v] = cell->head;
+            cell->head = v;
+            remap[v] = unique++;
+        }
+    }
+
+    re_arena_scratch_release(&scratch);
+    return unique;
+}
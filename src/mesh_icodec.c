@@ -0,0 +1,63 @@
+#include "mesh.h"
+#include "rebound.h"
+
+// Indices of vertex cache and vertex fetch optimized meshes are either the
+// next unused vertex or one used recently, both close to the highest index so
+// far. Most of them take one byte.
+
+static u32_t zigzag(i32_t value) {
+    return ((u32_t) value << 1) ^ (u32_t) (value >> 31);
+}
+
+static i32_t unzigzag(u32_t value) {
+    return (i32_t) (value >> 1) ^ -(i32_t) (value & 1);
+}
+
+u64_t mesh_encode_indices_bound(u32_t index_count) {
+    // Five bytes hold 35 bits.
+    return (u64_t) index_count * 5;
+}
+
+u64_t mesh_encode_indices(u8_t *out, const u32_t *indices, u32_t index_count) {
+    u64_t size = 0;
+    u32_t next = 0;
+
+    for (u32_t i = 0; i < index_count; i++) {
+        u32_t value = zigzag((i32_t) (next - indices[i]));
+        while (value >= 0x80) {
+            out[size++] = (u8_t) (value | 0x80);
+            value >>= 7;
+        }
+        out[size++] = (u8_t) value;
+
+        next = indices[i] + 1 > next ? indices[i] + 1 : next;
+    }
+
+    return size;
+}
+
+b8_t mesh_decode_indices(u32_t *out, u32_t index_count, const u8_t *data, u64_t size) {
+    u64_t pos = 0;
+    u32_t next = 0;
+
+    for (u32_t i = 0; i < index_count; i++) {
+        u32_t value = 0;
+        u32_t shift = 0;
+        for (;;) {
+            if (pos == size || shift > 28) {
+                return false;
+            }
+            u8_t byte = data[pos++];
+            value |= (u32_t) (byte & 0x7f) << shift;
+            shift += 7;
+            if (byte < 0x80) {
+                break;
+            }
+        }
+
+        out[i] = next - (u32_t) unzigzag(value);
+        next = out[i] + 1 > next ? out[i] + 1 : next;
+    }
+
+    return pos == size;
+}
@@ -0,0 +1,374 @@
+#include "mesh.h"
+#include "rebound.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#define NOT_LOCAL 0xffffffffu
+
+// How much a neighbour's distance grows when its normal points away from the
+// meshlet's, keeping normal cones narrow enough to cull.
+#define CONE_WEIGHT 2.0f
+
+// Zero and false if the triangle has no area.
+static b8_t unit_normal(f32_t *n, const f32_t *a, const f32_t *b, const f32_t *c) {
+    f32_t e0[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    f32_t e1[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    n[0] = e0[1] * e1[2] - e0[2] * e1[1];
+    n[1] = e0[2] * e1[0] - e0[0] * e1[2];
+    n[2] = e0[0] * e1[1] - e0[1] * e1[0];
+
+    f32_t length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length == 0.0f) {
+        return false;
+    }
+    n[0] /= length;
+    n[1] /= length;
+    n[2] /= length;
+    return true;
+}
+
+/*=========================*/
+// Builder
+/*=========================*/
+
+u32_t mesh_meshlet_bound(u32_t index_count, u32_t max_vertices, u32_t max_triangles) {
+    // A meshlet is only closed when the next triangle doesn't fit, so it has
+    // max_triangles triangles or more than max_vertices - 3 vertices, which
+    // take a third as many triangles at least.
+    u32_t triangle_count = index_count / 3;
+    u32_t per_meshlet = max_vertices > 3 ? (max_vertices - 2) / 3 : 1;
+    if (max_triangles < per_meshlet) {
+        per_meshlet = max_triangles;
+    }
+    if (per_meshlet == 0) {
+        per_meshlet = 1;
+    }
+    return (triangle_count + per_meshlet - 1) / per_meshlet;
+}
+
+typedef struct meshlet_builder_t meshlet_builder_t;
+struct meshlet_builder_t {
+    const u32_t *indices;
+    const f32_t *positions;
+
+    // Triangles using each vertex, offsets[v] to offsets[v + 1].
+    u32_t *offsets;
+    u32_t *adjacency;
+    // Triangles left to emit per vertex.
+    u32_t *live;
+    b8_t *emitted;
+
+    // Unit normal of every triangle, zero for degenerate ones.
+    f32_t *normals;
+
+    // Index of every vertex in the current meshlet, NOT_LOCAL outside of it.
+    u32_t *local;
+    f32_t centroid[3];
+    // Average normal of the meshlet, not normalized.
+    f32_t normal[3];
+};
+
+// Vertices the triangle would add to the current meshlet.
+static u32_t new_vertices(const meshlet_builder_t *b, const u32_t *tri) {
+    u32_t count = b->local[tri[0]] == NOT_LOCAL;
+    count += b->local[tri[1]] == NOT_LOCAL && tri[1] != tri[0];
+    count += b->local[tri[2]] == NOT_LOCAL && tri[2] != tri[0] && tri[2] != tri[1];
+    return count;
+}
+
+// Distance of the triangle to the meshlet's centroid, scaled up by up to
+// 1 + 2 * CONE_WEIGHT the further its normal is from the meshlet's.
+static f32_t neighbour_score(const meshlet_builder_t *b, u32_t t) {
+    const u32_t *tri = b->indices + t * 3;
+    f32_t distance = 0.0f;
+    for (u32_t axis = 0; axis < 3; axis++) {
+        f32_t c = (b->positions[tri[0] * 3 + axis] + b->positions[tri[1] * 3 + axis] + b->positions[tri[2] * 3 + axis]) / 3.0f;
+        distance += (c - b->centroid[axis]) * (c - b->centroid[axis]);
+    }
+
+    const f32_t *n = b->normals + t * 3;
+    f32_t length = sqrtf(b->normal[0] * b->normal[0] + b->normal[1] * b->normal[1] + b->normal[2] * b->normal[2]);
+    f32_t spread = 0.0f;
+    if (length > 0.0f) {
+        spread = 1.0f - (n[0] * b->normal[0] + n[1] * b->normal[1] + n[2] * b->normal[2]) / length;
+    }
+    return sqrtf(distance) * (1.0f + CONE_WEIGHT * spread);
+}
+
+// Unemitted triangle next to the meshlet adding the fewest vertices, the
+// best scoring one among those. -1 if the meshlet has no neighbours.
+static i32_t best_neighbour(const meshlet_builder_t *b, const u32_t *vertices, u32_t vertex_count) {
+    i32_t best = -1;
+    u32_t best_new = 4;
+    f32_t best_score = FLT_MAX;
+
+    for (u32_t i = 0; i < vertex_count; i++) {
+        u32_t v = vertices[i];
+        if (b->live[v] == 0) {
+            continue;
+        }
+
+        for (u32_t a = b->offsets[v]; a < b->offsets[v + 1]; a++) {
+            u32_t t = b->adjacency[a];
+            if (b->emitted[t]) {
+                continue;
+            }
+
+            const u32_t *tri = b->indices + t * 3;
+            u32_t added = new_vertices(b, tri);
+            if (added > best_new) {
+                continue;
+            }
+
+            f32_t score = neighbour_score(b, t);
+            if (added < best_new || score < best_score) {
+                best = t;
+                best_new = added;
+                best_score = score;
+            }
+        }
+    }
+
+    return best;
+}
+
+u32_t mesh_build_meshlets(
+        mesh_meshlet_t *meshlets,
+        u32_t *meshlet_vertices,
+        u8_t *meshlet_triangles,
+        const u32_t *indices,
+        u32_t index_count,
+        const f32_t *positions,
+        u32_t vertex_count,
+        u32_t max_vertices,
+        u32_t max_triangles) {
+    u32_t triangle_count = index_count / 3;
+    if (triangle_count == 0 || max_vertices < 3 || max_vertices > 256 || max_triangles == 0) {
+        return 0;
+    }
+    for (u32_t i = 0; i < triangle_count * 3; i++) {
+        if (indices[i] >= vertex_count) {
+            return 0;
+        }
+    }
+
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    meshlet_builder_t b = {
+        .indices = indices,
+        .positions = positions,
+        .offsets = re_arena_push_zero(scratch.arena, (vertex_count + 1) * sizeof(u32_t)),
+        .adjacency = re_arena_push(scratch.arena, triangle_count * 3 * sizeof(u32_t)),
+        .live = re_arena_push_zero(scratch.arena, vertex_count * sizeof(u32_t)),
+        .emitted = re_arena_push_zero(scratch.arena, triangle_count * sizeof(b8_t)),
+        .normals = re_arena_push(scratch.arena, triangle_count * 3 * sizeof(f32_t)),
+        .local = re_arena_push(scratch.arena, vertex_count * sizeof(u32_t)),
+    };
+    memset(b.local, 0xff, vertex_count * sizeof(u32_t));
+
+    for (u32_t t = 0; t < triangle_count; t++) {
+        const f32_t *p0 = positions + indices[t * 3 + 0] * 3;
+        const f32_t *p1 = positions + indices[t * 3 + 1] * 3;
+        const f32_t *p2 = positions + indices[t * 3 + 2] * 3;
+        unit_normal(b.normals + t * 3, p0, p1, p2);
+    }
+
+    for (u32_t i = 0; i < triangle_count * 3; i++) {
+        b.live[indices[i]]++;
+    }
+    for (u32_t v = 0; v < vertex_count; v++) {
+        b.offsets[v + 1] = b.offsets[v] + b.live[v];
+    }
+    u32_t *fill = re_arena_push(scratch.arena, vertex_count * sizeof(u32_t));
+    memcpy(fill, b.offsets, vertex_count * sizeof(u32_t));
+    for (u32_t i = 0; i < triangle_count * 3; i++) {
+        b.adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    u32_t meshlet_count = 0;
+    mesh_meshlet_t current = {0};
+    f32_t sum[3] = {0};
+    u32_t cursor = 0;
+
+    for (;;) {
+        i32_t t = -1;
+        if (current.vertex_count > 0) {
+            t = best_neighbour(&b, meshlet_vertices + current.vertex_offset, current.vertex_count);
+        }
+        // Disconnected pieces continue in index order, which vertex cache
+        // optimized input keeps local.
+        if (t < 0) {
+            while (cursor < triangle_count && b.emitted[cursor]) {
+                cursor++;
+            }
+            if (cursor == triangle_count) {
+                break;
+            }
+            t = cursor;
+        }
+
+        const u32_t *tri = indices + t * 3;
+        if (current.vertex_count + new_vertices(&b, tri) > max_vertices || current.triangle_count == max_triangles) {
+            for (u32_t i = 0; i < current.vertex_count; i++) {
+                b.local[meshlet_vertices[current.vertex_offset + i]] = NOT_LOCAL;
+            }
+            meshlets[meshlet_count++] = current;
+            current = (mesh_meshlet_t) {current.vertex_offset + current.vertex_count, current.triangle_offset + current.triangle_count, 0, 0};
+            sum[0] = sum[1] = sum[2] = 0.0f;
+            b.normal[0] = b.normal[1] = b.normal[2] = 0.0f;
+        }
+
+        for (u32_t k = 0; k < 3; k++) {
+            u32_t v = tri[k];
+            if (b.local[v] == NOT_LOCAL) {
+                b.local[v] = current.vertex_count;
+                meshlet_vertices[current.vertex_offset + current.vertex_count++] = v;
+                for (u32_t axis = 0; axis < 3; axis++) {
+                    sum[axis] += positions[v * 3 + axis];
+                }
+            }
+            meshlet_triangles[(current.triangle_offset + current.triangle_count) * 3 + k] = b.local[v];
+            b.live[v]--;
+        }
+        current.triangle_count++;
+        b.emitted[t] = true;
+        for (u32_t axis = 0; axis < 3; axis++) {
+            b.normal[axis] += b.normals[t * 3 + axis];
+        }
+
+        for (u32_t axis = 0; axis < 3; axis++) {
+            b.centroid[axis] = sum[axis] / current.vertex_count;
+        }
+    }
+
+    if (current.triangle_count > 0) {
+        meshlets[meshlet_count++] = current;
+    }
+
+    re_arena_scratch_release(&scratch);
+    return meshlet_count;
+}
+
+/*=========================*/
+// Bounds
+/*=========================*/
+
+static f32_t distance3(const f32_t *a, const f32_t *b) {
+    f32_t d[3] = {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+    return sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+}
+
+// Ritter's sphere, seeded with the pair of axis extremes furthest apart.
+static void bounding_sphere(const u32_t *vertices, u32_t vertex_count, const f32_t *positions, f32_t *center, f32_t *radius) {
+    u32_t min[3] = {0};
+    u32_t max[3] = {0};
+    for (u32_t i = 0; i < vertex_count; i++) {
+        const f32_t *p = positions + vertices[i] * 3;
+        for (u32_t axis = 0; axis < 3; axis++) {
+            min[axis] = p[axis] < positions[vertices[min[axis]] * 3 + axis] ? i : min[axis];
+            max[axis] = p[axis] > positions[vertices[max[axis]] * 3 + axis] ? i : max[axis];
+        }
+    }
+
+    u32_t seed = 0;
+    f32_t seed_distance = -1.0f;
+    for (u32_t axis = 0; axis < 3; axis++) {
+        f32_t d = distance3(positions + vertices[min[axis]] * 3, positions + vertices[max[axis]] * 3);
+        if (d > seed_distance) {
+            seed = axis;
+            seed_distance = d;
+        }
+    }
+
+    const f32_t *a = positions + vertices[min[seed]] * 3;
+    const f32_t *b = positions + vertices[max[seed]] * 3;
+    for (u32_t axis = 0; axis < 3; axis++) {
+        center[axis] = (a[axis] + b[axis]) * 0.5f;
+    }
+    *radius = seed_distance * 0.5f;
+
+    for (u32_t i = 0; i < vertex_count; i++) {
+        const f32_t *p = positions + vertices[i] * 3;
+        f32_t d = distance3(p, center);
+        if (d > *radius) {
+            f32_t grown = (*radius + d) * 0.5f;
+            for (u32_t axis = 0; axis < 3; axis++) {
+                center[axis] += (p[axis] - center[axis]) * (grown - *radius) / d;
+            }
+            *radius = grown;
+        }
+    }
+}
+
+// Unit normal of a meshlet triangle, false if it has no area.
+static b8_t triangle_normal(f32_t *n, const u32_t *meshlet_vertices, const u8_t *tri, const f32_t *positions) {
+    const f32_t *a = positions + meshlet_vertices[tri[0]] * 3;
+    const f32_t *b = positions + meshlet_vertices[tri[1]] * 3;
+    const f32_t *c = positions + meshlet_vertices[tri[2]] * 3;
+    return unit_normal(n, a, b, c);
+}
+
+mesh_bounds_t mesh_compute_meshlet_bounds(
+        const u32_t *meshlet_vertices,
+        const u8_t *meshlet_triangles,
+        u32_t triangle_count,
+        const f32_t *positions) {
+    mesh_bounds_t bounds = {.cone_cutoff = 1.0f};
+
+    u32_t vertex_count = 0;
+    for (u32_t i = 0; i < triangle_count * 3; i++) {
+        vertex_count = meshlet_triangles[i] + 1u > vertex_count ? meshlet_triangles[i] + 1u : vertex_count;
+    }
+    if (vertex_count == 0) {
+        return bounds;
+    }
+    bounding_sphere(meshlet_vertices, vertex_count, positions, bounds.center, &bounds.radius);
+
+    // The cone axis is the average triangle normal and has to stay within 90
+    // degrees of all of them.
+    f32_t axis[3] = {0};
+    for (u32_t t = 0; t < triangle_count; t++) {
+        f32_t n[3];
+        if (triangle_normal(n, meshlet_vertices, meshlet_triangles + t * 3, positions)) {
+            axis[0] += n[0];
+            axis[1] += n[1];
+            axis[2] += n[2];
+        }
+    }
+
+    f32_t axis_length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (axis_length == 0.0f) {
+        return bounds;
+    }
+    for (u32_t i = 0; i < 3; i++) {
+        bounds.cone_axis[i] = axis[i] / axis_length;
+    }
+
+    f32_t min_dot = 1.0f;
+    for (u32_t t = 0; t < triangle_count; t++) {
+        f32_t n[3];
+        if (triangle_normal(n, meshlet_vertices, meshlet_triangles + t * 3, positions)) {
+            min_dot = fminf(min_dot, n[0] * bounds.cone_axis[0] + n[1] * bounds.cone_axis[1] + n[2] * bounds.cone_axis[2]);
+        }
+    }
+
+    // Wide cones almost never cull, they are left open.
+    if (min_dot > 0.1f) {
+        bounds.cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+    }
+
+    return bounds;
+}
+
+b8_t mesh_meshlet_backfacing(const mesh_bounds_t *bounds, const f32_t *camera) {
+    if (bounds->cone_cutoff >= 1.0f) {
+        return false;
+    }
+
+    // The camera has to be outside of the sphere swept along the cone.
+    f32_t d[3] = {bounds->center[0] - camera[0], bounds->center[1] - camera[1], bounds->center[2] - camera[2]};
+    f32_t distance = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    f32_t along = d[0] * bounds->cone_axis[0] + d[1] * bounds->cone_axis[1] + d[2] * bounds->cone_axis[2];
+    return along >= bounds->cone_cutoff * distance + bounds->radius;
+}
@@ -0,0 +1,230 @@
+#include "mesh.h"
+#include "rebound.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define NORMAL_PI 3.14159265f
+
+// Faces less than about a degree apart count as coplanar, so a face always
+// passes its own test despite rounding and flat shading still merges them.
+#define NORMAL_COPLANAR 0.9998f
+
+// Slot without a corner, padding its group to a multiple of four.
+#define NORMAL_PADDING 0xffffffffu
+
+// Face normal of a triangle scaled by twice its area.
+static void face_normal(f32_t out[3], const u32_t *tri, const f32_t *positions) {
+    const f32_t *p0 = positions + (u64_t) tri[0] * 3;
+    const f32_t *p1 = positions + (u64_t) tri[1] * 3;
+    const f32_t *p2 = positions + (u64_t) tri[2] * 3;
+
+    f32_t d1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    f32_t d2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    out[0] = d1[1] * d2[2] - d1[2] * d2[1];
+    out[1] = d1[2] * d2[0] - d1[0] * d2[2];
+    out[2] = d1[0] * d2[1] - d1[1] * d2[0];
+}
+
+#if defined(__SSE2__)
+static inline __m128 gather_axis(const f32_t *positions, const u32_t *tris, u32_t corner, u32_t axis) {
+    return _mm_setr_ps(
+            positions[(u64_t) tris[corner] * 3 + axis],
+            positions[(u64_t) tris[3 + corner] * 3 + axis],
+            positions[(u64_t) tris[6 + corner] * 3 + axis],
+            positions[(u64_t) tris[9 + corner] * 3 + axis]);
+}
+
+// face_normal for four triangles at once, one per lane.
+static void face_normals4(f32_t out[4][3], const u32_t *tris, const f32_t *positions) {
+    __m128 p[3][3];
+    for (u32_t c = 0; c < 3; c++) {
+        for (u32_t axis = 0; axis < 3; axis++) {
+            p[c][axis] = gather_axis(positions, tris, c, axis);
+        }
+    }
+
+    __m128 d1[3];
+    __m128 d2[3];
+    for (u32_t axis = 0; axis < 3; axis++) {
+        d1[axis] = _mm_sub_ps(p[1][axis], p[0][axis]);
+        d2[axis] = _mm_sub_ps(p[2][axis], p[0][axis]);
+    }
+
+    f32_t lanes[3][4];
+    _mm_storeu_ps(lanes[0], _mm_sub_ps(_mm_mul_ps(d1[1], d2[2]), _mm_mul_ps(d1[2], d2[1])));
+    _mm_storeu_ps(lanes[1], _mm_sub_ps(_mm_mul_ps(d1[2], d2[0]), _mm_mul_ps(d1[0], d2[2])));
+    _mm_storeu_ps(lanes[2], _mm_sub_ps(_mm_mul_ps(d1[0], d2[1]), _mm_mul_ps(d1[1], d2[0])));
+    for (u32_t l = 0; l < 4; l++) {
+        for (u32_t axis = 0; axis < 3; axis++) {
+            out[l][axis] = lanes[axis][l];
+        }
+    }
+}
+#endif
+
+// Face normals of every corner, sorted by position group, as xyz and length.
+// Each group is padded with zero faces to a multiple of four slots. Keeping a
+// slot in 16 bytes instead of four arrays halves the cache lines the
+// scattered writes and the group loops touch.
+typedef struct corner_faces_t corner_faces_t;
+struct corner_faces_t {
+    f32_t *slots;
+    u32_t *corner;
+    u32_t *cursor;
+    const u32_t *groups;
+};
+
+static void place_corners(corner_faces_t *faces, const u32_t *tri, u32_t first_corner, const f32_t normal[3]) {
+    f32_t length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    for (u32_t c = 0; c < 3; c++) {
+        u32_t slot = faces->cursor[faces->groups[tri[c]]]++;
+        f32_t *out = faces->slots + (u64_t) slot * 4;
+        out[0] = normal[0];
+        out[1] = normal[1];
+        out[2] = normal[2];
+        out[3] = length;
+        faces->corner[slot] = first_corner + c;
+    }
+}
+
+// Sums the faces in slots [begin, end) that are at most acos(limit) from the
+// unit normal u, each weighted by its area.
+static void accumulate(f32_t sum[3], const f32_t *slots, u32_t begin, u32_t end, const f32_t u[3], f32_t limit) {
+#if defined(__SSE2__)
+    __m128 ux = _mm_set1_ps(u[0]);
+    __m128 uy = _mm_set1_ps(u[1]);
+    __m128 uz = _mm_set1_ps(u[2]);
+    __m128 limit4 = _mm_set1_ps(limit);
+    __m128 sx = _mm_setzero_ps();
+    __m128 sy = _mm_setzero_ps();
+    __m128 sz = _mm_setzero_ps();
+    for (u32_t k = begin; k < end; k += 4) {
+        __m128 x = _mm_loadu_ps(slots + (u64_t) k * 4);
+        __m128 y = _mm_loadu_ps(slots + (u64_t) k * 4 + 4);
+        __m128 z = _mm_loadu_ps(slots + (u64_t) k * 4 + 8);
+        __m128 length = _mm_loadu_ps(slots + (u64_t) k * 4 + 12);
+        _MM_TRANSPOSE4_PS(x, y, z, length);
+
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ux, x), _mm_mul_ps(uy, y)), _mm_mul_ps(uz, z));
+        __m128 mask = _mm_cmpge_ps(d, _mm_mul_ps(limit4, length));
+        sx = _mm_add_ps(sx, _mm_and_ps(mask, x));
+        sy = _mm_add_ps(sy, _mm_and_ps(mask, y));
+        sz = _mm_add_ps(sz, _mm_and_ps(mask, z));
+    }
+
+    f32_t lanes[3][4];
+    _mm_storeu_ps(lanes[0], sx);
+    _mm_storeu_ps(lanes[1], sy);
+    _mm_storeu_ps(lanes[2], sz);
+    for (u32_t axis = 0; axis < 3; axis++) {
+        sum[axis] = (lanes[axis][0] + lanes[axis][1]) + (lanes[axis][2] + lanes[axis][3]);
+    }
+#else
+    sum[0] = sum[1] = sum[2] = 0.0f;
+    for (u32_t k = begin; k < end; k++) {
+        const f32_t *face = slots + (u64_t) k * 4;
+        if (u[0] * face[0] + u[1] * face[1] + u[2] * face[2] >= limit * face[3]) {
+            sum[0] += face[0];
+            sum[1] += face[1];
+            sum[2] += face[2];
+        }
+    }
+#endif
+}
+
+b8_t mesh_generate_normals(
+        f32_t *normals,
+        const u32_t *indices,
+        u32_t index_count,
+        const f32_t *positions,
+        u32_t vertex_count,
+        f32_t crease_angle) {
+    for (u32_t i = 0; i < index_count; i++) {
+        if (indices[i] >= vertex_count) {
+            return false;
+        }
+    }
+
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+
+    // Corners at the same position are smoothed together whatever the index
+    // buffer says, uv seams don't split normals.
+    u32_t *groups = re_arena_push(scratch.arena, vertex_count * sizeof(u32_t));
+    mesh_stream_t stream = {positions, 3 * sizeof(f32_t), 3 * sizeof(f32_t)};
+    u32_t group_count = mesh_deduplicate(groups, &stream, 1, vertex_count);
+
+    u32_t triangle_count = index_count / 3;
+    u32_t corner_count = triangle_count * 3;
+    u32_t *offsets = re_arena_push_zero(scratch.arena, (group_count + 1) * sizeof(u32_t));
+    for (u32_t c = 0; c < corner_count; c++) {
+        offsets[groups[indices[c]] + 1]++;
+    }
+    for (u32_t g = 0; g < group_count; g++) {
+        offsets[g + 1] = offsets[g] + (offsets[g + 1] + 3) / 4 * 4;
+    }
+    u32_t slot_count = offsets[group_count];
+
+    corner_faces_t faces = {
+        .slots = re_arena_push_zero(scratch.arena, (u64_t) slot_count * 4 * sizeof(f32_t)),
+        .corner = re_arena_push(scratch.arena, slot_count * sizeof(u32_t)),
+        .cursor = re_arena_push(scratch.arena, group_count * sizeof(u32_t)),
+        .groups = groups,
+    };
+    memset(faces.corner, 0xff, slot_count * sizeof(u32_t));
+    memcpy(faces.cursor, offsets, group_count * sizeof(u32_t));
+
+    u32_t t = 0;
+#if defined(__SSE2__)
+    for (; t + 4 <= triangle_count; t += 4) {
+        f32_t face[4][3];
+        face_normals4(face, indices + (u64_t) t * 3, positions);
+        for (u32_t l = 0; l < 4; l++) {
+            place_corners(&faces, indices + (u64_t) (t + l) * 3, (t + l) * 3, face[l]);
+        }
+    }
+#endif
+    for (; t < triangle_count; t++) {
+        f32_t face[3];
+        face_normal(face, indices + (u64_t) t * 3, positions);
+        place_corners(&faces, indices + (u64_t) t * 3, t * 3, face);
+    }
+
+    f32_t limit = crease_angle >= NORMAL_PI ? -2.0f : fminf(cosf(crease_angle), NORMAL_COPLANAR);
+    for (u32_t g = 0; g < group_count; g++) {
+        u32_t begin = offsets[g];
+        u32_t end = offsets[g + 1];
+        for (u32_t i = begin; i < end && faces.corner[i] != NORMAL_PADDING; i++) {
+            // Corners of degenerate triangles have no face to compare with
+            // and take the smooth normal of the whole group.
+            const f32_t *face = faces.slots + (u64_t) i * 4;
+            f32_t inv = face[3] > FLT_MIN ? 1.0f / face[3] : 0.0f;
+            f32_t u[3] = {face[0] * inv, face[1] * inv, face[2] * inv};
+
+            f32_t sum[3];
+            accumulate(sum, faces.slots, begin, end, u, face[3] > FLT_MIN ? limit : -2.0f);
+
+            f32_t *out = normals + (u64_t) faces.corner[i] * 3;
+            f32_t sum_length = sqrtf(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+            if (sum_length > FLT_MIN) {
+                out[0] = sum[0] / sum_length;
+                out[1] = sum[1] / sum_length;
+                out[2] = sum[2] / sum_length;
+            } else {
+                // Only degenerate or cancelling faces, any direction is as
+                // good as another.
+                out[0] = 0.0f;
+                out[1] = 0.0f;
+                out[2] = 1.0f;
+            }
+        }
+    }
+
+    re_arena_scratch_release(&scratch);
+    return true;
+}
@@ -0,0 +1,368 @@
+#include "mesh.h"
+#include "rebound.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*=========================*/
+// Estimator
+/*=========================*/
+
+#define OVERDRAW_GRID 256
+
+// Camera basis for one view. right x up points back towards the camera, so
+// counter-clockwise triangles in (right, up) face it.
+typedef struct overdraw_view_t overdraw_view_t;
+struct overdraw_view_t {
+    f32_t right[3];
+    f32_t up[3];
+    f32_t forward[3];
+};
+
+static const overdraw_view_t overdraw_views[6] = {
+    {{ 1,  0,  0}, {0, 1,  0}, { 0,  0, -1}},
+    {{-1,  0,  0}, {0, 1,  0}, { 0,  0,  1}},
+    {{ 0,  0, -1}, {0, 1,  0}, {-1,  0,  0}},
+    {{ 0,  0,  1}, {0, 1,  0}, { 1,  0,  0}},
+    {{ 1,  0,  0}, {0, 0, -1}, { 0, -1,  0}},
+    {{ 1,  0,  0}, {0, 0,  1}, { 0,  1,  0}},
+};
+
+static f32_t dot3(const f32_t *a, const f32_t *b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Counts the fragments of one triangle that pass the depth test. Pixel
+// centers exactly on a shared edge belong to one triangle only.
+static u32_t rasterize(f32_t *depth, const f32_t *a, const f32_t *b, const f32_t *c) {
+    f32_t area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+    if (area <= 0.0f) {
+        return 0;
+    }
+
+    i32_t min_x = floorf(fminf(a[0], fminf(b[0], c[0])));
+    i32_t min_y = floorf(fminf(a[1], fminf(b[1], c[1])));
+    i32_t max_x = ceilf(fmaxf(a[0], fmaxf(b[0], c[0])));
+    i32_t max_y = ceilf(fmaxf(a[1], fmaxf(b[1], c[1])));
+    min_x = min_x < 0 ? 0 : min_x;
+    min_y = min_y < 0 ? 0 : min_y;
+    max_x = max_x > OVERDRAW_GRID ? OVERDRAW_GRID : max_x;
+    max_y = max_y > OVERDRAW_GRID ? OVERDRAW_GRID : max_y;
+
+    const f32_t *v[3] = {a, b, c};
+    u32_t shaded = 0;
+    for (i32_t y = min_y; y < max_y; y++) {
+        for (i32_t x = min_x; x < max_x; x++) {
+            f32_t px = x + 0.5f;
+            f32_t py = y + 0.5f;
+
+            // Edge functions, each one is the weight of the opposite vertex.
+            f32_t w[3];
+            b8_t inside = true;
+            for (u32_t e = 0; e < 3 && inside; e++) {
+                const f32_t *p0 = v[(e + 1) % 3];
+                const f32_t *p1 = v[(e + 2) % 3];
+                f32_t dx = p1[0] - p0[0];
+                f32_t dy = p1[1] - p0[1];
+                w[e] = dx * (py - p0[1]) - dy * (px - p0[0]);
+
+                // Top-left rule.
+                b8_t top_left = dy > 0.0f || (dy == 0.0f && dx < 0.0f);
+                inside = w[e] > 0.0f || (w[e] == 0.0f && top_left);
+            }
+            if (!inside) {
+                continue;
+            }
+
+            f32_t z = (w[0] * a[2] + w[1] * b[2] + w[2] * c[2]) / area;
+            f32_t *d = &depth[y * OVERDRAW_GRID + x];
+            if (z < *d) {
+                *d = z;
+                shaded++;
+            }
+        }
+    }
+
+    return shaded;
+}
+
+mesh_overdraw_stats_t mesh_analyze_overdraw(
+        const u32_t *indices,
+        u32_t index_count,
+        const f32_t *positions,
+        u32_t vertex_count) {
+    mesh_overdraw_stats_t stats = {0};
+    u32_t triangle_count = index_count / 3;
+    if (triangle_count == 0 || vertex_count == 0) {
+        return stats;
+    }
+
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    f32_t *depth = re_arena_push(scratch.arena, OVERDRAW_GRID * OVERDRAW_GRID * sizeof(f32_t));
+    f32_t *projected = re_arena_push(scratch.arena, vertex_count * 3 * sizeof(f32_t));
+
+    for (u32_t view = 0; view < 6; view++) {
+        const overdraw_view_t *ov = &overdraw_views[view];
+
+        f32_t min[2] = {FLT_MAX, FLT_MAX};
+        f32_t max[2] = {-FLT_MAX, -FLT_MAX};
+        for (u32_t i = 0; i < vertex_count; i++) {
+            const f32_t *p = positions + i * 3;
+            f32_t *out = projected + i * 3;
+            out[0] = dot3(p, ov->right);
+            out[1] = dot3(p, ov->up);
+            out[2] = dot3(p, ov->forward);
+            for (u32_t k = 0; k < 2; k++) {
+                min[k] = fminf(min[k], out[k]);
+                max[k] = fmaxf(max[k], out[k]);
+            }
+        }
+
+        // Uniform scale onto the grid keeps the aspect ratio.
+        f32_t extent = fmaxf(max[0] - min[0], max[1] - min[1]);
+        f32_t scale = extent > 0.0f ? (OVERDRAW_GRID - 1) / extent : 0.0f;
+        for (u32_t i = 0; i < vertex_count; i++) {
+            projected[i * 3 + 0] = (projected[i * 3 + 0] - min[0]) * scale;
+            projected[i * 3 + 1] = (projected[i * 3 + 1] - min[1]) * scale;
+        }
+
+        for (u32_t i = 0; i < OVERDRAW_GRID * OVERDRAW_GRID; i++) {
+            depth[i] = FLT_MAX;
+        }
+
+        for (u32_t t = 0; t < triangle_count; t++) {
+            u32_t a = indices[t * 3 + 0];
+            u32_t b = indices[t * 3 + 1];
+            u32_t c = indices[t * 3 + 2];
+            if (a >= vertex_count || b >= vertex_count || c >= vertex_count) {
+                continue;
+            }
+            stats.shaded += rasterize(depth, projected + a * 3, projected + b * 3, projected + c * 3);
+        }
+
+        for (u32_t i = 0; i < OVERDRAW_GRID * OVERDRAW_GRID; i++) {
+            stats.covered += depth[i] != FLT_MAX;
+        }
+    }
+
+    re_arena_scratch_release(&scratch);
+
+    stats.overdraw = stats.covered > 0 ? (f32_t) stats.shaded / stats.covered : 0.0f;
+    return stats;
+}
+
+/*=========================*/
+// Optimizer
+/*=========================*/
+
+// Simulated FIFO cache shared by the boundary passes. Bumping time by more
+// than the cache size flushes it.
+typedef struct fifo_cache_t fifo_cache_t;
+struct fifo_cache_t {
+    u32_t *loaded_at;
+    u32_t time;
+    u32_t size;
+};
+
+static void fifo_flush(fifo_cache_t *cache) {
+    cache->time += cache->size + 1;
+}
+
+static u32_t fifo_triangle(fifo_cache_t *cache, const u32_t *triangle) {
+    u32_t misses = 0;
+    for (u32_t k = 0; k < 3; k++) {
+        u32_t v = triangle[k];
+        if (cache->time - cache->loaded_at[v] > cache->size) {
+            cache->loaded_at[v] = cache->time++;
+            misses++;
+        }
+    }
+
+    return misses;
+}
+
+// ACMR of a whole triangle order starting from a cold cache.
+static f32_t fifo_acmr(fifo_cache_t *cache, const u32_t *indices, u32_t triangle_count) {
+    fifo_flush(cache);
+    u32_t misses = 0;
+    for (u32_t t = 0; t < triangle_count; t++) {
+        misses += fifo_triangle(cache, indices + t * 3);
+    }
+
+    return (f32_t) misses / triangle_count;
+}
+
+typedef struct overdraw_cluster_t overdraw_cluster_t;
+struct overdraw_cluster_t {
+    u32_t begin;
+    u32_t end;
+    f32_t key;
+};
+
+static int cluster_compare(const void *a, const void *b) {
+    const overdraw_cluster_t *ca = a;
+    const overdraw_cluster_t *cb = b;
+    if (ca->key != cb->key) {
+        return ca->key > cb->key ? -1 : 1;
+    }
+
+    // Keep the input order between equal keys.
+    return ca->begin < cb->begin ? -1 : ca->begin > cb->begin;
+}
+
+// Splits the triangle order at hard boundaries, where a triangle misses the
+// cache with every vertex, then again wherever the running ACMR of a cluster
+// drops to the threshold times its overall ACMR. A tail that never gets there
+// joins the cluster before it rather than paying a cold cache of its own.
+static u32_t find_clusters(
+        overdraw_cluster_t *clusters,
+        b8_t *hard,
+        const u32_t *indices,
+        u32_t triangle_count,
+        fifo_cache_t *cache,
+        f32_t threshold) {
+    fifo_flush(cache);
+    for (u32_t t = 0; t < triangle_count; t++) {
+        hard[t] = fifo_triangle(cache, indices + t * 3) == 3;
+    }
+
+    u32_t count = 0;
+    u32_t hard_begin = 0;
+    while (hard_begin < triangle_count) {
+        u32_t hard_end = hard_begin + 1;
+        while (hard_end < triangle_count && !hard[hard_end]) {
+            hard_end++;
+        }
+
+        fifo_flush(cache);
+        u32_t misses = 0;
+        for (u32_t t = hard_begin; t < hard_end; t++) {
+            misses += fifo_triangle(cache, indices + t * 3);
+        }
+        f32_t target = threshold * misses / (hard_end - hard_begin);
+
+        u32_t begin = hard_begin;
+        u32_t running_misses = 0;
+        fifo_flush(cache);
+        for (u32_t t = hard_begin; t < hard_end; t++) {
+            running_misses += fifo_triangle(cache, indices + t * 3);
+            b8_t split = (f32_t) running_misses / (t + 1 - begin) <= target;
+            if (!split && t + 1 == hard_end && begin > hard_begin) {
+                clusters[count - 1].end = hard_end;
+            } else if (split || t + 1 == hard_end) {
+                clusters[count++] = (overdraw_cluster_t) {begin, t + 1, 0.0f};
+                begin = t + 1;
+                running_misses = 0;
+                fifo_flush(cache);
+            }
+        }
+
+        hard_begin = hard_end;
+    }
+
+    return count;
+}
+
+void mesh_optimize_overdraw(
+        u32_t *out,
+        const u32_t *indices,
+        u32_t index_count,
+        const f32_t *positions,
+        u32_t vertex_count,
+        u32_t cache_size,
+        f32_t threshold) {
+    u32_t triangle_count = index_count / 3;
+
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    u32_t *input = re_arena_push(scratch.arena, index_count * sizeof(u32_t));
+    memcpy(input, indices, index_count * sizeof(u32_t));
+
+    b8_t valid = triangle_count > 0;
+    for (u32_t i = 0; i < triangle_count * 3 && valid; i++) {
+        valid = input[i] < vertex_count;
+    }
+    if (!valid) {
+        memmove(out, input, index_count * sizeof(u32_t));
+        re_arena_scratch_release(&scratch);
+        return;
+    }
+
+    fifo_cache_t cache = {
+        re_arena_push_zero(scratch.arena, vertex_count * sizeof(u32_t)),
+        0,
+        cache_size,
+    };
+    overdraw_cluster_t *clusters = re_arena_push(scratch.arena, triangle_count * sizeof(overdraw_cluster_t));
+    b8_t *hard = re_arena_push(scratch.arena, triangle_count * sizeof(b8_t));
+    u32_t cluster_count = find_clusters(clusters, hard, input, triangle_count, &cache, threshold);
+
+    // Centroid of the mesh, each triangle counted once per corner.
+    f32_t center[3] = {0};
+    for (u32_t i = 0; i < triangle_count * 3; i++) {
+        const f32_t *p = positions + input[i] * 3;
+        center[0] += p[0];
+        center[1] += p[1];
+        center[2] += p[2];
+    }
+    for (u32_t k = 0; k < 3; k++) {
+        center[k] /= triangle_count * 3;
+    }
+
+    // Clusters far out along their average normal occlude the rest.
+    for (u32_t c = 0; c < cluster_count; c++) {
+        f32_t normal[3] = {0};
+        f32_t centroid[3] = {0};
+        f32_t area_sum = 0.0f;
+
+        for (u32_t t = clusters[c].begin; t < clusters[c].end; t++) {
+            const f32_t *a = positions + input[t * 3 + 0] * 3;
+            const f32_t *b = positions + input[t * 3 + 1] * 3;
+            const f32_t *p = positions + input[t * 3 + 2] * 3;
+
+            f32_t e0[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+            f32_t e1[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+            f32_t n[3] = {
+                e0[1] * e1[2] - e0[2] * e1[1],
+                e0[2] * e1[0] - e0[0] * e1[2],
+                e0[0] * e1[1] - e0[1] * e1[0],
+            };
+            f32_t area = sqrtf(dot3(n, n));
+
+            for (u32_t k = 0; k < 3; k++) {
+                normal[k] += n[k];
+                centroid[k] += (a[k] + b[k] + p[k]) / 3.0f * area;
+            }
+            area_sum += area;
+        }
+
+        f32_t length = sqrtf(dot3(normal, normal));
+        if (area_sum <= 0.0f || length <= 0.0f) {
+            continue;
+        }
+        for (u32_t k = 0; k < 3; k++) {
+            centroid[k] = centroid[k] / area_sum - center[k];
+            normal[k] /= length;
+        }
+        clusters[c].key = dot3(centroid, normal);
+    }
+
+    qsort(clusters, cluster_count, sizeof(overdraw_cluster_t), cluster_compare);
+
+    u32_t written = 0;
+    for (u32_t c = 0; c < cluster_count; c++) {
+        u32_t count = (clusters[c].end - clusters[c].begin) * 3;
+        memcpy(out + written, input + clusters[c].begin * 3, count * sizeof(u32_t));
+        written += count;
+    }
+    memcpy(out + written, input + written, (index_count - written) * sizeof(u32_t));
+
+    // Cold starts at the new cluster boundaries add up, the order only pays
+    // off if the vertex cache stays within the threshold.
+    if (fifo_acmr(&cache, out, triangle_count) > threshold * fifo_acmr(&cache, input, triangle_count)) {
+        memcpy(out, input, index_count * sizeof(u32_t));
+    }
+
+    re_arena_scratch_release(&scratch);
+}
@@ -0,0 +1,550 @@
+#include "mesh.h"
+#include "rebound.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EMPTY 0xffffffffu
+#define EMPTY_EDGE 0xffffffffffffffffull
+
+// Border planes count this much more than the surface, which keeps open
+// edges in place.
+#define BORDER_WEIGHT 10.0
+// Collapses that turn a triangle's normal by more than about 75 degrees are
+// rejected.
+#define FLIP_THRESHOLD 0.25
+
+/*=========================*/
+// Quadrics
+/*=========================*/
+
+// Sum of squared distances to weighted planes, as the symmetric matrix
+// [A b; b^T c].
+typedef struct quadric_t quadric_t;
+struct quadric_t {
+    f64_t a00, a11, a22, a01, a02, a12;
+    f64_t b0, b1, b2;
+    f64_t c;
+    f64_t weight;
+};
+
+static void quadric_add_plane(quadric_t *q, const f64_t *n, f64_t d, f64_t weight) {
+    q->a00 += weight * n[0] * n[0];
+    q->a11 += weight * n[1] * n[1];
+    q->a22 += weight * n[2] * n[2];
+    q->a01 += weight * n[0] * n[1];
+    q->a02 += weight * n[0] * n[2];
+    q->a12 += weight * n[1] * n[2];
+    q->b0 += weight * n[0] * d;
+    q->b1 += weight * n[1] * d;
+    q->b2 += weight * n[2] * d;
+    q->c += weight * d * d;
+    q->weight += weight;
+}
+
+static void quadric_add(quadric_t *q, const quadric_t *other) {
+    q->a00 += other->a00;
+    q->a11 += other->a11;
+    q->a22 += other->a22;
+    q->a01 += other->a01;
+    q->a02 += other->a02;
+    q->a12 += other->a12;
+    q->b0 += other->b0;
+    q->b1 += other->b1;
+    q->b2 += other->b2;
+    q->c += other->c;
+    q->weight += other->weight;
+}
+
+static f64_t quadric_eval(const quadric_t *q, const f32_t *p) {
+    f64_t x = p[0], y = p[1], z = p[2];
+    return q->a00 * x * x + q->a11 * y * y + q->a22 * z * z +
+        2.0 * (q->a01 * x * y + q->a02 * x * z + q->a12 * y * z) +
+        2.0 * (q->b0 * x + q->b1 * y + q->b2 * z) +
+        q->c;
+}
+
+// Root mean square distance to the planes of both quadrics.
+static f64_t collapse_error(const quadric_t *a, const quadric_t *b, const f32_t *p) {
+    f64_t weight = a->weight + b->weight;
+    f64_t sum = quadric_eval(a, p) + quadric_eval(b, p);
+    return weight > 0.0 && sum > 0.0 ? sqrt(sum / weight) : 0.0;
+}
+
+static void cross(f64_t *out, const f32_t *a, const f32_t *b, const f32_t *c) {
+    f64_t u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    f64_t v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    out[0] = u[1] * v[2] - u[2] * v[1];
+    out[1] = u[2] * v[0] - u[0] * v[2];
+    out[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+/*=========================*/
+// Simplifier
+/*=========================*/
+
+typedef enum {
+    KIND_MANIFOLD,
+    // On exactly one open edge loop, only moves along it.
+    KIND_BORDER,
+    // Non-manifold or where several borders meet, never moves.
+    KIND_LOCKED,
+} vertex_kind_t;
+
+// Vertices sharing a position form a group, the vertices in a group are its
+// wedges. Topology, quadrics and collapses work on groups so attribute seams
+// don't look like borders.
+typedef struct simplify_t simplify_t;
+struct simplify_t {
+    const f32_t *positions;
+
+    u32_t *group;
+    u32_t group_count;
+    // First wedge of every group, the rest follow through wedge_next which
+    // loops back to the first.
+    u32_t *group_vertex;
+    u32_t *wedge_next;
+
+    quadric_t *quadrics;
+    u8_t *kind;
+
+    u32_t *tris;
+    u32_t triangle_count;
+    // Triangles using each vertex at the start of a pass.
+    u32_t *offsets;
+    u32_t *adjacency;
+
+    // Directed group edges of the current triangles.
+    u64_t *edges;
+    u32_t edge_capacity;
+
+    // Within a pass, where every collapsed vertex went. Groups take part in
+    // at most one collapse per pass so this never chains.
+    u32_t *remap;
+    b8_t *touched;
+};
+
+static const f32_t *group_position(const simplify_t *s, u32_t g) {
+    return s->positions + (u64_t) s->group_vertex[g] * 3;
+}
+
+static u32_t edge_slot(const simplify_t *s, u64_t key) {
+    u64_t h = key * 0x9e3779b97f4a7c15ull;
+    return (u32_t) (h >> 32) & (s->edge_capacity - 1);
+}
+
+// Returns false if the directed edge was already there.
+static b8_t edge_insert(simplify_t *s, u32_t a, u32_t b) {
+    u64_t key = (u64_t) a << 32 | b;
+    u32_t slot = edge_slot(s, key);
+    while (s->edges[slot] != EMPTY_EDGE) {
+        if (s->edges[slot] == key) {
+            return false;
+        }
+        slot = (slot + 1) & (s->edge_capacity - 1);
+    }
+    s->edges[slot] = key;
+    return true;
+}
+
+static b8_t edge_exists(const simplify_t *s, u32_t a, u32_t b) {
+    u64_t key = (u64_t) a << 32 | b;
+    u32_t slot = edge_slot(s, key);
+    while (s->edges[slot] != EMPTY_EDGE) {
+        if (s->edges[slot] == key) {
+            return true;
+        }
+        slot = (slot + 1) & (s->edge_capacity - 1);
+    }
+    return false;
+}
+
+static b8_t edge_is_border(const simplify_t *s, u32_t a, u32_t b) {
+    return edge_exists(s, a, b) != edge_exists(s, b, a);
+}
+
+// Rebuilds the vertex to triangle adjacency, the edge set and the vertex
+// kinds from the current triangles. Border planes are added to the quadrics
+// the first time.
+static void classify(simplify_t *s, u32_t vertex_count, b8_t first, re_arena_t *arena) {
+    memset(s->offsets, 0, (vertex_count + 1) * sizeof(u32_t));
+    for (u32_t i = 0; i < s->triangle_count * 3; i++) {
+        s->offsets[s->tris[i] + 1]++;
+    }
+    for (u32_t v = 0; v < vertex_count; v++) {
+        s->offsets[v + 1] += s->offsets[v];
+    }
+    re_arena_temp_t scratch = re_arena_scratch_get(&arena, 1);
+    u32_t *fill = re_arena_push(scratch.arena, vertex_count * sizeof(u32_t));
+    memcpy(fill, s->offsets, vertex_count * sizeof(u32_t));
+    for (u32_t i = 0; i < s->triangle_count * 3; i++) {
+        s->adjacency[fill[s->tris[i]]++] = i / 3;
+    }
+
+    memset(s->edges, 0xff, s->edge_capacity * sizeof(u64_t));
+    memset(s->kind, KIND_MANIFOLD, s->group_count);
+    for (u32_t t = 0; t < s->triangle_count; t++) {
+        for (u32_t k = 0; k < 3; k++) {
+            u32_t a = s->group[s->tris[t * 3 + k]];
+            u32_t b = s->group[s->tris[t * 3 + (k + 1) % 3]];
+            if (!edge_insert(s, a, b)) {
+                s->kind[a] = KIND_LOCKED;
+                s->kind[b] = KIND_LOCKED;
+            }
+        }
+    }
+
+    // A border vertex has one open edge leaving and one arriving.
+    u8_t *border_edges = re_arena_push_zero(scratch.arena, s->group_count);
+    for (u32_t t = 0; t < s->triangle_count; t++) {
+        const u32_t *tri = s->tris + t * 3;
+        for (u32_t k = 0; k < 3; k++) {
+            u32_t a = s->group[tri[k]];
+            u32_t b = s->group[tri[(k + 1) % 3]];
+            if (edge_exists(s, b, a)) {
+                continue;
+            }
+
+            border_edges[a] += border_edges[a] < 255;
+            border_edges[b] += border_edges[b] < 255;
+
+            if (first) {
+                const f32_t *pa = group_position(s, a);
+                const f32_t *pb = group_position(s, b);
+                f64_t n[3];
+                cross(n, group_position(s, s->group[tri[0]]), group_position(s, s->group[tri[1]]), group_position(s, s->group[tri[2]]));
+                f64_t e[3] = {pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]};
+                f64_t m[3] = {e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0]};
+                f64_t length = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+                if (length > 0.0) {
+                    m[0] /= length;
+                    m[1] /= length;
+                    m[2] /= length;
+                    f64_t d = -(m[0] * pa[0] + m[1] * pa[1] + m[2] * pa[2]);
+                    f64_t weight = (e[0] * e[0] + e[1] * e[1] + e[2] * e[2]) * BORDER_WEIGHT;
+                    quadric_add_plane(&s->quadrics[a], m, d, weight);
+                    quadric_add_plane(&s->quadrics[b], m, d, weight);
+                }
+            }
+        }
+    }
+    for (u32_t g = 0; g < s->group_count; g++) {
+        if (border_edges[g] > 0 && s->kind[g] == KIND_MANIFOLD) {
+            s->kind[g] = border_edges[g] == 2 ? KIND_BORDER : KIND_LOCKED;
+        }
+    }
+
+    re_arena_scratch_release(&scratch);
+}
+
+// The wedge of group target that wedge shares a triangle with.
+static u32_t wedge_target(const simplify_t *s, u32_t wedge, u32_t target) {
+    for (u32_t a = s->offsets[wedge]; a < s->offsets[wedge + 1]; a++) {
+        const u32_t *tri = s->tris + s->adjacency[a] * 3;
+        for (u32_t k = 0; k < 3; k++) {
+            u32_t v = s->remap[tri[k]];
+            if (s->group[v] == target) {
+                return v;
+            }
+        }
+    }
+    return EMPTY;
+}
+
+static b8_t can_collapse(const simplify_t *s, u32_t source, u32_t target) {
+    if (s->kind[source] == KIND_LOCKED) {
+        return false;
+    }
+    if (s->kind[source] == KIND_BORDER && !edge_is_border(s, source, target)) {
+        return false;
+    }
+
+    // Every side of a seam needs a wedge to collapse onto, so the seam moves
+    // along itself.
+    u32_t first = s->group_vertex[source];
+    if (s->wedge_next[first] != first) {
+        u32_t w = first;
+        do {
+            if (wedge_target(s, w, target) == EMPTY) {
+                return false;
+            }
+            w = s->wedge_next[w];
+        } while (w != first);
+    }
+
+    return true;
+}
+
+// Checks the triangles around source for flips and counts the ones the
+// collapse removes.
+static b8_t collapse_flips(const simplify_t *s, u32_t source, u32_t target, u32_t *removed) {
+    const f32_t *to = group_position(s, target);
+    *removed = 0;
+
+    u32_t first = s->group_vertex[source];
+    u32_t w = first;
+    do {
+        for (u32_t a = s->offsets[w]; a < s->offsets[w + 1]; a++) {
+            const u32_t *tri = s->tris + s->adjacency[a] * 3;
+            const f32_t *p[3];
+            i32_t moved = -1;
+            b8_t collapses = false;
+            for (u32_t k = 0; k < 3; k++) {
+                u32_t g = s->group[s->remap[tri[k]]];
+                p[k] = group_position(s, g);
+                moved = g == source ? (i32_t) k : moved;
+                collapses |= g == target;
+            }
+            if (collapses) {
+                *removed += 1;
+                continue;
+            }
+            if (moved < 0) {
+                continue;
+            }
+
+            f64_t before[3], after[3];
+            cross(before, p[0], p[1], p[2]);
+            p[moved] = to;
+            cross(after, p[0], p[1], p[2]);
+
+            f64_t dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+            f64_t length_before = sqrt(before[0] * before[0] + before[1] * before[1] + before[2] * before[2]);
+            f64_t length_after = sqrt(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+            if (dot <= FLIP_THRESHOLD * length_before * length_after) {
+                return true;
+            }
+        }
+        w = s->wedge_next[w];
+    } while (w != first);
+
+    return false;
+}
+
+typedef struct collapse_t collapse_t;
+struct collapse_t {
+    f64_t error;
+    u32_t source;
+    u32_t target;
+};
+
+static int collapse_compare(const void *a, const void *b) {
+    const collapse_t *ca = a;
+    const collapse_t *cb = b;
+    if (ca->error != cb->error) {
+        return ca->error < cb->error ? -1 : 1;
+    }
+    return ca->source < cb->source ? -1 : ca->source > cb->source;
+}
+
+u32_t mesh_simplify(
+        u32_t *out,
+        const u32_t *indices,
+        u32_t index_count,
+        const f32_t *positions,
+        u32_t vertex_count,
+        u32_t target_index_count,
+        f32_t target_error,
+        f32_t *error) {
+    *error = 0.0f;
+    u32_t triangle_count = index_count / 3;
+
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    simplify_t s = {
+        .positions = positions,
+        .group = re_arena_push(scratch.arena, vertex_count * sizeof(u32_t)),
+        .wedge_next = re_arena_push(scratch.arena, vertex_count * sizeof(u32_t)),
+        .tris = re_arena_push(scratch.arena, triangle_count * 3 * sizeof(u32_t)),
+        .triangle_count = triangle_count,
+        .offsets = re_arena_push(scratch.arena, (vertex_count + 1) * sizeof(u32_t)),
+        .adjacency = re_arena_push(scratch.arena, triangle_count * 3 * sizeof(u32_t)),
+        .remap = re_arena_push(scratch.arena, vertex_count * sizeof(u32_t)),
+    };
+    memcpy(s.tris, indices, triangle_count * 3 * sizeof(u32_t));
+
+    b8_t valid = triangle_count > 0;
+    for (u32_t i = 0; i < triangle_count * 3 && valid; i++) {
+        valid = s.tris[i] < vertex_count;
+    }
+    if (!valid) {
+        memmove(out, indices, index_count * sizeof(u32_t));
+        re_arena_scratch_release(&scratch);
+        return index_count;
+    }
+
+    mesh_stream_t position_stream = {positions, 3 * sizeof(f32_t), 3 * sizeof(f32_t)};
+    s.group_count = mesh_deduplicate(s.group, &position_stream, 1, vertex_count);
+    s.group_vertex = re_arena_push(scratch.arena, s.group_count * sizeof(u32_t));
+    u32_t *last = re_arena_push(scratch.arena, s.group_count * sizeof(u32_t));
+    memset(s.group_vertex, 0xff, s.group_count * sizeof(u32_t));
+    for (u32_t v = 0; v < vertex_count; v++) {
+        u32_t g = s.group[v];
+        if (s.group_vertex[g] == EMPTY) {
+            s.group_vertex[g] = v;
+        } else {
+            s.wedge_next[last[g]] = v;
+        }
+        last[g] = v;
+    }
+    for (u32_t g = 0; g < s.group_count; g++) {
+        s.wedge_next[last[g]] = s.group_vertex[g];
+    }
+
+    // Triangles with two corners at the same position have no area and would
+    // confuse the topology.
+    u32_t kept = 0;
+    for (u32_t t = 0; t < triangle_count; t++) {
+        u32_t a = s.tris[t * 3 + 0];
+        u32_t b = s.tris[t * 3 + 1];
+        u32_t c = s.tris[t * 3 + 2];
+        if (s.group[a] != s.group[b] && s.group[b] != s.group[c] && s.group[a] != s.group[c]) {
+            s.tris[kept * 3 + 0] = a;
+            s.tris[kept * 3 + 1] = b;
+            s.tris[kept * 3 + 2] = c;
+            kept++;
+        }
+    }
+    s.triangle_count = kept;
+
+    s.quadrics = re_arena_push_zero(scratch.arena, s.group_count * sizeof(quadric_t));
+    s.kind = re_arena_push(scratch.arena, s.group_count);
+    s.touched = re_arena_push(scratch.arena, s.group_count * sizeof(b8_t));
+    s.edge_capacity = 16;
+    while (s.edge_capacity < triangle_count * 6) {
+        s.edge_capacity *= 2;
+    }
+    s.edges = re_arena_push(scratch.arena, s.edge_capacity * sizeof(u64_t));
+
+    for (u32_t t = 0; t < s.triangle_count; t++) {
+        const u32_t *tri = s.tris + t * 3;
+        f64_t n[3];
+        cross(n, positions + tri[0] * 3, positions + tri[1] * 3, positions + tri[2] * 3);
+        f64_t length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0) {
+            continue;
+        }
+
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+        const f32_t *p = positions + tri[0] * 3;
+        f64_t d = -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]);
+        for (u32_t k = 0; k < 3; k++) {
+            quadric_add_plane(&s.quadrics[s.group[tri[k]]], n, d, length * 0.5);
+        }
+    }
+
+    f64_t *best_error = re_arena_push(scratch.arena, s.group_count * sizeof(f64_t));
+    u32_t *best_target = re_arena_push(scratch.arena, s.group_count * sizeof(u32_t));
+    collapse_t *collapses = re_arena_push(scratch.arena, s.group_count * sizeof(collapse_t));
+
+    f64_t max_error = 0.0;
+    u32_t target_triangles = target_index_count / 3;
+    for (u32_t pass = 0; s.triangle_count > target_triangles; pass++) {
+        classify(&s, vertex_count, pass == 0, scratch.arena);
+        for (u32_t v = 0; v < vertex_count; v++) {
+            s.remap[v] = v;
+        }
+        memset(s.touched, 0, s.group_count * sizeof(b8_t));
+
+        // Cheapest valid collapse of every group.
+        for (u32_t g = 0; g < s.group_count; g++) {
+            best_error[g] = DBL_MAX;
+        }
+        for (u32_t t = 0; t < s.triangle_count; t++) {
+            for (u32_t k = 0; k < 3; k++) {
+                u32_t a = s.group[s.tris[t * 3 + k]];
+                u32_t b = s.group[s.tris[t * 3 + (k + 1) % 3]];
+                u32_t pair[2][2] = {{a, b}, {b, a}};
+                for (u32_t i = 0; i < 2; i++) {
+                    u32_t source = pair[i][0];
+                    u32_t target = pair[i][1];
+                    if (source == target) {
+                        continue;
+                    }
+
+                    f64_t e = collapse_error(&s.quadrics[source], &s.quadrics[target], group_position(&s, target));
+                    if (e < best_error[source] && can_collapse(&s, source, target)) {
+                        best_error[source] = e;
+                        best_target[source] = target;
+                    }
+                }
+            }
+        }
+
+        u32_t collapse_count = 0;
+        for (u32_t g = 0; g < s.group_count; g++) {
+            if (best_error[g] <= target_error) {
+                collapses[collapse_count++] = (collapse_t) {best_error[g], g, best_target[g]};
+            }
+        }
+        qsort(collapses, collapse_count, sizeof(collapse_t), collapse_compare);
+
+        // A collapse removes about two triangles. Past the error of the one
+        // that would reach the goal, locked neighbours have pushed the pass
+        // onto collapses that are better left for the next one.
+        u32_t goal = (s.triangle_count - target_triangles) / 2;
+        f64_t pass_error = goal < collapse_count ? 1.5 * collapses[goal].error : DBL_MAX;
+
+        u32_t remaining = s.triangle_count;
+        u32_t applied = 0;
+        for (u32_t i = 0; i < collapse_count && remaining > target_triangles; i++) {
+            collapse_t c = collapses[i];
+            if (c.error > pass_error) {
+                if (applied > 0) {
+                    break;
+                }
+                // Everything below the limit was blocked, the limit follows
+                // the cheapest collapse that is left instead.
+                pass_error = 1.5 * c.error;
+            }
+
+            u32_t removed;
+            if (s.touched[c.source] || s.touched[c.target] || collapse_flips(&s, c.source, c.target, &removed)) {
+                continue;
+            }
+
+            u32_t first = s.group_vertex[c.source];
+            u32_t w = first;
+            do {
+                s.remap[w] = wedge_target(&s, w, c.target);
+                w = s.wedge_next[w];
+            } while (w != first);
+
+            quadric_add(&s.quadrics[c.target], &s.quadrics[c.source]);
+            s.touched[c.source] = true;
+            s.touched[c.target] = true;
+            max_error = c.error > max_error ? c.error : max_error;
+            remaining = removed < remaining ? remaining - removed : 0;
+            applied++;
+        }
+
+        if (applied == 0) {
+            break;
+        }
+
+        // Triangles that lost an edge have two wedges of the same group.
+        u32_t kept = 0;
+        for (u32_t t = 0; t < s.triangle_count; t++) {
+            u32_t a = s.remap[s.tris[t * 3 + 0]];
+            u32_t b = s.remap[s.tris[t * 3 + 1]];
+            u32_t c = s.remap[s.tris[t * 3 + 2]];
+            if (s.group[a] == s.group[b] || s.group[b] == s.group[c] || s.group[a] == s.group[c]) {
+                continue;
+            }
+            s.tris[kept * 3 + 0] = a;
+            s.tris[kept * 3 + 1] = b;
+            s.tris[kept * 3 + 2] = c;
+            kept++;
+        }
+        s.triangle_count = kept;
+    }
+
+    memcpy(out, s.tris, s.triangle_count * 3 * sizeof(u32_t));
+    *error = (f32_t) max_error;
+
+    re_arena_scratch_release(&scratch);
+    return s.triangle_count * 3;
+}
@@ -0,0 +1,116 @@
+#include "mesh.h"
+#include "rebound.h"
+
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__SSE2__)
+
+// Horizontal sum of the first three lanes.
+static inline f32_t sum3(__m128 v) {
+    __m128 yz = _mm_add_ss(_mm_shuffle_ps(v, v, 1), _mm_shuffle_ps(v, v, 2));
+    return _mm_cvtss_f32(_mm_add_ss(v, yz));
+}
+
+void mesh_skin(
+        f32_t *out_positions,
+        f32_t *out_normals,
+        const f32_t *positions,
+        const f32_t *normals,
+        const u16_t *joints,
+        const f32_t *weights,
+        u32_t vertex_count,
+        const f32_t *palette) {
+    b8_t with_normals = normals && out_normals;
+    for (u32_t i = 0; i < vertex_count; i++) {
+        // Blended columns, the fourth lane of each is zero.
+        __m128 columns[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+        for (u32_t k = 0; k < 4; k++) {
+            const f32_t *joint = palette + (u32_t) joints[i * 4 + k] * MESH_SKIN_JOINT_FLOATS;
+            __m128 w = _mm_set1_ps(weights[i * 4 + k]);
+            for (u32_t c = 0; c < 4; c++) {
+                columns[c] = _mm_add_ps(columns[c], _mm_mul_ps(w, _mm_loadu_ps(joint + c * 4)));
+            }
+        }
+
+        const f32_t *p = positions + i * 3;
+        __m128 position = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(p[0])), _mm_mul_ps(columns[1], _mm_set1_ps(p[1]))),
+                _mm_add_ps(_mm_mul_ps(columns[2], _mm_set1_ps(p[2])), columns[3]));
+
+        // The fourth lane spills into the next vertex, which is written
+        // after, or is stored through a copy for the last one.
+        f32_t lanes[4];
+        b8_t last = i + 1 == vertex_count;
+        _mm_storeu_ps(last ? lanes : out_positions + i * 3, position);
+        if (last) {
+            out_positions[i * 3] = lanes[0];
+            out_positions[i * 3 + 1] = lanes[1];
+            out_positions[i * 3 + 2] = lanes[2];
+        }
+
+        if (with_normals) {
+            const f32_t *n = normals + i * 3;
+            __m128 normal = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(n[0])), _mm_mul_ps(columns[1], _mm_set1_ps(n[1]))),
+                    _mm_mul_ps(columns[2], _mm_set1_ps(n[2])));
+            f32_t length_sq = sum3(_mm_mul_ps(normal, normal));
+            if (length_sq > 0.0f) {
+                normal = _mm_div_ps(normal, _mm_sqrt_ps(_mm_set1_ps(length_sq)));
+            }
+            _mm_storeu_ps(last ? lanes : out_normals + i * 3, normal);
+            if (last) {
+                out_normals[i * 3] = lanes[0];
+                out_normals[i * 3 + 1] = lanes[1];
+                out_normals[i * 3 + 2] = lanes[2];
+            }
+        }
+    }
+}
+
+#else
+
+void mesh_skin(
+        f32_t *out_positions,
+        f32_t *out_normals,
+        const f32_t *positions,
+        const f32_t *normals,
+        const u16_t *joints,
+        const f32_t *weights,
+        u32_t vertex_count,
+        const f32_t *palette) {
+    b8_t with_normals = normals && out_normals;
+    for (u32_t i = 0; i < vertex_count; i++) {
+        f32_t m[MESH_SKIN_JOINT_FLOATS] = {0};
+        for (u32_t k = 0; k < 4; k++) {
+            const f32_t *joint = palette + (u32_t) joints[i * 4 + k] * MESH_SKIN_JOINT_FLOATS;
+            f32_t w = weights[i * 4 + k];
+            for (u32_t e = 0; e < MESH_SKIN_JOINT_FLOATS; e++) {
+                m[e] += w * joint[e];
+            }
+        }
+
+        f32_t p[3] = {positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]};
+        for (u32_t r = 0; r < 3; r++) {
+            out_positions[i * 3 + r] = m[r] * p[0] + m[4 + r] * p[1] + m[8 + r] * p[2] + m[12 + r];
+        }
+
+        if (with_normals) {
+            f32_t n[3] = {normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]};
+            f32_t t[3];
+            for (u32_t r = 0; r < 3; r++) {
+                t[r] = m[r] * n[0] + m[4 + r] * n[1] + m[8 + r] * n[2];
+            }
+            f32_t length_sq = t[0] * t[0] + t[1] * t[1] + t[2] * t[2];
+            f32_t scale = length_sq > 0.0f ? 1.0f / sqrtf(length_sq) : 1.0f;
+            for (u32_t r = 0; r < 3; r++) {
+                out_normals[i * 3 + r] = t[r] * scale;
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,365 @@
+#include "mesh.h"
+#include "rebound.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define TANGENT_PI 3.14159265f
+
+// Sides of a mirror seam a corner or vertex is on.
+#define TANGENT_UNMIRRORED 1
+#define TANGENT_MIRRORED 2
+
+// Abramowitz, Stegun 4.4.45, within 7e-5 radians. Angles only weigh the
+// corners, both paths use it so they give the same tangents.
+static f32_t approx_acos(f32_t x) {
+    f32_t a = fabsf(x);
+    f32_t r = sqrtf(1.0f - a) * (1.5707288f + a * (-0.2121144f + a * (0.0742610f + a * -0.0187293f)));
+    return x < 0.0f ? TANGENT_PI - r : r;
+}
+
+// Tangent and angle of every corner of a triangle, the tangent already scaled
+// by the angle. Zero for triangles without uv area. Returns whether the uvs
+// are mirrored. The math matches triangle_tangents4 operation for operation,
+// so both paths put a triangle on the same side of a mirror seam.
+static b8_t triangle_tangents(f32_t out[3][4], const u32_t *tri, const f32_t *positions, const f32_t *normals, const f32_t *uvs) {
+    const f32_t *p0 = positions + (u64_t) tri[0] * 3;
+    const f32_t *p1 = positions + (u64_t) tri[1] * 3;
+    const f32_t *p2 = positions + (u64_t) tri[2] * 3;
+    const f32_t *uv0 = uvs + (u64_t) tri[0] * 2;
+    const f32_t *uv1 = uvs + (u64_t) tri[1] * 2;
+    const f32_t *uv2 = uvs + (u64_t) tri[2] * 2;
+
+    f32_t d1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    f32_t d2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    f32_t s1 = uv1[0] - uv0[0];
+    f32_t t1 = uv1[1] - uv0[1];
+    f32_t s2 = uv2[0] - uv0[0];
+    f32_t t2 = uv2[1] - uv0[1];
+
+    // v points down the image in glTF, so unmirrored uvs wind the other way
+    // than the triangle.
+    f32_t area = s1 * t2 - t1 * s2;
+    b8_t mirrored = area > 0.0f;
+    memset(out, 0, 3 * 4 * sizeof(f32_t));
+
+    // The uv area scales and possibly flips this, the sign of the area turns
+    // it back into the direction of increasing u.
+    f32_t os[3] = {t2 * d1[0] - t1 * d2[0], t2 * d1[1] - t1 * d2[1], t2 * d1[2] - t1 * d2[2]};
+    f32_t os_len = sqrtf(os[0] * os[0] + os[1] * os[1] + os[2] * os[2]);
+    if (fabsf(area) <= FLT_MIN || os_len <= FLT_MIN) {
+        return mirrored;
+    }
+    f32_t sign = mirrored ? 1.0f : -1.0f;
+
+    for (u32_t c = 0; c < 3; c++) {
+        const f32_t *p = positions + (u64_t) tri[c] * 3;
+        const f32_t *prev = positions + (u64_t) tri[(c + 2) % 3] * 3;
+        const f32_t *next = positions + (u64_t) tri[(c + 1) % 3] * 3;
+        const f32_t *normal = normals + (u64_t) tri[c] * 3;
+
+        f32_t n_len = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (n_len <= FLT_MIN) {
+            continue;
+        }
+        f32_t n_inv = 1.0f / n_len;
+        f32_t n[3] = {normal[0] * n_inv, normal[1] * n_inv, normal[2] * n_inv};
+
+        // Tangent and both edges projected onto the plane of the normal.
+        f32_t v[3][3] = {
+            {os[0] * sign, os[1] * sign, os[2] * sign},
+            {prev[0] - p[0], prev[1] - p[1], prev[2] - p[2]},
+            {next[0] - p[0], next[1] - p[1], next[2] - p[2]},
+        };
+        b8_t valid = true;
+        for (u32_t i = 0; i < 3; i++) {
+            f32_t d = v[i][0] * n[0] + v[i][1] * n[1] + v[i][2] * n[2];
+            for (u32_t axis = 0; axis < 3; axis++) {
+                v[i][axis] -= n[axis] * d;
+            }
+            f32_t len = sqrtf(v[i][0] * v[i][0] + v[i][1] * v[i][1] + v[i][2] * v[i][2]);
+            valid = valid && len > FLT_MIN;
+            f32_t inv = 1.0f / (len > FLT_MIN ? len : 1.0f);
+            for (u32_t axis = 0; axis < 3; axis++) {
+                v[i][axis] *= inv;
+            }
+        }
+        if (!valid) {
+            continue;
+        }
+
+        f32_t cos = v[1][0] * v[2][0] + v[1][1] * v[2][1] + v[1][2] * v[2][2];
+        f32_t angle = approx_acos(fminf(fmaxf(cos, -1.0f), 1.0f));
+        out[c][0] = v[0][0] * angle;
+        out[c][1] = v[0][1] * angle;
+        out[c][2] = v[0][2] * angle;
+        out[c][3] = angle;
+    }
+
+    return mirrored;
+}
+
+#if defined(__SSE2__)
+typedef struct vec3x4_t vec3x4_t;
+struct vec3x4_t {
+    __m128 x;
+    __m128 y;
+    __m128 z;
+};
+
+static inline vec3x4_t gather3(const f32_t *data, const u32_t *tris, u32_t corner) {
+    const f32_t *a = data + (u64_t) tris[corner] * 3;
+    const f32_t *b = data + (u64_t) tris[3 + corner] * 3;
+    const f32_t *c = data + (u64_t) tris[6 + corner] * 3;
+    const f32_t *d = data + (u64_t) tris[9 + corner] * 3;
+    return (vec3x4_t) {
+        _mm_setr_ps(a[0], b[0], c[0], d[0]),
+        _mm_setr_ps(a[1], b[1], c[1], d[1]),
+        _mm_setr_ps(a[2], b[2], c[2], d[2]),
+    };
+}
+
+static inline vec3x4_t sub3(vec3x4_t a, vec3x4_t b) {
+    return (vec3x4_t) {_mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z)};
+}
+
+static inline vec3x4_t scale3(vec3x4_t a, __m128 s) {
+    return (vec3x4_t) {_mm_mul_ps(a.x, s), _mm_mul_ps(a.y, s), _mm_mul_ps(a.z, s)};
+}
+
+static inline __m128 dot3(vec3x4_t a, vec3x4_t b) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+}
+
+// Normalizes every lane that isn't zero length, clearing valid for the rest.
+static inline vec3x4_t normalize3(vec3x4_t a, __m128 *valid) {
+    __m128 len = _mm_sqrt_ps(dot3(a, a));
+    __m128 nonzero = _mm_cmpgt_ps(len, _mm_set1_ps(FLT_MIN));
+    *valid = _mm_and_ps(*valid, nonzero);
+    __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_or_ps(_mm_and_ps(nonzero, len), _mm_andnot_ps(nonzero, _mm_set1_ps(1.0f))));
+    return scale3(a, inv);
+}
+
+// Same as approx_acos, for four values.
+static inline __m128 approx_acos4(__m128 x) {
+    __m128 sign_bit = _mm_set1_ps(-0.0f);
+    __m128 a = _mm_andnot_ps(sign_bit, x);
+    __m128 poly = _mm_add_ps(_mm_set1_ps(0.0742610f), _mm_mul_ps(a, _mm_set1_ps(-0.0187293f)));
+    poly = _mm_add_ps(_mm_set1_ps(-0.2121144f), _mm_mul_ps(a, poly));
+    poly = _mm_add_ps(_mm_set1_ps(1.5707288f), _mm_mul_ps(a, poly));
+    __m128 r = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), a)), poly);
+    __m128 negative = _mm_cmplt_ps(x, _mm_setzero_ps());
+    return _mm_or_ps(_mm_and_ps(negative, _mm_sub_ps(_mm_set1_ps(TANGENT_PI), r)), _mm_andnot_ps(negative, r));
+}
+
+// triangle_tangents for four triangles at once, one per lane.
+static void triangle_tangents4(f32_t out[4][3][4], b8_t mirrored[4], const u32_t *tris, const f32_t *positions, const f32_t *normals, const f32_t *uvs) {
+    vec3x4_t p[3];
+    for (u32_t c = 0; c < 3; c++) {
+        p[c] = gather3(positions, tris, c);
+    }
+
+    __m128 u[3];
+    __m128 v[3];
+    for (u32_t c = 0; c < 3; c++) {
+        const f32_t *a = uvs + (u64_t) tris[c] * 2;
+        const f32_t *b = uvs + (u64_t) tris[3 + c] * 2;
+        const f32_t *cc = uvs + (u64_t) tris[6 + c] * 2;
+        const f32_t *d = uvs + (u64_t) tris[9 + c] * 2;
+        u[c] = _mm_setr_ps(a[0], b[0], cc[0], d[0]);
+        v[c] = _mm_setr_ps(a[1], b[1], cc[1], d[1]);
+    }
+
+    vec3x4_t d1 = sub3(p[1], p[0]);
+    vec3x4_t d2 = sub3(p[2], p[0]);
+    __m128 s1 = _mm_sub_ps(u[1], u[0]);
+    __m128 t1 = _mm_sub_ps(v[1], v[0]);
+    __m128 s2 = _mm_sub_ps(u[2], u[0]);
+    __m128 t2 = _mm_sub_ps(v[2], v[0]);
+
+    __m128 area = _mm_sub_ps(_mm_mul_ps(s1, t2), _mm_mul_ps(t1, s2));
+    __m128 positive = _mm_cmpgt_ps(area, _mm_setzero_ps());
+    __m128 sign = _mm_or_ps(_mm_and_ps(positive, _mm_set1_ps(1.0f)), _mm_andnot_ps(positive, _mm_set1_ps(-1.0f)));
+
+    vec3x4_t os = sub3(scale3(d1, t2), scale3(d2, t1));
+    __m128 sign_bit = _mm_set1_ps(-0.0f);
+    __m128 triangle_valid = _mm_and_ps(
+            _mm_cmpgt_ps(_mm_andnot_ps(sign_bit, area), _mm_set1_ps(FLT_MIN)),
+            _mm_cmpgt_ps(_mm_sqrt_ps(dot3(os, os)), _mm_set1_ps(FLT_MIN)));
+    os = scale3(os, sign);
+
+    f32_t lanes[3][4][4];
+    for (u32_t c = 0; c < 3; c++) {
+        __m128 valid = triangle_valid;
+        vec3x4_t n = normalize3(gather3(normals, tris, c), &valid);
+
+        vec3x4_t t = sub3(os, scale3(n, dot3(n, os)));
+        vec3x4_t e1 = sub3(p[(c + 2) % 3], p[c]);
+        vec3x4_t e2 = sub3(p[(c + 1) % 3], p[c]);
+        e1 = sub3(e1, scale3(n, dot3(n, e1)));
+        e2 = sub3(e2, scale3(n, dot3(n, e2)));
+        t = normalize3(t, &valid);
+        e1 = normalize3(e1, &valid);
+        e2 = normalize3(e2, &valid);
+
+        __m128 cos = _mm_min_ps(_mm_max_ps(dot3(e1, e2), _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+        __m128 angle = _mm_and_ps(valid, approx_acos4(cos));
+        t = scale3(t, angle);
+
+        _mm_storeu_ps(lanes[c][0], t.x);
+        _mm_storeu_ps(lanes[c][1], t.y);
+        _mm_storeu_ps(lanes[c][2], t.z);
+        _mm_storeu_ps(lanes[c][3], angle);
+    }
+
+    i32_t mirrored_mask = _mm_movemask_ps(positive);
+    for (u32_t l = 0; l < 4; l++) {
+        mirrored[l] = (mirrored_mask >> l) & 1;
+        for (u32_t c = 0; c < 3; c++) {
+            for (u32_t k = 0; k < 4; k++) {
+                out[l][c][k] = lanes[c][k][l];
+            }
+        }
+    }
+}
+#endif
+
+// Adds the corners of a triangle to the sums of their groups, kept apart by
+// whether the triangle's uvs are mirrored, and records the side of every
+// corner that has a tangent.
+static void accumulate(f32_t *sums, u8_t *sides, const u32_t *groups, const u32_t *tri, const f32_t corners[3][4], b8_t mirrored) {
+    for (u32_t c = 0; c < 3; c++) {
+        f32_t *sum = sums + (u64_t) groups[tri[c]] * 8 + (mirrored ? 4 : 0);
+        for (u32_t k = 0; k < 4; k++) {
+            sum[k] += corners[c][k];
+        }
+        sides[c] = corners[c][3] > 0.0f ? (mirrored ? TANGENT_MIRRORED : TANGENT_UNMIRRORED) : 0;
+    }
+}
+
+// Normalizes one side's tangent sum, or picks any direction in the tangent
+// plane if no triangle with uv area added to it.
+static void side_tangent(f32_t *out, const f32_t *sum, const f32_t *n, b8_t mirrored) {
+    f32_t len = sqrtf(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+    if (len > FLT_MIN) {
+        out[0] = sum[0] / len;
+        out[1] = sum[1] / len;
+        out[2] = sum[2] / len;
+    } else {
+        f32_t axis[3] = {0.0f, 0.0f, 0.0f};
+        axis[fabsf(n[0]) < 0.9f ? 0 : 1] = 1.0f;
+        f32_t d = axis[0] * n[0] + axis[1] * n[1] + axis[2] * n[2];
+        f32_t n_len2 = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+        d = n_len2 > FLT_MIN ? d / n_len2 : 0.0f;
+        f32_t x[3] = {axis[0] - n[0] * d, axis[1] - n[1] * d, axis[2] - n[2] * d};
+        f32_t x_len = sqrtf(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+        out[0] = x[0] / x_len;
+        out[1] = x[1] / x_len;
+        out[2] = x[2] / x_len;
+    }
+    out[3] = mirrored ? -1.0f : 1.0f;
+}
+
+b8_t mesh_generate_tangents(
+        f32_t *tangents,
+        u32_t *remap,
+        u32_t *sources,
+        u32_t *new_vertex_count,
+        const u32_t *indices,
+        u32_t index_count,
+        const f32_t *positions,
+        const f32_t *normals,
+        const f32_t *uvs,
+        u32_t vertex_count) {
+    for (u32_t i = 0; i < index_count; i++) {
+        if (indices[i] >= vertex_count) {
+            return false;
+        }
+    }
+
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+
+    // Corners with the same position, normal and uv share a tangent whatever
+    // the index buffer says, like in MikkTSpace.
+    u32_t *groups = re_arena_push(scratch.arena, vertex_count * sizeof(u32_t));
+    mesh_stream_t streams[3] = {
+        {positions, 3 * sizeof(f32_t), 3 * sizeof(f32_t)},
+        {normals, 3 * sizeof(f32_t), 3 * sizeof(f32_t)},
+        {uvs, 2 * sizeof(f32_t), 2 * sizeof(f32_t)},
+    };
+    u32_t group_count = mesh_deduplicate(groups, streams, 3, vertex_count);
+
+    // Tangent sum and angle sum of unmirrored and mirrored corners per group.
+    f32_t *sums = re_arena_push_zero(scratch.arena, (u64_t) group_count * 8 * sizeof(f32_t));
+    u32_t triangle_count = index_count / 3;
+    u8_t *corner_sides = re_arena_push_zero(scratch.arena, index_count * sizeof(u8_t));
+
+    u32_t t = 0;
+#if defined(__SSE2__)
+    for (; t + 4 <= triangle_count; t += 4) {
+        f32_t corners[4][3][4];
+        b8_t mirrored[4];
+        triangle_tangents4(corners, mirrored, indices + (u64_t) t * 3, positions, normals, uvs);
+        for (u32_t l = 0; l < 4; l++) {
+            u64_t corner = (u64_t) (t + l) * 3;
+            accumulate(sums, corner_sides + corner, groups, indices + corner, (const f32_t (*)[4]) corners[l], mirrored[l]);
+        }
+    }
+#endif
+    for (; t < triangle_count; t++) {
+        f32_t corners[3][4];
+        b8_t mirrored = triangle_tangents(corners, indices + (u64_t) t * 3, positions, normals, uvs);
+        accumulate(sums, corner_sides + (u64_t) t * 3, groups, indices + (u64_t) t * 3, (const f32_t (*)[4]) corners, mirrored);
+    }
+
+    u8_t *vertex_sides = re_arena_push_zero(scratch.arena, vertex_count * sizeof(u8_t));
+    for (u32_t i = 0; i < triangle_count * 3; i++) {
+        vertex_sides[indices[i]] |= corner_sides[i];
+    }
+
+    // Both sides of every group, the same for all of its vertices.
+    f32_t *group_tangents = re_arena_push(scratch.arena, (u64_t) group_count * 8 * sizeof(f32_t));
+    b8_t *group_done = re_arena_push_zero(scratch.arena, group_count * sizeof(b8_t));
+    // Vertex split off every vertex for its mirrored corners, or itself.
+    u32_t *split = re_arena_push(scratch.arena, vertex_count * sizeof(u32_t));
+    u32_t count = vertex_count;
+    for (u32_t v = 0; v < vertex_count; v++) {
+        u32_t group = groups[v];
+        const f32_t *sum = sums + (u64_t) group * 8;
+        f32_t *side = group_tangents + (u64_t) group * 8;
+        if (!group_done[group]) {
+            group_done[group] = true;
+            side_tangent(side, sum, normals + (u64_t) v * 3, false);
+            side_tangent(side + 4, sum + 4, normals + (u64_t) v * 3, true);
+        }
+
+        // A vertex on a mirror seam is split, its mirrored corners get a
+        // copy with the mirrored tangent like in MikkTSpace. Other vertices
+        // take the side of their corners, unused ones the heavier side.
+        sources[v] = v;
+        split[v] = v;
+        u8_t sides = vertex_sides[v];
+        b8_t mirrored = sides == 0 ? sum[7] > sum[3] : sides == TANGENT_MIRRORED;
+        memcpy(tangents + (u64_t) v * 4, side + (mirrored ? 4 : 0), 4 * sizeof(f32_t));
+        if (sides == (TANGENT_UNMIRRORED | TANGENT_MIRRORED)) {
+            split[v] = count;
+            sources[count] = v;
+            memcpy(tangents + (u64_t) count * 4, side + 4, 4 * sizeof(f32_t));
+            count++;
+        }
+    }
+
+    for (u32_t i = 0; i < index_count; i++) {
+        u32_t v = indices[i];
+        remap[i] = i < triangle_count * 3 && corner_sides[i] == TANGENT_MIRRORED ? split[v] : v;
+    }
+    *new_vertex_count = count;
+
+    re_arena_scratch_release(&scratch);
+    return true;
+}
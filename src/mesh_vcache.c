@@ -0,0 +1,230 @@
+#include "mesh.h"
+#include "rebound.h"
+
+#include <string.h>
+
+mesh_cache_stats_t mesh_analyze_vertex_cache(
+        const u32_t *indices,
+        u32_t index_count,
+        u32_t vertex_count,
+        u32_t cache_size,
+        mesh_cache_model_t model) {
+    mesh_cache_stats_t stats = {0};
+    u32_t triangle_count = index_count / 3;
+    if (triangle_count == 0 || cache_size == 0) {
+        return stats;
+    }
+
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    b8_t *referenced = re_arena_push_zero(scratch.arena, vertex_count * sizeof(b8_t));
+
+    u32_t misses = 0;
+    u32_t unique = 0;
+
+    if (model == MESH_CACHE_FIFO) {
+        // A vertex is cached while fewer than cache_size misses happened since
+        // it was loaded.
+        u32_t *loaded_at = re_arena_push_zero(scratch.arena, vertex_count * sizeof(u32_t));
+        u32_t time = cache_size + 1;
+        for (u32_t i = 0; i < triangle_count * 3; i++) {
+            u32_t v = indices[i];
+            if (v >= vertex_count) {
+                continue;
+            }
+
+            if (time - loaded_at[v] > cache_size) {
+                loaded_at[v] = time++;
+                misses++;
+            }
+            unique += !referenced[v];
+            referenced[v] = true;
+        }
+    } else {
+        // Most recently used first.
+        u32_t *cache = re_arena_push(scratch.arena, cache_size * sizeof(u32_t));
+        u32_t cached = 0;
+        for (u32_t i = 0; i < triangle_count * 3; i++) {
+            u32_t v = indices[i];
+            if (v >= vertex_count) {
+                continue;
+            }
+
+            u32_t slot = 0;
+            while (slot < cached && cache[slot] != v) {
+                slot++;
+            }
+            if (slot == cached) {
+                misses++;
+                cached += cached < cache_size;
+                slot = cached - 1;
+            }
+            memmove(cache + 1, cache, slot * sizeof(u32_t));
+            cache[0] = v;
+
+            unique += !referenced[v];
+            referenced[v] = true;
+        }
+    }
+
+    re_arena_scratch_release(&scratch);
+
+    stats.acmr = (f32_t) misses / triangle_count;
+    stats.atvr = unique > 0 ? (f32_t) misses / unique : 0.0f;
+    return stats;
+}
+
+/*=========================*/
+// Tipsify
+/*=========================*/
+
+// Tipsify emits every remaining triangle around a fanning vertex, then moves
+// on to the neighbouring vertex that is most likely still in the cache while
+// having few enough triangles left to not push itself out.
+// Sander, Nehab, Barczak, "Fast Triangle Reordering for Vertex Locality and
+// Reduced Overdraw", 2007.
+
+typedef struct tipsify_t tipsify_t;
+struct tipsify_t {
+    const u32_t *indices;
+    u32_t vertex_count;
+    u32_t cache_size;
+
+    // Triangles using each vertex, offsets[v] to offsets[v + 1].
+    u32_t *offsets;
+    u32_t *adjacency;
+    // Triangles left to emit per vertex.
+    u32_t *live;
+    u32_t *cache_time;
+    u32_t time;
+    b8_t *emitted;
+
+    u32_t *dead_end;
+    u32_t dead_end_count;
+    u32_t cursor;
+};
+
+static i32_t tipsify_skip_dead_end(tipsify_t *ts) {
+    while (ts->dead_end_count > 0) {
+        u32_t v = ts->dead_end[--ts->dead_end_count];
+        if (ts->live[v] > 0) {
+            return v;
+        }
+    }
+
+    while (ts->cursor < ts->vertex_count) {
+        if (ts->live[ts->cursor] > 0) {
+            return ts->cursor;
+        }
+        ts->cursor++;
+    }
+
+    return -1;
+}
+
+static i32_t tipsify_next(tipsify_t *ts, const u32_t *candidates, u32_t candidate_count) {
+    i32_t best = -1;
+    i32_t best_priority = -1;
+
+    for (u32_t i = 0; i < candidate_count; i++) {
+        u32_t v = candidates[i];
+        if (ts->live[v] == 0) {
+            continue;
+        }
+
+        // Vertices that would be evicted before their fan is done get the
+        // lowest priority.
+        i32_t priority = 0;
+        u32_t age = ts->time - ts->cache_time[v];
+        if (age + 2 * ts->live[v] <= ts->cache_size) {
+            priority = age;
+        }
+        if (priority > best_priority) {
+            best_priority = priority;
+            best = v;
+        }
+    }
+
+    return best >= 0 ? best : tipsify_skip_dead_end(ts);
+}
+
+void mesh_optimize_vertex_cache(
+        u32_t *out,
+        const u32_t *indices,
+        u32_t index_count,
+        u32_t vertex_count,
+        u32_t cache_size) {
+    u32_t triangle_count = index_count / 3;
+
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    u32_t *input = re_arena_push(scratch.arena, index_count * sizeof(u32_t));
+    memcpy(input, indices, index_count * sizeof(u32_t));
+
+    b8_t valid = triangle_count > 0;
+    for (u32_t i = 0; i < triangle_count * 3 && valid; i++) {
+        valid = input[i] < vertex_count;
+    }
+    if (!valid) {
+        memmove(out, input, index_count * sizeof(u32_t));
+        re_arena_scratch_release(&scratch);
+        return;
+    }
+
+    tipsify_t ts = {
+        .indices = input,
+        .vertex_count = vertex_count,
+        .cache_size = cache_size,
+        .offsets = re_arena_push_zero(scratch.arena, (vertex_count + 1) * sizeof(u32_t)),
+        .adjacency = re_arena_push(scratch.arena, triangle_count * 3 * sizeof(u32_t)),
+        .live = re_arena_push_zero(scratch.arena, vertex_count * sizeof(u32_t)),
+        .cache_time = re_arena_push_zero(scratch.arena, vertex_count * sizeof(u32_t)),
+        .time = cache_size + 1,
+        .emitted = re_arena_push_zero(scratch.arena, triangle_count * sizeof(b8_t)),
+        .dead_end = re_arena_push(scratch.arena, triangle_count * 3 * sizeof(u32_t)),
+    };
+
+    for (u32_t i = 0; i < triangle_count * 3; i++) {
+        ts.live[input[i]]++;
+    }
+    for (u32_t v = 0; v < vertex_count; v++) {
+        ts.offsets[v + 1] = ts.offsets[v] + ts.live[v];
+    }
+    u32_t *fill = re_arena_push(scratch.arena, vertex_count * sizeof(u32_t));
+    memcpy(fill, ts.offsets, vertex_count * sizeof(u32_t));
+    for (u32_t i = 0; i < triangle_count * 3; i++) {
+        ts.adjacency[fill[input[i]]++] = i / 3;
+    }
+
+    u32_t *candidates = re_arena_push(scratch.arena, triangle_count * 3 * sizeof(u32_t));
+    u32_t written = 0;
+    i32_t fan = input[0];
+    while (fan >= 0) {
+        u32_t candidate_count = 0;
+
+        for (u32_t a = ts.offsets[fan]; a < ts.offsets[fan + 1]; a++) {
+            u32_t t = ts.adjacency[a];
+            if (ts.emitted[t]) {
+                continue;
+            }
+            ts.emitted[t] = true;
+
+            for (u32_t k = 0; k < 3; k++) {
+                u32_t v = input[t * 3 + k];
+                out[written++] = v;
+                ts.dead_end[ts.dead_end_count++] = v;
+                candidates[candidate_count++] = v;
+                ts.live[v]--;
+
+                if (ts.time - ts.cache_time[v] > cache_size) {
+                    ts.cache_time[v] = ts.time++;
+                }
+            }
+        }
+
+        fan = tipsify_next(&ts, candidates, candidate_count);
+    }
+
+    // Leftover indices of an incomplete triangle stay at the end.
+    memcpy(out + written, input + written, (index_count - written) * sizeof(u32_t));
+
+    re_arena_scratch_release(&scratch);
+}
@@ -0,0 +1,115 @@
+#include "mesh.h"
+#include "rebound.h"
+
+#include <string.h>
+
+mesh_fetch_stats_t mesh_analyze_vertex_fetch(
+        const u32_t *indices,
+        u32_t index_count,
+        u32_t vertex_count,
+        u32_t vertex_size) {
+    return mesh_analyze_vertex_fetch_streams(indices, index_count, vertex_count, &vertex_size, 1);
+}
+
+mesh_fetch_stats_t mesh_analyze_vertex_fetch_streams(
+        const u32_t *indices,
+        u32_t index_count,
+        u32_t vertex_count,
+        const u32_t *stream_strides,
+        u32_t stream_count) {
+    mesh_fetch_stats_t stats = {0};
+    u32_t vertex_size = 0;
+    for (u32_t s = 0; s < stream_count; s++) {
+        vertex_size += stream_strides[s];
+    }
+    if (index_count == 0 || vertex_size == 0) {
+        return stats;
+    }
+
+    re_arena_temp_t scratch = re_arena_scratch_get(NULL, 0);
+    b8_t *referenced = re_arena_push_zero(scratch.arena, vertex_count * sizeof(b8_t));
+
+    // Tag of the line held by each slot, 0 when empty so tags start at 1.
+    u32_t line_count = MESH_FETCH_CACHE_SIZE / MESH_FETCH_CACHE_LINE;
+    u64_t *tags = re_arena_push_zero(scratch.arena, line_count * sizeof(u64_t));
+
+    // Streams follow each other in memory, each starting on a new line.
+    u64_t *stream_offsets = re_arena_push(scratch.arena, stream_count * sizeof(u64_t));
+    u64_t offset = 0;
+    for (u32_t s = 0; s < stream_count; s++) {
+        stream_offsets[s] = offset;
+        u64_t size = (u64_t) vertex_count * stream_strides[s];
+        offset += (size + MESH_FETCH_CACHE_LINE - 1) / MESH_FETCH_CACHE_LINE * MESH_FETCH_CACHE_LINE;
+    }
+
+    u64_t referenced_bytes = 0;
+    for (u32_t i = 0; i < index_count; i++) {
+        u32_t v = indices[i];
+        if (v >= vertex_count) {
+            continue;
+        }
+
+        if (!referenced[v]) {
+            referenced[v] = true;
+            referenced_bytes += vertex_size;
+        }
+
+        for (u32_t s = 0; s < stream_count; s++) {
+            if (stream_strides[s] == 0) {
+                continue;
+            }
+
+            // A vertex may straddle several lines.
+            u64_t start = stream_offsets[s] + (u64_t) v * stream_strides[s];
+            u64_t first = start / MESH_FETCH_CACHE_LINE;
+            u64_t last = (start + stream_strides[s] - 1) / MESH_FETCH_CACHE_LINE;
+            for (u64_t line = first; line <= last; line++) {
+                u64_t *slot = &tags[line % line_count];
+                if (*slot != line + 1) {
+                    *slot = line + 1;
+                    stats.bytes_fetched += MESH_FETCH_CACHE_LINE;
+                }
+            }
+        }
+    }
+
+    re_arena_scratch_release(&scratch);
+
+    stats.efficiency = stats.bytes_fetched > 0 ? (f32_t) referenced_bytes / stats.bytes_fetched : 0.0f;
+    return stats;
+}
+
+u32_t mesh_optimize_vertex_fetch(
+        u32_t *remap,
+        const u32_t *indices,
+        u32_t index_count,
+        u32_t vertex_count) {
+    memset(remap, 0xff, vertex_count * sizeof(u32_t));
+
+    u32_t next = 0;
+    for (u32_t i = 0; i < index_count; i++) {
+        u32_t v = indices[i];
+        if (v >= vertex_count) {
+            for (u32_t j = 0; j < vertex_count; j++) {
+                remap[j] = j;
+            }
+            return vertex_count;
+        }
+
+        if (remap[v] == MESH_VERTEX_UNUSED) {
+            remap[v] = next++;
+        }
+    }
+
+    return next;
+}
+
+void mesh_remap_indices(
+        u32_t *out,
+        const u32_t *indices,
+        u32_t index_count,
+        const u32_t *remap) {
+    for (u32_t i = 0; i < index_count; i++) {
+        out[i] = remap[indices[i]];
+    }
+}
@@ -0,0 +1,585 @@
+#include "meshopt.h"
+#include "rebound.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define MESHOPT_VERTEX_HEADER 0xa0
+#define MESHOPT_INDEX_HEADER 0xe0
+#define MESHOPT_SEQUENCE_HEADER 0xd0
+
+#define MESHOPT_BYTE_GROUP_SIZE 16
+// Most bytes a single byte group can read, 4 bit codes plus 16 escapes.
+#define MESHOPT_BYTE_GROUP_DECODE_LIMIT 24
+#define MESHOPT_VERTEX_BLOCK_SIZE_BYTES 8192
+#define MESHOPT_VERTEX_BLOCK_MAX_SIZE 256
+#define MESHOPT_TAIL_MAX_SIZE 32
+
+/*=========================*/
+// Vertices
+/*=========================*/
+
+static u32_t vertex_block_size(u32_t vertex_size) {
+    u32_t size = MESHOPT_VERTEX_BLOCK_SIZE_BYTES / vertex_size;
+    size &= ~(MESHOPT_BYTE_GROUP_SIZE - 1);
+    return size < MESHOPT_VERTEX_BLOCK_MAX_SIZE ? size : MESHOPT_VERTEX_BLOCK_MAX_SIZE;
+}
+
+// Unpacks 16 values of 2 or 4 bits, most significant bits first. A value with
+// every bit set is an escape and the byte is read from the end of the group.
+static const u8_t *decode_bytes_group(const u8_t *data, u8_t *out, u32_t bits_log2) {
+    switch (bits_log2) {
+        case 0:
+            memset(out, 0, MESHOPT_BYTE_GROUP_SIZE);
+            return data;
+        case 3:
+            memcpy(out, data, MESHOPT_BYTE_GROUP_SIZE);
+            return data + MESHOPT_BYTE_GROUP_SIZE;
+    }
+
+    u32_t bits = 1u << bits_log2;
+    u32_t escape = (1u << bits) - 1;
+    const u8_t *escapes = data + bits * 2;
+
+    for (u32_t i = 0; i < MESHOPT_BYTE_GROUP_SIZE; i++) {
+        u32_t bit = i * bits;
+        u32_t value = (data[bit / 8] >> (8 - bits - bit % 8)) & escape;
+        if (value == escape) {
+            value = *escapes++;
+        }
+        out[i] = value;
+    }
+
+    return escapes;
+}
+
+static const u8_t *decode_bytes(const u8_t *data, const u8_t *end, u8_t *out, u32_t count) {
+    const u8_t *header = data;
+    // Two bits per group.
+    u32_t header_size = (count / MESHOPT_BYTE_GROUP_SIZE + 3) / 4;
+    if ((u64_t) (end - data) < header_size) {
+        return NULL;
+    }
+    data += header_size;
+
+    for (u32_t i = 0; i < count; i += MESHOPT_BYTE_GROUP_SIZE) {
+        if ((u64_t) (end - data) < MESHOPT_BYTE_GROUP_DECODE_LIMIT) {
+            return NULL;
+        }
+
+        u32_t group = i / MESHOPT_BYTE_GROUP_SIZE;
+        u32_t bits_log2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+        data = decode_bytes_group(data, out + i, bits_log2);
+    }
+
+    return data;
+}
+
+// Every byte of the vertex is stored as its own stream of zigzag encoded
+// deltas from the same byte of the previous vertex.
+static const u8_t *decode_vertex_block(
+        const u8_t *data,
+        const u8_t *end,
+        u8_t *out,
+        u32_t vertex_count,
+        u32_t vertex_size,
+        u8_t *last_vertex) {
+    u8_t deltas[MESHOPT_VERTEX_BLOCK_MAX_SIZE];
+    u32_t aligned_count = (vertex_count + MESHOPT_BYTE_GROUP_SIZE - 1) & ~(MESHOPT_BYTE_GROUP_SIZE - 1);
+
+    for (u32_t k = 0; k < vertex_size; k++) {
+        data = decode_bytes(data, end, deltas, aligned_count);
+        if (data == NULL) {
+            return NULL;
+        }
+
+        u8_t previous = last_vertex[k];
+        u8_t *dst = out + k;
+        for (u32_t i = 0; i < vertex_count; i++) {
+            u8_t delta = deltas[i];
+            previous += (u8_t) (-(delta & 1) ^ (delta >> 1));
+            *dst = previous;
+            dst += vertex_size;
+        }
+        last_vertex[k] = previous;
+    }
+
+    return data;
+}
+
+b8_t meshopt_decode_vertex_buffer(void *out, u32_t vertex_count, u32_t vertex_size, const u8_t *data, u64_t size) {
+    if (vertex_size == 0 || vertex_size > 256 || vertex_size % 4 != 0) {
+        return false;
+    }
+
+    const u8_t *end = data + size;
+    if (size < 1 + vertex_size) {
+        return false;
+    }
+
+    u8_t header = *data++;
+    if ((header & 0xf0) != MESHOPT_VERTEX_HEADER || (header & 0x0f) > 0) {
+        return false;
+    }
+
+    // The first vertex is predicted from the one stored at the very end.
+    u8_t last_vertex[256];
+    memcpy(last_vertex, end - vertex_size, vertex_size);
+
+    u32_t block_size = vertex_block_size(vertex_size);
+    for (u32_t offset = 0; offset < vertex_count; offset += block_size) {
+        u32_t count = vertex_count - offset < block_size ? vertex_count - offset : block_size;
+        data = decode_vertex_block(data, end, (u8_t *) out + (u64_t) offset * vertex_size, count, vertex_size, last_vertex);
+        if (data == NULL) {
+            return false;
+        }
+    }
+
+    u32_t tail_size = vertex_size < MESHOPT_TAIL_MAX_SIZE ? MESHOPT_TAIL_MAX_SIZE : vertex_size;
+    return (u64_t) (end - data) == tail_size;
+}
+
+/*=========================*/
+// Indices
+/*=========================*/
+
+static u32_t decode_vbyte(const u8_t **data) {
+    u8_t lead = *(*data)++;
+    if (lead < 128) {
+        return lead;
+    }
+
+    // At most 4 more bytes, so malformed data can't run away.
+    u32_t result = lead & 127;
+    u32_t shift = 7;
+    for (u32_t i = 0; i < 4; i++) {
+        u8_t group = *(*data)++;
+        result |= (u32_t) (group & 127) << shift;
+        shift += 7;
+        if (group < 128) {
+            break;
+        }
+    }
+
+    return result;
+}
+
+static u32_t decode_index(const u8_t **data, u32_t last) {
+    u32_t v = decode_vbyte(data);
+    return last + ((v >> 1) ^ -(v & 1));
+}
+
+static void write_index(void *out, u32_t i, u32_t index_size, u32_t index) {
+    if (index_size == 2) {
+        ((u16_t *) out)[i] = index;
+    } else {
+        ((u32_t *) out)[i] = index;
+    }
+}
+
+static void write_triangle(void *out, u32_t i, u32_t index_size, u32_t a, u32_t b, u32_t c) {
+    write_index(out, i + 0, index_size, a);
+    write_index(out, i + 1, index_size, b);
+    write_index(out, i + 2, index_size, c);
+}
+
+// Both FIFOs have to be updated exactly the way the encoder did.
+static void push_vertex(u32_t *fifo, u32_t *offset, u32_t v, b8_t cond) {
+    fifo[*offset] = v;
+    *offset = (*offset + cond) & 15;
+}
+
+static void push_edge(u32_t (*fifo)[2], u32_t *offset, u32_t a, u32_t b) {
+    fifo[*offset][0] = a;
+    fifo[*offset][1] = b;
+    *offset = (*offset + 1) & 15;
+}
+
+b8_t meshopt_decode_index_buffer(void *out, u32_t index_count, u32_t index_size, const u8_t *data, u64_t size) {
+    if (index_count % 3 != 0 || (index_size != 2 && index_size != 4)) {
+        return false;
+    }
+
+    // Header, one code per triangle and the 16 byte table of auxiliary codes.
+    if (size < 1 + index_count / 3 + 16) {
+        return false;
+    }
+
+    u8_t header = data[0];
+    u32_t version = header & 0x0f;
+    if ((header & 0xf0) != MESHOPT_INDEX_HEADER || version > 1) {
+        return false;
+    }
+
+    u32_t edge_fifo[16][2];
+    u32_t vertex_fifo[16];
+    memset(edge_fifo, 0xff, sizeof(edge_fifo));
+    memset(vertex_fifo, 0xff, sizeof(vertex_fifo));
+    u32_t edge_offset = 0;
+    u32_t vertex_offset = 0;
+
+    u32_t next = 0;
+    u32_t last = 0;
+    // Version 1 spends codes 13 and 14 on +-1 deltas.
+    u32_t fec_max = version >= 1 ? 13 : 15;
+
+    const u8_t *codes = data + 1;
+    const u8_t *payload = codes + index_count / 3;
+    const u8_t *safe_end = data + size - 16;
+    const u8_t *aux_table = safe_end;
+
+    for (u32_t i = 0; i < index_count; i += 3) {
+        // A triangle reads at most 16 bytes, which the aux table covers.
+        if (payload > safe_end) {
+            return false;
+        }
+
+        u8_t code = *codes++;
+
+        if (code < 0xf0) {
+            // Triangle sharing an edge from the FIFO.
+            u32_t fe = code >> 4;
+            u32_t a = edge_fifo[(edge_offset - 1 - fe) & 15][0];
+            u32_t b = edge_fifo[(edge_offset - 1 - fe) & 15][1];
+            u32_t fec = code & 15;
+
+            u32_t c;
+            if (fec < fec_max) {
+                b8_t is_next = fec == 0;
+                c = is_next ? next : vertex_fifo[(vertex_offset - 1 - fec) & 15];
+                next += is_next;
+                push_vertex(vertex_fifo, &vertex_offset, c, is_next);
+            } else {
+                // 13 and 14 decode to -1 and +1.
+                c = fec != 15 ? last + (fec - (fec ^ 3)) : decode_index(&payload, last);
+                last = c;
+                push_vertex(vertex_fifo, &vertex_offset, c, true);
+            }
+
+            write_triangle(out, i, index_size, a, b, c);
+            push_edge(edge_fifo, &edge_offset, c, b);
+            push_edge(edge_fifo, &edge_offset, a, c);
+        } else if (code < 0xfe) {
+            // Triangle of new or recent vertices, described by the aux table.
+            u8_t aux = aux_table[code & 15];
+            u32_t feb = aux >> 4;
+            u32_t fec = aux & 15;
+
+            u32_t a = next++;
+            b8_t b_next = feb == 0;
+            u32_t b = b_next ? next : vertex_fifo[(vertex_offset - feb) & 15];
+            next += b_next;
+            b8_t c_next = fec == 0;
+            u32_t c = c_next ? next : vertex_fifo[(vertex_offset - fec) & 15];
+            next += c_next;
+
+            write_triangle(out, i, index_size, a, b, c);
+            push_vertex(vertex_fifo, &vertex_offset, a, true);
+            push_vertex(vertex_fifo, &vertex_offset, b, b_next);
+            push_vertex(vertex_fifo, &vertex_offset, c, c_next);
+            push_edge(edge_fifo, &edge_offset, b, a);
+            push_edge(edge_fifo, &edge_offset, c, b);
+            push_edge(edge_fifo, &edge_offset, a, c);
+        } else {
+            // Same as above with the aux code stored inline, allowing free
+            // indices. An aux code of 0 restarts the vertex numbering.
+            u8_t aux = *payload++;
+            u32_t fea = code == 0xfe ? 0 : 15;
+            u32_t feb = aux >> 4;
+            u32_t fec = aux & 15;
+
+            if (aux == 0) {
+                next = 0;
+            }
+
+            u32_t a = fea == 0 ? next++ : 0;
+            u32_t b = feb == 0 ? next++ : vertex_fifo[(vertex_offset - feb) & 15];
+            u32_t c = fec == 0 ? next++ : vertex_fifo[(vertex_offset - fec) & 15];
+
+            if (fea == 15) {
+                last = a = decode_index(&payload, last);
+            }
+            if (feb == 15) {
+                last = b = decode_index(&payload, last);
+            }
+            if (fec == 15) {
+                last = c = decode_index(&payload, last);
+            }
+
+            write_triangle(out, i, index_size, a, b, c);
+            push_vertex(vertex_fifo, &vertex_offset, a, true);
+            push_vertex(vertex_fifo, &vertex_offset, b, feb == 0 || feb == 15);
+            push_vertex(vertex_fifo, &vertex_offset, c, fec == 0 || fec == 15);
+            push_edge(edge_fifo, &edge_offset, b, a);
+            push_edge(edge_fifo, &edge_offset, c, b);
+            push_edge(edge_fifo, &edge_offset, a, c);
+        }
+    }
+
+    return payload == safe_end;
+}
+
+b8_t meshopt_decode_index_sequence(void *out, u32_t index_count, u32_t index_size, const u8_t *data, u64_t size) {
+    if (index_size != 2 && index_size != 4) {
+        return false;
+    }
+
+    // Header, at least one byte per index and a 4 byte tail.
+    if (size < 1 + (u64_t) index_count + 4) {
+        return false;
+    }
+
+    u8_t header = data[0];
+    if ((header & 0xf0) != MESHOPT_SEQUENCE_HEADER || (header & 0x0f) > 1) {
+        return false;
+    }
+
+    const u8_t *payload = data + 1;
+    const u8_t *safe_end = data + size - 4;
+
+    // Deltas are taken against one of two baselines, picked by the low bit.
+    u32_t last[2] = {0, 0};
+    for (u32_t i = 0; i < index_count; i++) {
+        // An index reads at most 5 bytes, which the tail covers.
+        if (payload >= safe_end) {
+            return false;
+        }
+
+        u32_t v = decode_vbyte(&payload);
+        u32_t baseline = v & 1;
+        v >>= 1;
+
+        u32_t index = last[baseline] + ((v >> 1) ^ -(v & 1));
+        last[baseline] = index;
+        write_index(out, i, index_size, index);
+    }
+
+    return payload == safe_end;
+}
+
+/*=========================*/
+// Filters
+/*=========================*/
+
+static i32_t round_to_int(f32_t v) {
+    return (i32_t) (v + (v >= 0.0f ? 0.5f : -0.5f));
+}
+
+static void decode_oct(f32_t x, f32_t y, f32_t z, f32_t max, i32_t *out) {
+    z = z - fabsf(x) - fabsf(y);
+
+    // Fold the lower hemisphere back out.
+    f32_t t = z >= 0.0f ? 0.0f : z;
+    x += x >= 0.0f ? t : -t;
+    y += y >= 0.0f ? t : -t;
+
+    f32_t scale = max / sqrtf(x * x + y * y + z * z);
+    out[0] = round_to_int(x * scale);
+    out[1] = round_to_int(y * scale);
+    out[2] = round_to_int(z * scale);
+}
+
+#if defined(__SSE2__)
+// Rounds half away from zero like round_to_int.
+static __m128i round_to_int4(__m128 v) {
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 negative = _mm_cmplt_ps(v, _mm_setzero_ps());
+    return _mm_cvttps_epi32(_mm_add_ps(v, _mm_xor_ps(half, _mm_and_ps(negative, _mm_set1_ps(-0.0f)))));
+}
+
+// Negates v where the mask is set.
+static __m128 negate_where(__m128 v, __m128 mask) {
+    return _mm_xor_ps(v, _mm_and_ps(mask, _mm_set1_ps(-0.0f)));
+}
+
+static __m128 abs4(__m128 v) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+
+static void decode_oct4(__m128 x, __m128 y, __m128 z, f32_t max, i32_t out[3][4]) {
+    __m128 zero = _mm_setzero_ps();
+    z = _mm_sub_ps(_mm_sub_ps(z, abs4(x)), abs4(y));
+
+    __m128 t = _mm_min_ps(z, zero);
+    x = _mm_add_ps(x, negate_where(t, _mm_cmplt_ps(x, zero)));
+    y = _mm_add_ps(y, negate_where(t, _mm_cmplt_ps(y, zero)));
+
+    __m128 length_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+    __m128 scale = _mm_div_ps(_mm_set1_ps(max), _mm_sqrt_ps(length_sq));
+
+    _mm_storeu_si128((__m128i *) out[0], round_to_int4(_mm_mul_ps(x, scale)));
+    _mm_storeu_si128((__m128i *) out[1], round_to_int4(_mm_mul_ps(y, scale)));
+    _mm_storeu_si128((__m128i *) out[2], round_to_int4(_mm_mul_ps(z, scale)));
+}
+#endif
+
+void meshopt_decode_filter_oct(void *data, u32_t count, u32_t stride) {
+    u32_t i = 0;
+
+    if (stride == 4) {
+        i8_t *v = data;
+#if defined(__SSE2__)
+        for (; i + 4 <= count; i += 4) {
+            i8_t *e = v + i * 4;
+            i32_t out[3][4];
+            decode_oct4(
+                    _mm_setr_ps(e[0], e[4], e[8], e[12]),
+                    _mm_setr_ps(e[1], e[5], e[9], e[13]),
+                    _mm_setr_ps(e[2], e[6], e[10], e[14]),
+                    127.0f,
+                    out);
+            for (u32_t j = 0; j < 4; j++) {
+                e[j * 4 + 0] = out[0][j];
+                e[j * 4 + 1] = out[1][j];
+                e[j * 4 + 2] = out[2][j];
+            }
+        }
+#endif
+        for (; i < count; i++) {
+            i8_t *e = v + i * 4;
+            i32_t out[3];
+            decode_oct(e[0], e[1], e[2], 127.0f, out);
+            e[0] = out[0];
+            e[1] = out[1];
+            e[2] = out[2];
+        }
+    } else if (stride == 8) {
+        i16_t *v = data;
+#if defined(__SSE2__)
+        for (; i + 4 <= count; i += 4) {
+            i16_t *e = v + i * 4;
+            i32_t out[3][4];
+            decode_oct4(
+                    _mm_setr_ps(e[0], e[4], e[8], e[12]),
+                    _mm_setr_ps(e[1], e[5], e[9], e[13]),
+                    _mm_setr_ps(e[2], e[6], e[10], e[14]),
+                    32767.0f,
+                    out);
+            for (u32_t j = 0; j < 4; j++) {
+                e[j * 4 + 0] = out[0][j];
+                e[j * 4 + 1] = out[1][j];
+                e[j * 4 + 2] = out[2][j];
+            }
+        }
+#endif
+        for (; i < count; i++) {
+            i16_t *e = v + i * 4;
+            i32_t out[3];
+            decode_oct(e[0], e[1], e[2], 32767.0f, out);
+            e[0] = out[0];
+            e[1] = out[1];
+            e[2] = out[2];
+        }
+    }
+}
+
+// The fourth component holds the index of the dropped component in its low
+// two bits and the quantization scale above them.
+static void decode_quat(i16_t *e) {
+    f32_t scale = 1.0f / sqrtf(2.0f) / (f32_t) (e[3] | 3);
+
+    f32_t x = e[0] * scale;
+    f32_t y = e[1] * scale;
+    f32_t z = e[2] * scale;
+    f32_t ww = 1.0f - x * x - y * y - z * z;
+    f32_t w = sqrtf(ww >= 0.0f ? ww : 0.0f);
+
+    i32_t xf = round_to_int(x * 32767.0f);
+    i32_t yf = round_to_int(y * 32767.0f);
+    i32_t zf = round_to_int(z * 32767.0f);
+    i32_t wf = (i32_t) (w * 32767.0f + 0.5f);
+
+    u32_t dropped = e[3] & 3;
+    e[(dropped + 1) & 3] = xf;
+    e[(dropped + 2) & 3] = yf;
+    e[(dropped + 3) & 3] = zf;
+    e[(dropped + 0) & 3] = wf;
+}
+
+void meshopt_decode_filter_quat(void *data, u32_t count, u32_t stride) {
+    if (stride != 8) {
+        return;
+    }
+
+    i16_t *v = data;
+    u32_t i = 0;
+
+#if defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        i16_t *e = v + i * 4;
+
+        __m128 scale = _mm_div_ps(
+                _mm_set1_ps(1.0f / sqrtf(2.0f)),
+                _mm_setr_ps(e[3] | 3, e[7] | 3, e[11] | 3, e[15] | 3));
+        __m128 x = _mm_mul_ps(_mm_setr_ps(e[0], e[4], e[8], e[12]), scale);
+        __m128 y = _mm_mul_ps(_mm_setr_ps(e[1], e[5], e[9], e[13]), scale);
+        __m128 z = _mm_mul_ps(_mm_setr_ps(e[2], e[6], e[10], e[14]), scale);
+
+        __m128 ww = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+        __m128 w = _mm_sqrt_ps(_mm_max_ps(ww, _mm_setzero_ps()));
+
+        __m128 range = _mm_set1_ps(32767.0f);
+        i32_t out[4][4];
+        _mm_storeu_si128((__m128i *) out[0], round_to_int4(_mm_mul_ps(x, range)));
+        _mm_storeu_si128((__m128i *) out[1], round_to_int4(_mm_mul_ps(y, range)));
+        _mm_storeu_si128((__m128i *) out[2], round_to_int4(_mm_mul_ps(z, range)));
+        _mm_storeu_si128((__m128i *) out[3], round_to_int4(_mm_mul_ps(w, range)));
+
+        for (u32_t j = 0; j < 4; j++) {
+            i16_t *q = e + j * 4;
+            u32_t dropped = q[3] & 3;
+            q[(dropped + 1) & 3] = out[0][j];
+            q[(dropped + 2) & 3] = out[1][j];
+            q[(dropped + 3) & 3] = out[2][j];
+            q[(dropped + 0) & 3] = out[3][j];
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        decode_quat(v + i * 4);
+    }
+}
+
+// Each 32 bit value is a 24 bit signed mantissa and an 8 bit signed exponent.
+static u32_t decode_exp(u32_t v) {
+    i32_t mantissa = (i32_t) (v << 8) >> 8;
+    i32_t exponent = (i32_t) v >> 24;
+
+    // ldexp(mantissa, exponent) without the call.
+    union {
+        f32_t f;
+        u32_t u;
+    } bits;
+    bits.u = (u32_t) (exponent + 127) << 23;
+    bits.f *= (f32_t) mantissa;
+    return bits.u;
+}
+
+void meshopt_decode_filter_exp(void *data, u32_t count, u32_t stride) {
+    if (stride % 4 != 0) {
+        return;
+    }
+
+    u32_t *v = data;
+    u64_t total = (u64_t) count * (stride / 4);
+    u64_t i = 0;
+
+#if defined(__SSE2__)
+    for (; i + 4 <= total; i += 4) {
+        __m128i value = _mm_loadu_si128((const __m128i *) (v + i));
+        __m128i mantissa = _mm_srai_epi32(_mm_slli_epi32(value, 8), 8);
+        __m128i exponent = _mm_srai_epi32(value, 24);
+        __m128 power = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(exponent, _mm_set1_epi32(127)), 23));
+        _mm_storeu_ps((f32_t *) (v + i), _mm_mul_ps(power, _mm_cvtepi32_ps(mantissa)));
+    }
+#endif
+
+    for (; i < total; i++) {
+        v[i] = decode_exp(v[i]);
+    }
+}
@@ -0,0 +1,145 @@
+#include <rebound.h>
+
+#include "heap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Heaps of random sizes checked, operations on each and the most allocations
+// live at once.
+#define CHECK_ROUNDS 32
+#define CHECK_OPERATIONS 20000
+#define CHECK_MAX_LIVE 256
+
+// xorshift64, so a seed reproduces a failure on every libc.
+static u64_t next_random(u64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static i32_t compare_offsets(const void *a, const void *b) {
+    u64_t x = ((const heap_allocation_t *) a)->offset;
+    u64_t y = ((const heap_allocation_t *) b)->offset;
+    return (x > y) - (x < y);
+}
+
+// Sorts a copy of the live allocations by offset, neighbours may touch but
+// never overlap.
+static b8_t disjoint(const heap_allocation_t *live, u32_t count, heap_allocation_t *sorted) {
+    memcpy(sorted, live, count * sizeof(heap_allocation_t));
+    qsort(sorted, count, sizeof(heap_allocation_t), compare_offsets);
+    for (u32_t i = 1; i < count; i++) {
+        if (sorted[i - 1].offset + sorted[i - 1].size > sorted[i].offset) {
+            re_log_error("Allocations at %llu and %llu overlap.",
+                    (unsigned long long) sorted[i - 1].offset, (unsigned long long) sorted[i].offset);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Random allocations and frees, checking every allocation's bounds and
+// alignment, the heap's invariants after every operation and that the live
+// allocations are disjoint. Freeing everything has to leave one free block.
+static b8_t check_random(u64_t *state, re_arena_t *arena) {
+    heap_allocation_t live[CHECK_MAX_LIVE];
+    heap_allocation_t sorted[CHECK_MAX_LIVE];
+    for (u32_t round = 0; round < CHECK_ROUNDS; round++) {
+        u64_t size = (1 + next_random(state) % 1024) * 4096;
+        // Few nodes in some rounds, so allocations also fail for lack of them.
+        u32_t max_allocations = round % 4 == 0 ? 8 : CHECK_MAX_LIVE;
+        heap_t heap = heap_new(size, max_allocations, arena);
+
+        u32_t count = 0;
+        for (u32_t op = 0; op < CHECK_OPERATIONS; op++) {
+            if (count < CHECK_MAX_LIVE && (count == 0 || next_random(state) % 2 == 0)) {
+                u64_t request = 1 + next_random(state) % (size / 8);
+                u64_t alignment = 1ull << (next_random(state) % 12);
+                heap_allocation_t a;
+                if (heap_alloc(&heap, request, alignment, &a)) {
+                    if (a.offset % alignment != 0 || a.size < request || a.offset + a.size > heap.size) {
+                        re_log_error("Allocation of %llu bytes at %llu, %llu aligned, is out of place.",
+                                (unsigned long long) request, (unsigned long long) a.offset, (unsigned long long) alignment);
+                        return false;
+                    }
+                    live[count++] = a;
+                }
+            } else {
+                u32_t i = next_random(state) % count;
+                heap_free(&heap, live[i]);
+                live[i] = live[--count];
+            }
+
+            if (!heap_validate(&heap) || !disjoint(live, count, sorted)) {
+                re_log_error("Round %u, operation %u.", round, op);
+                return false;
+            }
+        }
+
+        while (count > 0) {
+            heap_free(&heap, live[--count]);
+        }
+        heap_stats_t stats = heap_stats(&heap);
+        if (!heap_validate(&heap) || stats.free != heap.size || stats.free_block_count != 1) {
+            re_log_error("Round %u left %u free blocks of %llu bytes after freeing everything.",
+                    round, stats.free_block_count, (unsigned long long) stats.free);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Exact fits, reuse of a merged hole and running out of nodes.
+static b8_t check_edges(re_arena_t *arena) {
+    heap_allocation_t a[8];
+    heap_t heap = heap_new(1024, 4, arena);
+    u32_t count = 0;
+    while (count < 8 && heap_alloc(&heap, 256, 16, &a[count])) {
+        count++;
+    }
+    if (count != 4) {
+        re_log_error("Fit %u allocations of a quarter of the heap.", count);
+        return false;
+    }
+
+    heap_free(&heap, a[1]);
+    heap_free(&heap, a[2]);
+    if (!heap_alloc(&heap, 512, 16, &a[1]) || a[1].offset != 256 || !heap_validate(&heap)) {
+        re_log_error("Two freed neighbours weren't merged into one hole.");
+        return false;
+    }
+
+    // Aligned allocations split off a gap each, the nodes still suffice for
+    // max_allocations of them.
+    heap = heap_new(MB(1), 4, arena);
+    count = 0;
+    while (count < 8 && heap_alloc(&heap, 16, 256, &a[count])) {
+        count++;
+    }
+    if (count < 4 || !heap_validate(&heap)) {
+        re_log_error("Fit %u aligned allocations with nodes for 4.", count);
+        return false;
+    }
+    return true;
+}
+
+// Usage: heap_check [seed]
+i32_t main(i32_t argc, char **argv) {
+    re_init();
+    re_arena_t *arena = re_arena_create(GB(1));
+
+    u64_t seed = argc > 1 ? strtoull(argv[1], NULL, 10) : 1;
+    u64_t state = seed != 0 ? seed : 1;
+    b8_t passed = check_random(&state, arena) && check_edges(arena);
+    if (passed) {
+        re_log_info("Heap checks passed, %u rounds of %u operations, seed %llu.",
+                CHECK_ROUNDS, CHECK_OPERATIONS, (unsigned long long) seed);
+    } else {
+        re_log_error("Heap checks failed, seed %llu.", (unsigned long long) seed);
+    }
+
+    re_terminate();
+    return passed ? 0 : 1;
+}